@@ -0,0 +1,412 @@
+/* Asynchronous console logging, see async_log.h */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "async_log.h"
+
+struct async_log_entry_s
+{
+	uint16_t len;
+	char text[ASYNC_LOG_LINE_MAX];
+};
+
+/* One per producing thread, plus a larger one for result lines. Single producer (the owning thread),
+ * single consumer (the flusher). head and tail only ever increase.
+ */
+struct async_log_ring_s
+{
+	struct async_log_ring_s *next;
+
+	int results;
+	uint32_t size;
+	uint32_t head; /* Written by the producer */
+	uint32_t tail; /* Written by the flusher */
+	uint64_t dropped;
+
+	struct async_log_entry_s entries[];
+};
+
+static struct {
+	int running;
+	int terminate;
+	pthread_t threadId;
+	FILE *fh;
+
+	int inflight; /* Producers that saw running set and haven't finished pushing, stop waits for them. */
+
+	pthread_mutex_t ringsLock; /* Only taken when a thread or a call site logs for the first time. */
+	struct async_log_ring_s *rings;
+	struct async_log_site_s *sites; /* Rate limited sites, the flusher reports their suppressions. */
+
+	time_t tsTime;
+	int tsIdx;
+	char ts[2][32];
+
+	uint64_t droppedReported;
+	uint64_t resultsDroppedReported;
+	uint64_t suppressed;
+} g_log = {
+	.ringsLock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static __thread struct async_log_ring_s *tls_ring = NULL;
+static __thread struct async_log_ring_s *tls_result_ring = NULL;
+
+static void _update_timestamp(time_t now)
+{
+	if (now == g_log.tsTime)
+		return;
+
+	/* Write the buffer readers are not using, then publish it. */
+	int idx = !__atomic_load_n(&g_log.tsIdx, __ATOMIC_ACQUIRE);
+	struct tm tm;
+	localtime_r(&now, &tm);
+	strftime(&g_log.ts[idx][0], sizeof(g_log.ts[idx]), "%a %b %e %H:%M:%S %Y", &tm);
+	__atomic_store_n(&g_log.tsIdx, idx, __ATOMIC_RELEASE);
+	g_log.tsTime = now;
+}
+
+const char *async_log_timestamp()
+{
+	if (!__atomic_load_n(&g_log.running, __ATOMIC_ACQUIRE)) {
+		static __thread char ts[32];
+		time_t now = time(NULL);
+		struct tm tm;
+		localtime_r(&now, &tm);
+		strftime(&ts[0], sizeof(ts), "%a %b %e %H:%M:%S %Y", &tm);
+		return &ts[0];
+	}
+
+	return &g_log.ts[__atomic_load_n(&g_log.tsIdx, __ATOMIC_ACQUIRE)][0];
+}
+
+static struct async_log_ring_s *_ring_get(int results)
+{
+	struct async_log_ring_s **tls = results ? &tls_result_ring : &tls_ring;
+	if (*tls)
+		return *tls;
+
+	uint32_t size = results ? ASYNC_LOG_RESULT_RING_ENTRIES : ASYNC_LOG_RING_ENTRIES;
+	struct async_log_ring_s *r = calloc(1, sizeof(*r) + size * sizeof(struct async_log_entry_s));
+	if (!r)
+		return NULL;
+	r->results = results;
+	r->size = size;
+
+	/* Rings live until the logger stops, the flusher drains them even after the thread exits. */
+	pthread_mutex_lock(&g_log.ringsLock);
+	r->next = g_log.rings;
+	__atomic_store_n(&g_log.rings, r, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&g_log.ringsLock);
+
+	*tls = r;
+	return r;
+}
+
+static void _site_register(struct async_log_site_s *site)
+{
+	pthread_mutex_lock(&g_log.ringsLock);
+	if (!site->registered) {
+		site->next = g_log.sites;
+		__atomic_store_n(&g_log.sites, site, __ATOMIC_RELEASE);
+		__atomic_store_n(&site->registered, 1, __ATOMIC_RELEASE);
+	}
+	pthread_mutex_unlock(&g_log.ringsLock);
+}
+
+/* Returns 1 if the site is allowed to log, 0 if it's over its rate. */
+static int _site_permit(struct async_log_site_s *site, time_t now, uint32_t *suppressed)
+{
+	*suppressed = 0;
+
+	if (!__atomic_load_n(&site->registered, __ATOMIC_ACQUIRE))
+		_site_register(site);
+
+	time_t window = __atomic_load_n(&site->window, __ATOMIC_RELAXED);
+	if (window != now) {
+		/* New one second window. Whoever wins the exchange reports the previous windows suppressions. */
+		if (__atomic_compare_exchange_n(&site->window, &window, now, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+			*suppressed = __atomic_exchange_n(&site->suppressed, 0, __ATOMIC_RELAXED);
+			__atomic_store_n(&site->count, 0, __ATOMIC_RELAXED);
+		}
+	}
+
+	int max = site->maxPerSecond > 0 ? site->maxPerSecond : ASYNC_LOG_SITE_DEFAULT_RATE;
+	if (__atomic_add_fetch(&site->count, 1, __ATOMIC_RELAXED) > (uint32_t)max) {
+		__atomic_add_fetch(&site->suppressed, 1, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&g_log.suppressed, 1, __ATOMIC_RELAXED);
+		return 0;
+	}
+
+	return 1;
+}
+
+static void _ring_push(struct async_log_ring_s *r, const char *text, int len)
+{
+	uint32_t head = r->head;
+	uint32_t tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+	if (head - tail >= r->size) {
+		__atomic_add_fetch(&r->dropped, 1, __ATOMIC_RELAXED);
+		return;
+	}
+
+	struct async_log_entry_s *e = &r->entries[head % r->size];
+	memcpy(&e->text[0], text, len);
+	e->len = len;
+
+	__atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+}
+
+static void _vlog(struct async_log_site_s *site, uint32_t suppressed, int results, const char *fmt, va_list ap)
+{
+	char line[ASYNC_LOG_LINE_MAX];
+	int len = vsnprintf(&line[0], sizeof(line), fmt, ap);
+	if (len < 0)
+		return;
+	if (len >= (int)sizeof(line)) {
+		len = sizeof(line) - 1;
+		line[len - 1] = '\n';
+	}
+
+	char note[ASYNC_LOG_LINE_MAX];
+	int notelen = 0;
+	if (suppressed) {
+		notelen = snprintf(&note[0], sizeof(note), "(%u similar messages suppressed from %s:%d)\n",
+			suppressed, site->file, site->line);
+		if (notelen >= (int)sizeof(note))
+			notelen = sizeof(note) - 1;
+	}
+
+	/* Once we've seen the logger running, stop waits for us to finish pushing. */
+	__atomic_add_fetch(&g_log.inflight, 1, __ATOMIC_SEQ_CST);
+
+	struct async_log_ring_s *r = NULL;
+	if (__atomic_load_n(&g_log.running, __ATOMIC_SEQ_CST))
+		r = _ring_get(results);
+
+	if (r) {
+		if (notelen)
+			_ring_push(r, &note[0], notelen);
+		_ring_push(r, &line[0], len);
+	}
+
+	__atomic_sub_fetch(&g_log.inflight, 1, __ATOMIC_SEQ_CST);
+
+	if (!r) {
+		/* Logger isn't running, behave like printf. */
+		if (notelen)
+			fwrite(&note[0], 1, notelen, stdout);
+		fwrite(&line[0], 1, len, stdout);
+	}
+}
+
+void async_log_printf(struct async_log_site_s *site, const char *fmt, ...)
+{
+	uint32_t suppressed;
+	if (!_site_permit(site, time(NULL), &suppressed))
+		return;
+
+	va_list ap;
+	va_start(ap, fmt);
+	_vlog(site, suppressed, 0, fmt, ap);
+	va_end(ap);
+}
+
+void async_log_printf_result(const char *fmt, ...)
+{
+	va_list ap;
+	va_start(ap, fmt);
+	_vlog(NULL, 0, 1, fmt, ap);
+	va_end(ap);
+}
+
+/* Return number of messages written. */
+static int _drain(char *buf, int buflen)
+{
+	int count = 0;
+	int used = 0;
+	uint64_t dropped = 0;
+	uint64_t resultsDropped = 0;
+
+	struct async_log_ring_s *r = __atomic_load_n(&g_log.rings, __ATOMIC_ACQUIRE);
+	for (; r; r = r->next) {
+		uint32_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+		uint32_t tail = r->tail;
+
+		while (tail != head) {
+			struct async_log_entry_s *e = &r->entries[tail % r->size];
+			if (used + e->len > buflen) {
+				fwrite(buf, 1, used, g_log.fh);
+				used = 0;
+			}
+			memcpy(buf + used, &e->text[0], e->len);
+			used += e->len;
+			tail++;
+			count++;
+
+			/* Release each slot back to the producer as soon as we've copied it. */
+			__atomic_store_n(&r->tail, tail, __ATOMIC_RELEASE);
+		}
+
+		if (r->results)
+			resultsDropped += __atomic_load_n(&r->dropped, __ATOMIC_RELAXED);
+		else
+			dropped += __atomic_load_n(&r->dropped, __ATOMIC_RELAXED);
+	}
+
+	if (resultsDropped != g_log.resultsDroppedReported) {
+		used += snprintf(buf + used, buflen - used > 0 ? buflen - used : 0,
+			"%s: async_log: %" PRIu64 " result lines dropped, console too slow\n",
+			async_log_timestamp(), resultsDropped - g_log.resultsDroppedReported);
+		g_log.resultsDroppedReported = resultsDropped;
+	}
+
+	if (dropped != g_log.droppedReported) {
+		used += snprintf(buf + used, buflen - used > 0 ? buflen - used : 0,
+			"%s: async_log: %" PRIu64 " messages dropped, console too slow\n",
+			async_log_timestamp(), dropped - g_log.droppedReported);
+		g_log.droppedReported = dropped;
+	}
+
+	if (used) {
+		fwrite(buf, 1, used, g_log.fh);
+		fflush(g_log.fh);
+	}
+
+	return count;
+}
+
+/* Report suppressions a quiet site is still holding, a producer only reports them
+ * when the site next logs, which may be never. The current second's are left to
+ * the producers unless we're stopping.
+ */
+static void _flush_suppressed(char *buf, int buflen, time_t now, int all)
+{
+	int used = 0;
+
+	struct async_log_site_s *site = __atomic_load_n(&g_log.sites, __ATOMIC_ACQUIRE);
+	for (; site; site = site->next) {
+		if (!all && __atomic_load_n(&site->window, __ATOMIC_RELAXED) == now)
+			continue;
+
+		uint32_t suppressed = __atomic_exchange_n(&site->suppressed, 0, __ATOMIC_RELAXED);
+		if (suppressed == 0)
+			continue;
+
+		if (used + ASYNC_LOG_LINE_MAX > buflen) {
+			fwrite(buf, 1, used, g_log.fh);
+			used = 0;
+		}
+		int len = snprintf(buf + used, ASYNC_LOG_LINE_MAX, "(%u similar messages suppressed from %s:%d)\n",
+			suppressed, site->file, site->line);
+		used += len < ASYNC_LOG_LINE_MAX ? len : ASYNC_LOG_LINE_MAX - 1;
+	}
+
+	if (used) {
+		fwrite(buf, 1, used, g_log.fh);
+		fflush(g_log.fh);
+	}
+}
+
+static void *_flusher_thread(void *p)
+{
+	char *buf = malloc(65536);
+
+	while (!__atomic_load_n(&g_log.terminate, __ATOMIC_ACQUIRE)) {
+		time_t now = time(NULL);
+		if (now != g_log.tsTime) {
+			_update_timestamp(now);
+			_flush_suppressed(buf, 65536, now, 0);
+		}
+
+		if (_drain(buf, 65536 - 128) == 0)
+			usleep(5 * 1000);
+	}
+
+	/* Final drain, every producer that saw us running has finished pushing. */
+	_drain(buf, 65536 - 128);
+	_flush_suppressed(buf, 65536, 0, 1);
+
+	/* Results are what the user ran the tool for, make any gaps in them obvious at exit. */
+	if (g_log.resultsDroppedReported) {
+		fprintf(g_log.fh, "%s: async_log: %" PRIu64 " result lines were dropped in total\n",
+			async_log_timestamp(), g_log.resultsDroppedReported);
+		fflush(g_log.fh);
+	}
+
+	free(buf);
+	return NULL;
+}
+
+int async_log_start(FILE *fh)
+{
+	if (g_log.running)
+		return 0;
+
+	g_log.fh = fh ? fh : stdout;
+	g_log.terminate = 0;
+	g_log.tsTime = 0;
+	_update_timestamp(time(NULL));
+
+	if (pthread_create(&g_log.threadId, NULL, _flusher_thread, NULL) != 0)
+		return -1;
+
+	__atomic_store_n(&g_log.running, 1, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+void async_log_stop()
+{
+	if (!g_log.running)
+		return;
+
+	/* New messages go straight to the console from here on. */
+	__atomic_store_n(&g_log.running, 0, __ATOMIC_SEQ_CST);
+
+	/* Producers that saw us running may still be pushing, none of them wait on the flusher. */
+	while (__atomic_load_n(&g_log.inflight, __ATOMIC_SEQ_CST))
+		usleep(1000);
+
+	__atomic_store_n(&g_log.terminate, 1, __ATOMIC_RELEASE);
+	pthread_join(g_log.threadId, NULL);
+
+	/* Rings are deliberately not freed, threads may still hold a tls pointer to theirs
+	 * and we'd rather leak them at shutdown than risk a use after free.
+	 */
+}
+
+uint64_t async_log_get_dropped()
+{
+	uint64_t dropped = 0;
+	struct async_log_ring_s *r = __atomic_load_n(&g_log.rings, __ATOMIC_ACQUIRE);
+	for (; r; r = r->next) {
+		if (!r->results)
+			dropped += __atomic_load_n(&r->dropped, __ATOMIC_RELAXED);
+	}
+
+	return dropped;
+}
+
+uint64_t async_log_get_results_dropped()
+{
+	uint64_t dropped = 0;
+	struct async_log_ring_s *r = __atomic_load_n(&g_log.rings, __ATOMIC_ACQUIRE);
+	for (; r; r = r->next) {
+		if (r->results)
+			dropped += __atomic_load_n(&r->dropped, __ATOMIC_RELAXED);
+	}
+
+	return dropped;
+}
+
+uint64_t async_log_get_suppressed()
+{
+	return __atomic_load_n(&g_log.suppressed, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,122 @@
+/**
+ * @file        async_log.h
+ * @brief       Asynchronous console logging for packet processing threads.
+ *              Each producing thread formats into its own lock free single producer / single consumer ring,
+ *              a background thread drains the rings to the console. The producer never blocks on
+ *              a slow terminal, pipe or ssh session, if its ring is full the message is dropped and counted.
+ *
+ *              Each call site is individually rate limited, with a summary of suppressed messages
+ *              emitted once the site quietens down, or within a second or two by the flusher.
+ *
+ *              Tool results (as opposed to diagnostics) use ASYNC_LOG_RESULT, which is never rate
+ *              limited and goes to a larger per thread ring of its own. The producer still never
+ *              waits, results that don't fit are dropped, counted and reported when the logger stops.
+ *
+ *              Until async_log_start() is called, messages go directly to stdout, so tools
+ *              can adopt the logging calls without changing their startup behaviour.
+ */
+
+#ifndef ASYNC_LOG_H
+#define ASYNC_LOG_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Longest single message, longer messages are truncated. */
+#define ASYNC_LOG_LINE_MAX 256
+
+/* Messages per thread we can buffer while the flusher catches up. */
+#define ASYNC_LOG_RING_ENTRIES 1024
+
+/* Result lines per thread, only allocated by threads that log results. */
+#define ASYNC_LOG_RESULT_RING_ENTRIES 8192
+
+/* Default maximum messages per second, per call site. */
+#define ASYNC_LOG_SITE_DEFAULT_RATE 20
+
+struct async_log_site_s
+{
+	const char *file;
+	int line;
+	int maxPerSecond;
+
+	/* Managed by the logger */
+	time_t window;
+	uint32_t count;
+	uint32_t suppressed;
+	int registered;
+	struct async_log_site_s *next;
+};
+
+/**
+ * @brief       Log a printf style message from any thread, rate limited per call site.
+ *              Never blocks once the logger has started.
+ */
+#define ASYNC_LOG(fmt, ...) \
+	do { \
+		static struct async_log_site_s __async_log_site = { __FILE__, __LINE__, ASYNC_LOG_SITE_DEFAULT_RATE, 0, 0, 0 }; \
+		async_log_printf(&__async_log_site, fmt, ##__VA_ARGS__); \
+	} while (0)
+
+/**
+ * @brief       As ASYNC_LOG, for sites with a known higher (or lower) legitimate message rate.
+ */
+#define ASYNC_LOG_RATE(maxPerSecond, fmt, ...) \
+	do { \
+		static struct async_log_site_s __async_log_site = { __FILE__, __LINE__, maxPerSecond, 0, 0, 0 }; \
+		async_log_printf(&__async_log_site, fmt, ##__VA_ARGS__); \
+	} while (0)
+
+/**
+ * @brief       Log a result line, never rate limited. Never blocks, if the thread's result ring
+ *              is full the line is dropped and counted, see async_log_get_results_dropped().
+ */
+#define ASYNC_LOG_RESULT(fmt, ...) \
+	async_log_printf_result(fmt, ##__VA_ARGS__)
+
+/**
+ * @brief       Start the background flusher thread.
+ * @param[in]   FILE *fh - Destination, normally stdout.
+ * @return      0 - Success, else < 0 on error.
+ */
+int  async_log_start(FILE *fh);
+
+/**
+ * @brief       Wait for producers already logging, drain all pending messages and suppression
+ *              counts, then stop the flusher thread.
+ *              Messages logged after this point are written directly.
+ */
+void async_log_stop();
+
+void async_log_printf(struct async_log_site_s *site, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+void async_log_printf_result(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+/**
+ * @brief       Return a preformatted ctime() style wall clock string, without the trailing newline,
+ *              refreshed by the flusher once per second. Cheap enough to use per packet.
+ *              The returned string remains valid for at least a second.
+ */
+const char *async_log_timestamp();
+
+/**
+ * @brief       Total number of messages dropped because a ring was full,
+ *              or suppressed by the per site rate limiter.
+ */
+uint64_t async_log_get_dropped();
+uint64_t async_log_get_suppressed();
+
+/**
+ * @brief       Total number of result lines dropped because a result ring was full.
+ */
+uint64_t async_log_get_results_dropped();
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* ASYNC_LOG_H */
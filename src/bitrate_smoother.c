@@ -17,6 +17,10 @@
 #include <libltntstools/ltntstools.h>
 #include "ffmpeg-includes.h"
 #include "kbhit.h"
+#include "async_log.h"
+#include "utils.h"
+#include "host_audit.h"
+#include "tstd_verifier.h"
 
 #define DEFAULT_LATENCY 100
 
@@ -58,7 +62,9 @@ struct tool_context_s
 	int pcrPID;    /* UDP-TS only */
 	int isRTP;     /* Boolean. True = RTP mode, false = UDP-TS PCR mode */
 
-	/* The reframer used only in UDP-TS mode, NOT in RTP mode, to create 7*188 packet lengths. */
+	/* The reframer used only in UDP-TS mode, NOT in RTP mode, to create 7*188 packet lengths.
+	 * Bypassed when stripping stuffing, see smoother_pcr_cb().
+	 */
 	struct ltntstools_reframer_ctx_s *reframer;
 
 	void *sm; /* StreamModel Context */
@@ -70,8 +76,22 @@ struct tool_context_s
 	unsigned char filter[8192];
 	unsigned int pid;
 
+	/* VBR output, stuffing removed after smoothing */
+	struct stuffing_strip_s strip;
+	struct stuffing_strip_stats_s stripStats;
+	uint8_t *stripBuf;
+	int stripBufLength;
+
+	/* T-STD buffer model of the smoothed output, UDP-TS only */
+	void *tstd;
 };
 
+static void tstd_event_cb(void *userContext, const struct tstd_event_s *e)
+{
+	ASYNC_LOG("%s: T-STD output pid 0x%04x %s at %.3f secs, %" PRIi64 " bytes\n",
+		async_log_timestamp(), e->pid, tstd_verifier_event_name(e->type), e->streamTime, e->bytes);
+}
+
 /* Reframer hands us 7*188 buffers, guaranteed. Send to the UDP. */
 static void *reframer_cb(void *userContext, const uint8_t *buf, int lengthBytes)
 {
@@ -96,6 +116,22 @@ static int smoother_pcr_cb(void *userContext, unsigned char *buf, int byteCount,
 			free(ts);
 		}
 	}
+
+	if (ctx->strip.enabled) {
+		/* The smoother has already released these packets at their PCR correct time,
+		 * dropping the stuffing here leaves the timing of everything else alone.
+		 */
+		if (ctx->stripBufLength < byteCount) {
+			free(ctx->stripBuf);
+			ctx->stripBuf = malloc(byteCount);
+			ctx->stripBufLength = ctx->stripBuf ? byteCount : 0;
+		}
+		if (ctx->stripBuf) {
+			int count = stuffing_strip(&ctx->strip, &ctx->stripStats, buf, ctx->stripBuf, byteCount / 188);
+			buf = ctx->stripBuf;
+			byteCount = count * 188;
+		}
+	}
 	for (int i = 0; i < byteCount; i += 188) {
 		uint16_t pidnr = ltntstools_pid(buf + i);
 		struct ltntstools_pid_statistics_s *pid = &ctx->o_stream->pids[pidnr];
@@ -106,12 +142,9 @@ static int smoother_pcr_cb(void *userContext, unsigned char *buf, int byteCount,
 		uint8_t cc = ltntstools_continuity_counter(buf + i);
 		if (ltntstools_isCCInError(buf + i, pid->lastCC)) {
 			if (pid->packetCount > 1 && pidnr != 0x1fff) {
-				char ts[256];
-				time_t now = time(0);
-				sprintf(ts, "%s", ctime(&now));
-				ts[ strlen(ts) - 1] = 0;
-				printf("%s: %s() CC Error : pid %04x -- Got 0x%x wanted 0x%x\n", ts, __func__, pidnr, cc, (pid->lastCC + 1) & 0x0f);
-				printf("scb %02x %02x %02x %02x %02x %02x %02x %02x\n",
+				ASYNC_LOG("%s: %s() CC Error : pid %04x -- Got 0x%x wanted 0x%x\n",
+					async_log_timestamp(), __func__, pidnr, cc, (pid->lastCC + 1) & 0x0f);
+				ASYNC_LOG("scb %02x %02x %02x %02x %02x %02x %02x %02x\n",
 					*(buf + i + 0),
 					*(buf + i + 1),
 					*(buf + i + 2),
@@ -142,7 +175,27 @@ static int smoother_pcr_cb(void *userContext, unsigned char *buf, int byteCount,
 		}
 	}
 
-	ltststools_reframer_write(ctx->reframer, buf, byteCount);
+	if (ctx->tstd) {
+		/* What a decoder directly behind us would see. */
+		struct timespec now;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		tstd_verifier_write_timed(ctx->tstd, buf, byteCount / 188, (now.tv_sec * 1000000LL) + (now.tv_nsec / 1000));
+	}
+
+	if (ctx->strip.enabled) {
+		/* Stripping leaves each release a ragged number of packets, the reframer would
+		 * hold the remainder back until the next PCR, delaying and jittering it.
+		 * Send everything now, o_puc is direct so each write is one datagram of up to 7 packets.
+		 */
+		for (int i = 0; i < byteCount; i += 7 * 188) {
+			int len = byteCount - i;
+			if (len > 7 * 188)
+				len = 7 * 188;
+			avio_write(ctx->o_puc, buf + i, len);
+		}
+	} else {
+		ltststools_reframer_write(ctx->reframer, buf, byteCount);
+	}
 
 	return 0;
 }
@@ -207,12 +260,9 @@ static void *packet_cb(struct tool_context_s *ctx, unsigned char *buf, int byteC
 		uint8_t cc = ltntstools_continuity_counter(buf + i);
 		if (ltntstools_isCCInError(buf + i, pid->lastCC)) {
 			if (pid->packetCount > 1 && pidnr != 0x1fff) {
-				char ts[256];
-				time_t now = time(0);
-				sprintf(ts, "%s", ctime(&now));
-				ts[ strlen(ts) - 1] = 0;
-				printf("%s: %s() CC Error : pid %04x -- Got 0x%x wanted 0x%x\n", ts, __func__, pidnr, cc, (pid->lastCC + 1) & 0x0f);
-				printf("pcb %02x %02x %02x %02x %02x %02x %02x %02x\n",
+				ASYNC_LOG("%s: %s() CC Error : pid %04x -- Got 0x%x wanted 0x%x\n",
+					async_log_timestamp(), __func__, pidnr, cc, (pid->lastCC + 1) & 0x0f);
+				ASYNC_LOG("pcb %02x %02x %02x %02x %02x %02x %02x %02x\n",
 					*(buf + i + 0),
 					*(buf + i + 1),
 					*(buf + i + 2),
@@ -422,30 +472,20 @@ static void signal_handler(int signum)
 
 static void kernel_check_socket_sizes(AVIOContext *i)
 {
-	printf("Kernel configured default/max socket buffer sizes:\n");
-
-	char line[256];
-	int val;
-	FILE *fh = fopen("/proc/sys/net/core/rmem_default", "r");
-	if (fh) {
-		fread(&line[0], 1, sizeof(line), fh);
-		val = atoi(line);
-		printf("/proc/sys/net/core/rmem_default = %d\n", val);
-		fclose(fh);
-	}
-
-	fh = fopen("/proc/sys/net/core/rmem_max", "r");
-	if (fh) {
-		fread(&line[0], 1, sizeof(line), fh);
-		val = atoi(line);
-		printf("/proc/sys/net/core/rmem_max = %d\n", val);
-		if (i->buffer_size > val) {
-			fprintf(stderr, "buffer_size %d exceeds rmem_max %d, aborting\n", i->buffer_size, val);
-			exit(1);
-		}
-		fclose(fh);
-	}
+	struct host_audit_params_s params = { 0 };
+	params.socketBufferBytes = i->buffer_size;
+
+	struct host_audit_s audit;
+	host_audit_run(&audit, &params);
+
+	fflush(stdout);
+	host_audit_dprintf(&audit, STDOUT_FILENO);
 
+	const struct host_audit_finding_s *f = host_audit_find(&audit, HOST_AUDIT_RMEM_MAX);
+	if (f && f->severity == HOST_AUDIT_CRITICAL) {
+		fprintf(stderr, "buffer_size %d exceeds rmem_max, aborting\n", i->buffer_size);
+		exit(1);
+	}
 }
 
 #ifdef __linux__
@@ -497,6 +537,9 @@ static void usage(const char *progname)
 	printf("     8 - input packet RTP data and human readable clock\n");
 	printf("  -R pid 0xNNNN to be removed [def: none], multiple -R instances supported. [0x2000 all pids]\n");
 	printf("  -l latency (ms) of protection. [def: %d]\n", DEFAULT_LATENCY);
+	printf("  -N strip null packets (0x1fff) from the smoothed output, VBR output (UDP-TS Only). [def: no]\n");
+	printf("  -S pid 0xNNNN additional stuffing pid to strip, implies -N, multiple -S instances supported.\n");
+	printf("  -B Run the T-STD decoder buffer model on the smoothed output, report buffer events (UDP-TS Only). [def: no]\n");
 #ifdef __linux__
 	printf("  -t <#seconds> Stop after N seconds [def: 0 - unlimited]\n");
 #endif
@@ -513,11 +556,13 @@ int bitrate_smoother(int argc, char *argv[])
 {
 	int ret = 0;
 	int ch;
+	unsigned int stuffingPID;
 
 	struct tool_context_s tctx, *ctx;
 	ctx = &tctx;
 	memset(ctx, 0, sizeof(*ctx));
 	memset(&ctx->filter[0], 1, sizeof(ctx->filter)); /* Pass all pids by default */
+	stuffing_strip_init(&ctx->strip);
 
 	ctx->latencyMS = DEFAULT_LATENCY;
 	ctx->reframer = ltntstools_reframer_alloc(ctx, 7 * 188, (ltntstools_reframer_callback)reframer_cb);
@@ -525,13 +570,19 @@ int bitrate_smoother(int argc, char *argv[])
 	ltntstools_pid_stats_alloc(&ctx->i_stream);
 	ltntstools_pid_stats_alloc(&ctx->o_stream);
 
-	while ((ch = getopt(argc, argv, "?hi:l:o:L:P:R:v:t:")) != -1) {
+	while ((ch = getopt(argc, argv, "?Bhi:l:o:L:NP:R:S:v:t:")) != -1) {
 		switch (ch) {
 		case '?':
 		case 'h':
 			usage(argv[0]);
 			exit(1);
 			break;
+		case 'B':
+			if (ctx->tstd == NULL && tstd_verifier_alloc(&ctx->tstd, NULL, tstd_event_cb, ctx) < 0) {
+				fprintf(stderr, "\nUnable to allocate T-STD verifier.\n\n");
+				exit(1);
+			}
+			break;
 		case 'l':
 			ctx->latencyMS = atoi(optarg);
 			break;
@@ -547,6 +598,17 @@ int bitrate_smoother(int argc, char *argv[])
 		case 'L':
 			ctx->terminateLOSSeconds = atoi(optarg);
 			break;
+		case 'N':
+			ctx->strip.enabled = 1;
+			break;
+		case 'S':
+			if ((sscanf(optarg, "0x%x", &stuffingPID) != 1) || (stuffingPID > 0x1fff)) {
+				usage(argv[0]);
+				exit(1);
+			}
+			stuffing_strip_add_pid(&ctx->strip, stuffingPID);
+			ctx->strip.enabled = 1;
+			break;
 		case 'P':
 			if ((sscanf(optarg, "0x%x", &ctx->pcrPID) != 1) || (ctx->pcrPID > 0x1fff)) {
 					usage(argv[0]);
@@ -601,6 +663,16 @@ int bitrate_smoother(int argc, char *argv[])
 		ctx->isRTP = 1;
 		rtp_analyzer_init(&ctx->rtp_stream_in);
 		rtp_analyzer_init(&ctx->rtp_stream_out);
+
+		if (ctx->strip.enabled) {
+			printf("\nStuffing removal is UDP-TS only, ignored for RTP.\n");
+			ctx->strip.enabled = 0;
+		}
+		if (ctx->tstd) {
+			printf("\nT-STD buffer model is UDP-TS only, ignored for RTP.\n");
+			tstd_verifier_free(ctx->tstd);
+			ctx->tstd = NULL;
+		}
 	}
 
 	avformat_network_init();
@@ -641,6 +713,9 @@ int bitrate_smoother(int argc, char *argv[])
 	signal(SIGINT, signal_handler);
 	gRunning = 1;
 
+	/* CC errors are reported from the packet callbacks, don't let a slow console stall them. */
+	async_log_start(stdout);
+
 	pthread_create(&ctx->ffmpeg_threadId, 0, thread_packet_rx, ctx);
 
 	signal(SIGINT, signal_handler);
@@ -656,6 +731,8 @@ int bitrate_smoother(int argc, char *argv[])
 	avio_close(ctx->i_puc);
 	avio_close(ctx->o_puc);
 
+	async_log_stop();
+
 	if (ctx->isRTP == 0) {
 		if (ctx->smoother) {
 			smoother_pcr_free(ctx->smoother);
@@ -715,6 +792,21 @@ int bitrate_smoother(int argc, char *argv[])
 		}
 	}
 
+	if (ctx->strip.enabled) {
+		char strip[160];
+		stuffing_strip_sprintf(&strip[0], sizeof(strip), &ctx->stripStats);
+		printf("\nOutput %s\n", strip);
+	}
+	free(ctx->stripBuf);
+
+	if (ctx->tstd) {
+		printf("\nOutput ");
+		fflush(stdout);
+		tstd_verifier_dprintf(ctx->tstd, STDOUT_FILENO);
+		tstd_verifier_free(ctx->tstd);
+		ctx->tstd = NULL;
+	}
+
 	ltntstools_pid_stats_free(ctx->i_stream);
 	ltntstools_pid_stats_free(ctx->o_stream);
 
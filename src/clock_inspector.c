@@ -21,6 +21,15 @@
  * +SCR Timing             Hex           Dec   PID       27MHz VAL       TICKS         uS  Timecode        Now                      secs               ms
  * SCR #000000003 -- 000056790        354192  0031    959636022118      944813      34993  0.09:52:22.074  Fri Feb  9 09:13:52 2024 1707488033.067      0
  *                                                                       (since last PCR)                 
+ *
+ * PCR arrival jitter (-J), live udp/rtp only. The stream is received on our own socket
+ * with every datagram timestamped by the kernel, instead of through avio, and every PCR
+ * is compared against its arrival time. Overall jitter, frequency offset and drift rate
+ * are reported every few seconds and in full at exit. See pcr_jitter.h
+ *
+ * T-STD buffer model (-B). Every audio and video stream in the PMT is run through the
+ * ISO13818-1 TB/MB/EB decoder buffer model, overflows and underflows are reported as they
+ * happen, occupancy histograms, decode slack and peak rates at exit. See tstd_verifier.h
  */
 
 #include <stdio.h>
@@ -36,8 +45,15 @@
 #include <libltntstools/ltntstools.h>
 #include "xorg-list.h"
 #include "ffmpeg-includes.h"
+#include "tsfile_reader.h"
+#include "utils.h"
+#include "host_audit.h"
+#include "udp_receiver.h"
+#include "pcr_jitter.h"
+#include "tstd_verifier.h"
 
 #define DEFAULT_SCR_PID 0x31
+#define DEFAULT_JITTER_REPORT_SECS 5
 
 struct ordered_clock_item_s {
 	struct xorg_list list;
@@ -80,6 +96,9 @@ struct pid_s
 	struct ltn_pes_packet_s pes;
 
 	struct xorg_list ordered_pts_list;
+
+	/* PCR arrival jitter, allocated on the first PCR in -J mode */
+	void *pcrJitter;
 };
 
 struct tool_context_s
@@ -106,6 +125,16 @@ struct tool_context_s
 	int scr_pid;
 
 	struct ltntstools_stream_statistics_s *libstats;
+
+	/* -J, kernel timestamped live receive and PCR arrival analysis */
+	int doPCRJitter;
+	int jitterReportSecs;
+	void *receiver;
+
+	/* -B, T-STD buffer model */
+	int doTSTD;
+	void *tstd;
+	struct tstd_verifier_params_s tstdParams;
 };
 
 static int gRunning = 1;
@@ -535,32 +564,77 @@ static int validateClockMath()
 	return 0;
 }
 
-static void kernel_check_socket_sizes(AVIOContext *i)
+static void processPCRJitter(struct tool_context_s *ctx, uint8_t *pkt, const struct timespec *arrival)
 {
-	printf("Kernel configured default/max socket buffer sizes:\n");
-
-	char line[256];
-	int val;
-	FILE *fh = fopen("/proc/sys/net/core/rmem_default", "r");
-	if (fh) {
-		fread(&line[0], 1, sizeof(line), fh);
-		val = atoi(line);
-		printf("/proc/sys/net/core/rmem_default = %d\n", val);
-		fclose(fh);
-	}
-
-	fh = fopen("/proc/sys/net/core/rmem_max", "r");
-	if (fh) {
-		fread(&line[0], 1, sizeof(line), fh);
-		val = atoi(line);
-		printf("/proc/sys/net/core/rmem_max = %d\n", val);
-		if (i->buffer_size > val) {
-			fprintf(stderr, "buffer_size %d exceeds rmem_max %d, aborting\n", i->buffer_size, val);
-			exit(1);
+	uint64_t scr;
+	if (ltntstools_scr(pkt, &scr) < 0)
+		return;
+
+	uint16_t pid = ltntstools_pid(pkt);
+	struct pid_s *p = &ctx->pids[pid];
+	if (p->pcrJitter == NULL) {
+		if (pcr_jitter_alloc(&p->pcrJitter, pid, 0) < 0)
+			return;
+	}
+
+	pcr_jitter_write(p->pcrJitter, scr, arrival);
+}
+
+static void pcrJitterReport(struct tool_context_s *ctx, int detailed)
+{
+	time_t now = time(NULL);
+	char ts[64];
+	sprintf(ts, "%s", ctime(&now));
+	ts[ strlen(ts) - 1] = 0;
+
+	for (int i = 0; i <= 0x1fff; i++) {
+		if (ctx->pids[i].pcrJitter == NULL)
+			continue;
+
+		if (detailed) {
+			fflush(stdout);
+			pcr_jitter_dprintf(ctx->pids[i].pcrJitter, STDOUT_FILENO);
+		} else {
+			struct pcr_jitter_results_s r;
+			char line[256];
+			pcr_jitter_query(ctx->pids[i].pcrJitter, &r);
+			pcr_jitter_sprintf(&r, &line[0], sizeof(line));
+			printf("%s: %s\n", ts, line);
 		}
-		fclose(fh);
 	}
 
+	if (detailed && ctx->receiver) {
+		struct udp_receiver_stats_s rs;
+		udp_receiver_get_stats(ctx->receiver, &rs);
+		printf("Received %" PRIu64 " datagrams (%" PRIu64 " RTP, %" PRIu64 " malformed), kernel timestamps %" PRIu64
+			", userspace timestamps %" PRIu64 ", kernel socket drops %" PRIu64 "\n",
+			rs.datagrams, rs.rtpDatagrams, rs.badDatagrams,
+			rs.kernelTimestamps, rs.userTimestamps, rs.kernelDrops);
+	}
+}
+
+static void tstdEventCallback(void *userContext, const struct tstd_event_s *e)
+{
+	printf("T-STD: pid 0x%04x %s at packet %" PRIu64 ", %.3f secs, %" PRIi64 " bytes\n",
+		e->pid, tstd_verifier_event_name(e->type), e->packetNr, e->streamTime, e->bytes);
+}
+
+static void kernel_check_socket_sizes(int bufferSize)
+{
+	struct host_audit_params_s params = { 0 };
+	params.socketBufferBytes = bufferSize;
+
+	struct host_audit_s audit;
+	host_audit_run(&audit, &params);
+
+	fflush(stdout);
+	host_audit_dprintf(&audit, STDOUT_FILENO);
+
+	const struct host_audit_finding_s *f = host_audit_find(&audit, HOST_AUDIT_RMEM_MAX);
+	if (f && f->severity == HOST_AUDIT_CRITICAL) {
+		fprintf(stderr, "buffer_size %d exceeds rmem_max, aborting\n", bufferSize);
+		exit(1);
+	}
 }
 
 static void usage(const char *progname)
@@ -584,6 +658,12 @@ static void usage(const char *progname)
 	printf("     This mode casuses all PES headers to be cached (growing memory usage over time), it's memory expensive.\n");
 	printf("  -P Show progress indicator as a percentage when processing large files [def: disabled]\n");
 	printf("  -t <#seconds>. Stop after N seconds [def: 0 - unlimited]\n");
+	printf("  -J Live udp/rtp only. Timestamp every datagram in the kernel and measure PCR overall jitter,\n");
+	printf("     frequency offset and drift rate for every PCR pid, as percentiles. [def: disabled]\n");
+	printf("  -j <#seconds> With -J, seconds between summary lines [def: %d]\n", DEFAULT_JITTER_REPORT_SECS);
+	printf("  -B Run the T-STD decoder buffer model (TB/MB/EB) on every audio and video stream, report\n");
+	printf("     overflow/underflow events, occupancy histograms and the minimum safe latency [def: disabled]\n");
+	printf("  -b <kbps> With -B, the maximum video bitrate, sizes the video buffers [def: from the stream type]\n");
 	printf("\n  Example UDP or RTP:\n");
 	printf("    tstools_clock_inspector -i 'udp://227.1.20.80:4002?localaddr=192.168.20.45&buffer_size=2500000&overrun_nonfatal=1&fifo_size=50000000' -S 0x31 -p\n");
 }
@@ -600,20 +680,41 @@ int clock_inspector(int argc, char *argv[])
 	ctx->doPESStatistics = 0;
 	ctx->maxAllowablePTSDTSDrift = 700;
 	ctx->scr_pid = DEFAULT_SCR_PID;
+	ctx->jitterReportSecs = DEFAULT_JITTER_REPORT_SECS;
 	int progressReport = 0;
 	int stopSeconds = 0;
 
 	/* We use this specifically for tracking PCR walltime drift */
 	ltntstools_pid_stats_alloc(&ctx->libstats);
 
-    while ((ch = getopt(argc, argv, "?dhi:spt:T:D:PRS:X")) != -1) {
+    while ((ch = getopt(argc, argv, "?b:Bdhi:j:spt:T:D:JPRS:X")) != -1) {
 		switch (ch) {
+		case 'b':
+			ctx->tstdParams.videoMaxBitrateKbps = atoi(optarg);
+			if (ctx->tstdParams.videoMaxBitrateKbps < 1) {
+				usage(argv[0]);
+				exit(1);
+			}
+			break;
+		case 'B':
+			ctx->doTSTD = 1;
+			break;
 		case 'd':
 			ctx->dumpHex++;
 			break;
 		case 'i':
 			ctx->iname = optarg;
 			break;
+		case 'J':
+			ctx->doPCRJitter = 1;
+			break;
+		case 'j':
+			ctx->jitterReportSecs = atoi(optarg);
+			if (ctx->jitterReportSecs < 1) {
+				usage(argv[0]);
+				exit(1);
+			}
+			break;
 		case 'p':
 			ctx->doPESStatistics++;
 			break;
@@ -673,6 +774,11 @@ int clock_inspector(int argc, char *argv[])
 		exit(1);
 	}
 
+	if (ctx->doTSTD && tstd_verifier_alloc(&ctx->tstd, &ctx->tstdParams, tstdEventCallback, ctx) < 0) {
+		fprintf(stderr, "Unable to allocate T-STD verifier\n");
+		exit(1);
+	}
+
 	int blen = 188 * 1024;
 	uint8_t *buf = malloc(blen);
 	if (!buf) {
@@ -680,26 +786,46 @@ int clock_inspector(int argc, char *argv[])
 		exit(1);
 	}
 
+	uint64_t *offsets = malloc((blen / 188) * sizeof(uint64_t));
+	if (!offsets) {
+		fprintf(stderr, "Unable to allocate buffer\n");
+		exit(1);
+	}
+
+	/* Files go through the shared block reader, it deals with 192/204 byte packets
+	 * and resync after corruption. Everything else is a url, handled by avio.
+	 */
 	uint64_t fileLengthBytes = 0;
-	FILE *fh = fopen(ctx->iname, "rb");
-	if (fh) {
-		fseeko(fh, 0, SEEK_END);
-		fileLengthBytes = ftello(fh);
-		fclose(fh);
+	void *reader = NULL;
+	AVIOContext *puc = NULL;
+	if (ctx->doPCRJitter) {
+		/* Our own socket, avio's buffering and non blocking polling would swamp the measurement. */
+		progressReport = 0;
+		if (udp_receiver_alloc(&ctx->receiver, ctx->iname) < 0) {
+			fprintf(stderr, "-i error, -J needs a udp:// or rtp:// url\n");
+			return 1;
+		}
+
+		kernel_check_socket_sizes(udp_receiver_get_requested_buffer_size(ctx->receiver));
+	} else
+	if (isValidTransportFile(ctx->iname)) {
+		if (tsfile_reader_alloc(&reader, ctx->iname, 0) < 0) {
+			fprintf(stderr, "-i error, unable to open file\n");
+			return 1;
+		}
+		fileLengthBytes = tsfile_reader_get_file_size(reader);
 	} else {
 		progressReport = 0;
-	}
 
-	/* TODO: Replace this with avio so we can support streams. */
-	avformat_network_init();
-	AVIOContext *puc;
-	int ret = avio_open2(&puc, ctx->iname, AVIO_FLAG_READ | AVIO_FLAG_NONBLOCK | AVIO_FLAG_DIRECT, NULL, NULL);
-	if (ret < 0) {
-		fprintf(stderr, "-i error, unable to open file or url\n");
-		return 1;
-	}
+		avformat_network_init();
+		int ret = avio_open2(&puc, ctx->iname, AVIO_FLAG_READ | AVIO_FLAG_NONBLOCK | AVIO_FLAG_DIRECT, NULL, NULL);
+		if (ret < 0) {
+			fprintf(stderr, "-i error, unable to open file or url\n");
+			return 1;
+		}
 
-	kernel_check_socket_sizes(puc);
+		kernel_check_socket_sizes(puc->buffer_size);
+	}
 
 	signal(SIGINT, signal_handler);
 
@@ -708,6 +834,8 @@ int clock_inspector(int argc, char *argv[])
 	/* TODO: Migrate this to use the source-avio.[ch] framework */
 	uint64_t filepos = 0;
 	uint64_t streamPosition = 0;
+	struct timespec arrival = { 0 };
+	time_t nextJitterReport = time(NULL) + ctx->jitterReportSecs;
 	while (gRunning) {
 
 		if (stopSeconds) {
@@ -717,22 +845,56 @@ int clock_inspector(int argc, char *argv[])
 			}
 		}
 
-		int rlen = avio_read(puc, buf, blen);
-		if (rlen == -EAGAIN) {
-			usleep(1 * 1000);
-			continue;
+		if (ctx->doPCRJitter) {
+			time_t now = time(NULL);
+			if (now >= nextJitterReport) {
+				nextJitterReport = now + ctx->jitterReportSecs;
+				pcrJitterReport(ctx, 0);
+			}
+		}
+
+		int rlen;
+		if (ctx->receiver) {
+			/* One datagram, one arrival time. */
+			rlen = udp_receiver_read(ctx->receiver, buf, blen, &arrival, 100);
+			if (rlen == -EAGAIN)
+				continue;
+			if (rlen < 0)
+				break;
+		} else
+		if (reader) {
+			rlen = tsfile_reader_read_copy(reader, buf, offsets, blen / 188);
+			if (rlen <= 0)
+				break;
+			rlen *= 188;
+		} else {
+			rlen = avio_read(puc, buf, blen);
+			if (rlen == -EAGAIN) {
+				usleep(1 * 1000);
+				continue;
+			}
+			if (rlen < 0)
+				break;
 		}
-		if (rlen < 0)
-			break;
 
 		streamPosition += rlen;
 
 		/* Push the entire stream into the stats layer - so we can compyte walltime */
 		ltntstools_pid_stats_update(ctx->libstats, buf, rlen / 188);
 
+		if (ctx->tstd) {
+			if (ctx->receiver)
+				tstd_verifier_write_timed(ctx->tstd, buf, rlen / 188, (arrival.tv_sec * 1000000LL) + (arrival.tv_nsec / 1000));
+			else
+				tstd_verifier_write(ctx->tstd, buf, rlen / 188);
+		}
+
 		for (int i = 0; i < rlen; i += 188) {
 
-			filepos = (streamPosition - rlen) + i;
+			if (reader)
+				filepos = offsets[i / 188];
+			else
+				filepos = (streamPosition - rlen) + i;
 
 			uint8_t *p = (buf + i);
 
@@ -740,6 +902,10 @@ int clock_inspector(int argc, char *argv[])
 				processPacketStats(ctx, p, filepos);
 			}
 
+			if (ctx->receiver) {
+				processPCRJitter(ctx, p, &arrival);
+			}
+
 			if (ctx->doSCRStatistics) {
 				processSCRStats(ctx, p, filepos);
 			}
@@ -760,21 +926,48 @@ int clock_inspector(int argc, char *argv[])
 				(double)(((double)filepos / (double)fileLengthBytes) * 100.0));
 		}
 	}
-	avio_close(puc);
+	if (puc)
+		avio_close(puc);
+
+	if (ctx->receiver) {
+		printf("\n");
+		pcrJitterReport(ctx, 1);
+		udp_receiver_free(ctx->receiver);
+		ctx->receiver = NULL;
+	}
 
 	if (progressReport) {
 		fprintf(stderr, "\ndone\n");
 	}
 
+	if (reader) {
+		struct tsfile_reader_stats_s stats;
+		tsfile_reader_get_stats(reader, &stats);
+		if (tsfile_reader_get_packet_size(reader) != 188 || stats.bytesLost) {
+			printf("Input packet size %d, discarded %" PRIu64 " bytes during %" PRIu64 " resync(s)\n",
+				tsfile_reader_get_packet_size(reader), stats.bytesLost, stats.resyncCount);
+		}
+		tsfile_reader_free(reader);
+	}
+
 	printf("\n");
 	pidReport(ctx);
 
+	if (ctx->tstd) {
+		printf("\n");
+		fflush(stdout);
+		tstd_verifier_dprintf(ctx->tstd, STDOUT_FILENO);
+		tstd_verifier_free(ctx->tstd);
+		ctx->tstd = NULL;
+	}
+
 	if (ctx->libstats) {
 		ltntstools_pid_stats_free(ctx->libstats);
 		ctx->libstats = NULL;
 	}
 
 	free(buf);
+	free(offsets);
 
 	if (ctx->order_asc_pts_output) {
 		for (int i = 0; i <= 0x1fff; i++) {
@@ -783,5 +976,11 @@ int clock_inspector(int argc, char *argv[])
 			}
 		}
 	}
+
+	for (int i = 0; i <= 0x1fff; i++) {
+		if (ctx->pids[i].pcrJitter) {
+			pcr_jitter_free(ctx->pids[i].pcrJitter);
+		}
+	}
 	return 0;
 }
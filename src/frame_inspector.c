@@ -0,0 +1,139 @@
+/* For a given TS file, report frame types, frame sizes, GOP structure, IDR interval
+ * and PTS/DTS cadence for every video pid, without decoding anything.
+ * Uses the same engine as nic_monitor --video-frame-stats.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <getopt.h>
+
+#include "tsfile_reader.h"
+#include "video_frame_stats.h"
+
+#define DEFAULT_REPORT_PACKETS 1000000
+
+struct tool_context_s
+{
+	const char *ifn;
+	void *reader;
+	void *frameStats;
+	int verbose;
+	int reportPackets;
+	uint64_t ts_total_packets;
+};
+
+static void usage(const char *progname)
+{
+	printf("A tool to measure frame types, frame sizes, GOP structure, IDR interval and PTS/DTS cadence\n");
+	printf("for every video pid (MPEG2, H.264 or HEVC) in an ISO13818 MPEGTS file, without decoding.\n");
+	printf("Input file may contain 188, 192 (M2TS) or 204 byte packets.\n");
+	printf("Usage:\n");
+	printf("  -i <input.ts>\n");
+	printf("  -v Show a one line summary per pid during processing.\n");
+	printf("  -n <number> With -v, packets between summaries [def: %d]\n", DEFAULT_REPORT_PACKETS);
+}
+
+static void _report_lines(struct tool_context_s *ctx)
+{
+	struct video_frame_stats_s s;
+	int idx = 0;
+
+	while (video_frame_stats_enum(ctx->frameStats, &idx, &s) == 0) {
+		char line[160];
+		video_frame_stats_sprintf(&s, &line[0], sizeof(line));
+		printf("@%" PRIu64 " %s\n", ctx->ts_total_packets, line);
+	}
+}
+
+int frame_inspector(int argc, char *argv[])
+{
+	int ch;
+
+	struct tool_context_s tctx, *ctx;
+	ctx = &tctx;
+	memset(ctx, 0, sizeof(*ctx));
+	ctx->reportPackets = DEFAULT_REPORT_PACKETS;
+
+	while ((ch = getopt(argc, argv, "?hi:n:v")) != -1) {
+		switch (ch) {
+		case 'i':
+			ctx->ifn = optarg;
+			break;
+		case 'n':
+			ctx->reportPackets = atoi(optarg);
+			if (ctx->reportPackets < 1) {
+				usage(argv[0]);
+				exit(1);
+			}
+			break;
+		case 'v':
+			ctx->verbose = 1;
+			break;
+		default:
+			usage(argv[0]);
+			exit(1);
+		}
+	}
+
+	if (ctx->ifn == 0) {
+		usage(argv[0]);
+		fprintf(stderr, "\n-i is mandatory\n");
+		exit(1);
+	}
+
+	if (tsfile_reader_alloc(&ctx->reader, ctx->ifn, 0) < 0) {
+		fprintf(stderr, "Unable to open input file '%s'\n", ctx->ifn);
+		exit(1);
+	}
+
+	if (video_frame_stats_alloc(&ctx->frameStats) < 0) {
+		fprintf(stderr, "Unable to allocate video frame stats\n");
+		tsfile_reader_free(ctx->reader);
+		exit(1);
+	}
+
+	int max_packets = 1024;
+	uint8_t *buf = malloc(max_packets * 188);
+	if (!buf) {
+		video_frame_stats_free(ctx->frameStats);
+		tsfile_reader_free(ctx->reader);
+		fprintf(stderr, "Unable to allocate buffer\n");
+		exit(1);
+	}
+
+	uint64_t nextReport = ctx->reportPackets;
+	while (1) {
+		int rlen = tsfile_reader_read_copy(ctx->reader, buf, NULL, max_packets);
+		if (rlen <= 0)
+			break;
+
+		video_frame_stats_write(ctx->frameStats, buf, rlen);
+		ctx->ts_total_packets += rlen;
+
+		if (ctx->verbose && ctx->ts_total_packets >= nextReport) {
+			_report_lines(ctx);
+			nextReport += ctx->reportPackets;
+		}
+	}
+
+	struct tsfile_reader_stats_s rs;
+	tsfile_reader_get_stats(ctx->reader, &rs);
+
+	printf("\nRead %" PRIu64 " packets (%d byte container)", ctx->ts_total_packets, tsfile_reader_get_packet_size(ctx->reader));
+	if (rs.bytesLost)
+		printf(", %" PRIu64 " bytes lost to resync", rs.bytesLost);
+	printf("\n\n");
+	fflush(stdout);
+
+	video_frame_stats_dprintf(ctx->frameStats, STDOUT_FILENO);
+
+	free(buf);
+	video_frame_stats_free(ctx->frameStats);
+	tsfile_reader_free(ctx->reader);
+
+	return 0;
+}
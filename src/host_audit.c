@@ -0,0 +1,430 @@
+/* Read only host configuration audit, see host_audit.h */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <dirent.h>
+#include <sched.h>
+
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <net/if.h>
+#include <linux/ethtool.h>
+#include <linux/sockios.h>
+#endif
+
+#include "host_audit.h"
+
+/* Recommended minimums for multicast video capture. */
+#define RECOMMENDED_RMEM_MAX        (16 * 1048576)
+#define RECOMMENDED_NETDEV_BACKLOG  8000
+#define RECOMMENDED_PCAP_BUFFER     (16 * 1048576)
+
+static const int severityPenalty[] = { 0, 10, 30 };
+
+static void _add(struct host_audit_s *a, enum host_audit_check_e check, enum host_audit_severity_e severity, const char *fmt, ...)
+{
+	if (a->findingCount >= HOST_AUDIT_MAX_FINDINGS)
+		return;
+
+	struct host_audit_finding_s *f = &a->findings[a->findingCount++];
+	f->check = check;
+	f->severity = severity;
+
+	va_list ap;
+	va_start(ap, fmt);
+	vsnprintf(&f->text[0], sizeof(f->text), fmt, ap);
+	va_end(ap);
+
+	a->score -= severityPenalty[severity];
+	if (a->score < 0)
+		a->score = 0;
+}
+
+const char *host_audit_severity_name(enum host_audit_severity_e severity)
+{
+	switch (severity) {
+	case HOST_AUDIT_INFO:     return "INFO";
+	case HOST_AUDIT_WARNING:  return "WARN";
+	case HOST_AUDIT_CRITICAL: return "CRIT";
+	default:                  return "????";
+	}
+}
+
+#ifdef __linux__
+
+/* Read the first line of a /proc or /sys file, newline removed. */
+static int _read_line(const char *fn, char *dst, int lengthBytes)
+{
+	FILE *fh = fopen(fn, "r");
+	if (!fh)
+		return -1;
+
+	int ret = -1;
+	if (fgets(dst, lengthBytes, fh)) {
+		dst[strcspn(dst, "\n")] = 0;
+		ret = 0;
+	}
+	fclose(fh);
+
+	return ret;
+}
+
+static int _read_int64(const char *fn, int64_t *val)
+{
+	char line[64];
+	if (_read_line(fn, &line[0], sizeof(line)) < 0)
+		return -1;
+
+	*val = strtoll(line, NULL, 10);
+	return 0;
+}
+
+/* Parse a kernel cpu list, eg. "0-3,8,10-11" */
+static void _parse_cpulist(const char *str, cpu_set_t *set)
+{
+	CPU_ZERO(set);
+
+	const char *p = str;
+	while (*p) {
+		char *end;
+		long a = strtol(p, &end, 10);
+		if (end == p)
+			break;
+		long b = a;
+		if (*end == '-') {
+			p = end + 1;
+			b = strtol(p, &end, 10);
+		}
+		for (long i = a; i <= b && i < CPU_SETSIZE; i++)
+			CPU_SET(i, set);
+		p = end;
+		if (*p == ',')
+			p++;
+	}
+}
+
+static void _cpuset_to_list(cpu_set_t *set, char *dst, int lengthBytes)
+{
+	int len = 0;
+	dst[0] = 0;
+
+	for (int i = 0; i < CPU_SETSIZE && len < lengthBytes - 1; i++) {
+		if (!CPU_ISSET(i, set))
+			continue;
+		int j = i;
+		while (j + 1 < CPU_SETSIZE && CPU_ISSET(j + 1, set))
+			j++;
+		if (j > i)
+			len += snprintf(dst + len, lengthBytes - len, "%s%d-%d", len ? "," : "", i, j);
+		else
+			len += snprintf(dst + len, lengthBytes - len, "%s%d", len ? "," : "", i);
+		i = j;
+	}
+}
+
+static void _check_sysctls(struct host_audit_s *a, const struct host_audit_params_s *p)
+{
+	int64_t rmem_max = 0, rmem_default = 0, backlog = 0;
+
+	if (_read_int64("/proc/sys/net/core/rmem_max", &rmem_max) == 0) {
+		if (p->socketBufferBytes && p->socketBufferBytes > rmem_max) {
+			_add(a, HOST_AUDIT_RMEM_MAX, HOST_AUDIT_CRITICAL,
+				"net.core.rmem_max %" PRIi64 " is smaller than the requested socket buffer %d, sysctl -w net.core.rmem_max=%d",
+				rmem_max, p->socketBufferBytes, p->socketBufferBytes);
+		} else
+		if (rmem_max < RECOMMENDED_RMEM_MAX) {
+			_add(a, HOST_AUDIT_RMEM_MAX, HOST_AUDIT_WARNING,
+				"net.core.rmem_max %" PRIi64 " is small for video, sysctl -w net.core.rmem_max=%d",
+				rmem_max, RECOMMENDED_RMEM_MAX);
+		}
+	}
+
+	if (_read_int64("/proc/sys/net/core/rmem_default", &rmem_default) == 0 && rmem_default < 1048576) {
+		_add(a, HOST_AUDIT_RMEM_DEFAULT, HOST_AUDIT_INFO,
+			"net.core.rmem_default %" PRIi64 ", sockets that don't request a size get this", rmem_default);
+	}
+
+	if (_read_int64("/proc/sys/net/core/netdev_max_backlog", &backlog) == 0 && backlog < RECOMMENDED_NETDEV_BACKLOG) {
+		_add(a, HOST_AUDIT_NETDEV_BACKLOG, HOST_AUDIT_WARNING,
+			"net.core.netdev_max_backlog %" PRIi64 ", bursts may be dropped, sysctl -w net.core.netdev_max_backlog=%d",
+			backlog, RECOMMENDED_NETDEV_BACKLOG);
+	}
+}
+
+/* /proc/net/snmp has a Udp: header line followed by a Udp: values line. */
+static void _check_udp_errors(struct host_audit_s *a)
+{
+	FILE *fh = fopen("/proc/net/snmp", "r");
+	if (!fh)
+		return;
+
+	char hdr[1024], val[1024];
+	while (fgets(hdr, sizeof(hdr), fh)) {
+		if (strncmp(hdr, "Udp:", 4) != 0)
+			continue;
+		if (!fgets(val, sizeof(val), fh))
+			break;
+
+		char *hs = NULL, *vs = NULL;
+		char *h = strtok_r(hdr, " \n", &hs);
+		char *v = strtok_r(val, " \n", &vs);
+		while (h && v) {
+			if (strcmp(h, "RcvbufErrors") == 0) {
+				int64_t errors = strtoll(v, NULL, 10);
+				if (errors > 0) {
+					_add(a, HOST_AUDIT_UDP_RCVBUF_ERRORS, HOST_AUDIT_WARNING,
+						"%" PRIi64 " UDP datagrams dropped for lack of socket buffer since boot (Udp RcvbufErrors)", errors);
+				}
+				break;
+			}
+			h = strtok_r(NULL, " \n", &hs);
+			v = strtok_r(NULL, " \n", &vs);
+		}
+		break;
+	}
+	fclose(fh);
+}
+
+static void _check_nic_ring(struct host_audit_s *a, const char *ifname)
+{
+	int skt = socket(AF_INET, SOCK_DGRAM, 0);
+	if (skt < 0)
+		return;
+
+	struct ethtool_ringparam ring;
+	memset(&ring, 0, sizeof(ring));
+	ring.cmd = ETHTOOL_GRINGPARAM;
+
+	struct ifreq ifr;
+	memset(&ifr, 0, sizeof(ifr));
+	strncpy(ifr.ifr_name, ifname, IFNAMSIZ - 1);
+	ifr.ifr_data = (void *)&ring;
+
+	/* Not every driver supports it, virtual interfaces typically don't. */
+	if (ioctl(skt, SIOCETHTOOL, &ifr) == 0) {
+		if (ring.rx_max_pending && ring.rx_pending < ring.rx_max_pending) {
+			_add(a, HOST_AUDIT_NIC_RING, ring.rx_pending < ring.rx_max_pending / 4 ? HOST_AUDIT_WARNING : HOST_AUDIT_INFO,
+				"%s RX ring %d of a possible %d descriptors, ethtool -G %s rx %d",
+				ifname, ring.rx_pending, ring.rx_max_pending, ifname, ring.rx_max_pending);
+		}
+	}
+
+	close(skt);
+}
+
+/* Whole names only, eth1 mustn't match eth10 or veth1. The name ends at whitespace,
+ * or a '-' or '@' as in eth0-TxRx-3.
+ */
+static int _line_has_ifname(const char *line, const char *ifname)
+{
+	size_t len = strlen(ifname);
+	if (len == 0)
+		return 0;
+
+	for (const char *p = strstr(line, ifname); p; p = strstr(p + 1, ifname)) {
+		if (p != line && !isspace((unsigned char)p[-1]))
+			continue;
+		char c = p[len];
+		if (c == 0 || isspace((unsigned char)c) || c == '-' || c == '@')
+			return 1;
+	}
+
+	return 0;
+}
+
+/* Interrupts for the NIC are named after it in /proc/interrupts, eg. eth0-TxRx-3 or mlx5_comp0@pci... */
+static void _check_nic_irqs(struct host_audit_s *a, const char *ifname, cpu_set_t *captureCpus)
+{
+	FILE *fh = fopen("/proc/interrupts", "r");
+	if (!fh)
+		return;
+
+	int irqCount = 0, overlapCount = 0;
+	char line[4096];
+	while (fgets(line, sizeof(line), fh)) {
+		int irq;
+		if (sscanf(line, " %d:", &irq) != 1)
+			continue;
+		if (!_line_has_ifname(line, ifname))
+			continue;
+		irqCount++;
+
+		char fn[64], list[256];
+		snprintf(fn, sizeof(fn), "/proc/irq/%d/effective_affinity_list", irq);
+		if (_read_line(fn, &list[0], sizeof(list)) < 0) {
+			snprintf(fn, sizeof(fn), "/proc/irq/%d/smp_affinity_list", irq);
+			if (_read_line(fn, &list[0], sizeof(list)) < 0)
+				continue;
+		}
+
+		cpu_set_t irqCpus, both;
+		_parse_cpulist(list, &irqCpus);
+		CPU_AND(&both, &irqCpus, captureCpus);
+		if (CPU_COUNT(&both))
+			overlapCount++;
+	}
+	fclose(fh);
+
+	if (irqCount && overlapCount) {
+		char cpus[128];
+		_cpuset_to_list(captureCpus, &cpus[0], sizeof(cpus));
+		_add(a, HOST_AUDIT_NIC_IRQ_AFFINITY, HOST_AUDIT_WARNING,
+			"%d of %d %s interrupts may run on the capture cpus (%s), pin the tool (taskset) or move the IRQs",
+			overlapCount, irqCount, ifname, cpus);
+	}
+}
+
+static void _check_numa(struct host_audit_s *a, const char *ifname, cpu_set_t *captureCpus)
+{
+	char fn[256];
+	int64_t node = -1;
+
+	snprintf(fn, sizeof(fn), "/sys/class/net/%s/device/numa_node", ifname);
+	if (_read_int64(fn, &node) < 0 || node < 0)
+		return; /* Not a PCI device, or not a NUMA host */
+
+	char list[1024];
+	snprintf(fn, sizeof(fn), "/sys/devices/system/node/node%" PRIi64 "/cpulist", node);
+	if (_read_line(fn, &list[0], sizeof(list)) < 0)
+		return;
+
+	cpu_set_t local, remote;
+	_parse_cpulist(list, &local);
+	CPU_XOR(&remote, captureCpus, &local);
+	CPU_AND(&remote, &remote, captureCpus);
+
+	if (CPU_COUNT(&remote)) {
+		_add(a, HOST_AUDIT_NUMA, CPU_COUNT(&remote) == CPU_COUNT(captureCpus) ? HOST_AUDIT_WARNING : HOST_AUDIT_INFO,
+			"%s is on NUMA node %" PRIi64 " (cpus %s), %d of the %d capture cpus are remote, numactl -N %" PRIi64,
+			ifname, node, list, CPU_COUNT(&remote), CPU_COUNT(captureCpus), node);
+	}
+}
+
+static void _check_governor(struct host_audit_s *a, cpu_set_t *captureCpus)
+{
+	int total = 0, slow = 0;
+	char governor[64] = { 0 };
+
+	for (int i = 0; i < CPU_SETSIZE; i++) {
+		if (!CPU_ISSET(i, captureCpus))
+			continue;
+
+		char fn[128], g[64];
+		snprintf(fn, sizeof(fn), "/sys/devices/system/cpu/cpu%d/cpufreq/scaling_governor", i);
+		if (_read_line(fn, &g[0], sizeof(g)) < 0)
+			continue; /* No cpufreq, VMs usually */
+
+		total++;
+		if (strcmp(g, "performance") != 0) {
+			slow++;
+			strcpy(governor, g);
+		}
+	}
+
+	if (slow) {
+		_add(a, HOST_AUDIT_CPU_GOVERNOR, strcmp(governor, "powersave") == 0 ? HOST_AUDIT_WARNING : HOST_AUDIT_INFO,
+			"%d of %d capture cpus use the %s cpufreq governor, cpupower frequency-set -g performance",
+			slow, total, governor);
+	}
+}
+
+static void _check_thp(struct host_audit_s *a)
+{
+	char enabled[128], defrag[128];
+
+	if (_read_line("/sys/kernel/mm/transparent_hugepage/enabled", &enabled[0], sizeof(enabled)) < 0)
+		return;
+	if (strstr(enabled, "[never]"))
+		return;
+
+	/* Synchronous compaction on fault can stall the capture thread for milliseconds. */
+	if (_read_line("/sys/kernel/mm/transparent_hugepage/defrag", &defrag[0], sizeof(defrag)) == 0 &&
+		strstr(defrag, "[always]")) {
+		_add(a, HOST_AUDIT_THP, HOST_AUDIT_WARNING,
+			"Transparent hugepage defrag is 'always', page faults may stall on compaction, echo defer > /sys/kernel/mm/transparent_hugepage/defrag");
+	}
+}
+
+#endif /* __linux__ */
+
+int host_audit_run(struct host_audit_s *a, const struct host_audit_params_s *params)
+{
+	struct host_audit_params_s none = { 0 };
+	if (!params)
+		params = &none;
+
+	memset(a, 0, sizeof(*a));
+	a->when = time(NULL);
+	a->score = 100;
+
+#ifdef __linux__
+	cpu_set_t captureCpus;
+	if (sched_getaffinity(0, sizeof(captureCpus), &captureCpus) < 0) {
+		CPU_ZERO(&captureCpus);
+	}
+
+	_check_sysctls(a, params);
+	_check_udp_errors(a);
+
+	if (params->pcapBufferBytes && params->pcapBufferBytes < RECOMMENDED_PCAP_BUFFER) {
+		_add(a, HOST_AUDIT_PCAP_BUFFER, HOST_AUDIT_WARNING,
+			"pcap buffer %d bytes is small for video, use at least %d (-B)",
+			params->pcapBufferBytes, RECOMMENDED_PCAP_BUFFER);
+	}
+
+	if (params->ifname && params->ifname[0]) {
+		_check_nic_ring(a, params->ifname);
+		if (CPU_COUNT(&captureCpus)) {
+			_check_nic_irqs(a, params->ifname, &captureCpus);
+			_check_numa(a, params->ifname, &captureCpus);
+		}
+	}
+
+	if (CPU_COUNT(&captureCpus)) {
+		_check_governor(a, &captureCpus);
+	}
+	_check_thp(a);
+#endif
+
+	return a->findingCount;
+}
+
+const struct host_audit_finding_s *host_audit_find(const struct host_audit_s *a, enum host_audit_check_e check)
+{
+	for (int i = 0; i < a->findingCount; i++) {
+		if (a->findings[i].check == check)
+			return &a->findings[i];
+	}
+
+	return NULL;
+}
+
+int host_audit_sprintf(const struct host_audit_s *a, char *dst, int lengthBytes)
+{
+	int count[3] = { 0 };
+	for (int i = 0; i < a->findingCount; i++)
+		count[a->findings[i].severity]++;
+
+	return snprintf(dst, lengthBytes, "Host audit %d/100: %d critical, %d warnings, %d info",
+		a->score, count[HOST_AUDIT_CRITICAL], count[HOST_AUDIT_WARNING], count[HOST_AUDIT_INFO]);
+}
+
+void host_audit_dprintf(const struct host_audit_s *a, int fd)
+{
+	char line[160];
+	host_audit_sprintf(a, &line[0], sizeof(line));
+	dprintf(fd, "%s\n", line);
+
+	for (int i = 0; i < a->findingCount; i++) {
+		dprintf(fd, "  %s %s\n", host_audit_severity_name(a->findings[i].severity), a->findings[i].text);
+	}
+}
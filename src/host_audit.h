@@ -0,0 +1,105 @@
+/**
+ * @file        host_audit.h
+ * @brief       Read only audit of the host configuration, for capture and playout tools.
+ *              Most "the tool drops packets" reports are host configuration: small socket
+ *              buffer limits, default NIC ring sizes, NIC interrupts landing on the capture
+ *              core, the powersave CPU governor, small pcap buffers, THP compaction stalls
+ *              and NUMA placement. The audit inspects /proc, /sys and the ethtool ioctls,
+ *              and produces a score with a list of concrete findings.
+ *
+ *              Nothing on the host is ever changed, the findings say what to change.
+ *              Linux only, elsewhere the audit returns a perfect score with no findings.
+ */
+
+#ifndef HOST_AUDIT_H
+#define HOST_AUDIT_H
+
+#include <stdint.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HOST_AUDIT_MAX_FINDINGS 24
+
+enum host_audit_check_e
+{
+	HOST_AUDIT_RMEM_MAX = 0,      /* net.core.rmem_max smaller than requested or recommended */
+	HOST_AUDIT_RMEM_DEFAULT,      /* net.core.rmem_default, used by tools that don't ask */
+	HOST_AUDIT_NETDEV_BACKLOG,    /* net.core.netdev_max_backlog */
+	HOST_AUDIT_UDP_RCVBUF_ERRORS, /* UDP datagrams dropped for lack of socket buffer, since boot */
+	HOST_AUDIT_NIC_RING,          /* NIC RX ring smaller than the hardware maximum */
+	HOST_AUDIT_NIC_IRQ_AFFINITY,  /* NIC interrupts can run on the capture cpus */
+	HOST_AUDIT_CPU_GOVERNOR,      /* cpufreq governor isn't performance */
+	HOST_AUDIT_PCAP_BUFFER,       /* Requested pcap buffer is small */
+	HOST_AUDIT_THP,               /* Transparent hugepage synchronous defrag */
+	HOST_AUDIT_NUMA,              /* Capture cpus aren't local to the NIC */
+	HOST_AUDIT_CHECK_MAX,
+};
+
+enum host_audit_severity_e
+{
+	HOST_AUDIT_INFO = 0,
+	HOST_AUDIT_WARNING,
+	HOST_AUDIT_CRITICAL,
+};
+
+struct host_audit_finding_s
+{
+	enum host_audit_check_e check;
+	enum host_audit_severity_e severity;
+	char text[160];
+};
+
+struct host_audit_s
+{
+	time_t when;
+	int score; /* 0 - 100, 100 is a host with nothing to fix */
+	int findingCount;
+	struct host_audit_finding_s findings[HOST_AUDIT_MAX_FINDINGS];
+};
+
+/**
+ * @brief       What the tool intends to do, so the audit can judge the host against it.
+ *              Zero / NULL for anything that doesn't apply.
+ */
+struct host_audit_params_s
+{
+	const char *ifname;         /* Capture or playout interface, enables the NIC checks */
+	int socketBufferBytes;      /* Receive socket buffer the tool will request */
+	int pcapBufferBytes;        /* pcap_set_buffer_size() */
+};
+
+/**
+ * @brief       Run the audit, reading host state only. Safe to call at any time, from any thread.
+ *              Capture cpus are taken from the calling threads affinity mask.
+ * @param[out]  struct host_audit_s *audit - results.
+ * @param[in]   const struct host_audit_params_s *params - may be NULL.
+ * @return      Number of findings.
+ */
+int  host_audit_run(struct host_audit_s *audit, const struct host_audit_params_s *params);
+
+/**
+ * @brief       Find the result of a specific check.
+ * @return      Pointer to the finding, NULL if the check passed or didn't apply.
+ */
+const struct host_audit_finding_s *host_audit_find(const struct host_audit_s *audit, enum host_audit_check_e check);
+
+/**
+ * @brief       One line summary, score and the number of findings at each severity.
+ */
+int  host_audit_sprintf(const struct host_audit_s *audit, char *dst, int lengthBytes);
+
+/**
+ * @brief       Full report, one finding per line.
+ */
+void host_audit_dprintf(const struct host_audit_s *audit, int fd);
+
+const char *host_audit_severity_name(enum host_audit_severity_e severity);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* HOST_AUDIT_H */
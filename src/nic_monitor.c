@@ -41,6 +41,40 @@ static char ui_syncronized_getch(struct tool_context_s *ctx)
 	return c;
 }
 
+/* Read only, never changes the host. Takes the UI lock then the list lock, the same order as the UI thread. */
+static void host_audit_refresh(struct tool_context_s *ctx)
+{
+	struct host_audit_params_s params = { 0 };
+	if (ctx->iftype == IF_TYPE_PCAP) {
+		params.ifname = ctx->ifname;
+		params.pcapBufferBytes = ctx->bufferSize;
+	}
+
+	struct host_audit_s audit;
+	host_audit_run(&audit, &params);
+
+	pthread_mutex_lock(&ctx->ui_threadLock);
+	pthread_mutex_lock(&ctx->lock);
+	ctx->hostAudit = audit;
+	pthread_mutex_unlock(&ctx->lock);
+	pthread_mutex_unlock(&ctx->ui_threadLock);
+}
+
+static int file_readahead_sprintf(struct tool_context_s *ctx, char *dst, int lengthBytes)
+{
+	struct ltntstools_source_readahead_stats_s *s = &ctx->fileReadaheadStats;
+
+	return snprintf(dst, lengthBytes, "Readahead: %s depth %d reads %" PRIu64 " underruns %" PRIu64
+		" (max %" PRIu64 "us) rebases %" PRIu64 " @ %.2f Mb/ps",
+		s->usingIOUring ? "io_uring" : "thread",
+		s->depth,
+		s->readsCompleted,
+		s->underruns,
+		s->maxUnderrunUs,
+		s->lateRebases,
+		(double)s->bps / 1e6);
+}
+
 static void *ui_thread_func(void *p)
 {
 	struct tool_context_s *ctx = p;
@@ -50,9 +84,6 @@ static void *ui_thread_func(void *p)
 	ctx->trailerRow = DEFAULT_TRAILERROW;
 	double totalMbps = 0, totalRxMbps = 0, totalTxMbps = 0;
 	int totalStreams = 0;
-	struct ltntstools_proc_net_udp_item_s *items = NULL;
-	int itemCount = 0;
-
 	ltnpthread_setname_np(ctx->ui_threadId, "tstools-ui");
 	pthread_detach(pthread_self());
 	setlocale(LC_NUMERIC, "");
@@ -94,9 +125,10 @@ static void *ui_thread_func(void *p)
 		char mask[64];
 		sprintf(mask, "%s", inet_ntoa(ip_mask));
 		if (ctx->iftype == IF_TYPE_PCAP) {
-			sprintf(title_c, "NIC: %s (%s/%s) Dropped: %d/%d", ctx->ifname, inet_ntoa(ip_net), mask,
+			sprintf(title_c, "NIC: %s (%s/%s) Dropped: %d/%d Host: %d/100", ctx->ifname, inet_ntoa(ip_net), mask,
 				ctx->pcap_stats.ps_drop,
-				ctx->pcap_stats.ps_ifdrop);
+				ctx->pcap_stats.ps_ifdrop,
+				ctx->hostAudit.score);
 		} else
 		if (ctx->iftype == IF_TYPE_MPEGTS_FILE) {
 			if (ctx->fileLoops) {
@@ -232,10 +264,30 @@ static void *ui_thread_func(void *p)
 
 			if (discovered_item_state_get(di, DI_STATE_STREAM_FORWARDING)) {
 				streamCount++;
-				mvprintw(streamCount + 2, 0, " -> Forwarding stream to %s", di->forwardURL);
+				if (ctx->forwardStrip.enabled) {
+					char strip[160];
+					stuffing_strip_sprintf(&strip[0], sizeof(strip), &di->forwardStripStats);
+					mvprintw(streamCount + 2, 0, " -> Forwarding stream to %s, %s", di->forwardURL, strip);
+				} else {
+					mvprintw(streamCount + 2, 0, " -> Forwarding stream to %s", di->forwardURL);
+				}
 				streamCount++;
 			}
 
+			pthread_mutex_lock(&di->frameStatsLock);
+			if (di->frameStats) {
+				struct video_frame_stats_s vfs;
+				int idx = 0;
+				while (video_frame_stats_enum(di->frameStats, &idx, &vfs) == 0) {
+					char line[160];
+					video_frame_stats_sprintf(&vfs, &line[0], sizeof(line));
+					streamCount++;
+					mvprintw(streamCount + 2, 0, " -> %s", line);
+					streamCount++;
+				}
+			}
+			pthread_mutex_unlock(&di->frameStatsLock);
+
 			if (discovered_item_state_get(di, DI_STATE_PCAP_RECORDING)) {
 
 				char fn[512] = { 0 };
@@ -474,8 +526,10 @@ static void *ui_thread_func(void *p)
 				streamCount++;
 				mvprintw(streamCount + 2, 0, " -> ");
 
-				char *s;
-				ltn_histogram_interval_print_buf(&s, di->packetIntervals, 0);
+				char *s = NULL;
+				if (di->packetIntervals) {
+					ltn_histogram_interval_print_buf(&s, di->packetIntervals, 0);
+				}
 				if (s) {
 					char *buf = s;
 
@@ -504,48 +558,36 @@ static void *ui_thread_func(void *p)
 				streamCount++;
 				mvprintw(streamCount + 2, 0, " -> Socket / Process Report");
 
-				if (ctx->lastSocketReport + 2 < now) {
-					ctx->lastSocketReport = now;
-
-					if (items) {
-						ltntstools_proc_net_udp_item_free(ctx->procNetUDPContext, items);
-						items = NULL;
-					}
-					ltntstools_proc_net_udp_item_query(ctx->procNetUDPContext, &items, &itemCount);
-				}
-
-				if (itemCount) {
-					mvprintw(streamCount + 2, 55, "PID           COMMAND        DROPS    TOTAL");
+				if (ctx->sockDiag.intervalMs <= 0) {
+					mvprintw(streamCount + 2, 55, "(socket statistics disabled)");
 					streamCount++;
 				} else {
-					mvprintw(streamCount + 2, 55, "PID           COMMAND        DROPS   (discovery mode)");
-					streamCount++;
-				}
+					pthread_mutex_lock(&di->receiverLock);
+					if (di->receiverCount) {
+						mvprintw(streamCount + 2, 55, "PID           COMMAND        DROPS    TOTAL");
+						streamCount++;
+					} else {
+						mvprintw(streamCount + 2, 55, "PID           COMMAND        DROPS   (no local receivers)");
+						streamCount++;
+					}
 
-				if (items && itemCount) {
-					for (int i = 0; i < itemCount; i++) {
-						struct ltntstools_proc_net_udp_item_s *e = &items[i];
-
-						// TODO: String compare is slow. Convert to uint32_t for a fast match.
-						if (((e->local_addr.sin_addr.s_addr == INADDR_ANY) && (e->local_addr.sin_port == di->dstport)) ||
-							(strcmp(e->locaddr, di->dstaddr) == 0))
-						{
-							if (e->drops_delta)
-								attron(COLOR_PAIR(4));
-
-							mvprintw(streamCount + 2, 50, "%8" PRIu64 "  %16s    %9" PRIu64 "%9" PRIu64,
-								e->pidList[0].pid,
-								e->pidList[0].comm,
-								e->drops_delta,
-								e->drops);
-
-							if (e->drops_delta)
-								attroff(COLOR_PAIR(4));
-							streamCount++;
-						}
+					for (int i = 0; i < di->receiverCount; i++) {
+						struct sockdiag_receiver_s *r = &di->receivers[i];
+
+						if (r->dropsDelta)
+							attron(COLOR_PAIR(4));
+
+						mvprintw(streamCount + 2, 50, "%8d  %16s    %9u%9u",
+							r->pid,
+							r->comm[0] ? r->comm : "unknown",
+							r->dropsDelta,
+							r->drops);
+
+						if (r->dropsDelta)
+							attroff(COLOR_PAIR(4));
+						streamCount++;
 					}
-					
-					//ltntstools_proc_net_udp_item_dprintf(ctx->procNetUDPContext, 0, items, itemCount);
+					pthread_mutex_unlock(&di->receiverLock);
 				}
 			}
 
@@ -575,7 +617,7 @@ static void *ui_thread_func(void *p)
 				}
 
 				struct ltntstools_pat_s *m = NULL;
-				if (ltntstools_streammodel_query_model(di->streamModel, &m) == 0) {
+				if (di->streamModel && ltntstools_streammodel_query_model(di->streamModel, &m) == 0) {
 
 					/* Now that we have a working stream model, look PCR for each stream
 					 * and establish a clock analyzer through the stats infrastructure.
@@ -657,29 +699,16 @@ static void *ui_thread_func(void *p)
 								int slicesEnabled = 0;
 								struct h264_slice_counter_results_s slices;
 
+								/* The codec service points the slice counter at this streams H.264 pid. */
 								pthread_mutex_lock(&di->h264_sliceLock);
 								if (di->h264_slices) {
 									if (h264_slice_counter_get_pid(di->h264_slices) == m->programs[p].pmt.streams[s].elementary_PID) {
 										slicesEnabled = 1;
 										h264_slice_counter_query(di->h264_slices, &slices);
-									} else {
-										/* Set the pid to match this stream and we'll catch the stats the next time around. */
-										h264_slice_counter_reset_pid(di->h264_slices, m->programs[p].pmt.streams[s].elementary_PID);
 									}
 								}
 								pthread_mutex_unlock(&di->h264_sliceLock);
 
-								pthread_mutex_lock(&di->h264_metadataLock);
-								if (di->h264_metadata_parser) {
-									pthread_mutex_unlock(&di->h264_metadataLock);
-									streamCount++;
-									mvprintw(streamCount + 2, 54, "%s", di->h264_video_colorspace);
-									streamCount++;
-									mvprintw(streamCount + 2, 54, "%s", di->h264_video_format);
-								} else {
-									pthread_mutex_unlock(&di->h264_metadataLock);
-								}
-
 								if (slicesEnabled) {
 									streamCount++;
 									mvprintw(streamCount + 2, 54, "I: %'" PRIu64 " B: %'" PRIu64 " P: %'" PRIu64 " : %s...",
@@ -689,20 +718,18 @@ static void *ui_thread_func(void *p)
 
 							} /* If H264 */
 
-							if (m->programs[p].pmt.streams[s].stream_type  == 0x24 /* H.265 */) {
+							if (m->programs[p].pmt.streams[s].stream_type  == 0x1b /* H.264 */ ||
+								m->programs[p].pmt.streams[s].stream_type  == 0x24 /* H.265 */) {
 
-								pthread_mutex_lock(&di->h265_metadataLock);
-								if (di->h265_metadata_parser) {
-									pthread_mutex_unlock(&di->h265_metadataLock);
+								struct codec_metadata_s codec;
+								if (nic_monitor_codec_query(di, m->programs[p].pmt.streams[s].elementary_PID, &codec) == 0) {
 									streamCount++;
-									mvprintw(streamCount + 2, 54, "%s", di->h265_video_colorspace);
+									mvprintw(streamCount + 2, 54, "%s", codec.colorspace);
 									streamCount++;
-									mvprintw(streamCount + 2, 54, "%s", di->h265_video_format);
-								} else {
-									pthread_mutex_unlock(&di->h265_metadataLock);
+									mvprintw(streamCount + 2, 54, "%s (sampled %ds ago)", codec.format, (int)(time(NULL) - codec.lastSample));
 								}
 
-							} /* If H.265 / HEVC */
+							} /* If H.264 or H.265 / HEVC */
 
 						}
 
@@ -723,7 +750,7 @@ static void *ui_thread_func(void *p)
 							mvprintw(streamCount + 2, 54, "LTN Encoder S/W: %d.%d.%d / Latency: ",
 								major, minor, patch);
 
-							int64_t ms = ltntstools_probe_ltnencoder_get_total_latency(di->LTNLatencyProbe);
+							int64_t ms = di->LTNLatencyProbe ? ltntstools_probe_ltnencoder_get_total_latency(di->LTNLatencyProbe) : -1;
 							if (ms >= 0) {
 								mvprintw(streamCount + 2, 89, "%" PRIi64 "ms", ms);
 							} else {
@@ -734,7 +761,7 @@ static void *ui_thread_func(void *p)
 								/* Measure latency thorugh video transformers that strip the PMT ES encoder descriptor. */
 								streamCount++;
 
-								int64_t ms = ltntstools_probe_ltnencoder_get_total_latency(di->LTNLatencyProbe);
+								int64_t ms = di->LTNLatencyProbe ? ltntstools_probe_ltnencoder_get_total_latency(di->LTNLatencyProbe) : -1;
 								if (ms >= 0) {
 									mvprintw(streamCount + 2, 54, "Latency: %" PRIi64 "ms", ms);
 								} else {
@@ -809,7 +836,7 @@ static void *ui_thread_func(void *p)
 
 			streamCount++;
 			mvprintw(streamCount + 2, 0, "$) Record Format: %s",
-				ctx->recordAsTS ? "MPEG-TS" : "PCAP");
+				ctx->recordAsTS ? "MPEG-TS" : ctx->recordPcapng ? "PCAPNG" : "PCAP");
 
 			streamCount++;
 			streamCount++;
@@ -825,15 +852,17 @@ static void *ui_thread_func(void *p)
 			streamCount++;
 			mvprintw(streamCount + 2, 0, "H) Hide the selected stream (analysis continues)");
 			mvprintw(streamCount + 2, 0, "U) Unhide all hidden streams");
-			mvprintw(streamCount + 2 - 8, 53, "I) Toggle stream IAT histogram report");
-			mvprintw(streamCount + 2 - 7, 53, "L) Toggle stream log report");
-			mvprintw(streamCount + 2 - 6, 53, "M) Toggle stream PSIP model report");
-			mvprintw(streamCount + 2 - 5, 53, "P) Toggle stream PID traffic report");
-			mvprintw(streamCount + 2 - 4, 53, "C) Toggle stream Clock report");
-			mvprintw(streamCount + 2 - 3, 53, "r) Reset stats counters and begin new measurement period");
-			mvprintw(streamCount + 2 - 2, 53, "R) Start/Stop stream recording");
-			mvprintw(streamCount + 2 - 1, 53, "s) Toggle process/socket report");
-			mvprintw(streamCount + 2 - 0, 53, "T) Start/Stop TR101290 analysis (NOT YET SUPPORTED)");
+			streamCount++;
+			mvprintw(streamCount + 2, 0, "A) Re-run the host configuration audit");
+			mvprintw(streamCount + 2 - 9, 53, "I) Toggle stream IAT histogram report");
+			mvprintw(streamCount + 2 - 8, 53, "L) Toggle stream log report");
+			mvprintw(streamCount + 2 - 7, 53, "M) Toggle stream PSIP model report");
+			mvprintw(streamCount + 2 - 6, 53, "P) Toggle stream PID traffic report");
+			mvprintw(streamCount + 2 - 5, 53, "C) Toggle stream Clock report");
+			mvprintw(streamCount + 2 - 4, 53, "r) Reset stats counters and begin new measurement period");
+			mvprintw(streamCount + 2 - 3, 53, "R) Start/Stop stream recording");
+			mvprintw(streamCount + 2 - 2, 53, "s) Toggle process/socket report");
+			mvprintw(streamCount + 2 - 1, 53, "T) Start/Stop TR101290 analysis (NOT YET SUPPORTED)");
 #if 0
 			mvprintw(streamCount + 2 - 0, 53, "3) Toggle SCTE35 report");
 #endif
@@ -849,6 +878,53 @@ static void *ui_thread_func(void *p)
 			}
 		}
 
+		if (ctx->admission.enabled) {
+			char admission[160];
+			nic_monitor_admission_sprintf(ctx, &admission[0], sizeof(admission));
+			streamCount++;
+			mvprintw(streamCount + 2, 0, "%s", admission);
+			streamCount++;
+		}
+
+		if (ctx->memGovernor.budgetBytes) {
+			char governor[160];
+			nic_monitor_memory_sprintf(ctx, &governor[0], sizeof(governor));
+			streamCount++;
+			mvprintw(streamCount + 2, 0, "%s", governor);
+			streamCount++;
+		}
+
+		if (ctx->hostAudit.score < 100) {
+			char audit[160];
+			host_audit_sprintf(&ctx->hostAudit, &audit[0], sizeof(audit));
+			streamCount++;
+			mvprintw(streamCount + 2, 0, "%s (A to re-run)", audit);
+			for (int i = 0; i < ctx->hostAudit.findingCount; i++) {
+				const struct host_audit_finding_s *f = &ctx->hostAudit.findings[i];
+				if (f->severity == HOST_AUDIT_INFO)
+					continue;
+				streamCount++;
+				mvprintw(streamCount + 2, 0, " -> %s %s", host_audit_severity_name(f->severity), f->text);
+			}
+			streamCount++;
+		}
+
+		if (ctx->deepScheduler.slots) {
+			char deep[160];
+			nic_monitor_deep_sprintf(ctx, &deep[0], sizeof(deep));
+			streamCount++;
+			mvprintw(streamCount + 2, 0, "%s", deep);
+			streamCount++;
+		}
+
+		if (ctx->fileReadaheadDepth) {
+			char readahead[160];
+			file_readahead_sprintf(ctx, &readahead[0], sizeof(readahead));
+			streamCount++;
+			mvprintw(streamCount + 2, 0, "%s", readahead);
+			streamCount++;
+		}
+
 		attron(COLOR_PAIR(2));
 		ctx->trailerRow = streamCount + 3;
 		if (ctx->showForwardOptions) {
@@ -889,11 +965,6 @@ static void *ui_thread_func(void *p)
 		usleep(200 * 1000);
 	}
 
-	if (items) {
-		ltntstools_proc_net_udp_item_free(ctx->procNetUDPContext, items);
-		items = NULL;
-	}
-
 	ctx->ui_threadTerminated = 1;
 
 	pthread_exit(NULL);
@@ -1025,6 +1096,13 @@ static void *stats_thread_func(void *p)
 			discovered_items_housekeeping(ctx);
 		}
 
+		nic_monitor_deep_service(ctx);
+		nic_monitor_codec_service(ctx);
+		nic_monitor_audio_service(ctx);
+		nic_monitor_caption_service(ctx);
+		nic_monitor_sockdiag_service(ctx);
+		nic_monitor_loss_service(ctx, 0);
+
 		time(&now);
 		if (ctx->file_prefix && ctx->file_prefix_next_write_time <= now) {
 			ctx->file_prefix_next_write_time = now + ctx->file_write_interval;
@@ -1058,8 +1136,24 @@ static void *stats_thread_func(void *p)
 
 static void pcap_callback(u_char *args, const struct pcap_pkthdr *h, const u_char *pkt) 
 {
-	pcap_update_statistics(ctx, h, pkt); /* Update the stream stats realtime to avoid queue jitter */
-	pcap_queue_push(ctx, h, pkt); /* Push the packet onto a deferred queue for late IO processing. */
+	if (ctx->tstampNano) {
+		/* Everything downstream works in microseconds, only pcapng recordings keep the nanoseconds. */
+		struct pcap_pkthdr hdr = *h;
+		uint32_t tsNsec = h->ts.tv_usec;
+		hdr.ts.tv_usec = tsNsec / 1000;
+
+		if (pcap_update_statistics(ctx, &hdr, pkt, tsNsec))
+			return;
+
+		pcap_queue_push(ctx, &hdr, pkt, tsNsec, 0);
+		return;
+	}
+
+	/* Update the stream stats realtime to avoid queue jitter */
+	if (pcap_update_statistics(ctx, h, pkt, h->ts.tv_usec * 1000))
+		return; /* FEC, the recovered media has already been queued, or a flow that wasn't admitted */
+
+	pcap_queue_push(ctx, h, pkt, h->ts.tv_usec * 1000, 0); /* Push the packet onto a deferred queue for late IO processing. */
 }
 
 static struct pcap_pkthdr file_pkthdr;
@@ -1142,6 +1236,7 @@ static void *pcap_thread_func(void *p)
 
 	int processed;
 	void *sm = NULL;
+	void *ra = NULL;
 	AVIOContext *puc = NULL;
 	uint8_t *buf = NULL;
 
@@ -1190,6 +1285,11 @@ static void *pcap_thread_func(void *p)
 			}
 		}
 
+		/* Ask for nanosecond timestamps, not every platform or libpcap build can. */
+		if (pcap_set_tstamp_precision(ctx->descr, PCAP_TSTAMP_PRECISION_NANO) == 0) {
+			ctx->tstampNano = 1;
+		}
+
 		int ret = pcap_activate(ctx->descr);
 		if (ret != 0) {
 			if (ret == PCAP_ERROR_PERM_DENIED) {
@@ -1224,6 +1324,11 @@ static void *pcap_thread_func(void *p)
 	} else
 	if (ctx->iftype == IF_TYPE_MPEGTS_FILE) {
 
+		if (ctx->fileReadaheadDepth) {
+			if (ltntstools_source_readahead_alloc(&ra, ctx, &sm_callbacks, ctx->ifname, ctx->fileLoops, ctx->fileReadaheadDepth) < 0) {
+				fprintf(stderr, "Unable to open %s for read ahead playout\n", ctx->ifname);
+			}
+		} else
 		if (ltntstools_source_rcts_alloc(&sm, ctx, &sm_callbacks, ctx->ifname, ctx->fileLoops) < 0) {
 
 		}
@@ -1256,6 +1361,9 @@ static void *pcap_thread_func(void *p)
 		} else
 		if (ctx->iftype == IF_TYPE_MPEGTS_FILE) {
 			usleep(50 * 1000);
+			if (ra) {
+				ltntstools_source_readahead_get_stats(ra, &ctx->fileReadaheadStats);
+			}
 		} else
 		if (ctx->iftype == IF_TYPE_MPEGTS_AVDEVICE) {
 			/* TODO: Migrate this to use the source-avio.[ch] framework */
@@ -1333,6 +1441,11 @@ static void *pcap_thread_func(void *p)
 	if (sm)
 		ltntstools_source_rcts_free(sm);
 
+	if (ra) {
+		ltntstools_source_readahead_get_stats(ra, &ctx->fileReadaheadStats);
+		ltntstools_source_readahead_free(ra);
+	}
+
 	if (puc)
 		avio_close(puc);
 
@@ -1378,11 +1491,54 @@ static void usage(const char *progname)
 	printf("  --danger-skip-freespace-check        Skip the Disk Free space check, don't stop recording when disk has < 10pct free.\n");
 	printf("  --measure-sei-latency-always         Look for the LTN SEI timing data, regardless of PMT version descriptoring.\n");
 	printf("  --measure-scheduling-quanta          Test the scheduling quanta for 1000us sleep granularity.\n");
-	printf("  --show-h264-metadata 0xnnnn          Analyze the given H264 PID (or detect it), show different codec stats (Experimental).\n");
+	printf("  --show-h264-metadata 0xnnnn          Count H264 slice types (Experimental). Each stream counts its own H264 pid\n");
+	printf("                                       from the PMT, 0xnnnn (0x2000 all video pids) applies until the PMT is known.\n");
 	printf("  --report-rtp-headers                 For RTP UDP/TS streams, dump each RTP header to console.\n");
 	printf("  --http-json-reporting http://url     Send 1sec json stats reports for all discovered streams [def: disabled] (Experimental).\n");
 	printf("    Eg. http://127.0.0.1:13400/whatever_resource_name_you_want\n");
 	printf("  --report-memory-usage                Report memory usage and growth every 5 seconds.\n");
+	printf("  --memory-budget-mb <number>          Cap the estimated analyzer memory. When full, new streams are downgraded\n");
+	printf("                                       to pid stats only or refused, and idle/hidden streams lose their optional\n");
+	printf("                                       analyzers. [def: 0 unlimited]\n");
+	printf("  --admission-control                  Only create streams for flows that sustain a minimum rate of TS/RTP/2110 packets.\n");
+	printf("  --admission-min-pps <number>         Minimum packets per second before a flow is admitted. [def: %d]\n", ADMISSION_DEFAULT_MIN_PPS);
+	printf("  --admission-max-new-per-sec <number> Maximum number of new streams admitted per second. [def: %d]\n", ADMISSION_DEFAULT_MAX_PROMOTIONS);
+	printf("  --forward-strip-nulls                Remove null packets (0x1fff) from forwarded streams, VBR output, PCR timing kept.\n");
+	printf("  --forward-strip-pid 0xnnnn           Additional stuffing pid to remove when forwarding, implies --forward-strip-nulls.\n");
+	printf("  --file-readahead <number>            File input, keep <number> large reads in flight ahead of the PCR paced playout,\n");
+	printf("                                       so disk stalls don't become output jitter. [def: 0 disabled, typical: %d]\n", SOURCE_READAHEAD_DEFAULT_DEPTH);
+	printf("  --video-frame-stats                  Decode free frame type, size, GOP, IDR interval and PTS/DTS cadence stats\n");
+	printf("                                       for every video pid of every stream.\n");
+	printf("  --deep-inspection-slots <number>     Only this many streams at a time run the expensive analyzers (PSI model,\n");
+	printf("                                       codec metadata, frame stats, SEI probe). Slots rotate across all streams,\n");
+	printf("                                       errored streams are boosted and the selected stream keeps its slot.\n");
+	printf("                                       Pid, CC, IAT, bitrate and TR101290 always run. [def: 0 disabled, all streams]\n");
+	printf("  --deep-inspection-dwell <seconds>    How long each stream holds a deep inspection slot. [def: %d]\n", DEEP_DEFAULT_DWELL_SECS);
+	printf("  --codec-sample-interval <seconds>    Re-sample the H.264/H.265 resolution, format and colorspace of every video pid\n");
+	printf("                                       in every stream this often, from its parameter sets. [def: %d, 0 disabled]\n", CODEC_DEFAULT_SAMPLE_SECS);
+	printf("  --loss-episode-log <filename>        Append every loss episode (burst length, duration, gap, cross stream group)\n");
+	printf("                                       to a CSV file. Histograms are in the JSON reports and the exit summary.\n");
+	printf("  --loss-correlation-ms <number>       Loss episodes on different streams that start within this window are\n");
+	printf("                                       grouped, pointing at the NIC, host or a shared upstream hop. [def: %d]\n", LOSS_DEFAULT_CORRELATION_MS);
+	printf("  --audio-sample-interval <seconds>    Sample every audio pid (MPEG, AAC, AC-3, E-AC-3) in every stream this often,\n");
+	printf("                                       decode it and measure silence, peak and momentary/short-term loudness.\n");
+	printf("                                       [def: %d, 0 disabled]\n", AUDIO_DEFAULT_SAMPLE_SECS);
+	printf("  --audio-sample-ms <number>           Length of each audio sample. [def: %d]\n", AUDIO_DEFAULT_SAMPLE_MS);
+	printf("  --audio-workers <number>             Audio decode threads, samples are skipped when they fall behind. [def: %d, max %d]\n",
+		AUDIO_DEFAULT_WORKERS, AUDIO_MAX_WORKERS);
+	printf("  --audio-silence-dbfs <number>        A sample peaking below this is silent. [def: %d]\n", AUDIO_DEFAULT_SILENCE_DBFS);
+	printf("  --audio-loud-lufs <number>           A sample with short-term loudness above this is too loud. [def: %d]\n", AUDIO_DEFAULT_LOUD_LUFS);
+	printf("  --caption-loss-secs <seconds>        Report CEA-608/708 captions (H.264/H.265 SEI), DVB subtitles or teletext as\n");
+	printf("                                       missing when a pid that carried them goes quiet this long. [def: %d, 0 disabled]\n",
+		CAPTION_DEFAULT_LOSS_SECS);
+	printf("  --record-pcapng                      Record pcap as pcapng, nanosecond timestamps where the capture supports them,\n");
+	printf("                                       capture drop statistics every 5 seconds and a per flow offset index\n");
+	printf("                                       at the end of single file recordings.\n");
+	printf("  --socket-stats-ms <number>           How often local UDP receive sockets are checked for drops, attributed to\n");
+	printf("                                       the streams they receive. Linux only. [def: %d, 0 disabled]\n", SOCKDIAG_DEFAULT_INTERVAL_MS);
+	printf("  --microburst-us <number>             Sliding window for peak bytes per stream and for the interface, from capture\n");
+	printf("                                       timestamps, reported against the mean. 100 to 1000. [def: %d, 0 disabled]\n",
+		MICROBURST_DEFAULT_WINDOW_US);
 }
 
 static int processArguments(struct tool_context_s *ctx, int argc, char *argv[])
@@ -1428,6 +1584,36 @@ static int processArguments(struct tool_context_s *ctx, int argc, char *argv[])
 		// 25 - 29
 		{ "measure-sei-latency-always", no_argument,		0, 0 },
 		{ "report-memory-usage", 		no_argument,		0, 0 },
+		{ "memory-budget-mb",			required_argument,	0, 0 },
+		{ "admission-control",			no_argument,		0, 0 },
+		{ "admission-min-pps",			required_argument,	0, 0 },
+
+		// 30 - 34
+		{ "admission-max-new-per-sec",	required_argument,	0, 0 },
+		{ "file-readahead",				required_argument,	0, 0 },
+		{ "forward-strip-nulls",		no_argument,		0, 0 },
+		{ "forward-strip-pid",			required_argument,	0, 0 },
+		{ "video-frame-stats",			no_argument,		0, 0 },
+
+		// 35 - 39
+		{ "deep-inspection-slots",		required_argument,	0, 0 },
+		{ "deep-inspection-dwell",		required_argument,	0, 0 },
+		{ "codec-sample-interval",		required_argument,	0, 0 },
+		{ "loss-episode-log",			required_argument,	0, 0 },
+		{ "loss-correlation-ms",		required_argument,	0, 0 },
+
+		// 40 - 44
+		{ "audio-sample-interval",		required_argument,	0, 0 },
+		{ "audio-sample-ms",			required_argument,	0, 0 },
+		{ "audio-workers",				required_argument,	0, 0 },
+		{ "audio-silence-dbfs",			required_argument,	0, 0 },
+		{ "audio-loud-lufs",			required_argument,	0, 0 },
+
+		// 45 - 49
+		{ "caption-loss-secs",			required_argument,	0, 0 },
+		{ "record-pcapng",				no_argument,		0, 0 },
+		{ "socket-stats-ms",			required_argument,	0, 0 },
+		{ "microburst-us",				required_argument,	0, 0 },
 
 		{ 0, 0, 0, 0 }
 	};	
@@ -1585,7 +1771,7 @@ static int processArguments(struct tool_context_s *ctx, int argc, char *argv[])
 				break;
 			case 22: /* show-h264-metadata */
 				ctx->gatherH264Metadata = 1;
-				if ((sscanf(optarg, "0x%x", &ctx->gatherH264MetadataPID) != 1) || (ctx->gatherH264MetadataPID > 0x1fff)) {
+				if ((sscanf(optarg, "0x%x", &ctx->gatherH264MetadataPID) != 1) || (ctx->gatherH264MetadataPID > 0x2000)) {
 					usage(argv[0]);
 					exit(1);
 				}
@@ -1603,6 +1789,135 @@ static int processArguments(struct tool_context_s *ctx, int argc, char *argv[])
 			case 26: /* report-memory-usage */
 				ctx->reportProcessMemoryUsage = 1;
 				break;
+			case 27: /* memory-budget-mb */
+				ctx->memGovernor.budgetBytes = (uint64_t)atoi(optarg) * 1048576;
+				break;
+			case 28: /* admission-control */
+				ctx->admission.enabled = 1;
+				break;
+			case 29: /* admission-min-pps */
+				ctx->admission.enabled = 1;
+				ctx->admission.minPPS = atoi(optarg);
+				break;
+			case 30: /* admission-max-new-per-sec */
+				ctx->admission.enabled = 1;
+				ctx->admission.maxPromotionsPerSecond = atoi(optarg);
+				break;
+			case 31: /* file-readahead */
+				ctx->fileReadaheadDepth = atoi(optarg);
+				if (ctx->fileReadaheadDepth < 0 || ctx->fileReadaheadDepth > SOURCE_READAHEAD_MAX_DEPTH) {
+					fprintf(stderr, "--file-readahead must be 0 - %d, aborting.\n", SOURCE_READAHEAD_MAX_DEPTH);
+					exit(1);
+				}
+				break;
+			case 32: /* forward-strip-nulls */
+				ctx->forwardStrip.enabled = 1;
+				break;
+			case 33: /* forward-strip-pid */
+				{
+					unsigned int pid;
+					if ((sscanf(optarg, "0x%x", &pid) != 1) || (pid > 0x1fff)) {
+						fprintf(stderr, "--forward-strip-pid syntax error, 0xnnnn, aborting.\n");
+						exit(1);
+					}
+					stuffing_strip_add_pid(&ctx->forwardStrip, pid);
+					ctx->forwardStrip.enabled = 1;
+				}
+				break;
+			case 34: /* video-frame-stats */
+				ctx->videoFrameStats = 1;
+				break;
+			case 35: /* deep-inspection-slots */
+				ctx->deepScheduler.slots = atoi(optarg);
+				if (ctx->deepScheduler.slots < 0) {
+					fprintf(stderr, "--deep-inspection-slots must be 0 or more, aborting.\n");
+					exit(1);
+				}
+				break;
+			case 36: /* deep-inspection-dwell */
+				ctx->deepScheduler.dwellSecs = atoi(optarg);
+				if (ctx->deepScheduler.dwellSecs < 1) {
+					fprintf(stderr, "--deep-inspection-dwell must be 1 or more seconds, aborting.\n");
+					exit(1);
+				}
+				break;
+			case 37: /* codec-sample-interval */
+				ctx->codecMetadata.sampleSecs = atoi(optarg);
+				if (ctx->codecMetadata.sampleSecs < 0) {
+					fprintf(stderr, "--codec-sample-interval must be 0 or more seconds, aborting.\n");
+					exit(1);
+				}
+				break;
+			case 38: /* loss-episode-log */
+				free(ctx->lossEpisodes.logFilename);
+				ctx->lossEpisodes.logFilename = strdup(optarg);
+				break;
+			case 39: /* loss-correlation-ms */
+				ctx->lossEpisodes.correlationMs = atoi(optarg);
+				if (ctx->lossEpisodes.correlationMs < 0) {
+					fprintf(stderr, "--loss-correlation-ms must be 0 or more, aborting.\n");
+					exit(1);
+				}
+				break;
+			case 40: /* audio-sample-interval */
+				ctx->audioMonitor.sampleSecs = atoi(optarg);
+				if (ctx->audioMonitor.sampleSecs < 0) {
+					fprintf(stderr, "--audio-sample-interval must be 0 or more seconds, aborting.\n");
+					exit(1);
+				}
+				break;
+			case 41: /* audio-sample-ms */
+				ctx->audioMonitor.sampleMs = atoi(optarg);
+				if (ctx->audioMonitor.sampleMs < 400 || ctx->audioMonitor.sampleMs > 10000) {
+					fprintf(stderr, "--audio-sample-ms must be 400 to 10000, aborting.\n");
+					exit(1);
+				}
+				break;
+			case 42: /* audio-workers */
+				ctx->audioMonitor.workers = atoi(optarg);
+				if (ctx->audioMonitor.workers < 1 || ctx->audioMonitor.workers > AUDIO_MAX_WORKERS) {
+					fprintf(stderr, "--audio-workers must be 1 to %d, aborting.\n", AUDIO_MAX_WORKERS);
+					exit(1);
+				}
+				break;
+			case 43: /* audio-silence-dbfs */
+				ctx->audioMonitor.silenceDbfs = atoi(optarg);
+				if (ctx->audioMonitor.silenceDbfs >= 0) {
+					fprintf(stderr, "--audio-silence-dbfs must be negative, aborting.\n");
+					exit(1);
+				}
+				break;
+			case 44: /* audio-loud-lufs */
+				ctx->audioMonitor.loudLufs = atoi(optarg);
+				if (ctx->audioMonitor.loudLufs >= 0) {
+					fprintf(stderr, "--audio-loud-lufs must be negative, aborting.\n");
+					exit(1);
+				}
+				break;
+			case 45: /* caption-loss-secs */
+				ctx->captionMonitor.lossSecs = atoi(optarg);
+				if (ctx->captionMonitor.lossSecs < 0) {
+					fprintf(stderr, "--caption-loss-secs must be 0 or more seconds, aborting.\n");
+					exit(1);
+				}
+				break;
+			case 46: /* record-pcapng */
+				ctx->recordPcapng = 1;
+				break;
+			case 47: /* socket-stats-ms */
+				ctx->sockDiag.intervalMs = atoi(optarg);
+				if (ctx->sockDiag.intervalMs < 0) {
+					fprintf(stderr, "--socket-stats-ms must be 0 or more milliseconds, aborting.\n");
+					exit(1);
+				}
+				break;
+			case 48: /* microburst-us */
+				ctx->microburst.windowUs = atoi(optarg);
+				if (ctx->microburst.windowUs != 0 && (ctx->microburst.windowUs < 100 || ctx->microburst.windowUs > 1000)) {
+					fprintf(stderr, "--microburst-us must be 0 or 100 to 1000, aborting.\n");
+					exit(1);
+				}
+				break;
 			default:
 				usage(argv[0]);
 				exit(1);
@@ -1659,12 +1974,32 @@ int nic_monitor(int argc, char *argv[])
 		ctx->url_forwards[i].port = 4001;
 		sprintf(&ctx->url_forwards[i].uilabel[0], "%s:%d", ctx->url_forwards[i].addr, ctx->url_forwards[i].port);
 	}
+	stuffing_strip_init(&ctx->forwardStrip);
+	ctx->deepScheduler.dwellSecs = DEEP_DEFAULT_DWELL_SECS;
+	ctx->codecMetadata.sampleSecs = CODEC_DEFAULT_SAMPLE_SECS;
+	pthread_mutex_init(&ctx->lossEpisodes.lock, NULL);
+	ctx->lossEpisodes.correlationMs = LOSS_DEFAULT_CORRELATION_MS;
+	ctx->audioMonitor.sampleSecs = AUDIO_DEFAULT_SAMPLE_SECS;
+	ctx->audioMonitor.sampleMs = AUDIO_DEFAULT_SAMPLE_MS;
+	ctx->audioMonitor.workers = AUDIO_DEFAULT_WORKERS;
+	ctx->audioMonitor.silenceDbfs = AUDIO_DEFAULT_SILENCE_DBFS;
+	ctx->audioMonitor.loudLufs = AUDIO_DEFAULT_LOUD_LUFS;
+	ctx->captionMonitor.lossSecs = CAPTION_DEFAULT_LOSS_SECS;
+	ctx->sockDiag.intervalMs = SOCKDIAG_DEFAULT_INTERVAL_MS;
+	ctx->microburst.windowUs = MICROBURST_DEFAULT_WINDOW_US;
 
 	if (processArguments(ctx, argc, argv) < 0) {
 		usage(argv[0]);
 		exit(1);
 	}
 
+	nic_monitor_memory_initialize(ctx);
+
+	if (ctx->admission.enabled && nic_monitor_admission_alloc(ctx) < 0) {
+		fprintf(stderr, "Unable to allocate flow admission table, aborting.\n");
+		exit(1);
+	}
+
 	if (ctx->verbose) {
 		printf("  iface: %s\n", ctx->ifname);
 	}
@@ -1703,6 +2038,28 @@ int nic_monitor(int argc, char *argv[])
 		printf("json write interval: %d\n", JSON_WRITE_INTERVAL);
 	}
 
+	/* Most capture loss turns out to be host configuration, say so up front. */
+	host_audit_refresh(ctx);
+	host_audit_dprintf(&ctx->hostAudit, STDOUT_FILENO);
+
+	/* Verbose diagnostics come from the pcap and stats threads, keep them off the console's critical path. */
+	async_log_start(stdout);
+
+	if (nic_monitor_audio_start(ctx) < 0) {
+		fprintf(stderr, "Unable to start the audio workers, aborting.\n");
+		exit(1);
+	}
+
+	if (nic_monitor_sockdiag_start(ctx) < 0) {
+		fprintf(stderr, "Unable to start the socket statistics collector, aborting.\n");
+		exit(1);
+	}
+
+	if (nic_monitor_microburst_start(ctx) < 0) {
+		fprintf(stderr, "Unable to allocate the interface microburst detector, aborting.\n");
+		exit(1);
+	}
+
 	gRunning = 1;
 	pthread_create(&ctx->stats_threadId, 0, stats_thread_func, ctx);
 	if (ctx->iftype == IF_TYPE_PCAP || ctx->iftype == IF_TYPE_MPEGTS_FILE || ctx->iftype == IF_TYPE_MPEGTS_AVDEVICE) {
@@ -1783,7 +2140,6 @@ int nic_monitor(int argc, char *argv[])
 			time(&ctx->lastResetTime);
 			discovered_items_stats_reset(ctx);
 			ltntstools_proc_net_udp_items_reset_drops(ctx->procNetUDPContext);
-			ctx->lastSocketReport = 0;
 		}
 		if (c == 'C') {
 			discovered_items_select_show_clocks_toggle(ctx);
@@ -1833,6 +2189,9 @@ int nic_monitor(int argc, char *argv[])
 		if (c == 'h') {
 			ctx->showUIOptions = ~ctx->showUIOptions;
 		}
+		if (c == 'A') {
+			host_audit_refresh(ctx);
+		}
 #if 0
 		if (c == '3') {
 			discovered_items_select_scte35_toggle(ctx);
@@ -1895,6 +2254,13 @@ int nic_monitor(int argc, char *argv[])
 		endwin();
 	}
 
+	/* Flush any pending diagnostics ahead of the final reports. */
+	async_log_stop();
+
+	/* Samples still queued are abandoned, anything being decoded completes. */
+	nic_monitor_audio_stop(ctx);
+	nic_monitor_sockdiag_stop(ctx);
+
 	/* Prepare stats window messages for later print. */
 	char ts_b[64];
 	sprintf(&ts_b[0], "%s", ctime(&ctx->lastResetTime));
@@ -1908,8 +2274,76 @@ int nic_monitor(int argc, char *argv[])
 	struct tm diff = { 0 };
 	gmtime_r(&d, &diff);
 
+	/* Close episodes still open so the summaries count them, and flush the CSV log */
+	nic_monitor_loss_service(ctx, 1);
+
 	discovered_items_console_summary(ctx);
 
+	if (ctx->memGovernor.budgetBytes) {
+		nic_monitor_memory_dprintf(ctx, STDOUT_FILENO);
+		printf("\n");
+	}
+
+	if (ctx->admission.enabled) {
+		char admission[160];
+		nic_monitor_admission_sprintf(ctx, &admission[0], sizeof(admission));
+		printf("%s\n\n", admission);
+	}
+
+	if (ctx->deepScheduler.slots) {
+		char deep[160];
+		nic_monitor_deep_sprintf(ctx, &deep[0], sizeof(deep));
+		printf("%s\n\n", deep);
+	}
+
+	if (ctx->codecMetadata.sampleSecs) {
+		char codec[160];
+		nic_monitor_codec_sprintf(ctx, &codec[0], sizeof(codec));
+		printf("%s\n\n", codec);
+	}
+
+	if (ctx->audioMonitor.sampleSecs) {
+		char audio[256];
+		nic_monitor_audio_sprintf(ctx, &audio[0], sizeof(audio));
+		printf("%s\n\n", audio);
+	}
+
+	if (ctx->captionMonitor.lossSecs) {
+		char caption[160];
+		nic_monitor_caption_sprintf(ctx, &caption[0], sizeof(caption));
+		printf("%s\n\n", caption);
+	}
+
+	if (ctx->sockDiag.intervalMs) {
+		char receivers[160];
+		nic_monitor_sockdiag_sprintf(ctx, &receivers[0], sizeof(receivers));
+		printf("%s\n\n", receivers);
+	}
+
+	if (ctx->microburst.windowUs) {
+		fflush(stdout);
+		nic_monitor_microburst_interface_dprintf(ctx, STDOUT_FILENO);
+	}
+
+	if (ctx->lossEpisodes.total) {
+		char loss[256];
+		nic_monitor_loss_sprintf(ctx, &loss[0], sizeof(loss));
+		printf("%s\n", loss);
+		fflush(stdout);
+		nic_monitor_loss_log_dprintf(ctx, STDOUT_FILENO, 20);
+		printf("\n");
+	}
+
+	fflush(stdout);
+	host_audit_dprintf(&ctx->hostAudit, STDOUT_FILENO);
+	printf("\n");
+
+	if (ctx->fileReadaheadDepth) {
+		char readahead[160];
+		file_readahead_sprintf(ctx, &readahead[0], sizeof(readahead));
+		printf("%s\n\n", readahead);
+	}
+
 	struct ltntstools_proc_net_udp_item_s *items;
 	int itemCount;
 	if (ltntstools_proc_net_udp_item_query(ctx->procNetUDPContext, &items, &itemCount) == 0) {
@@ -1943,6 +2377,8 @@ int nic_monitor(int argc, char *argv[])
 	discovered_items_free(ctx);
 
 	pcap_queue_free(ctx);
+	nic_monitor_admission_free(ctx);
+	nic_monitor_microburst_stop(ctx);
 
 	printf("\nStats window:\n");
 	printf("  from %s -> %s\n", ts_b, ts_e);
@@ -1950,6 +2386,7 @@ int nic_monitor(int argc, char *argv[])
 
 	free(ctx->file_prefix);
 	free(ctx->detailed_file_prefix);
+	free(ctx->lossEpisodes.logFilename);
 
 	ltntstools_reframer_free(ctx->reframer);
 
@@ -24,6 +24,12 @@
 #include "parsers.h"
 #include "utils.h"
 #include "hash_index.h"
+#include "async_log.h"
+#include "source-readahead.h"
+#include "video_frame_stats.h"
+#include "host_audit.h"
+#include "smpte2022_fec.h"
+#include "pcapng_writer.h"
 #include "ffmpeg-includes.h"
 
 #include <pcap.h>
@@ -62,6 +68,62 @@ enum payload_type_e {
 	PAYLOAD_MAX,
 };
 
+/* Memory governor, see nic_monitor_memory.c */
+enum nic_monitor_mem_subsystem_e {
+	MEM_SUBSYSTEM_PID_STATS = 0,
+	MEM_SUBSYSTEM_IAT_HISTOGRAM,
+	MEM_SUBSYSTEM_IAT_AVERAGES,
+	MEM_SUBSYSTEM_BITRATE_BUCKETS,
+	MEM_SUBSYSTEM_STREAMMODEL,
+	MEM_SUBSYSTEM_LTN_PROBE,
+	MEM_SUBSYSTEM_H264,
+	MEM_SUBSYSTEM_FRAME_STATS,
+	MEM_SUBSYSTEM_FEC,
+	MEM_SUBSYSTEM_AUDIO,
+	MEM_SUBSYSTEM_LOSS,
+	MEM_SUBSYSTEM_CAPTIONS,
+	MEM_SUBSYSTEM_MICROBURST,
+	MEM_SUBSYSTEM_MAX,
+};
+
+enum nic_monitor_mem_admit_e {
+	MEM_ADMIT_FULL = 0,  /* All analyzers */
+	MEM_ADMIT_REDUCED,   /* PID statistics only */
+	MEM_ADMIT_REFUSE,    /* Don't track the stream at all */
+};
+
+struct memory_governor_s
+{
+	pthread_mutex_t lock;
+	uint64_t budgetBytes; /* 0 = unlimited */
+	uint64_t usedBytes;
+	uint64_t subsystemBytes[MEM_SUBSYSTEM_MAX];
+
+	uint64_t streamsAdmitted;
+	uint64_t streamsDowngraded;
+	uint64_t streamsRefused;
+	uint64_t streamsShed;
+	time_t lastRefusalReport;
+};
+
+/* Loss episodes, see nic_monitor_loss.c */
+#define LOSS_HIST_BUCKETS 24       /* Power of two buckets */
+#define LOSS_LOG_DEPTH 1024        /* Most recent episodes, all streams */
+#define LOSS_DEFAULT_CORRELATION_MS 10
+
+struct loss_episode_s
+{
+	struct timeval start;      /* Arrival of the last datagram before the loss */
+	uint32_t durationUs;       /* Until the first datagram after the loss */
+	uint64_t lost;             /* RTP datagrams, or TS packets for UDP-TS */
+	uint64_t gap;              /* Clean datagrams since the previous episode on this stream */
+	uint32_t streamId;
+	char stream[56];           /* src -> dst */
+	int isRTP;
+	uint32_t group;            /* 0 = only this stream, else shared with other streams */
+	uint64_t captureDrops;     /* pcap drops reported since the previous episode, host side loss */
+};
+
 struct tool_context_s
 {
 	char *ifname;
@@ -72,6 +134,8 @@ struct tool_context_s
 	} iftype;
 	int fileLoops; /* Boolean. A file input, should it loop and repeat at end of file? */
 	double fileLoopPct; /* How much (pct) has the file loop played out? */
+	int fileReadaheadDepth; /* File input, 0 plays out via rcts, else via the read ahead source with this many buffers. */
+	struct ltntstools_source_readahead_stats_s fileReadaheadStats; /* Snapshot, refreshed by the pcap thread */
 	char *recordingDir;
 	int verbose;
 	int monitor;
@@ -81,9 +145,12 @@ struct tool_context_s
 	int automaticallyJSONProbeStreams;
 	int recordWithSegments;
 	int recordAsTS;
+	int recordPcapng;          /* --record-pcapng, pcap recordings as pcapng with drop stats and a flow index */
+	int tstampNano;            /* The capture delivers nanosecond timestamps */
 	int showUIOptions;
 	int skipFreeSpaceCheck;
 	int gatherH264Metadata;
+	int videoFrameStats; /* Boolean. Frame type, size, GOP and cadence stats for every video pid in every stream. */
 	int gatherH264MetadataPID;
 	int reportRTPHeaders;
 	int measureSEILatencyAlways;
@@ -170,7 +237,6 @@ struct tool_context_s
 	/* UDP Socket stats */
 	void *procNetUDPContext;
 	int showForwardOptions;
-	time_t lastSocketReport;
 
 	/* URL Forwarding options */
 #define MAX_URL_FORWARDERS 3
@@ -179,6 +245,7 @@ struct tool_context_s
 		int port;
 		char uilabel[64];
 	} url_forwards[MAX_URL_FORWARDERS];
+	struct stuffing_strip_s forwardStrip; /* VBR forwarding, null / stuffing pids removed */
 
 	/* SRT Ingest, and packet reframing */
 	struct ltntstools_reframer_ctx_s *reframer;
@@ -187,6 +254,146 @@ struct tool_context_s
 	struct statm_context_s memUsage;
 	char memUsageStatus[80];
 
+	/* Estimated analyzer memory against a user defined budget */
+	struct memory_governor_s memGovernor;
+
+	/* Host configuration audit, taken at startup and on demand. Replaced under ctx->lock. */
+	struct host_audit_s hostAudit;
+
+	/* Flow admission control, new flows must prove themselves before we allocate a stream */
+#define ADMISSION_DEFAULT_MIN_PACKETS 16
+#define ADMISSION_DEFAULT_MIN_PPS 50
+#define ADMISSION_DEFAULT_MAX_PROMOTIONS 8
+	struct {
+		int enabled;
+		void *hdl;
+		int minPackets;
+		int minPPS;
+		int maxPromotionsPerSecond;
+
+		uint64_t candidatesSeen;
+		uint64_t promoted;
+		uint64_t rejectedUnclassified; /* Flows, each counted once */
+		uint64_t rejectedLowRate;      /* Flows, each counted once */
+		uint64_t deferredRateLimit;    /* Flows, each counted once */
+		uint64_t tableEvictions;
+	} admission;
+
+	/* Deep inspection scheduler, expensive analyzers rotate across streams in a fixed number of slots */
+#define DEEP_DEFAULT_DWELL_SECS 5
+	struct {
+		int slots;     /* 0 = disabled, all streams are always deep inspected */
+		int dwellSecs; /* How long each stream holds a slot */
+		time_t lastService;
+		int activeCount;
+		int streamCount;
+
+		uint64_t grants;
+		uint64_t errorGrants;
+		uint64_t focusGrants;
+		time_t longestWait; /* Longest gap between two slots, for any stream */
+	} deepScheduler;
+
+	/* Codec metadata, every H.264/H.265 video pid, re-sampled from its parameter sets */
+#define CODEC_DEFAULT_SAMPLE_SECS 10
+	struct {
+		int sampleSecs; /* 0 = disabled */
+		time_t lastService;
+		uint64_t samples;
+		uint64_t packetsParsed;
+	} codecMetadata;
+
+	/* Loss episodes, correlated across every stream on the interface */
+	struct {
+		pthread_mutex_t lock;
+		int correlationMs;
+		char *logFilename; /* CSV, appended from the stats thread */
+		time_t lastService;
+		uint32_t nextStreamId;
+		uint32_t nextGroup;
+		uint64_t psDropSeen;
+
+		uint64_t total;   /* Episodes logged, log[total % LOSS_LOG_DEPTH] is next */
+		uint64_t flushed; /* Episodes written to logFilename */
+		uint64_t groups;  /* Episodes shared by more than one stream */
+		uint64_t correlated;
+		uint64_t withCaptureDrops;
+		struct loss_episode_s log[LOSS_LOG_DEPTH];
+	} lossEpisodes;
+
+	/* Audio silence and loudness, sampled from every audio pid and decoded on a worker pool */
+#define AUDIO_DEFAULT_SAMPLE_SECS 30
+#define AUDIO_DEFAULT_SAMPLE_MS 3000
+#define AUDIO_DEFAULT_WORKERS 2
+#define AUDIO_MAX_WORKERS 8
+#define AUDIO_DEFAULT_SILENCE_DBFS -60
+#define AUDIO_DEFAULT_LOUD_LUFS -10
+	struct {
+		int sampleSecs; /* 0 = disabled */
+		int sampleMs;
+		int workers;
+		int silenceDbfs;
+		int loudLufs;
+		time_t lastService;
+
+		pthread_mutex_t lock;
+		pthread_cond_t cond;
+		struct xorg_list jobs;
+		int jobCount;
+		int terminate;
+		int threadCount;
+		pthread_t threads[AUDIO_MAX_WORKERS];
+
+		uint64_t jobsQueued;
+		uint64_t jobsDropped;
+		uint64_t jobsDecoded;
+		uint64_t decodeErrors;
+		uint64_t framesDecoded;
+		uint64_t silentIncidents;
+		uint64_t loudIncidents;
+	} audioMonitor;
+
+	/* Caption presence, decode free, every stream */
+#define CAPTION_DEFAULT_LOSS_SECS 5
+	struct {
+		int lossSecs; /* 0 = disabled */
+		time_t lastService;
+		uint64_t losses;
+	} captionMonitor;
+
+	/* Local receivers and their UDP socket drops, netlink sock_diag on its own thread */
+#define SOCKDIAG_DEFAULT_INTERVAL_MS 1000
+#define SOCKDIAG_RESOLVE_SECS 5    /* Minimum gap between /proc scans for new socket owners */
+#define SOCKDIAG_LOG_SECS 10       /* Drops are summarised in the stream log at most this often */
+	struct {
+		int intervalMs; /* 0 = disabled */
+		pthread_t threadId;
+		int threadRunning;
+		int threadTerminate;
+
+		pthread_mutex_t lock;      /* Protects the snapshot */
+		struct sockdiag_socket_s *sockets; /* Unconnected UDP sockets, sorted by inode */
+		int socketCount;
+		uint32_t generation;       /* Bumped with each snapshot */
+		uint32_t serviced;         /* Last generation attributed to streams, stats thread only */
+		time_t lastResolve;
+
+		uint64_t queries;
+		uint64_t queryErrors;
+		uint64_t resolveScans;
+		uint64_t drops;            /* Attributed to a stream, since startup or reset */
+		uint64_t ambiguousDrops;   /* Wildcard sockets receiving several streams, can't be attributed */
+		struct sockdiag_socket_s *previous; /* Last snapshot serviced, sorted by inode, stats thread only */
+		int previousCount;
+	} sockDiag;
+
+	/* Microbursts, peak bytes in a sliding window of capture time, see nic_monitor_microburst.c */
+#define MICROBURST_DEFAULT_WINDOW_US 1000
+	struct {
+		int windowUs; /* 0 = disabled */
+		struct microburst_engine_s *aggregate; /* Every UDP frame on the interface, fed on the pcap thread */
+	} microburst;
+
 };
 
 struct json_item_s
@@ -225,11 +432,18 @@ struct pcap_item_s
 	struct xorg_list list;
 	struct pcap_pkthdr *h;
 	u_char *pkt;
+	uint32_t tsNsec;           /* Nanoseconds part of h->ts, which is always in microseconds */
+	uint32_t flags;            /* PCAP_ITEM_* */
 };
 
-void pcap_update_statistics(struct tool_context_s *ctx, const struct pcap_pkthdr *h, const u_char *pkt);
+/* Rebuilt by the FEC engine, never seen on the wire. h->ts is the capture time of the packet
+ * that completed the recovery.
+ */
+#define PCAP_ITEM_FEC_RECOVERED (1 << 0)
+
+int  pcap_update_statistics(struct tool_context_s *ctx, const struct pcap_pkthdr *h, const u_char *pkt, uint32_t tsNsec);
 int pcap_queue_initialize(struct tool_context_s *ctx);
-int pcap_queue_push(struct tool_context_s *ctx, const struct pcap_pkthdr *h, const u_char *pkt);
+int pcap_queue_push(struct tool_context_s *ctx, const struct pcap_pkthdr *h, const u_char *pkt, uint32_t tsNsec, uint32_t flags);
 int pcap_queue_service(struct tool_context_s *ctx);
 int pcap_queue_rebalance(struct tool_context_s *ctx);
 void pcap_queue_free(struct tool_context_s *ctx);
@@ -253,6 +467,238 @@ void display_doc_render(struct display_doc_s *doc, int row, int col);
 void display_doc_page_up(struct display_doc_s *doc);
 void display_doc_page_down(struct display_doc_s *doc);
 
+/* Ethernet, IPv4 and UDP headers, as captured ahead of each payload. */
+#define FEC_FRAME_HEADER_SIZE (sizeof(struct ether_header) + sizeof(struct iphdr) + sizeof(struct udphdr))
+
+/* Codec metadata for a single H.264 or H.265 video pid. The parser only exists
+ * while a sample is being taken, between samples only the results are kept.
+ */
+#define CODEC_MAX_PIDS 4
+enum codec_metadata_state_e {
+	CODEC_STATE_IDLE = 0,  /* Waiting for the next sample */
+	CODEC_STATE_ARMED,     /* Waiting for a PUSI packet carrying an SPS (and VPS for H.265) */
+	CODEC_STATE_CAPTURING, /* Feeding the rest of that PES, until the next PUSI */
+};
+
+struct codec_metadata_s
+{
+	uint16_t pid;
+	uint8_t streamType; /* 0x1b H.264, 0x24 H.265 */
+	enum codec_metadata_state_e state;
+	void *parser;
+	time_t nextSample;
+	time_t lastSample; /* 0 until the first complete sample */
+	uint64_t samples;
+	uint64_t packetsParsed;
+	char colorspace[64];
+	char format[64];
+};
+
+/* When a stream's PSI model is next asked for candidate pids, see nic_monitor_model.c */
+#define MODEL_BACKOFF_MAX_SECS 30
+struct model_check_s
+{
+	time_t next;
+	int backoffSecs;           /* While the stream has no candidates */
+};
+
+struct model_pid_s
+{
+	uint16_t pid;
+	uint8_t streamType;
+};
+
+/* Per stream loss episode reconstruction. Detection state belongs to the pcap
+ * thread, an open episode and the results are shared with the stats thread, under lock.
+ */
+struct loss_engine_s
+{
+	pthread_mutex_t lock;
+
+	uint32_t streamId;
+	int seqValid;
+	uint16_t lastSeq;
+	int ccValid;
+	uint8_t lastCC[8192];      /* UDP-TS, 0xff = pid not seen yet */
+
+	int open;                  /* An episode is in progress, set and cleared under lock */
+	int quiet;                 /* Clean datagrams since the last loss */
+	uint64_t episodeLost;
+	uint64_t episodeGap;
+	struct timeval lastArrival;       /* Of the last datagram, the start of any loss that follows */
+	struct timeval episodeStart, episodeEnd;
+	struct timeval lastEpisodeStart;
+	uint64_t clean;            /* Clean datagrams since the last episode */
+
+	/* Results */
+	uint64_t episodes;
+	uint64_t lost;
+	uint64_t maxBurst;
+	uint64_t correlated;       /* Episodes that started alongside another streams episode */
+	uint64_t resyncs;          /* RTP sequence jumps too large to be loss */
+	uint64_t burstHist[LOSS_HIST_BUCKETS];      /* Lost per episode */
+	uint64_t durationHist[LOSS_HIST_BUCKETS];   /* us */
+	uint64_t gapHist[LOSS_HIST_BUCKETS];        /* Clean datagrams between episodes */
+	uint64_t recurrenceHist[LOSS_HIST_BUCKETS]; /* ms between episode starts */
+};
+
+/* Peak bytes per window against the mean, per stream and for the interface, see nic_monitor_microburst.c.
+ * Detection state belongs to the one thread that writes the engine, the results are published once a second, under lock.
+ */
+#define MICROBURST_HIST_BUCKETS 10     /* Aligned windows by their bytes against the mean */
+#define MICROBURST_RING_STREAM 1024    /* Most frames a single window can hold */
+#define MICROBURST_RING_INTERFACE 16384
+struct microburst_frame_s
+{
+	uint64_t tsNs;
+	uint32_t bytes;
+};
+
+struct microburst_engine_s
+{
+	pthread_mutex_t lock;
+
+	uint64_t windowNs;
+	uint64_t lastNs;
+	struct microburst_frame_s *ring;
+	uint32_t ringSize;
+	uint32_t ringHead;
+	uint32_t ringCount;
+	uint64_t ringBytes;        /* The sliding window, ending at the latest frame */
+
+	uint64_t slot;             /* Aligned window being filled, tsNs / windowNs */
+	uint64_t slotBytes;
+	uint64_t second;
+	uint64_t secondBytes;
+	uint64_t secondPeak;       /* Largest sliding window this second */
+	uint64_t secondHist[MICROBURST_HIST_BUCKETS];
+	double windowMean;         /* Bytes per window during the previous second, 0 = unknown */
+	int primed;                /* The first, partial, second has gone by */
+
+	/* Results */
+	uint64_t seconds;
+	uint64_t lastPeakBytes;
+	double lastMeanBytes;
+	uint64_t maxPeakBytes;
+	double maxRatio;           /* Peak window against the mean, in the same second */
+	time_t maxRatioTime;
+	uint64_t maxExcessBytes;   /* Peak window less the mean, what a buffer drained at the mean rate must absorb */
+	uint64_t overflows;        /* Frames pushed out of a full ring, the peak may be under reported */
+	uint64_t hist[MICROBURST_HIST_BUCKETS];
+};
+
+/* A local socket receiving a stream, see nic_monitor_sockdiag.c */
+#define SOCKDIAG_MAX_RECEIVERS 4
+struct sockdiag_receiver_s
+{
+	uint64_t inode;
+	int pid;                   /* 0 when the owner couldn't be found */
+	char comm[16];
+	uint32_t rmemAlloc;        /* Bytes queued in the socket buffer */
+	uint32_t rcvBuf;           /* Socket buffer size */
+	uint32_t drops;            /* Kernel counter, since the socket was created */
+	uint32_t dropsDelta;       /* During the last snapshot interval */
+	int sharedBy;              /* Streams this socket could be receiving, a wildcard socket shared
+	                            * by more than one has its drops counted once, as ambiguous */
+};
+
+/* Audio silence and loudness for a single audio pid, see nic_monitor_audio.c.
+ * The stats thread captures, the audio worker pool decodes and measures.
+ */
+#define AUDIO_MAX_PIDS 8
+#define AUDIO_PENDING_LOG 16
+enum audio_monitor_state_e {
+	AUDIO_STATE_IDLE = 0,  /* Waiting for the next sample */
+	AUDIO_STATE_ARMED,     /* Waiting for a PUSI to start capturing on */
+	AUDIO_STATE_CAPTURING, /* Collecting elementary stream for sampleMs */
+	AUDIO_STATE_DECODING,  /* Queued for, or being decoded by, a worker */
+};
+
+struct audio_monitor_pid_s
+{
+	uint16_t pid;
+	uint8_t streamType;
+	enum audio_monitor_state_e state;
+	time_t nextSample;
+	int64_t captureStartMs;
+	uint8_t *es;
+	int esSize;                /* Allocated, sized from the pid's bitrate and charged to the governor */
+	int esLength;
+
+	/* Results of the last sample */
+	time_t lastSample; /* 0 until the first decoded sample */
+	char codecName[16];
+	int channels;
+	int sampleRate;
+	double peakDbfs;
+	double momentaryMaxLufs;
+	double shortTermMaxLufs;
+	int silent;
+	int loud;
+
+	uint64_t samples;
+	uint64_t silentSamples;
+	uint64_t loudSamples;
+	uint64_t skipped;      /* Worker pool was busy */
+	uint64_t decodeErrors;
+};
+
+/* Caption and subtitle presence for a single pid, see nic_monitor_caption.c. */
+#define CAPTION_MAX_PIDS 8
+#define CAPTION_SCAN_BYTES (4 * 184)
+#define CAPTION_MODEL_CHECK_SECS 10
+enum caption_kind_e {
+	CAPTION_KIND_NONE = 0,     /* Video pids, or private PES not recognised (yet) */
+	CAPTION_KIND_TELETEXT,
+	CAPTION_KIND_DVB_SUBTITLE,
+};
+
+struct caption_pid_s
+{
+	uint16_t pid;
+	uint8_t streamType; /* 0x1b H.264, 0x24 H.265, 0x06 private PES */
+	enum caption_kind_e kind;
+
+	/* Head of the current access unit, video pids only */
+	int scanPackets;
+	int scanLength;
+	uint8_t scan[CAPTION_SCAN_BYTES];
+	int dtvccLength;
+	uint8_t dtvccPacket[128];
+
+	/* DVB subtitle segments, which run across packets */
+	int segSkip;              /* Past the segments, until the next PUSI */
+	int segHeaderLength;
+	uint8_t segHeader[6];
+	int segRemaining;
+	int segContent;           /* The current segment is object data */
+
+	/* Results */
+	uint64_t ccBytes;         /* Caption content: non-null 608 pairs, 708 service blocks, teletext rows, subtitle objects */
+	uint32_t cea608Channels;  /* Bit 0-3, CC1-CC4 */
+	uint64_t cea708Services;  /* Bit n, service n */
+	uint64_t byteRate;
+	uint64_t lastRateBytes;
+	time_t lastRateTime;
+	time_t lastSeen;          /* 0 until the pid carries anything */
+	int present;
+	uint64_t losses;
+};
+
+/* Reference counted, decode jobs keep this alive after the stream is freed. */
+struct audio_monitor_s
+{
+	pthread_mutex_t lock;
+	int refCount;
+	struct model_check_s modelCheck;
+	int pidCount;
+	struct audio_monitor_pid_s pids[AUDIO_MAX_PIDS];
+
+	/* Incidents from the workers, moved into the stream log by the stats thread */
+	int pendingLogCount;
+	char pendingLog[AUDIO_PENDING_LOG][128];
+};
+
 struct discovered_item_s
 {
 	struct xorg_list list;
@@ -348,6 +794,8 @@ struct discovered_item_s
 	/* PCAP recording */
 	void *pcapRecorder;
 	time_t lastTimeFSFreeSpaceCheck;
+	void *pcapng;              /* pcapng_writer, when recording as pcapng */
+	time_t pcapngLastStats;
 
 	/* Monitor the UDP packet lengths, increment
 	 * this each time the length is not 188 * 7
@@ -379,21 +827,38 @@ struct discovered_item_s
 	int forwardSlotNr; /* 7/8/9 else stream is not forwarding. */
 	AVIOContext *forwardAVIO;
 	char forwardURL[64];
+	struct stuffing_strip_stats_s forwardStripStats;
 
 	/* H264 specific statistics */
 	pthread_mutex_t h264_sliceLock;
 	void *h264_slices; /* We count each different kind of slice that we see */
 
-	pthread_mutex_t h264_metadataLock;
-	void *h264_metadata_parser;
-	char h264_video_colorspace[64];
-	char h264_video_format[64];
-
-	/* H265/HEVC specific statistics */
-	pthread_mutex_t h265_metadataLock;
-	void *h265_metadata_parser;
-	char h265_video_colorspace[64];
-	char h265_video_format[64];
+	/* Decode free frame and GOP statistics, all video pids */
+	pthread_mutex_t frameStatsLock;
+	void *frameStats;
+
+	/* H.264 / H.265 codec metadata, sampled from the video pids in the stream model */
+	pthread_mutex_t codecLock;
+	struct model_check_s codecModelCheck;
+	int codecCount;
+	struct codec_metadata_s codec[CODEC_MAX_PIDS];
+
+	/* Audio silence and loudness, NULL when disabled */
+	struct audio_monitor_s *audio;
+
+	/* CEA-608/708, DVB subtitle and teletext presence, candidate pids from the stream model */
+	pthread_mutex_t captionLock;
+	struct model_check_s captionModelCheck;
+	int captionCount;
+	struct caption_pid_s caption[CAPTION_MAX_PIDS];
+
+	/* Local sockets receiving this stream, from the sock_diag snapshot */
+	pthread_mutex_t receiverLock;
+	int receiverCount;
+	struct sockdiag_receiver_s receivers[SOCKDIAG_MAX_RECEIVERS];
+	uint64_t receiverDrops;    /* All receivers, since startup or reset */
+	uint64_t receiverDropsUnlogged;
+	time_t receiverDropsLastLog;
 
 	/* TR101290 */
 	void *trHandle;
@@ -424,21 +889,60 @@ struct discovered_item_s
 	int hasHiddenDuplicates;
 	char warningIndicatorLabel[8]; /* ARray of single characters, shows warning flags to operator. */
 
+	/* Memory governor accounting. Optional analyzers are NULL when memReduced is set. */
+	uint64_t memBytes[MEM_SUBSYSTEM_MAX];
+	int memReduced;     /* Stream is running with pid statistics only. */
+	int memShedPending; /* Governor has asked the pcap thread to drop optional analyzers. */
+
+	/* Deep inspection scheduler. The expensive analyzers are only fed while deepActive is set. */
+	int deepActive;
+	time_t deepGrantedTime;
+	time_t deepLastTime;   /* When the stream last gave up a slot, 0 = never inspected */
+	uint64_t deepCCErrors; /* CC errors when the slot was given up, a change earns a boost */
+	uint64_t deepGrants;
+
+	/* Loss episodes, burst length, gap and recurrence */
+	struct loss_engine_s loss;
+
+	/* Microbursts, NULL when disabled */
+	struct microburst_engine_s *microburst;
+
+	/* SMPTE 2022-1 FEC, allocated when a column or row FEC flow for this stream shows up.
+	 * Media then goes through the engine and the recovered, in order, packets are what
+	 * the statistics, forwarding and recording see. Written on the pcap thread only.
+	 */
+	pthread_mutex_t fecLock;
+	void *fec;
+	uint8_t fecFrameHeader[FEC_FRAME_HEADER_SIZE]; /* eth/ip/udp headers of the last media packet */
+	int fecRefused;                               /* The memory budget couldn't afford the engine */
+
+	/* A FEC flow discovered as a stream of its own, before its media flow showed up.
+	 * Out of the lookup once the media flow appears, housekeeping frees it.
+	 */
+	int fecRetired;
+
 };
 
 const char *payloadTypeDesc(enum payload_type_e pt);
 
 void discovered_item_free(struct discovered_item_s *di);
 void discovered_items_free(struct tool_context_s *ctx);
-struct discovered_item_s *discovered_item_alloc(struct tool_context_s *ctx, struct ether_header *ethhdr, struct iphdr *iphdr, struct udphdr *udphdr, uint16_t hashKey);
+struct discovered_item_s *discovered_item_alloc(struct tool_context_s *ctx, struct ether_header *ethhdr, struct iphdr *iphdr, struct udphdr *udphdr, uint16_t hashKey, int reduced);
 
 struct discovered_item_s *discovered_item_findcreate(struct tool_context_s *ctx,
 	struct ether_header *ethhdr, struct iphdr *iphdr, struct udphdr *udphdr);
 
+/* Lookup only, never allocates. */
+struct discovered_item_s *discovered_item_find(struct tool_context_s *ctx, struct iphdr *iphdr, struct udphdr *udphdr);
+struct discovered_item_s *discovered_item_find_fec_media(struct tool_context_s *ctx, struct iphdr *iphdr, struct udphdr *udphdr,
+	struct discovered_item_s **self);
+void discovered_item_fec_retire(struct tool_context_s *ctx, struct discovered_item_s *di);
+
 void discovered_item_json_summary(struct tool_context_s *ctx, struct discovered_item_s *di);
 void discovered_item_fd_summary(struct tool_context_s *ctx, struct discovered_item_s *di, int fd);
 
 void discovered_items_console_summary(struct tool_context_s *ctx);
+void discovered_item_fd_per_video_frame_report(struct tool_context_s *ctx, struct discovered_item_s *di, int fd);
 void discovered_items_housekeeping(struct tool_context_s *ctx);
 
 /* For a given item, open a detailed stats file on disk, append the current stats, close it. */
@@ -498,6 +1002,99 @@ void    nic_monitor_tr101290_reset(struct discovered_item_s *di);
 /* Exclusively called from the ncurses domain */
 void    nic_monitor_tr101290_draw_ui(struct discovered_item_s *di, int *streamCount, int p1col, int p2col);
 
+/* Memory governor */
+void     nic_monitor_memory_initialize(struct tool_context_s *ctx);
+uint64_t nic_monitor_memory_cost(enum nic_monitor_mem_subsystem_e s);
+const char *nic_monitor_memory_subsystem_name(enum nic_monitor_mem_subsystem_e s);
+void     nic_monitor_memory_charge(struct discovered_item_s *di, enum nic_monitor_mem_subsystem_e s);
+void     nic_monitor_memory_release(struct discovered_item_s *di, enum nic_monitor_mem_subsystem_e s);
+void     nic_monitor_memory_release_all(struct discovered_item_s *di);
+int      nic_monitor_memory_charge_bytes(struct tool_context_s *ctx, struct discovered_item_s *di, enum nic_monitor_mem_subsystem_e s, uint64_t bytes);
+void     nic_monitor_memory_disown_bytes(struct discovered_item_s *di, enum nic_monitor_mem_subsystem_e s, uint64_t bytes);
+void     nic_monitor_memory_release_bytes(struct tool_context_s *ctx, struct discovered_item_s *di, enum nic_monitor_mem_subsystem_e s, uint64_t bytes);
+enum nic_monitor_mem_admit_e nic_monitor_memory_admit(struct tool_context_s *ctx);
+void     nic_monitor_memory_shed(struct tool_context_s *ctx, struct discovered_item_s *di);
+int      nic_monitor_memory_sprintf(struct tool_context_s *ctx, char *dst, int lengthBytes);
+void     nic_monitor_memory_dprintf(struct tool_context_s *ctx, int fd);
+
+/* Flow admission control */
+int  nic_monitor_admission_alloc(struct tool_context_s *ctx);
+void nic_monitor_admission_free(struct tool_context_s *ctx);
+int  nic_monitor_admission_check(struct tool_context_s *ctx, const struct timeval *ts,
+	struct iphdr *iphdr, struct udphdr *udphdr, const uint8_t *payload, int lengthBytes);
+int  nic_monitor_admission_sprintf(struct tool_context_s *ctx, char *dst, int lengthBytes);
+
+/* Deep inspection scheduler */
+void nic_monitor_deep_service(struct tool_context_s *ctx);
+int  nic_monitor_deep_sprintf(struct tool_context_s *ctx, char *dst, int lengthBytes);
+
+/* Sampled codec metadata */
+void nic_monitor_codec_service(struct tool_context_s *ctx);
+void nic_monitor_codec_write(struct discovered_item_s *di, const uint8_t *pkts, uint32_t pktCount);
+int  nic_monitor_codec_query(struct discovered_item_s *di, uint16_t pid, struct codec_metadata_s *result);
+void nic_monitor_codec_free(struct discovered_item_s *di);
+void nic_monitor_codec_dprintf(struct discovered_item_s *di, int fd);
+int  nic_monitor_codec_sprintf(struct tool_context_s *ctx, char *dst, int lengthBytes);
+
+/* Loss episodes */
+void nic_monitor_loss_init(struct discovered_item_s *di);
+void nic_monitor_loss_write(struct tool_context_s *ctx, struct discovered_item_s *di,
+	const uint8_t *pkts, uint32_t pktCount, const struct timeval *ts);
+void nic_monitor_loss_close(struct tool_context_s *ctx, struct discovered_item_s *di);
+void nic_monitor_loss_reset(struct discovered_item_s *di);
+void nic_monitor_loss_service(struct tool_context_s *ctx, int flushAll);
+void nic_monitor_loss_dprintf(struct discovered_item_s *di, int fd);
+void nic_monitor_loss_json(struct discovered_item_s *di, json_object *feed);
+int  nic_monitor_loss_sprintf(struct tool_context_s *ctx, char *dst, int lengthBytes);
+void nic_monitor_loss_log_dprintf(struct tool_context_s *ctx, int fd, int maxEpisodes);
+
+/* Audio silence and loudness */
+int  nic_monitor_audio_start(struct tool_context_s *ctx);
+void nic_monitor_audio_stop(struct tool_context_s *ctx);
+int  nic_monitor_audio_alloc(struct discovered_item_s *di);
+void nic_monitor_audio_free(struct discovered_item_s *di);
+void nic_monitor_audio_release_buffers(struct discovered_item_s *di);
+void nic_monitor_audio_service(struct tool_context_s *ctx);
+void nic_monitor_audio_write(struct discovered_item_s *di, const uint8_t *pkts, uint32_t pktCount);
+void nic_monitor_audio_dprintf(struct discovered_item_s *di, int fd);
+void nic_monitor_audio_json(struct discovered_item_s *di, json_object *feed);
+int  nic_monitor_audio_sprintf(struct tool_context_s *ctx, char *dst, int lengthBytes);
+
+/* Caption presence */
+void nic_monitor_caption_service(struct tool_context_s *ctx);
+void nic_monitor_caption_write(struct discovered_item_s *di, const uint8_t *pkts, uint32_t pktCount);
+void nic_monitor_caption_reset(struct discovered_item_s *di);
+void nic_monitor_caption_dprintf(struct discovered_item_s *di, int fd);
+void nic_monitor_caption_json(struct discovered_item_s *di, json_object *feed);
+int  nic_monitor_caption_sprintf(struct tool_context_s *ctx, char *dst, int lengthBytes);
+
+/* Receiver socket drops */
+int  nic_monitor_sockdiag_start(struct tool_context_s *ctx);
+void nic_monitor_sockdiag_stop(struct tool_context_s *ctx);
+void nic_monitor_sockdiag_service(struct tool_context_s *ctx);
+void nic_monitor_sockdiag_reset(struct discovered_item_s *di);
+void nic_monitor_sockdiag_dprintf(struct discovered_item_s *di, int fd);
+void nic_monitor_sockdiag_json(struct discovered_item_s *di, json_object *feed);
+int  nic_monitor_sockdiag_sprintf(struct tool_context_s *ctx, char *dst, int lengthBytes);
+
+/* Stream model pids */
+int  nic_monitor_model_pids(struct discovered_item_s *di, struct model_check_s *check, time_t now, int intervalSecs,
+	int (*match)(uint8_t streamType), struct model_pid_s *pids, int maxPids);
+
+/* Microbursts */
+int  nic_monitor_microburst_start(struct tool_context_s *ctx);
+void nic_monitor_microburst_stop(struct tool_context_s *ctx);
+int  nic_monitor_microburst_alloc(struct discovered_item_s *di);
+void nic_monitor_microburst_free(struct discovered_item_s *di);
+void nic_monitor_microburst_write(struct microburst_engine_s *e, const struct timeval *ts, uint32_t tsNsec, uint32_t lengthBytes);
+void nic_monitor_microburst_reset(struct microburst_engine_s *e);
+void nic_monitor_microburst_dprintf(struct discovered_item_s *di, int fd);
+void nic_monitor_microburst_json(struct discovered_item_s *di, json_object *feed);
+void nic_monitor_microburst_interface_dprintf(struct tool_context_s *ctx, int fd);
+
+/* Recording */
+void nic_monitor_recording_free(struct tool_context_s *ctx, struct discovered_item_s *di);
+
 #if KAFKA_REPORTER
 /* Kafka */
 int  kafka_initialize(struct discovered_item_s *di);
@@ -0,0 +1,213 @@
+#include "nic_monitor.h"
+
+/* Flow admission control.
+ * Without it, any datagram to a new addr:port allocates a complete discovered
+ * item (several MB) on the pcap thread. A port scan or an encoder spraying
+ * ports would create thousands of those in seconds.
+ *
+ * Unknown flows are tracked in a small fixed size table, keyed on the
+ * src/dst address and ports. A flow is promoted to a discovered item once it
+ * has delivered a minimum number of packets that classify as TS, RTP/TS,
+ * SMPTE2110 or A/324, at a minimum packet rate. Promotions are rate limited
+ * per second. Everything else ages out of the table.
+ *
+ * Only ever touched from the pcap thread, so no locking. The UI and
+ * reporting read the counters without a lock, they're informational.
+ */
+
+#define ADMISSION_TABLE_SIZE 1024 /* Power of two */
+#define ADMISSION_PROBE_DEPTH 8
+
+struct admission_flow_s
+{
+	int inUse;
+	uint32_t saddr, daddr;
+	uint16_t sport, dport;
+
+	struct timeval firstSeen;
+	struct timeval lastSeen;
+	uint32_t packetCount;
+	uint32_t classifiedCount;
+	int rejectedUnclassified;  /* Already counted in the totals */
+	int rejectedLowRate;
+	int deferredRateLimit;
+};
+
+struct admission_ctx_s
+{
+	struct admission_flow_s flows[ADMISSION_TABLE_SIZE];
+
+	time_t promotionSecond;
+	int promotionsThisSecond;
+};
+
+static uint32_t _flow_hash(uint32_t saddr, uint32_t daddr, uint16_t sport, uint16_t dport)
+{
+	uint32_t h = daddr ^ (saddr * 0x9e3779b1) ^ (((uint32_t)dport << 16) | sport);
+	h ^= h >> 16;
+	h *= 0x85ebca6b;
+	h ^= h >> 13;
+	return h & (ADMISSION_TABLE_SIZE - 1);
+}
+
+/* Cheap version of determinePayloadType(), without needing a discovered item. */
+static int _is_classified(const uint8_t *buf, int lengthBytes)
+{
+	if (lengthBytes >= 188 && (lengthBytes % 188) == 0 && buf[0] == 0x47)
+		return 1; /* UDP/TS */
+
+	if (lengthBytes < 12 || (buf[0] & 0xc0) != 0x80)
+		return 0; /* Not RTP v2 */
+
+	if (lengthBytes >= 12 + 188 && ((lengthBytes - 12) % 188) == 0 && buf[12] == 0x47)
+		return 1; /* RTP/TS */
+
+	switch (buf[1] & 0x7f) {
+	case 96:  /* SMPTE2110-20 */
+	case 97:  /* A/324 CTP */
+	case 98:  /* SMPTE2110-30 */
+	case 100: /* SMPTE2110-40 */
+		return 1;
+	}
+
+	return 0;
+}
+
+int nic_monitor_admission_alloc(struct tool_context_s *ctx)
+{
+	ctx->admission.hdl = calloc(1, sizeof(struct admission_ctx_s));
+	if (!ctx->admission.hdl)
+		return -1;
+
+	if (ctx->admission.minPackets <= 0)
+		ctx->admission.minPackets = ADMISSION_DEFAULT_MIN_PACKETS;
+	if (ctx->admission.minPPS <= 0)
+		ctx->admission.minPPS = ADMISSION_DEFAULT_MIN_PPS;
+	if (ctx->admission.maxPromotionsPerSecond <= 0)
+		ctx->admission.maxPromotionsPerSecond = ADMISSION_DEFAULT_MAX_PROMOTIONS;
+
+	return 0;
+}
+
+void nic_monitor_admission_free(struct tool_context_s *ctx)
+{
+	free(ctx->admission.hdl);
+	ctx->admission.hdl = NULL;
+}
+
+/* Return 1 if the flow should be promoted to a discovered item, else 0. */
+int nic_monitor_admission_check(struct tool_context_s *ctx, const struct timeval *ts,
+	struct iphdr *iphdr, struct udphdr *udphdr, const uint8_t *payload, int lengthBytes)
+{
+	struct admission_ctx_s *actx = ctx->admission.hdl;
+	if (!actx)
+		return 1;
+
+#ifdef __APPLE__
+	uint32_t saddr = iphdr->ip_src.s_addr;
+	uint32_t daddr = iphdr->ip_dst.s_addr;
+#endif
+#ifdef __linux__
+	uint32_t saddr = iphdr->saddr;
+	uint32_t daddr = iphdr->daddr;
+#endif
+	uint16_t sport = udphdr->uh_sport;
+	uint16_t dport = udphdr->uh_dport;
+
+	/* Find the flow, or the best slot to put it in: a free one, else the least recently seen. */
+	uint32_t idx = _flow_hash(saddr, daddr, sport, dport);
+	struct admission_flow_s *f = NULL, *victim = NULL;
+	for (int i = 0; i < ADMISSION_PROBE_DEPTH; i++) {
+		struct admission_flow_s *e = &actx->flows[(idx + i) & (ADMISSION_TABLE_SIZE - 1)];
+		if (e->inUse && e->saddr == saddr && e->daddr == daddr && e->sport == sport && e->dport == dport) {
+			f = e;
+			break;
+		}
+		if (!e->inUse) {
+			if (!victim || victim->inUse)
+				victim = e;
+		} else
+		if (!victim || (victim->inUse && timercmp(&e->lastSeen, &victim->lastSeen, <))) {
+			victim = e;
+		}
+	}
+
+	if (!f) {
+		if (victim->inUse)
+			ctx->admission.tableEvictions++;
+
+		f = victim;
+		memset(f, 0, sizeof(*f));
+		f->inUse = 1;
+		f->saddr = saddr;
+		f->daddr = daddr;
+		f->sport = sport;
+		f->dport = dport;
+		f->firstSeen = *ts;
+		ctx->admission.candidatesSeen++;
+	}
+
+	f->lastSeen = *ts;
+	f->packetCount++;
+
+	if (_is_classified(payload, lengthBytes))
+		f->classifiedCount++;
+
+	if (f->packetCount < ctx->admission.minPackets)
+		return 0;
+
+	struct timeval diff;
+	timersub(&f->lastSeen, &f->firstSeen, &diff);
+	double elapsed = (double)diff.tv_sec + ((double)diff.tv_usec / 1000000.0);
+	double pps = elapsed > 0 ? (double)f->packetCount / elapsed : (double)f->packetCount;
+
+	/* Mostly unclassifiable, or too slow. Start a new measurement window,
+	 * the flow gets another chance if it improves.
+	 */
+	if (f->classifiedCount < (f->packetCount * 9) / 10 || pps < ctx->admission.minPPS) {
+		if (f->classifiedCount < (f->packetCount * 9) / 10) {
+			if (!f->rejectedUnclassified)
+				ctx->admission.rejectedUnclassified++;
+			f->rejectedUnclassified = 1;
+		} else
+		if (!f->rejectedLowRate) {
+			ctx->admission.rejectedLowRate++;
+			f->rejectedLowRate = 1;
+		}
+		f->firstSeen = *ts;
+		f->packetCount = 0;
+		f->classifiedCount = 0;
+		return 0;
+	}
+
+	/* Rate limit the number of new streams per second we allocate. */
+	if (actx->promotionSecond != ts->tv_sec) {
+		actx->promotionSecond = ts->tv_sec;
+		actx->promotionsThisSecond = 0;
+	}
+	if (actx->promotionsThisSecond >= ctx->admission.maxPromotionsPerSecond) {
+		if (!f->deferredRateLimit)
+			ctx->admission.deferredRateLimit++;
+		f->deferredRateLimit = 1;
+		return 0;
+	}
+	actx->promotionsThisSecond++;
+
+	/* Promoted, the discovered item takes over from here. */
+	ctx->admission.promoted++;
+	f->inUse = 0;
+
+	return 1;
+}
+
+int nic_monitor_admission_sprintf(struct tool_context_s *ctx, char *dst, int lengthBytes)
+{
+	return snprintf(dst, lengthBytes, "Admission: candidates %" PRIu64 " promoted %" PRIu64
+		" unclassified %" PRIu64 " low-rate %" PRIu64 " deferred %" PRIu64 " evicted %" PRIu64,
+		ctx->admission.candidatesSeen,
+		ctx->admission.promoted,
+		ctx->admission.rejectedUnclassified,
+		ctx->admission.rejectedLowRate,
+		ctx->admission.deferredRateLimit,
+		ctx->admission.tableEvictions);
+}
@@ -0,0 +1,844 @@
+#include "nic_monitor.h"
+#include <math.h>
+
+/* Sampled audio silence and loudness monitoring.
+ * Each stream's model tells us which pids carry audio. Every sample interval
+ * the stats thread captures a few seconds of elementary stream from each audio
+ * pid (PES headers removed) and queues it for the audio worker pool. Decoding
+ * and measurement happen on the pool, never on the capture or stats threads.
+ * The pool and its queue are bounded, a sample that doesn't fit is skipped and
+ * counted, the stream is tried again next interval.
+ *
+ * Measurements follow ITU-R BS.1770: K-weighted, channel weighted mean square
+ * in 100ms blocks, momentary loudness over 400ms, short-term over 3s. Sample
+ * peak is in dBFS. A sample is silent when its peak stays below the silence
+ * threshold, over loud when its short-term (or momentary, for samples shorter
+ * than 3s) loudness exceeds the loud threshold.
+ *
+ * Each capture buffer is sized from the pid's bitrate and the sample length,
+ * with headroom for VBR and the PES that completes the sample, and charged to
+ * the memory governor. Buffers are freed when the stream loses its deep
+ * inspection slot or sheds its analyzers. A queued sample is charged to the
+ * pool rather than the stream, until a worker is done with it.
+ *
+ * The per stream monitor is reference counted, decode jobs in flight keep it
+ * alive after the stream itself has gone.
+ */
+
+#define AUDIO_CAPTURE_MIN_BYTES (64 * 1024)
+#define AUDIO_CAPTURE_MAX_BYTES (1024 * 1024)
+#define AUDIO_QUEUE_DEPTH_PER_WORKER 4
+#define AUDIO_BLOCK_MS 100
+#define AUDIO_SHORTTERM_BLOCKS 30 /* 3s */
+#define AUDIO_MOMENTARY_BLOCKS 4  /* 400ms */
+#define AUDIO_FLOOR_DB -144.0
+#define AUDIO_MAX_CHANNELS 8
+
+struct audio_job_s
+{
+	struct xorg_list list;
+	struct audio_monitor_s *mon;
+	int idx;
+	uint16_t pid;
+	uint8_t streamType;
+	uint8_t *es;
+	int esSize;
+	int esLength;
+};
+
+struct biquad_s
+{
+	double b0, b1, b2, a1, a2;
+	double z1, z2;
+};
+
+struct loudness_s
+{
+	int channels;
+	int sampleRate;
+	struct biquad_s shelf[AUDIO_MAX_CHANNELS];
+	struct biquad_s highpass[AUDIO_MAX_CHANNELS];
+	double weight[AUDIO_MAX_CHANNELS];
+
+	int blockSamples;
+	int blockFill;
+	double blockSum[AUDIO_MAX_CHANNELS];
+	double blocks[AUDIO_SHORTTERM_BLOCKS];
+	int blockCount;
+
+	double peak;
+	double momentaryMax;
+	double shortTermMax;
+	uint64_t frames;
+};
+
+static int _is_audio_stream_type(uint8_t streamType)
+{
+	switch (streamType) {
+	case 0x03: /* MPEG-1 audio */
+	case 0x04: /* MPEG-2 audio */
+	case 0x0f: /* AAC ADTS */
+	case 0x11: /* AAC LATM */
+	case 0x81: /* AC-3 */
+	case 0x87: /* E-AC-3 */
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+static enum AVCodecID _codec_id(uint8_t streamType)
+{
+	switch (streamType) {
+	case 0x03:
+	case 0x04: return AV_CODEC_ID_MP2;
+	case 0x0f: return AV_CODEC_ID_AAC;
+	case 0x11: return AV_CODEC_ID_AAC_LATM;
+	case 0x81: return AV_CODEC_ID_AC3;
+	case 0x87: return AV_CODEC_ID_EAC3;
+	default:   return AV_CODEC_ID_NONE;
+	}
+}
+
+static double _to_db(double v)
+{
+	if (v <= 0.0)
+		return AUDIO_FLOOR_DB;
+	double db = 20.0 * log10(v);
+	return db < AUDIO_FLOOR_DB ? AUDIO_FLOOR_DB : db;
+}
+
+static double _to_lufs(double meanSquare)
+{
+	if (meanSquare <= 0.0)
+		return AUDIO_FLOOR_DB;
+	double l = -0.691 + 10.0 * log10(meanSquare);
+	return l < AUDIO_FLOOR_DB ? AUDIO_FLOOR_DB : l;
+}
+
+/* BS.1770 K-weighting, a high shelf then a high pass, for any sample rate. */
+static void _loudness_init(struct loudness_s *l, int channels, int sampleRate)
+{
+	memset(l, 0, sizeof(*l));
+	l->channels = channels > AUDIO_MAX_CHANNELS ? AUDIO_MAX_CHANNELS : channels;
+	l->sampleRate = sampleRate;
+	l->blockSamples = (sampleRate * AUDIO_BLOCK_MS) / 1000;
+	l->momentaryMax = AUDIO_FLOOR_DB;
+	l->shortTermMax = AUDIO_FLOOR_DB;
+
+	double f0 = 1681.974450955533;
+	double G = 3.999843853973347;
+	double Q = 0.7071752369554196;
+	double K = tan(M_PI * f0 / sampleRate);
+	double Vh = pow(10.0, G / 20.0);
+	double Vb = pow(Vh, 0.4996667741545416);
+	double a0 = 1.0 + K / Q + K * K;
+
+	struct biquad_s shelf = {
+		.b0 = (Vh + Vb * K / Q + K * K) / a0,
+		.b1 = 2.0 * (K * K - Vh) / a0,
+		.b2 = (Vh - Vb * K / Q + K * K) / a0,
+		.a1 = 2.0 * (K * K - 1.0) / a0,
+		.a2 = (1.0 - K / Q + K * K) / a0,
+	};
+
+	f0 = 38.13547087602444;
+	Q = 0.5003270373238773;
+	K = tan(M_PI * f0 / sampleRate);
+	a0 = 1.0 + K / Q + K * K;
+
+	struct biquad_s highpass = {
+		.b0 = 1.0,
+		.b1 = -2.0,
+		.b2 = 1.0,
+		.a1 = 2.0 * (K * K - 1.0) / a0,
+		.a2 = (1.0 - K / Q + K * K) / a0,
+	};
+
+	for (int i = 0; i < l->channels; i++) {
+		l->shelf[i] = shelf;
+		l->highpass[i] = highpass;
+
+		/* Default ffmpeg layouts, 5.1 is FL FR FC LFE SL SR. LFE doesn't count, surrounds are +1.5dB */
+		l->weight[i] = 1.0;
+		if (l->channels == 6) {
+			if (i == 3)
+				l->weight[i] = 0.0;
+			if (i >= 4)
+				l->weight[i] = 1.41;
+		}
+	}
+}
+
+static double _biquad(struct biquad_s *f, double x)
+{
+	double y = f->b0 * x + f->z1;
+	f->z1 = f->b1 * x - f->a1 * y + f->z2;
+	f->z2 = f->b2 * x - f->a2 * y;
+	return y;
+}
+
+static void _loudness_block_complete(struct loudness_s *l)
+{
+	double sum = 0;
+	for (int i = 0; i < l->channels; i++) {
+		sum += l->weight[i] * (l->blockSum[i] / l->blockFill);
+		l->blockSum[i] = 0;
+	}
+	l->blockFill = 0;
+
+	l->blocks[l->blockCount % AUDIO_SHORTTERM_BLOCKS] = sum;
+	l->blockCount++;
+
+	if (l->blockCount >= AUDIO_MOMENTARY_BLOCKS) {
+		double m = 0;
+		for (int i = 0; i < AUDIO_MOMENTARY_BLOCKS; i++)
+			m += l->blocks[(l->blockCount - 1 - i) % AUDIO_SHORTTERM_BLOCKS];
+		m = _to_lufs(m / AUDIO_MOMENTARY_BLOCKS);
+		if (m > l->momentaryMax)
+			l->momentaryMax = m;
+	}
+	if (l->blockCount >= AUDIO_SHORTTERM_BLOCKS) {
+		double s = 0;
+		for (int i = 0; i < AUDIO_SHORTTERM_BLOCKS; i++)
+			s += l->blocks[i];
+		s = _to_lufs(s / AUDIO_SHORTTERM_BLOCKS);
+		if (s > l->shortTermMax)
+			l->shortTermMax = s;
+	}
+}
+
+static double _sample(const AVFrame *frame, int planar, enum AVSampleFormat fmt, int ch, int channels, int n)
+{
+	int idx = planar ? n : (n * channels) + ch;
+	const uint8_t *p = planar ? frame->extended_data[ch] : frame->extended_data[0];
+
+	switch (fmt) {
+	case AV_SAMPLE_FMT_U8:  return (((const uint8_t *)p)[idx] - 128) / 128.0;
+	case AV_SAMPLE_FMT_S16: return ((const int16_t *)p)[idx] / 32768.0;
+	case AV_SAMPLE_FMT_S32: return ((const int32_t *)p)[idx] / 2147483648.0;
+	case AV_SAMPLE_FMT_FLT: return ((const float *)p)[idx];
+	case AV_SAMPLE_FMT_DBL: return ((const double *)p)[idx];
+	default:                return 0;
+	}
+}
+
+static int _frame_channels(const AVFrame *frame)
+{
+#if LIBAVUTIL_VERSION_INT >= AV_VERSION_INT(57, 24, 100)
+	return frame->ch_layout.nb_channels;
+#else
+	return frame->channels;
+#endif
+}
+
+static void _loudness_write(struct loudness_s *l, const AVFrame *frame)
+{
+	int channels = _frame_channels(frame);
+	if (l->sampleRate == 0) {
+		if (frame->sample_rate <= 0 || channels <= 0)
+			return;
+		_loudness_init(l, channels, frame->sample_rate);
+	}
+	if (channels > AUDIO_MAX_CHANNELS)
+		channels = AUDIO_MAX_CHANNELS;
+
+	int planar = av_sample_fmt_is_planar(frame->format);
+	enum AVSampleFormat fmt = av_get_packed_sample_fmt(frame->format);
+
+	for (int n = 0; n < frame->nb_samples; n++) {
+		for (int ch = 0; ch < channels && ch < l->channels; ch++) {
+			double x = _sample(frame, planar, fmt, ch, _frame_channels(frame), n);
+			double a = fabs(x);
+			if (a > l->peak)
+				l->peak = a;
+
+			double y = _biquad(&l->highpass[ch], _biquad(&l->shelf[ch], x));
+			l->blockSum[ch] += y * y;
+		}
+		if (++l->blockFill >= l->blockSamples)
+			_loudness_block_complete(l);
+	}
+	l->frames++;
+}
+
+/* Decode a captured sample, on a worker thread. Returns 0 if anything decoded. */
+static int _decode(struct audio_job_s *job, struct loudness_s *l, char *codecName, int codecNameLength)
+{
+	const AVCodec *codec = avcodec_find_decoder(_codec_id(job->streamType));
+	if (!codec)
+		return -1;
+	snprintf(codecName, codecNameLength, "%s", codec->name);
+
+	AVCodecParserContext *parser = av_parser_init(codec->id);
+	AVCodecContext *cc = avcodec_alloc_context3(codec);
+	AVFrame *frame = av_frame_alloc();
+	AVPacket *pkt = av_packet_alloc();
+
+	if (!parser || !cc || !frame || !pkt || avcodec_open2(cc, codec, NULL) < 0) {
+		av_parser_close(parser);
+		avcodec_free_context(&cc);
+		av_frame_free(&frame);
+		av_packet_free(&pkt);
+		return -1;
+	}
+
+	/* The parser wants padded input. */
+	uint8_t *buf = av_mallocz(job->esLength + AV_INPUT_BUFFER_PADDING_SIZE);
+	if (buf)
+		memcpy(buf, job->es, job->esLength);
+
+	const uint8_t *data = buf;
+	int remaining = buf ? job->esLength : 0;
+	int flushing = 0;
+	while (remaining > 0 || !flushing) {
+		if (remaining > 0) {
+			int used = av_parser_parse2(parser, cc, &pkt->data, &pkt->size, data, remaining,
+				AV_NOPTS_VALUE, AV_NOPTS_VALUE, 0);
+			if (used < 0)
+				break;
+			data += used;
+			remaining -= used;
+			if (pkt->size == 0)
+				continue;
+			if (avcodec_send_packet(cc, pkt) < 0)
+				continue; /* Corrupt frame, carry on with the next */
+		} else {
+			avcodec_send_packet(cc, NULL);
+			flushing = 1;
+		}
+
+		while (avcodec_receive_frame(cc, frame) == 0) {
+			_loudness_write(l, frame);
+		}
+	}
+
+	av_free(buf);
+	av_parser_close(parser);
+	avcodec_free_context(&cc);
+	av_frame_free(&frame);
+	av_packet_free(&pkt);
+
+	return l->frames ? 0 : -1;
+}
+
+static void _monitor_put(struct audio_monitor_s *mon)
+{
+	pthread_mutex_lock(&mon->lock);
+	int refs = --mon->refCount;
+	pthread_mutex_unlock(&mon->lock);
+
+	if (refs)
+		return;
+
+	for (int i = 0; i < mon->pidCount; i++)
+		free(mon->pids[i].es);
+	pthread_mutex_destroy(&mon->lock);
+	free(mon);
+}
+
+static void _log(struct audio_monitor_s *mon, const char *msg)
+{
+	if (mon->pendingLogCount < AUDIO_PENDING_LOG)
+		strcpy(&mon->pendingLog[mon->pendingLogCount++][0], msg);
+}
+
+/* Returns the new silence and loudness incidents, for the caller to count under audioMonitor.lock. */
+static void _job_complete(struct tool_context_s *ctx, struct audio_job_s *job, struct loudness_s *l, int ret, const char *codecName,
+	int *silentIncidents, int *loudIncidents)
+{
+	struct audio_monitor_s *mon = job->mon;
+	time_t now = time(NULL);
+	char msg[128];
+
+	pthread_mutex_lock(&mon->lock);
+	struct audio_monitor_pid_s *a = &mon->pids[job->idx];
+
+	/* The PMT may have changed while we were decoding. */
+	if (job->idx < mon->pidCount && a->pid == job->pid && a->state == AUDIO_STATE_DECODING) {
+		a->state = AUDIO_STATE_IDLE;
+		a->nextSample = now + ctx->audioMonitor.sampleSecs;
+
+		if (ret < 0) {
+			a->decodeErrors++;
+		} else {
+			a->lastSample = now;
+			a->samples++;
+			a->channels = l->channels;
+			a->sampleRate = l->sampleRate;
+			strcpy(a->codecName, codecName);
+			a->peakDbfs = _to_db(l->peak);
+			a->momentaryMaxLufs = l->momentaryMax;
+			a->shortTermMaxLufs = l->shortTermMax;
+
+			double loudness = l->blockCount >= AUDIO_SHORTTERM_BLOCKS ? l->shortTermMax : l->momentaryMax;
+			int silent = a->peakDbfs < ctx->audioMonitor.silenceDbfs;
+			int loud = loudness > ctx->audioMonitor.loudLufs;
+
+			if (silent) {
+				a->silentSamples++;
+			}
+			if (loud) {
+				a->loudSamples++;
+			}
+
+			if (silent != a->silent) {
+				if (silent) {
+					sprintf(msg, "Audio pid 0x%04x silent, peak %.1f dBFS", a->pid, a->peakDbfs);
+					(*silentIncidents)++;
+				} else {
+					sprintf(msg, "Audio pid 0x%04x audio restored, peak %.1f dBFS", a->pid, a->peakDbfs);
+				}
+				_log(mon, msg);
+				a->silent = silent;
+			}
+			if (loud != a->loud) {
+				if (loud) {
+					sprintf(msg, "Audio pid 0x%04x too loud, %.1f LUFS", a->pid, loudness);
+					(*loudIncidents)++;
+				} else {
+					sprintf(msg, "Audio pid 0x%04x loudness back to %.1f LUFS", a->pid, loudness);
+				}
+				_log(mon, msg);
+				a->loud = loud;
+			}
+		}
+	}
+	pthread_mutex_unlock(&mon->lock);
+}
+
+static void *_worker_func(void *p)
+{
+	struct tool_context_s *ctx = (struct tool_context_s *)p;
+
+	pthread_mutex_lock(&ctx->audioMonitor.lock);
+	while (!ctx->audioMonitor.terminate) {
+		if (xorg_list_is_empty(&ctx->audioMonitor.jobs)) {
+			pthread_cond_wait(&ctx->audioMonitor.cond, &ctx->audioMonitor.lock);
+			continue;
+		}
+
+		struct audio_job_s *job = xorg_list_first_entry(&ctx->audioMonitor.jobs, struct audio_job_s, list);
+		xorg_list_del(&job->list);
+		ctx->audioMonitor.jobCount--;
+		pthread_mutex_unlock(&ctx->audioMonitor.lock);
+
+		struct loudness_s l;
+		char codecName[16] = { 0 };
+		memset(&l, 0, sizeof(l));
+		int silentIncidents = 0, loudIncidents = 0;
+		int ret = _decode(job, &l, &codecName[0], sizeof(codecName));
+		_job_complete(ctx, job, &l, ret, codecName, &silentIncidents, &loudIncidents);
+
+		pthread_mutex_lock(&ctx->audioMonitor.lock);
+		if (ret < 0)
+			ctx->audioMonitor.decodeErrors++;
+		else
+			ctx->audioMonitor.jobsDecoded++;
+		ctx->audioMonitor.framesDecoded += l.frames;
+		ctx->audioMonitor.silentIncidents += silentIncidents;
+		ctx->audioMonitor.loudIncidents += loudIncidents;
+		pthread_mutex_unlock(&ctx->audioMonitor.lock);
+
+		free(job->es);
+		nic_monitor_memory_release_bytes(ctx, NULL, MEM_SUBSYSTEM_AUDIO, job->esSize);
+		_monitor_put(job->mon);
+		free(job);
+
+		pthread_mutex_lock(&ctx->audioMonitor.lock);
+	}
+	pthread_mutex_unlock(&ctx->audioMonitor.lock);
+
+	return NULL;
+}
+
+int nic_monitor_audio_start(struct tool_context_s *ctx)
+{
+	if (ctx->audioMonitor.sampleSecs <= 0)
+		return 0;
+
+	pthread_mutex_init(&ctx->audioMonitor.lock, NULL);
+	pthread_cond_init(&ctx->audioMonitor.cond, NULL);
+	xorg_list_init(&ctx->audioMonitor.jobs);
+
+	for (int i = 0; i < ctx->audioMonitor.workers; i++) {
+		if (pthread_create(&ctx->audioMonitor.threads[i], NULL, _worker_func, ctx) != 0)
+			return -1;
+		ctx->audioMonitor.threadCount++;
+	}
+
+	return 0;
+}
+
+void nic_monitor_audio_stop(struct tool_context_s *ctx)
+{
+	if (ctx->audioMonitor.threadCount == 0)
+		return;
+
+	pthread_mutex_lock(&ctx->audioMonitor.lock);
+	ctx->audioMonitor.terminate = 1;
+	pthread_cond_broadcast(&ctx->audioMonitor.cond);
+	pthread_mutex_unlock(&ctx->audioMonitor.lock);
+
+	for (int i = 0; i < ctx->audioMonitor.threadCount; i++)
+		pthread_join(ctx->audioMonitor.threads[i], NULL);
+	ctx->audioMonitor.threadCount = 0;
+
+	/* Samples nobody got to. */
+	while (!xorg_list_is_empty(&ctx->audioMonitor.jobs)) {
+		struct audio_job_s *job = xorg_list_first_entry(&ctx->audioMonitor.jobs, struct audio_job_s, list);
+		xorg_list_del(&job->list);
+		free(job->es);
+		nic_monitor_memory_release_bytes(ctx, NULL, MEM_SUBSYSTEM_AUDIO, job->esSize);
+		_monitor_put(job->mon);
+		free(job);
+	}
+	ctx->audioMonitor.jobCount = 0;
+}
+
+/* Called with mon->lock held, the pid's charge goes with it. */
+static void _buffer_free(struct discovered_item_s *di, struct audio_monitor_pid_s *a)
+{
+	if (!a->es)
+		return;
+
+	free(a->es);
+	nic_monitor_memory_release_bytes(di->ctx, di, MEM_SUBSYSTEM_AUDIO, a->esSize);
+	a->es = NULL;
+	a->esSize = 0;
+	a->esLength = 0;
+}
+
+/* Enough for sampleMs at the pid's current bitrate, twice over for VBR and the PES that
+ * completes the sample. Returns 0 when the budget can't afford it.
+ */
+static int _buffer_alloc(struct discovered_item_s *di, struct audio_monitor_pid_s *a)
+{
+	struct tool_context_s *ctx = di->ctx;
+
+	double mbps = di->stats ? ltntstools_pid_stats_pid_get_mbps(di->stats, a->pid) : 0;
+	int64_t size = (int64_t)((mbps * 1000000.0 / 8.0) * ctx->audioMonitor.sampleMs / 1000.0) * 2;
+	if (size < AUDIO_CAPTURE_MIN_BYTES)
+		size = AUDIO_CAPTURE_MIN_BYTES;
+	if (size > AUDIO_CAPTURE_MAX_BYTES)
+		size = AUDIO_CAPTURE_MAX_BYTES;
+
+	if (nic_monitor_memory_charge_bytes(ctx, di, MEM_SUBSYSTEM_AUDIO, size) < 0)
+		return 0;
+
+	a->es = malloc(size);
+	if (!a->es) {
+		nic_monitor_memory_release_bytes(ctx, di, MEM_SUBSYSTEM_AUDIO, size);
+		return 0;
+	}
+	a->esSize = size;
+	a->esLength = 0;
+
+	return size;
+}
+
+/* Hand a completed capture to the pool, or drop it if the pool is behind. Called with mon->lock held. */
+static void _submit(struct discovered_item_s *di, struct audio_monitor_s *mon, int idx, time_t now)
+{
+	struct tool_context_s *ctx = di->ctx;
+	struct audio_monitor_pid_s *a = &mon->pids[idx];
+
+	struct audio_job_s *job = NULL;
+	pthread_mutex_lock(&ctx->audioMonitor.lock);
+	if (ctx->audioMonitor.jobCount < ctx->audioMonitor.threadCount * AUDIO_QUEUE_DEPTH_PER_WORKER) {
+		job = calloc(1, sizeof(*job));
+	}
+	if (job) {
+		job->mon = mon;
+		job->idx = idx;
+		job->pid = a->pid;
+		job->streamType = a->streamType;
+		job->es = a->es;
+		job->esSize = a->esSize;
+		job->esLength = a->esLength;
+		mon->refCount++;
+
+		xorg_list_append(&job->list, &ctx->audioMonitor.jobs);
+		ctx->audioMonitor.jobCount++;
+		ctx->audioMonitor.jobsQueued++;
+		pthread_cond_signal(&ctx->audioMonitor.cond);
+	} else {
+		ctx->audioMonitor.jobsDropped++;
+	}
+	pthread_mutex_unlock(&ctx->audioMonitor.lock);
+
+	if (job) {
+		/* Owned by the job now, and charged to the pool until a worker frees it. */
+		nic_monitor_memory_disown_bytes(di, MEM_SUBSYSTEM_AUDIO, a->esSize);
+		a->es = NULL;
+		a->esSize = 0;
+		a->state = AUDIO_STATE_DECODING;
+	} else {
+		_buffer_free(di, a);
+		a->state = AUDIO_STATE_IDLE;
+		a->nextSample = now + ctx->audioMonitor.sampleSecs;
+		a->skipped++;
+	}
+	a->esLength = 0;
+}
+
+static int64_t _now_ms()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((int64_t)ts.tv_sec * 1000) + (ts.tv_nsec / 1000000);
+}
+
+/* Called on the stats thread, only for streams holding a deep inspection slot. */
+void nic_monitor_audio_write(struct discovered_item_s *di, const uint8_t *pkts, uint32_t pktCount)
+{
+	struct tool_context_s *ctx = di->ctx;
+	struct audio_monitor_s *mon = di->audio;
+
+	if (!mon || mon->pidCount == 0 || di->memReduced)
+		return;
+
+	time_t now = time(NULL);
+	int64_t nowMs = 0;
+
+	pthread_mutex_lock(&mon->lock);
+	for (int i = 0; i < mon->pidCount; i++) {
+		struct audio_monitor_pid_s *a = &mon->pids[i];
+
+		if (a->state == AUDIO_STATE_DECODING)
+			continue;
+
+		if (a->state == AUDIO_STATE_IDLE) {
+			if (now < a->nextSample)
+				continue;
+			if (!a->es && !_buffer_alloc(di, a)) {
+				a->nextSample = now + ctx->audioMonitor.sampleSecs;
+				a->skipped++;
+				continue;
+			}
+			a->esLength = 0;
+			a->state = AUDIO_STATE_ARMED;
+		}
+
+		for (uint32_t j = 0; j < pktCount && a->state != AUDIO_STATE_IDLE && a->state != AUDIO_STATE_DECODING; j++) {
+			const uint8_t *pkt = pkts + (j * 188);
+			if (ltntstools_pid(pkt) != a->pid)
+				continue;
+			if (!(pkt[3] & 0x10))
+				continue; /* No payload */
+
+			int offset = 4;
+			if (pkt[3] & 0x20)
+				offset += 1 + pkt[4];
+
+			int pusi = ltntstools_payload_unit_start_indicator(pkt);
+			if (pusi) {
+				/* Start on a PES boundary, skip the PES header. */
+				if (offset + 9 > 188 || pkt[offset] != 0x00 || pkt[offset + 1] != 0x00 || pkt[offset + 2] != 0x01)
+					continue;
+				offset += 9 + pkt[offset + 8];
+
+				if (a->state == AUDIO_STATE_ARMED) {
+					a->state = AUDIO_STATE_CAPTURING;
+					a->captureStartMs = nowMs ? nowMs : (nowMs = _now_ms());
+				}
+			}
+			if (a->state != AUDIO_STATE_CAPTURING || offset >= 188)
+				continue;
+
+			int len = 188 - offset;
+			if (a->esLength + len > a->esSize) {
+				_submit(di, mon, i, now);
+				break;
+			}
+			memcpy(a->es + a->esLength, pkt + offset, len);
+			a->esLength += len;
+
+			if (pusi) {
+				if (!nowMs)
+					nowMs = _now_ms();
+				if (nowMs - a->captureStartMs >= ctx->audioMonitor.sampleMs) {
+					_submit(di, mon, i, now);
+					break;
+				}
+			}
+		}
+	}
+	pthread_mutex_unlock(&mon->lock);
+}
+
+/* Rebuild the list of audio pids if the stream model disagrees with it. */
+static void _refresh_pids(struct tool_context_s *ctx, struct discovered_item_s *di, time_t now)
+{
+	struct audio_monitor_s *mon = di->audio;
+	struct model_pid_s pids[AUDIO_MAX_PIDS];
+	int count = nic_monitor_model_pids(di, &mon->modelCheck, now, ctx->audioMonitor.sampleSecs,
+		_is_audio_stream_type, &pids[0], AUDIO_MAX_PIDS);
+	if (count < 0)
+		return;
+
+	pthread_mutex_lock(&mon->lock);
+	int changed = count != mon->pidCount;
+	for (int i = 0; !changed && i < count; i++) {
+		if (pids[i].pid != mon->pids[i].pid || pids[i].streamType != mon->pids[i].streamType)
+			changed = 1;
+	}
+	if (changed) {
+		/* Jobs in flight notice the pid mismatch and discard their results. */
+		for (int i = 0; i < mon->pidCount; i++)
+			_buffer_free(di, &mon->pids[i]);
+		memset(&mon->pids[0], 0, sizeof(mon->pids));
+		for (int i = 0; i < count; i++) {
+			mon->pids[i].pid = pids[i].pid;
+			mon->pids[i].streamType = pids[i].streamType;
+			mon->pids[i].nextSample = now;
+		}
+		mon->pidCount = count;
+	}
+	pthread_mutex_unlock(&mon->lock);
+}
+
+void nic_monitor_audio_service(struct tool_context_s *ctx)
+{
+	if (ctx->audioMonitor.sampleSecs <= 0)
+		return;
+
+	time_t now = time(NULL);
+	if (ctx->audioMonitor.lastService == now)
+		return;
+	ctx->audioMonitor.lastService = now;
+
+	struct discovered_item_s *e = NULL;
+
+	pthread_mutex_lock(&ctx->lock);
+	xorg_list_for_each_entry(e, &ctx->list, list) {
+		struct audio_monitor_s *mon = e->audio;
+		if (!mon)
+			continue;
+
+		/* Incidents reported by the workers go into the streams log from here, on the stats thread. */
+		pthread_mutex_lock(&mon->lock);
+		for (int i = 0; i < mon->pendingLogCount; i++)
+			display_doc_append_with_time(&e->doc_stream_log, &mon->pendingLog[i][0], NULL);
+		mon->pendingLogCount = 0;
+		pthread_mutex_unlock(&mon->lock);
+
+		_refresh_pids(ctx, e, now);
+	}
+	pthread_mutex_unlock(&ctx->lock);
+}
+
+int nic_monitor_audio_alloc(struct discovered_item_s *di)
+{
+	if (di->ctx->audioMonitor.sampleSecs <= 0)
+		return 0;
+
+	struct audio_monitor_s *mon = calloc(1, sizeof(*mon));
+	if (!mon)
+		return -1;
+
+	pthread_mutex_init(&mon->lock, NULL);
+	mon->refCount = 1;
+	di->audio = mon;
+
+	return 0;
+}
+
+void nic_monitor_audio_free(struct discovered_item_s *di)
+{
+	struct audio_monitor_s *mon = di->audio;
+	if (!mon)
+		return;
+
+	nic_monitor_audio_release_buffers(di);
+	di->audio = NULL;
+	_monitor_put(mon);
+}
+
+/* Free the capture buffers the stream holds, when it loses its deep slot or sheds.
+ * Samples with the workers finish, a capture in progress starts over next time.
+ */
+void nic_monitor_audio_release_buffers(struct discovered_item_s *di)
+{
+	struct audio_monitor_s *mon = di->audio;
+	if (!mon)
+		return;
+
+	pthread_mutex_lock(&mon->lock);
+	for (int i = 0; i < mon->pidCount; i++) {
+		struct audio_monitor_pid_s *a = &mon->pids[i];
+		if (a->state == AUDIO_STATE_DECODING)
+			continue;
+		_buffer_free(di, a);
+		a->state = AUDIO_STATE_IDLE;
+	}
+	pthread_mutex_unlock(&mon->lock);
+}
+
+void nic_monitor_audio_dprintf(struct discovered_item_s *di, int fd)
+{
+	struct audio_monitor_s *mon = di->audio;
+	if (!mon)
+		return;
+
+	pthread_mutex_lock(&mon->lock);
+	for (int i = 0; i < mon->pidCount; i++) {
+		struct audio_monitor_pid_s *a = &mon->pids[i];
+		if (a->lastSample == 0)
+			continue;
+		dprintf(fd, "Audio pid 0x%04x: %s %dch %dHz, peak %.1f dBFS, momentary max %.1f LUFS, short-term max %.1f LUFS%s%s "
+			"(%" PRIu64 " samples, %" PRIu64 " silent, %" PRIu64 " loud, %" PRIu64 " skipped, %" PRIu64 " decode errors)\n",
+			a->pid, a->codecName, a->channels, a->sampleRate,
+			a->peakDbfs, a->momentaryMaxLufs, a->shortTermMaxLufs,
+			a->silent ? ", SILENT" : "",
+			a->loud ? ", LOUD" : "",
+			a->samples, a->silentSamples, a->loudSamples, a->skipped, a->decodeErrors);
+	}
+	pthread_mutex_unlock(&mon->lock);
+}
+
+void nic_monitor_audio_json(struct discovered_item_s *di, json_object *feed)
+{
+	struct audio_monitor_s *mon = di->audio;
+	if (!mon)
+		return;
+
+	json_object *array = json_object_new_array();
+
+	pthread_mutex_lock(&mon->lock);
+	for (int i = 0; i < mon->pidCount; i++) {
+		struct audio_monitor_pid_s *a = &mon->pids[i];
+		if (a->lastSample == 0)
+			continue;
+
+		json_object *item = json_object_new_object();
+		json_object_object_add(item, "pid", json_object_new_int(a->pid));
+		json_object_object_add(item, "codec", json_object_new_string(a->codecName));
+		json_object_object_add(item, "channels", json_object_new_int(a->channels));
+		json_object_object_add(item, "sample_rate", json_object_new_int(a->sampleRate));
+		json_object_object_add(item, "peak_dbfs", json_object_new_double(a->peakDbfs));
+		json_object_object_add(item, "momentary_max_lufs", json_object_new_double(a->momentaryMaxLufs));
+		json_object_object_add(item, "shortterm_max_lufs", json_object_new_double(a->shortTermMaxLufs));
+		json_object_object_add(item, "silent", json_object_new_boolean(a->silent));
+		json_object_object_add(item, "loud", json_object_new_boolean(a->loud));
+		json_object_object_add(item, "sampled", json_object_new_int64(a->lastSample));
+		json_object_array_add(array, item);
+	}
+	pthread_mutex_unlock(&mon->lock);
+
+	json_object_object_add(feed, "audio", array);
+}
+
+int nic_monitor_audio_sprintf(struct tool_context_s *ctx, char *dst, int lengthBytes)
+{
+	if (ctx->audioMonitor.sampleSecs <= 0)
+		return snprintf(dst, lengthBytes, "Audio monitor: disabled");
+
+	return snprintf(dst, lengthBytes, "Audio monitor: %dms sampled every %ds on %d workers, %" PRIu64 " decoded, "
+		"%" PRIu64 " skipped (pool busy), %" PRIu64 " decode errors, %" PRIu64 " frames, "
+		"%" PRIu64 " silence and %" PRIu64 " loudness incidents",
+		ctx->audioMonitor.sampleMs, ctx->audioMonitor.sampleSecs, ctx->audioMonitor.workers,
+		ctx->audioMonitor.jobsDecoded, ctx->audioMonitor.jobsDropped, ctx->audioMonitor.decodeErrors,
+		ctx->audioMonitor.framesDecoded,
+		ctx->audioMonitor.silentIncidents, ctx->audioMonitor.loudIncidents);
+}
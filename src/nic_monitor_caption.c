@@ -0,0 +1,567 @@
+#include "nic_monitor.h"
+
+/* Decode free caption presence.
+ * Each stream's model tells us which pids could carry captions or subtitles:
+ *  - H.264 / H.265 video, CEA-608/708 cc_data in ATSC A/53 SEI (ITU-T T.35, 'GA94').
+ *  - Private PES (stream type 0x06), DVB subtitles or EBU teletext, told apart by
+ *    the PES data_identifier rather than the PMT descriptors.
+ *
+ * Only caption content counts towards presence. An encoder that keeps sending
+ * cc_data made entirely of 608 null pairs and 708 padding, teletext packets
+ * with nothing but page headers, or subtitle display sets with no objects, has
+ * lost its captions as far as a viewer is concerned.
+ *
+ * Video is never decoded. Captions ride in an SEI ahead of the first slice of each
+ * access unit, so per video pid we copy the first few packets after each PUSI,
+ * walk the NALs with the same start code scan sei_unregistered uses, and stop at
+ * the first slice. The rest of the PES costs a pid comparison per packet, cheap
+ * enough to run on every stream, deep inspection slot or not.
+ *
+ * Runs on the stats thread. The service computes byte rates once per second and
+ * logs loss / return of captions that were previously seen.
+ */
+
+/* Per access unit, the SEI lives well inside the first 4 packets, after AUD/SPS/PPS. */
+#define CAPTION_SCAN_PACKETS (CAPTION_SCAN_BYTES / 184)
+
+static int _is_caption_stream_type(uint8_t streamType)
+{
+	return streamType == 0x1b /* H.264 */ || streamType == 0x24 /* H.265 */ || streamType == 0x06 /* Private PES */;
+}
+
+/* CEA-608 pairs: control codes carry the data channel, bit 3 of the first byte.
+ * 0x80 0x80, null with odd parity, is padding.
+ */
+static void _cea608(struct caption_pid_s *c, int field, uint8_t b1, uint8_t b2)
+{
+	b1 &= 0x7f;
+	b2 &= 0x7f;
+
+	if (b1 == 0 && b2 == 0)
+		return;
+	c->ccBytes += 2;
+
+	if (b1 >= 0x10 && b1 <= 0x1f && b2 >= 0x20 && b2 <= 0x7f) {
+		int channel = (b1 & 0x08) ? 1 : 0;
+		c->cea608Channels |= 1 << ((field * 2) + channel);
+	}
+}
+
+/* CEA-708 DTVCC packet, collect the service numbers of each service block.
+ * Only the bytes of non-empty service blocks count as content.
+ */
+static void _cea708_packet(struct caption_pid_s *c)
+{
+	if (c->dtvccLength < 1)
+		return;
+
+	int size = c->dtvccPacket[0] & 0x3f;
+	size = size ? size * 2 : 128;
+	if (size > c->dtvccLength)
+		size = c->dtvccLength;
+
+	int i = 1;
+	while (i < size) {
+		int service = c->dtvccPacket[i] >> 5;
+		int blockSize = c->dtvccPacket[i] & 0x1f;
+		i++;
+		if (service == 0)
+			break; /* Null block, padding follows */
+		if (service == 7) {
+			if (i >= size)
+				break;
+			service = c->dtvccPacket[i] & 0x3f;
+			i++;
+		}
+		if (blockSize && service < 64) {
+			c->cea708Services |= 1ULL << service;
+			c->ccBytes += blockSize;
+		}
+		i += blockSize;
+	}
+}
+
+/* A/53 cc_data(), following the 'GA94' user identifier and type code 0x03. */
+static void _cc_data(struct caption_pid_s *c, const uint8_t *p, int len)
+{
+	if (len < 2 || !(p[0] & 0x40))
+		return; /* process_cc_data_flag clear */
+
+	int count = p[0] & 0x1f;
+	p += 2; /* Flags and em_data */
+	len -= 2;
+
+	for (int i = 0; i < count && len >= 3; i++, p += 3, len -= 3) {
+		int valid = p[0] & 0x04;
+		int type = p[0] & 0x03;
+
+		if (!valid) {
+			if (type == 3)
+				c->dtvccLength = 0;
+			continue;
+		}
+
+		if (type < 2) {
+			_cea608(c, type, p[1], p[2]);
+			continue;
+		}
+
+		if (type == 3) {
+			/* DTVCC packet start, the previous one is complete. */
+			_cea708_packet(c);
+			c->dtvccLength = 0;
+		}
+		if (c->dtvccLength + 2 <= (int)sizeof(c->dtvccPacket)) {
+			c->dtvccPacket[c->dtvccLength++] = p[1];
+			c->dtvccPacket[c->dtvccLength++] = p[2];
+		}
+	}
+}
+
+/* Walk the SEI messages of an unescaped SEI RBSP, looking for registered T.35 A/53 payloads. */
+static void _sei_rbsp(struct caption_pid_s *c, const uint8_t *p, int len)
+{
+	int i = 0;
+	while (i < len && p[i] != 0x80 /* rbsp trailing bits */) {
+		int type = 0, size = 0;
+		while (i < len && p[i] == 0xff)
+			type += p[i++];
+		if (i >= len)
+			return;
+		type += p[i++];
+		while (i < len && p[i] == 0xff)
+			size += p[i++];
+		if (i >= len)
+			return;
+		size += p[i++];
+		if (i + size > len)
+			size = len - i; /* Truncated by the scan window, take what we have */
+
+		const uint8_t *m = p + i;
+		if (type == 4 && size >= 8 &&
+			m[0] == 0xb5 && m[1] == 0x00 && m[2] == 0x31 &&
+			m[3] == 'G' && m[4] == 'A' && m[5] == '9' && m[6] == '4' && m[7] == 0x03) {
+			_cc_data(c, m + 8, size - 8);
+		}
+		i += size;
+	}
+}
+
+/* Find the NALs in the head of an access unit, up to the first slice. */
+static void _scan_access_unit(struct caption_pid_s *c)
+{
+	const uint8_t *buf = c->scan;
+	int len = c->scanLength;
+	int headerBytes = c->streamType == 0x1b ? 1 : 2;
+
+	for (int i = 0; i + 3 + headerBytes < len; i++) {
+		if (buf[i] != 0x00 || buf[i + 1] != 0x00 || buf[i + 2] != 0x01)
+			continue;
+
+		uint8_t b = buf[i + 3];
+		int sei = 0;
+		if (c->streamType == 0x1b) {
+			int type = b & 0x1f;
+			if (type >= 1 && type <= 5)
+				return; /* Slice, no more SEI ahead of it */
+			sei = type == 6;
+		} else {
+			int type = (b >> 1) & 0x3f;
+			if (type <= 31)
+				return;
+			sei = type == 39 || type == 40;
+		}
+		if (!sei)
+			continue;
+
+		/* Remove emulation prevention bytes up to the next start code, or the end of the window. */
+		uint8_t rbsp[CAPTION_SCAN_BYTES];
+		int rlen = 0;
+		int j = i + 3 + headerBytes;
+		int zeros = 0;
+		for (; j < len; j++) {
+			if (zeros >= 2 && buf[j] == 0x01)
+				break;
+			if (zeros >= 2 && buf[j] == 0x03) {
+				zeros = 0;
+				continue;
+			}
+			zeros = buf[j] == 0x00 ? zeros + 1 : 0;
+			rbsp[rlen++] = buf[j];
+		}
+		_sei_rbsp(c, rbsp, rlen);
+		i = j - 3;
+	}
+}
+
+/* Private PES, on a PUSI: stream_id 0xbd then data_identifier 0x10-0x1f teletext, 0x20 DVB subtitles.
+ * Returns the offset of the first data unit or segment, -1 if there's nothing for us.
+ */
+static int _private_pes(struct caption_pid_s *c, const uint8_t *p, int len)
+{
+	if (len < 9 || p[0] != 0x00 || p[1] != 0x00 || p[2] != 0x01 || p[3] != 0xbd)
+		return -1;
+
+	int offset = 9 + p[8];
+	if (offset >= len)
+		return -1;
+
+	uint8_t id = p[offset];
+	if (id >= 0x10 && id <= 0x1f) {
+		c->kind = CAPTION_KIND_TELETEXT;
+		return offset + 1;
+	}
+	if (id == 0x20 && offset + 1 < len && p[offset + 1] == 0x00) {
+		c->kind = CAPTION_KIND_DVB_SUBTITLE;
+		return offset + 2;
+	}
+
+	return -1;
+}
+
+/* Teletext bytes arrive in transmission order, LSB first, hamming 8/4 keeps data in bits 2, 4, 6 and 8. */
+static int _hamming84(uint8_t b)
+{
+	uint8_t r = 0;
+	for (int i = 0; i < 8; i++) {
+		if (b & (1 << i))
+			r |= 0x80 >> i;
+	}
+	return ((r >> 1) & 1) | (((r >> 3) & 1) << 1) | (((r >> 5) & 1) << 2) | (((r >> 7) & 1) << 3);
+}
+
+/* EN 300 472 data units, aligned to the start of each packet's payload. Only
+ * display rows 1-23 of teletext (0x02) and teletext subtitle (0x03) units count,
+ * stuffing units and page headers on their own are an empty service.
+ */
+static void _teletext_units(struct caption_pid_s *c, const uint8_t *p, int len)
+{
+	while (len >= 2) {
+		int id = p[0];
+		int size = p[1];
+		if (2 + size > len)
+			break;
+
+		if ((id == 0x02 || id == 0x03) && size >= 4) {
+			/* field/line, framing code, then the magazine and packet address */
+			int packet = (_hamming84(p[4]) >> 3) | (_hamming84(p[5]) << 1);
+			if (packet >= 1 && packet <= 23)
+				c->ccBytes += 40;
+		}
+
+		p += 2 + size;
+		len -= 2 + size;
+	}
+}
+
+/* EN 300 743 segments, which run across packets. Page and region compositions
+ * and display definitions are sent whether anything is on screen or not, object
+ * data is an actual subtitle.
+ */
+static void _dvb_subtitle_segments(struct caption_pid_s *c, const uint8_t *p, int len)
+{
+	while (len > 0 && !c->segSkip) {
+		if (c->segRemaining) {
+			int n = len < c->segRemaining ? len : c->segRemaining;
+			if (c->segContent)
+				c->ccBytes += n;
+			c->segRemaining -= n;
+			p += n;
+			len -= n;
+			continue;
+		}
+
+		if (c->segHeaderLength == 0 && p[0] != 0x0f) {
+			c->segSkip = 1; /* end_of_PES_data_field_marker, or stuffing */
+			break;
+		}
+		c->segHeader[c->segHeaderLength++] = *p++;
+		len--;
+		if (c->segHeaderLength == sizeof(c->segHeader)) {
+			c->segContent = c->segHeader[1] == 0x13; /* object_data_segment */
+			c->segRemaining = (c->segHeader[4] << 8) | c->segHeader[5];
+			c->segHeaderLength = 0;
+		}
+	}
+}
+
+/* Called on the stats thread for every TS stream. */
+void nic_monitor_caption_write(struct discovered_item_s *di, const uint8_t *pkts, uint32_t pktCount)
+{
+	if (di->captionCount == 0)
+		return;
+
+	pthread_mutex_lock(&di->captionLock);
+	for (uint32_t j = 0; j < pktCount; j++) {
+		const uint8_t *pkt = pkts + (j * 188);
+		uint16_t pid = ltntstools_pid(pkt);
+
+		struct caption_pid_s *c = NULL;
+		for (int i = 0; i < di->captionCount; i++) {
+			if (di->caption[i].pid == pid) {
+				c = &di->caption[i];
+				break;
+			}
+		}
+		if (!c || !(pkt[3] & 0x10))
+			continue;
+
+		int offset = 4;
+		if (pkt[3] & 0x20)
+			offset += 1 + pkt[4];
+		if (offset >= 188)
+			continue;
+
+		const uint8_t *payload = pkt + offset;
+		int len = 188 - offset;
+		int pusi = ltntstools_payload_unit_start_indicator(pkt);
+
+		if (c->streamType == 0x06) {
+			if (pusi) {
+				c->segSkip = 0;
+				c->segHeaderLength = 0;
+				c->segRemaining = 0;
+				int start = _private_pes(c, payload, len);
+				if (start < 0) {
+					c->segSkip = 1;
+					continue;
+				}
+				payload += start;
+				len -= start;
+			}
+			if (c->kind == CAPTION_KIND_TELETEXT)
+				_teletext_units(c, payload, len);
+			else
+			if (c->kind == CAPTION_KIND_DVB_SUBTITLE)
+				_dvb_subtitle_segments(c, payload, len);
+			continue;
+		}
+
+		if (pusi) {
+			if (c->scanPackets)
+				_scan_access_unit(c); /* Short PES, scan what we had */
+			c->scanLength = 0;
+			c->scanPackets = 0;
+
+			/* Skip the PES header. */
+			if (len < 9 || payload[0] != 0x00 || payload[1] != 0x00 || payload[2] != 0x01)
+				continue;
+			int hdr = 9 + payload[8];
+			if (hdr >= len)
+				continue;
+			payload += hdr;
+			len -= hdr;
+		} else
+		if (c->scanPackets == 0) {
+			continue; /* Not collecting, the rest of the PES */
+		}
+
+		memcpy(c->scan + c->scanLength, payload, len);
+		c->scanLength += len;
+		if (++c->scanPackets == CAPTION_SCAN_PACKETS) {
+			_scan_access_unit(c);
+			c->scanPackets = 0;
+			c->scanLength = 0;
+		}
+	}
+	pthread_mutex_unlock(&di->captionLock);
+}
+
+static const char *_kind_ascii(const struct caption_pid_s *c)
+{
+	switch (c->kind) {
+	case CAPTION_KIND_TELETEXT:     return "Teletext";
+	case CAPTION_KIND_DVB_SUBTITLE: return "DVB subtitles";
+	default:
+		return c->streamType == 0x06 ? "Private" : "CEA-608/708";
+	}
+}
+
+static int _services_sprintf(const struct caption_pid_s *c, char *dst, int lengthBytes)
+{
+	int n = 0;
+	dst[0] = 0;
+	for (int i = 0; i < 4 && n < lengthBytes; i++) {
+		if (c->cea608Channels & (1 << i))
+			n += snprintf(dst + n, lengthBytes - n, "%sCC%d", n ? " " : "", i + 1);
+	}
+	for (int i = 1; i < 64 && n < lengthBytes; i++) {
+		if (c->cea708Services & (1ULL << i))
+			n += snprintf(dst + n, lengthBytes - n, "%sS%d", n ? " " : "", i);
+	}
+	return n;
+}
+
+/* Rebuild the list of candidate pids if the stream model disagrees with it. */
+static void _refresh_pids(struct tool_context_s *ctx, struct discovered_item_s *di, time_t now)
+{
+	struct model_pid_s pids[CAPTION_MAX_PIDS];
+	int count = nic_monitor_model_pids(di, &di->captionModelCheck, now, CAPTION_MODEL_CHECK_SECS,
+		_is_caption_stream_type, &pids[0], CAPTION_MAX_PIDS);
+	if (count < 0)
+		return;
+
+	int changed = count != di->captionCount;
+	for (int i = 0; !changed && i < count; i++) {
+		if (pids[i].pid != di->caption[i].pid || pids[i].streamType != di->caption[i].streamType)
+			changed = 1;
+	}
+	if (!changed)
+		return;
+
+	pthread_mutex_lock(&di->captionLock);
+	memset(&di->caption[0], 0, sizeof(di->caption));
+	for (int i = 0; i < count; i++) {
+		di->caption[i].pid = pids[i].pid;
+		di->caption[i].streamType = pids[i].streamType;
+	}
+	di->captionCount = count;
+	pthread_mutex_unlock(&di->captionLock);
+}
+
+/* Once per second: byte rates, and captions going missing or coming back. */
+static void _update_presence(struct tool_context_s *ctx, struct discovered_item_s *di, time_t now)
+{
+	char msg[160];
+
+	pthread_mutex_lock(&di->captionLock);
+	for (int i = 0; i < di->captionCount; i++) {
+		struct caption_pid_s *c = &di->caption[i];
+
+		if (c->lastRateTime) {
+			time_t elapsed = now - c->lastRateTime;
+			if (elapsed > 0)
+				c->byteRate = (c->ccBytes - c->lastRateBytes) / elapsed;
+		}
+		c->lastRateTime = now;
+		if (c->ccBytes != c->lastRateBytes)
+			c->lastSeen = now;
+		c->lastRateBytes = c->ccBytes;
+
+		if (c->lastSeen == 0)
+			continue; /* Never carried captions, nothing to lose */
+
+		int present = c->lastSeen + ctx->captionMonitor.lossSecs > now;
+		if (present == c->present)
+			continue;
+		c->present = present;
+
+		if (present) {
+			char services[96];
+			_services_sprintf(c, &services[0], sizeof(services));
+			sprintf(msg, "%s present on pid 0x%04x %s", _kind_ascii(c), c->pid, services);
+		} else {
+			c->losses++;
+			ctx->captionMonitor.losses++;
+			sprintf(msg, "%s missing on pid 0x%04x for %ds", _kind_ascii(c), c->pid, ctx->captionMonitor.lossSecs);
+		}
+		display_doc_append_with_time(&di->doc_stream_log, msg, NULL);
+	}
+	pthread_mutex_unlock(&di->captionLock);
+}
+
+void nic_monitor_caption_service(struct tool_context_s *ctx)
+{
+	if (ctx->captionMonitor.lossSecs <= 0)
+		return;
+
+	time_t now = time(NULL);
+	if (ctx->captionMonitor.lastService == now)
+		return;
+	ctx->captionMonitor.lastService = now;
+
+	struct discovered_item_s *e = NULL;
+
+	pthread_mutex_lock(&ctx->lock);
+	xorg_list_for_each_entry(e, &ctx->list, list) {
+		_refresh_pids(ctx, e, now);
+		_update_presence(ctx, e, now);
+	}
+	pthread_mutex_unlock(&ctx->lock);
+}
+
+void nic_monitor_caption_reset(struct discovered_item_s *di)
+{
+	pthread_mutex_lock(&di->captionLock);
+	for (int i = 0; i < di->captionCount; i++) {
+		struct caption_pid_s *c = &di->caption[i];
+		c->cea608Channels = 0;
+		c->cea708Services = 0;
+		c->losses = 0;
+	}
+	pthread_mutex_unlock(&di->captionLock);
+}
+
+void nic_monitor_caption_dprintf(struct discovered_item_s *di, int fd)
+{
+	pthread_mutex_lock(&di->captionLock);
+	for (int i = 0; i < di->captionCount; i++) {
+		struct caption_pid_s *c = &di->caption[i];
+		if (c->lastSeen == 0) {
+			if (c->streamType != 0x06)
+				dprintf(fd, "Captions pid 0x%04x: none seen\n", c->pid);
+			continue;
+		}
+
+		char services[96];
+		_services_sprintf(c, &services[0], sizeof(services));
+		dprintf(fd, "%s pid 0x%04x: %s, %" PRIu64 " B/s%s%s (%" PRIu64 " bytes, %" PRIu64 " losses)\n",
+			_kind_ascii(c), c->pid,
+			c->present ? "present" : "MISSING",
+			c->byteRate,
+			services[0] ? ", " : "", services,
+			c->ccBytes, c->losses);
+	}
+	pthread_mutex_unlock(&di->captionLock);
+}
+
+void nic_monitor_caption_json(struct discovered_item_s *di, json_object *feed)
+{
+	json_object *array = json_object_new_array();
+
+	pthread_mutex_lock(&di->captionLock);
+	for (int i = 0; i < di->captionCount; i++) {
+		struct caption_pid_s *c = &di->caption[i];
+		if (c->streamType == 0x06 && c->kind == CAPTION_KIND_NONE)
+			continue; /* Private data of some other kind */
+
+		json_object *item = json_object_new_object();
+		json_object_object_add(item, "pid", json_object_new_int(c->pid));
+		json_object_object_add(item, "type", json_object_new_string(_kind_ascii(c)));
+		json_object_object_add(item, "present", json_object_new_boolean(c->present));
+		json_object_object_add(item, "bytes_per_second", json_object_new_int64(c->byteRate));
+		json_object_object_add(item, "bytes", json_object_new_int64(c->ccBytes));
+		json_object_object_add(item, "losses", json_object_new_int64(c->losses));
+		json_object_object_add(item, "last_seen", json_object_new_int64(c->lastSeen));
+
+		json_object *services = json_object_new_array();
+		for (int j = 0; j < 4; j++) {
+			if (c->cea608Channels & (1 << j)) {
+				char s[8];
+				sprintf(s, "CC%d", j + 1);
+				json_object_array_add(services, json_object_new_string(s));
+			}
+		}
+		for (int j = 1; j < 64; j++) {
+			if (c->cea708Services & (1ULL << j)) {
+				char s[8];
+				sprintf(s, "S%d", j);
+				json_object_array_add(services, json_object_new_string(s));
+			}
+		}
+		json_object_object_add(item, "services", services);
+		json_object_array_add(array, item);
+	}
+	pthread_mutex_unlock(&di->captionLock);
+
+	json_object_object_add(feed, "captions", array);
+}
+
+int nic_monitor_caption_sprintf(struct tool_context_s *ctx, char *dst, int lengthBytes)
+{
+	if (ctx->captionMonitor.lossSecs <= 0)
+		return snprintf(dst, lengthBytes, "Caption monitor: disabled");
+
+	return snprintf(dst, lengthBytes, "Caption monitor: missing after %ds, %" PRIu64 " caption losses",
+		ctx->captionMonitor.lossSecs, ctx->captionMonitor.losses);
+}
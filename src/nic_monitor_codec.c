@@ -0,0 +1,281 @@
+#include "nic_monitor.h"
+
+/* Sampled codec metadata.
+ * Each stream's model tells us which pids carry H.264 or H.265 video, so every
+ * stream gets a metadata parser on its own video pid(s), no global pid.
+ *
+ * Parsing every packet for parameter sets that change once in a blue moon is
+ * wasteful. Instead, every sample interval we arm a parser on each video pid,
+ * skip everything until a PUSI packet carrying an SPS turns up, feed that one
+ * PES through to the next PUSI, record the results and free the parser again.
+ * Between samples a video pid costs a pid comparison per packet.
+ *
+ * The pid set is refreshed from the stream model on the stats thread, the
+ * same thread that feeds the parsers. The UI reads results under codecLock.
+ */
+
+static int _is_codec_stream_type(uint8_t streamType)
+{
+	return streamType == 0x1b /* H.264 */ || streamType == 0x24 /* H.265 */;
+}
+
+/* Does this PUSI packet carry an SPS? Encoders emit AUD, VPS, SPS, PPS ahead of
+ * the IDR slices, so they land in the first packet of the PES.
+ */
+static int _carries_sps(const uint8_t *pkt, uint8_t streamType)
+{
+	if (!(pkt[3] & 0x10))
+		return 0; /* No payload */
+
+	int offset = 4;
+	if (pkt[3] & 0x20)
+		offset += 1 + pkt[4];
+
+	for (int i = offset; i + 3 < 188; i++) {
+		if (pkt[i] != 0x00 || pkt[i + 1] != 0x00 || pkt[i + 2] != 0x01)
+			continue;
+
+		uint8_t b = pkt[i + 3];
+		if (streamType == 0x1b && (b & 0x1f) == 7)
+			return 1;
+		if (streamType == 0x24 && ((b >> 1) & 0x3f) == 33)
+			return 1;
+	}
+
+	return 0;
+}
+
+static void _parser_free(struct codec_metadata_s *c)
+{
+	if (!c->parser)
+		return;
+
+	if (c->streamType == 0x1b)
+		ltntstools_h264_codec_metadata_free(c->parser);
+	else
+		ltntstools_h265_codec_metadata_free(c->parser);
+	c->parser = NULL;
+}
+
+static int _parser_alloc(struct codec_metadata_s *c)
+{
+	if (c->streamType == 0x1b)
+		return ltntstools_h264_codec_metadata_alloc(&c->parser, c->pid, 0xe0);
+
+	return ltntstools_h265_codec_metadata_alloc(&c->parser, c->pid, 0xe0);
+}
+
+/* Feed a single packet, returns 1 when the parser has everything it needs. */
+static int _parser_write(struct tool_context_s *ctx, struct codec_metadata_s *c, const uint8_t *pkt)
+{
+	int complete = 0;
+
+	c->packetsParsed++;
+	ctx->codecMetadata.packetsParsed++;
+	if (c->streamType == 0x1b) {
+		ltntstools_h264_codec_metadata_write(c->parser, pkt, 1, &complete);
+		if (complete) {
+			struct h264_codec_metadata_results_s r;
+			if (ltntstools_h264_codec_metadata_query(c->parser, &r) == 0) {
+				strcpy(&c->colorspace[0], &r.sps.video_colorspace_ascii[0]);
+				strcpy(&c->format[0], &r.sps.video_format_ascii[0]);
+			}
+		}
+	} else {
+		ltntstools_h265_codec_metadata_write(c->parser, pkt, 1, &complete);
+		if (complete) {
+			struct h265_codec_metadata_results_s r;
+			if (ltntstools_h265_codec_metadata_query(c->parser, &r) == 0) {
+				strcpy(&c->colorspace[0], &r.video_colorspace_ascii[0]);
+				strcpy(&c->format[0], &r.video_format_ascii[0]);
+			}
+		}
+	}
+
+	return complete;
+}
+
+static void _sample_complete(struct tool_context_s *ctx, struct codec_metadata_s *c, time_t now)
+{
+	_parser_free(c);
+	c->state = CODEC_STATE_IDLE;
+	c->lastSample = now;
+	c->nextSample = now + ctx->codecMetadata.sampleSecs;
+	c->samples++;
+	ctx->codecMetadata.samples++;
+}
+
+/* Called on the stats thread, only for streams holding a deep inspection slot. */
+void nic_monitor_codec_write(struct discovered_item_s *di, const uint8_t *pkts, uint32_t pktCount)
+{
+	struct tool_context_s *ctx = di->ctx;
+
+	if (di->codecCount == 0)
+		return;
+
+	time_t now = time(NULL);
+
+	pthread_mutex_lock(&di->codecLock);
+	for (int i = 0; i < di->codecCount; i++) {
+		struct codec_metadata_s *c = &di->codec[i];
+
+		if (c->state == CODEC_STATE_IDLE) {
+			if (now < c->nextSample)
+				continue;
+			if (_parser_alloc(c) < 0) {
+				c->nextSample = now + ctx->codecMetadata.sampleSecs;
+				continue;
+			}
+			c->state = CODEC_STATE_ARMED;
+		}
+
+		for (uint32_t j = 0; j < pktCount && c->state != CODEC_STATE_IDLE; j++) {
+			const uint8_t *pkt = pkts + (j * 188);
+			if (ltntstools_pid(pkt) != c->pid)
+				continue;
+
+			int pusi = ltntstools_payload_unit_start_indicator(pkt);
+
+			if (c->state == CODEC_STATE_CAPTURING && pusi) {
+				/* The next PES terminates the one we captured, the parser emits it. */
+				if (_parser_write(ctx, c, pkt)) {
+					_sample_complete(ctx, c, now);
+					break;
+				}
+				c->state = CODEC_STATE_ARMED;
+				continue;
+			}
+
+			if (c->state == CODEC_STATE_ARMED) {
+				if (!pusi || !_carries_sps(pkt, c->streamType))
+					continue;
+				c->state = CODEC_STATE_CAPTURING;
+			}
+
+			if (_parser_write(ctx, c, pkt)) {
+				_sample_complete(ctx, c, now);
+			}
+		}
+	}
+	pthread_mutex_unlock(&di->codecLock);
+}
+
+/* Rebuild the list of video pids if the stream model disagrees with it. */
+static void _refresh_pids(struct tool_context_s *ctx, struct discovered_item_s *di, time_t now)
+{
+	struct model_pid_s pids[CODEC_MAX_PIDS];
+	int count = nic_monitor_model_pids(di, &di->codecModelCheck, now, ctx->codecMetadata.sampleSecs,
+		_is_codec_stream_type, &pids[0], CODEC_MAX_PIDS);
+	if (count < 0)
+		return;
+
+	struct codec_metadata_s found[CODEC_MAX_PIDS];
+	for (int i = 0; i < count; i++) {
+		memset(&found[i], 0, sizeof(found[i]));
+		found[i].pid = pids[i].pid;
+		found[i].streamType = pids[i].streamType;
+		found[i].nextSample = now;
+	}
+
+	int changed = count != di->codecCount;
+	for (int i = 0; !changed && i < count; i++) {
+		if (found[i].pid != di->codec[i].pid || found[i].streamType != di->codec[i].streamType)
+			changed = 1;
+	}
+	if (!changed)
+		return;
+
+	pthread_mutex_lock(&di->codecLock);
+	for (int i = 0; i < di->codecCount; i++) {
+		_parser_free(&di->codec[i]);
+	}
+	memcpy(&di->codec[0], &found[0], count * sizeof(found[0]));
+	di->codecCount = count;
+	pthread_mutex_unlock(&di->codecLock);
+
+	/* Count slices on the streams own H.264 pid. */
+	pthread_mutex_lock(&di->h264_sliceLock);
+	if (di->h264_slices) {
+		for (int i = 0; i < count; i++) {
+			if (found[i].streamType != 0x1b)
+				continue;
+			if (h264_slice_counter_get_pid(di->h264_slices) != found[i].pid)
+				h264_slice_counter_reset_pid(di->h264_slices, found[i].pid);
+			break;
+		}
+	}
+	pthread_mutex_unlock(&di->h264_sliceLock);
+}
+
+void nic_monitor_codec_service(struct tool_context_s *ctx)
+{
+	if (ctx->codecMetadata.sampleSecs <= 0)
+		return;
+
+	time_t now = time(NULL);
+	if (ctx->codecMetadata.lastService == now)
+		return;
+	ctx->codecMetadata.lastService = now;
+
+	struct discovered_item_s *e = NULL;
+
+	pthread_mutex_lock(&ctx->lock);
+	xorg_list_for_each_entry(e, &ctx->list, list) {
+		_refresh_pids(ctx, e, now);
+	}
+	pthread_mutex_unlock(&ctx->lock);
+}
+
+int nic_monitor_codec_query(struct discovered_item_s *di, uint16_t pid, struct codec_metadata_s *result)
+{
+	int ret = -1;
+
+	pthread_mutex_lock(&di->codecLock);
+	for (int i = 0; i < di->codecCount; i++) {
+		if (di->codec[i].pid == pid && di->codec[i].lastSample) {
+			*result = di->codec[i];
+			result->parser = NULL;
+			ret = 0;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&di->codecLock);
+
+	return ret;
+}
+
+void nic_monitor_codec_free(struct discovered_item_s *di)
+{
+	pthread_mutex_lock(&di->codecLock);
+	for (int i = 0; i < di->codecCount; i++) {
+		_parser_free(&di->codec[i]);
+	}
+	di->codecCount = 0;
+	pthread_mutex_unlock(&di->codecLock);
+}
+
+void nic_monitor_codec_dprintf(struct discovered_item_s *di, int fd)
+{
+	pthread_mutex_lock(&di->codecLock);
+	for (int i = 0; i < di->codecCount; i++) {
+		struct codec_metadata_s *c = &di->codec[i];
+		if (c->lastSample == 0)
+			continue;
+		dprintf(fd, "%s pid 0x%04x: %s, %s (%" PRIu64 " samples, %" PRIu64 " packets parsed)\n",
+			c->streamType == 0x1b ? "H.264" : "H.265", c->pid,
+			c->format, c->colorspace,
+			c->samples, c->packetsParsed);
+	}
+	pthread_mutex_unlock(&di->codecLock);
+}
+
+int nic_monitor_codec_sprintf(struct tool_context_s *ctx, char *dst, int lengthBytes)
+{
+	if (ctx->codecMetadata.sampleSecs <= 0)
+		return snprintf(dst, lengthBytes, "Codec metadata: disabled");
+
+	return snprintf(dst, lengthBytes, "Codec metadata: sampled every %ds, %" PRIu64 " samples from %" PRIu64 " parsed packets",
+		ctx->codecMetadata.sampleSecs,
+		ctx->codecMetadata.samples,
+		ctx->codecMetadata.packetsParsed);
+}
@@ -0,0 +1,175 @@
+#include "nic_monitor.h"
+
+/* Deep inspection scheduler.
+ * The cheap per stream counters (pid stats, CC, IAT, bitrate) always run, as
+ * does TR101290, whose timers would raise false alarms on a stream it stopped seeing.
+ * The expensive analyzers (streammodel PSI parsing, codec metadata,
+ * slice and frame statistics, the LTN SEI probe) only run while a stream holds
+ * one of a fixed number of deep inspection slots. Slots are rotated across all
+ * streams once per second, each grant lasts for the dwell time, so the CPU spent
+ * on deep analysis is bounded by the slot count, not the stream count.
+ *
+ * Candidates are ranked by how long it's been since they were last inspected.
+ * Streams never inspected go first, streams that picked up CC errors since
+ * their last turn get a boost, and the operators selected stream holds its
+ * slot for as long as it's selected.
+ *
+ * A slot count of zero (the default) disables the scheduler, every stream
+ * runs every analyzer all the time.
+ *
+ * The scheduler runs on the stats thread, the same thread that feeds the IO
+ * analyzers. The pcap thread only reads di->deepActive.
+ */
+
+#define DEEP_ERROR_BOOST_SECS 60
+
+static int _is_focused(struct discovered_item_s *di)
+{
+	return discovered_item_state_get(di, DI_STATE_SELECTED) ? 1 : 0;
+}
+
+static int _is_eligible(struct discovered_item_s *di, time_t now)
+{
+	if (discovered_item_state_get(di, DI_STATE_HIDDEN))
+		return 0;
+	if (di->lastUpdated + 5 < now)
+		return 0; /* Not streaming */
+
+	return 1;
+}
+
+/* Higher is more deserving of a slot. */
+static int64_t _score(struct discovered_item_s *di, time_t now)
+{
+	if (_is_focused(di))
+		return INT64_MAX;
+	if (di->deepLastTime == 0)
+		return INT64_MAX - 1 - (now - di->firstSeen); /* Never inspected, oldest first */
+
+	int64_t score = now - di->deepLastTime;
+	if (di->stats && di->stats->ccErrors != di->deepCCErrors)
+		score += DEEP_ERROR_BOOST_SECS;
+
+	return score;
+}
+
+static void _grant(struct tool_context_s *ctx, struct discovered_item_s *di, time_t now)
+{
+	/* The analyzers missed everything since the last slot, tell the ones that care. */
+	pthread_mutex_lock(&di->frameStatsLock);
+	if (di->frameStats) {
+		video_frame_stats_discontinuity(di->frameStats);
+	}
+	pthread_mutex_unlock(&di->frameStatsLock);
+
+	if (_is_focused(di))
+		ctx->deepScheduler.focusGrants++;
+	else
+	if (di->deepLastTime && di->stats && di->stats->ccErrors != di->deepCCErrors)
+		ctx->deepScheduler.errorGrants++;
+
+	if (di->deepLastTime && (now - di->deepLastTime) > ctx->deepScheduler.longestWait)
+		ctx->deepScheduler.longestWait = now - di->deepLastTime;
+
+	di->deepGrantedTime = now;
+	di->deepGrants++;
+	di->deepActive = 1;
+	ctx->deepScheduler.grants++;
+}
+
+static void _revoke(struct discovered_item_s *di, time_t now)
+{
+	di->deepActive = 0;
+
+	/* Nothing feeds a half captured audio sample until the next grant. */
+	nic_monitor_audio_release_buffers(di);
+	di->deepLastTime = now;
+	if (di->stats)
+		di->deepCCErrors = di->stats->ccErrors;
+}
+
+void nic_monitor_deep_service(struct tool_context_s *ctx)
+{
+	if (ctx->deepScheduler.slots <= 0)
+		return;
+
+	time_t now = time(NULL);
+	if (ctx->deepScheduler.lastService == now)
+		return;
+	ctx->deepScheduler.lastService = now;
+
+	struct discovered_item_s *e = NULL;
+	int active = 0;
+	int eligible = 0;
+
+	pthread_mutex_lock(&ctx->lock);
+
+	xorg_list_for_each_entry(e, &ctx->list, list) {
+		if (_is_eligible(e, now))
+			eligible++;
+	}
+
+	/* When every stream fits in a slot there's nothing to rotate. */
+	int rotate = eligible > ctx->deepScheduler.slots;
+
+	/* 1. Expire slots that have had their turn, or whose stream has gone away. */
+	e = NULL;
+	xorg_list_for_each_entry(e, &ctx->list, list) {
+		if (!e->deepActive)
+			continue;
+
+		int expired = rotate && !_is_focused(e) && e->deepGrantedTime + ctx->deepScheduler.dwellSecs <= now;
+		if (!_is_eligible(e, now) || expired) {
+			_revoke(e, now);
+		} else {
+			active++;
+		}
+	}
+
+	/* 2. Fill the free slots with the most deserving streams. */
+	while (active < ctx->deepScheduler.slots) {
+		struct discovered_item_s *best = NULL;
+		int64_t bestScore = -1;
+
+		e = NULL;
+		xorg_list_for_each_entry(e, &ctx->list, list) {
+			if (e->deepActive || !_is_eligible(e, now))
+				continue;
+			int64_t score = _score(e, now);
+			if (score > bestScore) {
+				bestScore = score;
+				best = e;
+			}
+		}
+		if (!best)
+			break;
+
+		_grant(ctx, best, now);
+		active++;
+	}
+
+	ctx->deepScheduler.activeCount = active;
+	ctx->deepScheduler.streamCount = eligible;
+
+	pthread_mutex_unlock(&ctx->lock);
+}
+
+int nic_monitor_deep_sprintf(struct tool_context_s *ctx, char *dst, int lengthBytes)
+{
+	int slots = ctx->deepScheduler.slots;
+	int streams = ctx->deepScheduler.streamCount;
+
+	/* Worst case time between visits when all slots rotate, ignoring boosts and focus. */
+	int cycleSecs = 0;
+	if (slots)
+		cycleSecs = ((streams + slots - 1) / slots) * ctx->deepScheduler.dwellSecs;
+
+	return snprintf(dst, lengthBytes, "Deep inspection: %d/%d slots, %d streams, dwell %ds, cycle ~%ds, grants %" PRIu64
+		" (errors %" PRIu64 " focus %" PRIu64 "), longest wait %ds",
+		ctx->deepScheduler.activeCount, slots, streams,
+		ctx->deepScheduler.dwellSecs, cycleSecs,
+		ctx->deepScheduler.grants,
+		ctx->deepScheduler.errorGrants,
+		ctx->deepScheduler.focusGrants,
+		(int)ctx->deepScheduler.longestWait);
+}
@@ -51,30 +51,46 @@ void discovered_item_free(struct discovered_item_s *di)
 
 	rtp_analyzer_free(&di->rtpAnalyzerCtx);
 
+	if (di->fec) {
+		pthread_mutex_lock(&di->fecLock);
+		smpte2022_fec_free(di->fec);
+		di->fec = NULL;
+		pthread_mutex_unlock(&di->fecLock);
+	}
+
+	/* Before the stream log goes, an open episode lands there */
+	nic_monitor_loss_close(di->ctx, di);
+
 	display_doc_free(&di->doc_stream_log);
 	
-	if (di->h264_metadata_parser) {
-		pthread_mutex_lock(&di->h264_metadataLock);
-		h264_slice_counter_free(di->h264_metadata_parser);
-		/* Intensional permanent. */
-	}
+	nic_monitor_codec_free(di);
+	nic_monitor_audio_free(di);
+	nic_monitor_microburst_free(di);
 	if (di->h264_slices) {
 		pthread_mutex_lock(&di->h264_sliceLock);
 		h264_slice_counter_free(di->h264_slices);
 		/* Intensional permanent. */
 	}
-	if (di->pcapRecorder) {
-		ltntstools_segmentwriter_free(di->pcapRecorder);
-		di->pcapRecorder = NULL;
+	if (di->frameStats) {
+		pthread_mutex_lock(&di->frameStatsLock);
+		video_frame_stats_free(di->frameStats);
+		/* Intensional permanent. */
 	}
+	nic_monitor_recording_free(di->ctx, di);
 
 	if (di->packetIntervals) {
 		ltn_histogram_free(di->packetIntervals);
 		di->packetIntervals = NULL;
 	}
 
-	throughput_hires_free(di->packetIntervalAverages);
-	throughput_hires_free(di->packetPayloadSizeBits);
+	if (di->packetIntervalAverages) {
+		throughput_hires_free(di->packetIntervalAverages);
+		di->packetIntervalAverages = NULL;
+	}
+	if (di->packetPayloadSizeBits) {
+		throughput_hires_free(di->packetPayloadSizeBits);
+		di->packetPayloadSizeBits = NULL;
+	}
 
 	if (di->streamModel) {
 		ltntstools_streammodel_free(di->streamModel);
@@ -89,6 +105,8 @@ void discovered_item_free(struct discovered_item_s *di)
 	ltntstools_pid_stats_free(di->stats);
 	ltntstools_pid_stats_free(di->statsToFileSummary);
 
+	nic_monitor_memory_release_all(di);
+
 #if KAFKA_REPORTER
 	kafka_free(di);
 #endif
@@ -96,7 +114,10 @@ void discovered_item_free(struct discovered_item_s *di)
 	free(di);
 }
 
-struct discovered_item_s *discovered_item_alloc(struct tool_context_s *ctx, struct ether_header *ethhdr, struct iphdr *iphdr, struct udphdr *udphdr, uint16_t hash)
+/* When reduced is set, the memory governor is under pressure and we only
+ * allocate the mandatory pid statistics, every optional analyzer is left NULL.
+ */
+struct discovered_item_s *discovered_item_alloc(struct tool_context_s *ctx, struct ether_header *ethhdr, struct iphdr *iphdr, struct udphdr *udphdr, uint16_t hash, int reduced)
 {
 	struct discovered_item_s *di = calloc(1, sizeof(*di));
 	if (di) {
@@ -110,6 +131,9 @@ struct discovered_item_s *discovered_item_alloc(struct tool_context_s *ctx, stru
 		memcpy(&di->udphdr, udphdr, sizeof(*udphdr));
 		pthread_mutex_init(&di->bitrateBucketLock, NULL);
 
+		/* With the scheduler enabled, the stream waits for its first slot. */
+		di->deepActive = ctx->deepScheduler.slots == 0;
+
 		struct in_addr dstaddr, srcaddr;
 #ifdef __linux__
 		srcaddr.s_addr = di->iphdr.saddr;
@@ -137,14 +161,24 @@ struct discovered_item_s *discovered_item_alloc(struct tool_context_s *ctx, stru
 			di->srcOriginRemoteHost = 1;
 		}
 
-		/* Each 16000ms histogram is ~ 256KB */
-		ltn_histogram_alloc_video_defaults(&di->packetIntervals, "IAT Intervals");
+		di->memReduced = reduced;
+
+		if (!reduced) {
+			/* Each 16000ms histogram is ~ 256KB */
+			ltn_histogram_alloc_video_defaults(&di->packetIntervals, "IAT Intervals");
+			if (di->packetIntervals)
+				nic_monitor_memory_charge(di, MEM_SUBSYSTEM_IAT_HISTOGRAM);
 
-		/* Sized for 210mbps. Each node (20k) needs 36 bytes, so a 720KB alloc on this */
-		throughput_hires_alloc(&di->packetIntervalAverages, 20000);
+			/* Sized for 210mbps. Each node (20k) needs 36 bytes, so a 720KB alloc on this */
+			throughput_hires_alloc(&di->packetIntervalAverages, 20000);
+			if (di->packetIntervalAverages)
+				nic_monitor_memory_charge(di, MEM_SUBSYSTEM_IAT_AVERAGES);
 
-		/* Sized for 210mbps. Each node (20k) needs 36 bytes, so a 720KB alloc on this */
-		throughput_hires_alloc(&di->packetPayloadSizeBits, 20000);
+			/* Sized for 210mbps. Each node (20k) needs 36 bytes, so a 720KB alloc on this */
+			throughput_hires_alloc(&di->packetPayloadSizeBits, 20000);
+			if (di->packetPayloadSizeBits)
+				nic_monitor_memory_charge(di, MEM_SUBSYSTEM_BITRATE_BUCKETS);
+		}
 
 		/* Each allocation  is approximately 3MB, plus an additional 2x256KB for each PCR PID.
 		 * So a single SPTS mux needs 3.5MB of RAM.
@@ -153,44 +187,74 @@ struct discovered_item_s *discovered_item_alloc(struct tool_context_s *ctx, stru
 		 */
 		ltntstools_pid_stats_alloc(&di->stats);
 		ltntstools_pid_stats_alloc(&di->statsToFileSummary);
+		nic_monitor_memory_charge(di, MEM_SUBSYSTEM_PID_STATS);
 
-		/* Stream Model */
-		if (ltntstools_streammodel_alloc(&di->streamModel, di) < 0) {
-			fprintf(stderr, "\nUnable to allocate streammodel object, it's safe to continue.\n\n");
-		}
+		if (!reduced) {
+			/* Stream Model */
+			if (ltntstools_streammodel_alloc(&di->streamModel, di) < 0) {
+				fprintf(stderr, "\nUnable to allocate streammodel object, it's safe to continue.\n\n");
+			} else {
+				nic_monitor_memory_charge(di, MEM_SUBSYSTEM_STREAMMODEL);
+			}
 
-		/* LTN Latency Estimator Probe - we'll only use this if we detect the LTN encoder */
-		if (ltntstools_probe_ltnencoder_alloc(&di->LTNLatencyProbe) < 0) {
-			fprintf(stderr, "\nUnable to allocate ltn encoder latency probe, it's safe to continue.\n\n");
+			/* LTN Latency Estimator Probe - we'll only use this if we detect the LTN encoder */
+			if (ltntstools_probe_ltnencoder_alloc(&di->LTNLatencyProbe) < 0) {
+				fprintf(stderr, "\nUnable to allocate ltn encoder latency probe, it's safe to continue.\n\n");
+			} else {
+				nic_monitor_memory_charge(di, MEM_SUBSYSTEM_LTN_PROBE);
+			}
 		}
 
 		pthread_mutex_init(&di->h264_sliceLock, NULL);
 
-		if (ctx->gatherH264Metadata && ctx->gatherH264MetadataPID) {
+		if (ctx->gatherH264Metadata && !reduced) {
 			/* Keeping this user opt in for the time being, I get random segfaults. */
-			/* TODO: dynamically figure out the PID. */
-			/* 0x2000 by default, count all slices across all video pids. */
+			/* Starts on the requested pid (0x2000, all video pids), the codec service
+			 * moves it to the streams own H.264 pid once the stream model has one.
+			 */
 			di->h264_slices = h264_slice_counter_alloc(ctx->gatherH264MetadataPID);
+			if (di->h264_slices)
+				nic_monitor_memory_charge(di, MEM_SUBSYSTEM_H264);
 		}
 
-		pthread_mutex_init(&di->h264_metadataLock, NULL);
+		pthread_mutex_init(&di->frameStatsLock, NULL);
 
-		if (ctx->gatherH264Metadata && ctx->gatherH264MetadataPID) {
-			if (ltntstools_h264_codec_metadata_alloc(&di->h264_metadata_parser, ctx->gatherH264MetadataPID, 0xe0) < 0) {
-				fprintf(stderr, "\nUnable to allocate h264 metadata parser, it's safe to continue.\n\n");
+		if (ctx->videoFrameStats && !reduced) {
+			if (video_frame_stats_alloc(&di->frameStats) < 0) {
+				fprintf(stderr, "\nUnable to allocate video frame stats, it's safe to continue.\n\n");
+			} else {
+				nic_monitor_memory_charge(di, MEM_SUBSYSTEM_FRAME_STATS);
 			}
 		}
 
-		pthread_mutex_init(&di->h265_metadataLock, NULL);
+		/* Parsers come and go with each sample, see nic_monitor_codec.c */
+		pthread_mutex_init(&di->codecLock, NULL);
 
-		display_doc_initialize(&di->doc_stream_log);
-		display_doc_append_with_time(&di->doc_stream_log, "Logging begins", NULL);
+		nic_monitor_loss_init(di);
+		nic_monitor_memory_charge(di, MEM_SUBSYSTEM_LOSS);
 
-#if 0
-		if (ltntstools_h265_codec_metadata_alloc(&di->h265_metadata_parser, 0x31, 0xe0) < 0) {
-			fprintf(stderr, "\nUnable to allocate h265 metadata parser, it's safe to continue.\n\n");
+		/* Candidate pids come from the stream model, see nic_monitor_caption.c */
+		pthread_mutex_init(&di->captionLock, NULL);
+		nic_monitor_memory_charge(di, MEM_SUBSYSTEM_CAPTIONS);
+
+		/* Filled from the sock_diag snapshot, see nic_monitor_sockdiag.c */
+		pthread_mutex_init(&di->receiverLock, NULL);
+
+		/* Decoding happens on the audio worker pool, see nic_monitor_audio.c */
+		if (nic_monitor_audio_alloc(di) < 0) {
+			fprintf(stderr, "\nUnable to allocate audio monitor, it's safe to continue.\n\n");
 		}
-#endif
+
+		/* Fed from the deferred queue with capture timestamps, see nic_monitor_microburst.c */
+		if (nic_monitor_microburst_alloc(di) < 0) {
+			fprintf(stderr, "\nUnable to allocate microburst detector, it's safe to continue.\n\n");
+		}
+
+		/* The FEC engine itself waits for a FEC flow, see pcap_update_statistics() */
+		pthread_mutex_init(&di->fecLock, NULL);
+
+		display_doc_initialize(&di->doc_stream_log);
+		display_doc_append_with_time(&di->doc_stream_log, "Logging begins", NULL);
 
 #if 0
 		if (nic_monitor_tr101290_alloc(di) < 0) {
@@ -341,26 +405,12 @@ static void discovered_item_insert(struct tool_context_s *ctx, struct discovered
      stats-thread       35%      5%
 */
 
-struct discovered_item_s *discovered_item_findcreate(struct tool_context_s *ctx,
-	struct ether_header *ethhdr, struct iphdr *iphdr, struct udphdr *udphdr)
+/* With the hash, lookup the di objects in the cachelist. Called with ctx->lock held. */
+static struct discovered_item_s *_discovered_item_lookup(struct tool_context_s *ctx, uint16_t hash,
+	struct iphdr *iphdr, struct udphdr *udphdr)
 {
 	struct discovered_item_s *found = NULL;
 
-	/* Compute the src/dst ip/udp address/ports hash for faster lookup */
-	uint16_t hash = _compute_stream_hash(iphdr, udphdr);
-
-	if (ctx->verbose > 2) {
-		char *str = network_stream_ascii(iphdr, udphdr);
-		printf("cache srch on %s\n", str);
-		free(str);
-		if (ctx->verbose > 3) {
-			hash_index_print(ctx->hashIndex, hash);
-		}
-	}
-
-	pthread_mutex_lock(&ctx->lock);
-
-	/* With the hash, lookup the di objects in the cachelist. */
 	if (hash_index_get_count(ctx->hashIndex, hash) >= 1) {
 		/* One or more items in the cache for the same hash,
 		 * we have to enum and locate our exact item.
@@ -382,12 +432,105 @@ struct discovered_item_s *discovered_item_findcreate(struct tool_context_s *ctx,
 		}
 	}
 
+	return found;
+}
+
+struct discovered_item_s *discovered_item_find(struct tool_context_s *ctx, struct iphdr *iphdr, struct udphdr *udphdr)
+{
+	uint16_t hash = _compute_stream_hash(iphdr, udphdr);
+
+	pthread_mutex_lock(&ctx->lock);
+	struct discovered_item_s *found = _discovered_item_lookup(ctx, hash, iphdr, udphdr);
+	pthread_mutex_unlock(&ctx->lock);
+
+	return found;
+}
+
+/* SMPTE 2022-1 sends column FEC to the media port + 2 and row FEC to port + 4, same
+ * addresses, but not necessarily from the same source port as the media.
+ * Returns the RTP stream the FEC flow described by iphdr/udphdr protects, or NULL.
+ * self is set to the flows own item, if it has one, from the same lookup. A flow
+ * that's already a TS stream isn't FEC, no media is returned for it.
+ */
+struct discovered_item_s *discovered_item_find_fec_media(struct tool_context_s *ctx, struct iphdr *iphdr, struct udphdr *udphdr,
+	struct discovered_item_s **self)
+{
+	struct discovered_item_s *found = NULL;
+	uint16_t dport = ntohs(udphdr->uh_dport);
+
+	pthread_mutex_lock(&ctx->lock);
+	*self = _discovered_item_lookup(ctx, _compute_stream_hash(iphdr, udphdr), iphdr, udphdr);
+	if (*self && ((*self)->payloadType == PAYLOAD_RTP_TS || (*self)->payloadType == PAYLOAD_UDP_TS)) {
+		pthread_mutex_unlock(&ctx->lock);
+		return NULL;
+	}
+
+	for (int offset = 2; offset <= 4 && !found && dport > offset; offset += 2) {
+		struct udphdr media = *udphdr;
+		media.uh_dport = htons(dport - offset);
+
+		uint16_t hash = _compute_stream_hash(iphdr, &media);
+		struct discovered_item_s *item = NULL;
+		int enumerator = 0;
+		while (hash_index_get_enum(ctx->hashIndex, hash, &enumerator, (void **)&item) == 0) {
+			if (item == NULL || item == (void *)0xdead || item->payloadType != PAYLOAD_RTP_TS)
+				continue;
+
+			media.uh_sport = item->udphdr.uh_sport;
+			if (network_addr_compare(iphdr, &media, &item->iphdr, &item->udphdr) == 1) {
+				found = item;
+				break;
+			}
+		}
+	}
+	pthread_mutex_unlock(&ctx->lock);
+
+	return found;
+}
+
+/* Take a FEC flow that was discovered before its media flow out of the lookup, its packets
+ * belong to the media streams FEC engine from now on. Housekeeping frees it, on the stats
+ * thread, which is the only other thread that could be holding it.
+ * Called on the pcap thread.
+ */
+void discovered_item_fec_retire(struct tool_context_s *ctx, struct discovered_item_s *di)
+{
+	pthread_mutex_lock(&ctx->lock);
+	if (!di->fecRetired) {
+		hash_index_remove(ctx->hashIndex, di->cacheHashKey, di);
+		discovered_item_state_set(di, DI_STATE_HIDDEN);
+		di->fecRetired = 1;
+	}
+	pthread_mutex_unlock(&ctx->lock);
+}
+
+struct discovered_item_s *discovered_item_findcreate(struct tool_context_s *ctx,
+	struct ether_header *ethhdr, struct iphdr *iphdr, struct udphdr *udphdr)
+{
+	struct discovered_item_s *found = NULL;
+
+	/* Compute the src/dst ip/udp address/ports hash for faster lookup */
+	uint16_t hash = _compute_stream_hash(iphdr, udphdr);
+
+	if (ctx->verbose > 2) {
+		char *str = network_stream_ascii(iphdr, udphdr);
+		ASYNC_LOG_RATE(1000, "cache srch on %s\n", str);
+		free(str);
+		if (ctx->verbose > 3) {
+			hash_index_print(ctx->hashIndex, hash);
+		}
+	}
+
+	pthread_mutex_lock(&ctx->lock);
+
+	found = _discovered_item_lookup(ctx, hash, iphdr, udphdr);
+
 	if (!found) {
 		ctx->cacheMiss++;
 
 		if (ctx->verbose > 3) {
 			char *str = network_stream_ascii(iphdr, udphdr);
-			printf("cache miss on %s\n", str);
+			ASYNC_LOG_RATE(1000, "cache miss on %s\n", str);
 			free(str);
 		}
 
@@ -396,7 +539,7 @@ struct discovered_item_s *discovered_item_findcreate(struct tool_context_s *ctx,
 
 		if (ctx->verbose > 3) {
 			char *str = network_stream_ascii(iphdr, udphdr);
-			printf("cache  hit on %s\n", str);
+			ASYNC_LOG_RATE(1000, "cache  hit on %s\n", str);
 			free(str);
 		}
 
@@ -422,9 +565,18 @@ struct discovered_item_s *discovered_item_findcreate(struct tool_context_s *ctx,
 	}
 #endif
 
+	enum nic_monitor_mem_admit_e admit = MEM_ADMIT_FULL;
 	if (!found) {
-		found = discovered_item_alloc(ctx, ethhdr, iphdr, udphdr, hash);
+		admit = nic_monitor_memory_admit(ctx);
+	}
+
+	if (!found && admit != MEM_ADMIT_REFUSE) {
+		found = discovered_item_alloc(ctx, ethhdr, iphdr, udphdr, hash, admit == MEM_ADMIT_REDUCED);
 		if (found) {
+			if (admit == MEM_ADMIT_REDUCED) {
+				display_doc_append_with_time(&found->doc_stream_log, "Memory budget reached, stream admitted with pid statistics only", NULL);
+			}
+
 			discovered_item_insert(ctx, found);
 			hash_index_add(ctx->hashIndex, hash, found);
 
@@ -500,7 +652,12 @@ void discovered_item_json_summary(struct tool_context_s *ctx, struct discovered_
 
 	/* IATs - Min/MAX?AVG stats for the last 1 second. */
 	int64_t iat_min, iat_max, iat_avg;
-	throughput_hires_minmaxavg_i64(di->packetIntervalAverages, 0, NULL, NULL, &iat_min, &iat_max, &iat_avg);
+	iat_min = iat_max = iat_avg = 0;
+	pthread_mutex_lock(&di->bitrateBucketLock);
+	if (di->packetIntervalAverages) {
+		throughput_hires_minmaxavg_i64(di->packetIntervalAverages, 0, NULL, NULL, &iat_min, &iat_max, &iat_avg);
+	}
+	pthread_mutex_unlock(&di->bitrateBucketLock);
 
 	json_object *iat1_min = json_object_new_int64(iat_min);
 	json_object *iat1_max = json_object_new_int64(iat_max);
@@ -521,11 +678,36 @@ void discovered_item_json_summary(struct tool_context_s *ctx, struct discovered_
 	json_object_object_add(feedstats, "warning_indicators", warning_indicators);
 	json_object_object_add(feed, "stats", feedstats);
 
+	if ((di->payloadType == PAYLOAD_RTP_TS) || (di->payloadType == PAYLOAD_UDP_TS)) {
+		nic_monitor_loss_json(di, feed);
+		nic_monitor_audio_json(di, feed);
+		nic_monitor_caption_json(di, feed);
+	}
+	nic_monitor_sockdiag_json(di, feed);
+	nic_monitor_microburst_json(di, feed);
+
+	if (di->fec) {
+		struct smpte2022_fec_stats_s fs;
+		pthread_mutex_lock(&di->fecLock);
+		smpte2022_fec_get_stats(di->fec, &fs);
+		pthread_mutex_unlock(&di->fecLock);
+
+		json_object *fec = json_object_new_object();
+		json_object_object_add(fec, "columns", json_object_new_int(fs.columns));
+		json_object_object_add(fec, "rows", json_object_new_int(fs.rows));
+		json_object_object_add(fec, "column_packets", json_object_new_int64(fs.columnPackets));
+		json_object_object_add(fec, "row_packets", json_object_new_int64(fs.rowPackets));
+		json_object_object_add(fec, "prefec_lost", json_object_new_int64(fs.preFecLost));
+		json_object_object_add(fec, "recovered", json_object_new_int64(fs.recovered));
+		json_object_object_add(fec, "postfec_lost", json_object_new_int64(fs.postFecLost));
+		json_object_object_add(feed, "fec", fec);
+	}
+
 	/* Services */
 	json_object *services = json_object_new_array();
 
 	struct ltntstools_pat_s *m = NULL;
-	if (ltntstools_streammodel_query_model(di->streamModel, &m) == 0) {
+	if (di->streamModel && ltntstools_streammodel_query_model(di->streamModel, &m) == 0) {
 		for (int p = 0; p < m->program_count; p++) {
 			if (m->programs[p].program_number == 0)
 				continue; /* Skip the NIT pid */
@@ -566,6 +748,13 @@ void discovered_item_json_summary(struct tool_context_s *ctx, struct discovered_
 				json_object_object_add(item, "type", estype);
 				json_object_object_add(item, "desc", esdesc);
 
+				struct codec_metadata_s codec;
+				if (nic_monitor_codec_query(di, m->programs[p].pmt.streams[s].elementary_PID, &codec) == 0) {
+					json_object_object_add(item, "format", json_object_new_string(codec.format));
+					json_object_object_add(item, "colorspace", json_object_new_string(codec.colorspace));
+					json_object_object_add(item, "sampled", json_object_new_int64(codec.lastSample));
+				}
+
 				json_object_array_add(streams, item);
 
 			}
@@ -640,19 +829,75 @@ void discovered_item_json_summary(struct tool_context_s *ctx, struct discovered_
 
 }
 
-/* Write all the stream statistics to a remote server.
- * use a seperate background thread to make this happen,
- * so we don't block the stats thread in the event of
- * a network / remote server outage.
+/* Interface wide state, posted once per interval ahead of the per stream feeds,
+ * rather than repeated in every one of them.
  */
+static void _json_interface_summary(struct tool_context_s *ctx)
+{
+	json_object *feed = json_object_new_object();
+
+	char ts[64];
+	time_t now = time(NULL);
+	strftime(ts, sizeof(ts), "%F %T.000", localtime(&now));
+
+	char hostname[64];
+	gethostname(&hostname[0], sizeof(hostname));
+
+	json_object_object_add(feed, "host", json_object_new_string(hostname));
+	json_object_object_add(feed, "timestamp", json_object_new_string(ts));
+	json_object_object_add(feed, "type", json_object_new_string("interface"));
+	json_object_object_add(feed, "nic", json_object_new_string(ctx->ifname));
+	json_object_object_add(feed, "pcap_ifdrop", json_object_new_int64(ctx->pcap_stats.ps_ifdrop));
+	json_object_object_add(feed, "pcap_psdrop", json_object_new_int64(ctx->pcap_stats.ps_drop));
+
+	if (ctx->admission.enabled) {
+		json_object *adm = json_object_new_object();
+		json_object_object_add(adm, "candidates", json_object_new_int64(ctx->admission.candidatesSeen));
+		json_object_object_add(adm, "promoted", json_object_new_int64(ctx->admission.promoted));
+		json_object_object_add(adm, "rejected_unclassified", json_object_new_int64(ctx->admission.rejectedUnclassified));
+		json_object_object_add(adm, "rejected_lowrate", json_object_new_int64(ctx->admission.rejectedLowRate));
+		json_object_object_add(adm, "deferred", json_object_new_int64(ctx->admission.deferredRateLimit));
+		json_object_object_add(adm, "table_evictions", json_object_new_int64(ctx->admission.tableEvictions));
+		json_object_object_add(feed, "admission", adm);
+	}
+
+	/* Host configuration audit */
+	json_object *audit = json_object_new_object();
+	json_object_object_add(audit, "score", json_object_new_int(ctx->hostAudit.score));
+	json_object *findings = json_object_new_array();
+	for (int i = 0; i < ctx->hostAudit.findingCount; i++) {
+		const struct host_audit_finding_s *f = &ctx->hostAudit.findings[i];
+		json_object *item = json_object_new_object();
+		json_object_object_add(item, "severity", json_object_new_string(host_audit_severity_name(f->severity)));
+		json_object_object_add(item, "finding", json_object_new_string(f->text));
+		json_object_array_add(findings, item);
+	}
+	json_object_object_add(audit, "findings", findings);
+	json_object_object_add(feed, "host_audit", audit);
+
+	struct json_item_s *qi = json_item_alloc(ctx, 65536);
+	if (qi) {
+		/* double crlf, keep the cheap base64encoder happy. */
+		sprintf((char *)qi->buf, "%s\n\n", json_object_to_json_string_ext(feed, JSON_C_TO_STRING_PRETTY));
+		qi->lengthBytes = strlen((char *)qi->buf);
+		json_queue_push(ctx, qi);
+	}
+
+	json_object_put(feed);
+}
+
 void discovered_items_json_summary(struct tool_context_s *ctx)
 {
 	struct discovered_item_s *e = NULL;
+	int count = 0;
 
 	pthread_mutex_lock(&ctx->lock);
 	xorg_list_for_each_entry(e, &ctx->list, list) {
 		if (discovered_item_state_get(e, DI_STATE_JSON_PROBE_ACTIVE) == 0)
 			continue;
+		/* Only when somebody is consuming the feed */
+		if (count++ == 0)
+			_json_interface_summary(ctx);
 		discovered_item_json_summary(ctx, e);
 	}
 	pthread_mutex_unlock(&ctx->lock);
@@ -766,10 +1011,11 @@ void discovered_items_housekeeping(struct tool_context_s *ctx)
 	int numHiddenObjects = 0;
 #endif
 	xorg_list_for_each_entry_safe(e, next, &ctx->list, list) {
-		if (discovered_item_state_get(e, DI_STATE_HIDDEN) == 0)
+		/* FEC flows merged into their media stream go straight away. */
+		if (discovered_item_state_get(e, DI_STATE_HIDDEN) == 0 && !e->fecRetired)
 			continue;
 
-		if (e->lastUpdated && e->lastUpdated + (3 * 60) < now) {
+		if (e->fecRetired || (e->lastUpdated && e->lastUpdated + (3 * 60) < now)) {
 
 #if VISUALIZE_PURGE
 			char stream[128];
@@ -869,7 +1115,9 @@ void discovered_item_fd_per_pid_report(struct tool_context_s *ctx, struct discov
 				ltntstools_pid_stats_pid_get_mbps(di->stats, i));
 		}
 	}
-	ltn_histogram_interval_print(fd, di->packetIntervals, 0);
+	if (di->packetIntervals) {
+		ltn_histogram_interval_print(fd, di->packetIntervals, 0);
+	}
 	dprintf(fd, "\n");
 }
 
@@ -900,6 +1148,15 @@ void discovered_item_fd_per_h264_slice_report(struct tool_context_s *ctx, struct
 	dprintf(fd, "\n");
 }
 
+void discovered_item_fd_per_video_frame_report(struct tool_context_s *ctx, struct discovered_item_s *di, int fd)
+{
+	pthread_mutex_lock(&di->frameStatsLock);
+	if (di->frameStats) {
+		video_frame_stats_dprintf(di->frameStats, fd);
+	}
+	pthread_mutex_unlock(&di->frameStatsLock);
+}
+
 void discovered_items_console_summary(struct tool_context_s *ctx)
 {
 	struct discovered_item_s *e = NULL;
@@ -910,7 +1167,28 @@ void discovered_items_console_summary(struct tool_context_s *ctx)
 		if (e->payloadType == PAYLOAD_RTP_TS) {
 			rtp_analyzer_report_dprintf(&e->rtpAnalyzerCtx, 1);
 		}
+		if (e->fec) {
+			struct smpte2022_fec_stats_s fs;
+			char line[256];
+			pthread_mutex_lock(&e->fecLock);
+			smpte2022_fec_get_stats(e->fec, &fs);
+			pthread_mutex_unlock(&e->fecLock);
+			smpte2022_fec_sprintf(&fs, &line[0], sizeof(line));
+			printf("%s: SMPTE 2022-1 %s\n\n", e->dstaddr, line);
+		}
+		nic_monitor_loss_dprintf(e, STDOUT_FILENO);
 		discovered_item_fd_per_h264_slice_report(ctx, e, STDOUT_FILENO);
+		nic_monitor_codec_dprintf(e, STDOUT_FILENO);
+		nic_monitor_audio_dprintf(e, STDOUT_FILENO);
+		nic_monitor_caption_dprintf(e, STDOUT_FILENO);
+		nic_monitor_sockdiag_dprintf(e, STDOUT_FILENO);
+		nic_monitor_microburst_dprintf(e, STDOUT_FILENO);
+		discovered_item_fd_per_video_frame_report(ctx, e, STDOUT_FILENO);
+		if (e->forwardStripStats.packetsIn) {
+			char strip[160];
+			stuffing_strip_sprintf(&strip[0], sizeof(strip), &e->forwardStripStats);
+			printf("Forwarding %s, %s\n\n", e->dstaddr, strip);
+		}
 		if (ctx->automaticallyJSONProbeStreams) {
 			discovered_item_json_summary(ctx, e);
 		}
@@ -996,7 +1274,7 @@ void discovered_item_detailed_file_summary(struct tool_context_s *ctx, struct di
 	/* Query the LTN encoder latency, if it exists */
 	struct ltntstools_pat_s *m = NULL;
 	char enclat[8];
-	if (ltntstools_streammodel_query_model(di->streamModel, &m) == 0) {
+	if (di->streamModel && ltntstools_streammodel_query_model(di->streamModel, &m) == 0) {
 		
 		for (int p = 0; p < m->program_count; p++) {
 
@@ -1006,7 +1284,9 @@ void discovered_item_detailed_file_summary(struct tool_context_s *ctx, struct di
 			if (ret == 1) {
 				di->isLTNEncoder = 1;
 
-				int64_t encoderLatencyMS = ltntstools_probe_ltnencoder_get_total_latency(di->LTNLatencyProbe);
+				int64_t encoderLatencyMS = -1;
+				if (di->LTNLatencyProbe)
+					encoderLatencyMS = ltntstools_probe_ltnencoder_get_total_latency(di->LTNLatencyProbe);
 				if (encoderLatencyMS >= 0) {
 					sprintf(enclat, "%" PRIi64, encoderLatencyMS);
 				} else {
@@ -1125,7 +1405,7 @@ void discovered_item_file_summary(struct tool_context_s *ctx, struct discovered_
 	/* Query the LTN encoder latency, if it exists */
 	struct ltntstools_pat_s *m = NULL;
 	char enclat[8];
-	if (ltntstools_streammodel_query_model(di->streamModel, &m) == 0) {
+	if (di->streamModel && ltntstools_streammodel_query_model(di->streamModel, &m) == 0) {
 		
 		for (int p = 0; p < m->program_count; p++) {
 
@@ -1135,7 +1415,9 @@ void discovered_item_file_summary(struct tool_context_s *ctx, struct discovered_
 			if (ret == 1) {
 				di->isLTNEncoder = 1;
 
-				int64_t encoderLatencyMS = ltntstools_probe_ltnencoder_get_total_latency(di->LTNLatencyProbe);
+				int64_t encoderLatencyMS = -1;
+				if (di->LTNLatencyProbe)
+					encoderLatencyMS = ltntstools_probe_ltnencoder_get_total_latency(di->LTNLatencyProbe);
 				if (encoderLatencyMS >= 0) {
 					sprintf(enclat, "%" PRIi64, encoderLatencyMS);
 				} else {
@@ -1229,7 +1511,9 @@ void discovered_items_stats_reset(struct tool_context_s *ctx)
 		e->bitrate_hwm_us_10ms = 0;
 		e->bitrate_hwm_us_100ms = 0;
 
-		ltn_histogram_reset(e->packetIntervals);
+		if (e->packetIntervals) {
+			ltn_histogram_reset(e->packetIntervals);
+		}
 		display_doc_append_with_time(&e->doc_stream_log, "Operator manually reset statistics", NULL);
 
 		pthread_mutex_lock(&e->h264_sliceLock);
@@ -1238,7 +1522,17 @@ void discovered_items_stats_reset(struct tool_context_s *ctx)
 		}
 		pthread_mutex_unlock(&e->h264_sliceLock);
 
+		pthread_mutex_lock(&e->frameStatsLock);
+		if (e->frameStats) {
+			video_frame_stats_reset(e->frameStats);
+		}
+		pthread_mutex_unlock(&e->frameStatsLock);
+
 		nic_monitor_tr101290_reset(e);
+		nic_monitor_loss_reset(e);
+		nic_monitor_caption_reset(e);
+		nic_monitor_sockdiag_reset(e);
+		nic_monitor_microburst_reset(e->microburst);
 
 		if (e->payloadType == PAYLOAD_RTP_TS) {
 			rtp_analyzer_reset(&e->rtpAnalyzerCtx);
@@ -1246,6 +1540,8 @@ void discovered_items_stats_reset(struct tool_context_s *ctx)
 
 	}
 	pthread_mutex_unlock(&ctx->lock);
+
+	nic_monitor_microburst_reset(ctx->microburst.aggregate);
 }
 
 void discovered_item_state_set(struct discovered_item_s *di, unsigned int state)
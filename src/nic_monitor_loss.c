@@ -0,0 +1,468 @@
+#include "nic_monitor.h"
+
+/* Loss episodes.
+ * CC and RTP sequence error totals don't tell you how to size FEC or an SRT
+ * latency, the burst length distribution does. Each stream reconstructs its
+ * loss into episodes: a run of lost packets, merged with any further loss
+ * until LOSS_EPISODE_QUIET clean datagrams in a row have arrived. An episode
+ * also closes when the stream stops for LOSS_EPISODE_IDLE seconds, or when
+ * the stream is removed, ending at the last datagram that revealed loss.
+ *
+ * RTP streams count lost datagrams from the RTP sequence number. UDP-TS streams
+ * only have the continuity counter, so they count lost TS packets summed across
+ * pids, and each pid can only see up to 15 lost packets at a time.
+ *
+ * Per stream we keep power of two histograms of the burst length, the episode
+ * duration, the clean datagrams between episodes (gap) and the time between
+ * episode starts (recurrence).
+ *
+ * Every closed episode also goes into an interface wide log. An episode that
+ * starts within the correlation window of another streams episode is grouped
+ * with it. Loss shared by several streams at the same moment points at the NIC,
+ * the host or a common upstream hop, loss that only one stream sees points at
+ * that streams own path. Episodes that coincide with pcap drops are host side.
+ *
+ * Detection runs on the pcap thread, on every datagram, and takes no locks
+ * while no episode is open. An open episode is shared with the stats thread,
+ * which closes it on inactivity, so it is only touched under the stream lock.
+ * The CSV log is written from the stats thread.
+ */
+
+#define LOSS_EPISODE_QUIET 8      /* Clean datagrams that end an episode */
+#define LOSS_EPISODE_IDLE 2       /* Seconds without datagrams that end an episode */
+#define LOSS_RTP_RESYNC 5000      /* Larger sequence jumps are a sender restart, not loss */
+
+static int _bucket(uint64_t v)
+{
+	if (v == 0)
+		return 0;
+
+	int b = 64 - __builtin_clzll(v);
+	return b < LOSS_HIST_BUCKETS ? b : LOSS_HIST_BUCKETS - 1;
+}
+
+static int64_t _tv_diff_us(const struct timeval *a, const struct timeval *b)
+{
+	return ((int64_t)(a->tv_sec - b->tv_sec) * 1000000LL) + (a->tv_usec - b->tv_usec);
+}
+
+void nic_monitor_loss_init(struct discovered_item_s *di)
+{
+	pthread_mutex_init(&di->loss.lock, NULL);
+	memset(&di->loss.lastCC[0], 0xff, sizeof(di->loss.lastCC));
+}
+
+/* Lost RTP datagrams ahead of this one, from the sequence number. */
+static uint64_t _rtp_lost(struct loss_engine_s *l, const uint8_t *pkts)
+{
+	const struct rtp_hdr *h = (const struct rtp_hdr *)(pkts - 12);
+	uint16_t seq = ntohs(h->seq);
+
+	if (!l->seqValid) {
+		l->seqValid = 1;
+		l->lastSeq = seq;
+		return 0;
+	}
+
+	uint16_t diff = seq - (uint16_t)(l->lastSeq + 1);
+	if (diff >= 0x8000)
+		return 0; /* Duplicate or reordered, keep our place */
+
+	l->lastSeq = seq;
+	if (diff > LOSS_RTP_RESYNC) {
+		l->resyncs++;
+		return 0;
+	}
+
+	return diff;
+}
+
+/* Lost TS packets ahead of the packets in this datagram, summed across pids. */
+static uint64_t _cc_lost(struct loss_engine_s *l, const uint8_t *pkts, uint32_t pktCount)
+{
+	uint64_t lost = 0;
+
+	for (uint32_t i = 0; i < pktCount; i++) {
+		const uint8_t *pkt = pkts + (i * 188);
+		uint16_t pid = ltntstools_pid((uint8_t *)pkt);
+		if (pid == 0x1fff)
+			continue;
+
+		uint8_t cc = pkt[3] & 0x0f;
+		uint8_t afc = (pkt[3] >> 4) & 0x03;
+
+		/* Discontinuity indicator, the counter may legally jump */
+		if ((afc & 0x02) && pkt[4] && (pkt[5] & 0x80)) {
+			l->lastCC[pid] = cc;
+			continue;
+		}
+		if (!(afc & 0x01))
+			continue; /* The counter only advances with a payload */
+
+		if (l->lastCC[pid] != 0xff && cc != l->lastCC[pid]) {
+			lost += (cc - l->lastCC[pid] - 1) & 0x0f;
+		}
+		l->lastCC[pid] = cc;
+	}
+
+	return lost;
+}
+
+/* Append to the interface log and look for other streams that lost packets at the same moment. */
+static int _log_episode(struct tool_context_s *ctx, struct discovered_item_s *di, uint32_t durationUs)
+{
+	struct loss_engine_s *l = &di->loss;
+	int correlated = 0;
+
+	pthread_mutex_lock(&ctx->lossEpisodes.lock);
+
+	struct loss_episode_s *e = &ctx->lossEpisodes.log[ctx->lossEpisodes.total % LOSS_LOG_DEPTH];
+	memset(e, 0, sizeof(*e));
+	e->start = l->episodeStart;
+	e->durationUs = durationUs;
+	e->lost = l->episodeLost;
+	e->gap = l->episodeGap;
+	e->streamId = l->streamId;
+	e->isRTP = di->payloadType == PAYLOAD_RTP_TS;
+	snprintf(e->stream, sizeof(e->stream), "%s -> %s", di->srcaddr, di->dstaddr);
+
+	uint64_t psDrop = ctx->pcap_stats.ps_drop;
+	if (psDrop > ctx->lossEpisodes.psDropSeen) {
+		e->captureDrops = psDrop - ctx->lossEpisodes.psDropSeen;
+		ctx->lossEpisodes.withCaptureDrops++;
+	}
+	ctx->lossEpisodes.psDropSeen = psDrop;
+
+	/* Episodes close in roughly start order, look back a few seconds worth */
+	int64_t windowUs = (int64_t)ctx->lossEpisodes.correlationMs * 1000;
+	uint64_t depth = ctx->lossEpisodes.total < LOSS_LOG_DEPTH ? ctx->lossEpisodes.total : LOSS_LOG_DEPTH - 1;
+	for (uint64_t i = 1; i <= depth; i++) {
+		struct loss_episode_s *o = &ctx->lossEpisodes.log[(ctx->lossEpisodes.total - i) % LOSS_LOG_DEPTH];
+		int64_t d = _tv_diff_us(&e->start, &o->start);
+		if (d > 5000000)
+			break;
+		if (o->streamId == e->streamId || d > windowUs || d < -windowUs)
+			continue;
+
+		if (o->group == 0) {
+			o->group = ++ctx->lossEpisodes.nextGroup;
+			ctx->lossEpisodes.groups++;
+			ctx->lossEpisodes.correlated++;
+		}
+		if (e->group == 0) {
+			e->group = o->group;
+			ctx->lossEpisodes.correlated++;
+		}
+		correlated = 1;
+	}
+
+	ctx->lossEpisodes.total++;
+
+	pthread_mutex_unlock(&ctx->lossEpisodes.lock);
+
+	return correlated;
+}
+
+/* Caller holds l->lock. */
+static void _close_episode(struct tool_context_s *ctx, struct discovered_item_s *di)
+{
+	struct loss_engine_s *l = &di->loss;
+
+	int64_t durationUs = _tv_diff_us(&l->episodeEnd, &l->episodeStart);
+	if (durationUs < 0)
+		durationUs = 0;
+
+	int correlated = _log_episode(ctx, di, (uint32_t)durationUs);
+
+	l->episodes++;
+	l->lost += l->episodeLost;
+	if (l->episodeLost > l->maxBurst)
+		l->maxBurst = l->episodeLost;
+	if (correlated)
+		l->correlated++;
+	l->burstHist[_bucket(l->episodeLost)]++;
+	l->durationHist[_bucket(durationUs)]++;
+	if (l->lastEpisodeStart.tv_sec) {
+		l->gapHist[_bucket(l->episodeGap)]++;
+		int64_t ms = _tv_diff_us(&l->episodeStart, &l->lastEpisodeStart) / 1000;
+		l->recurrenceHist[_bucket(ms > 0 ? ms : 0)]++;
+	}
+
+	l->lastEpisodeStart = l->episodeStart;
+	l->clean = l->quiet;
+	__atomic_store_n(&l->open, 0, __ATOMIC_RELEASE);
+
+	char msg[128];
+	sprintf(msg, "Loss episode, %" PRIu64 " %s lost over %.1f ms%s",
+		l->episodeLost, di->payloadType == PAYLOAD_RTP_TS ? "datagrams" : "packets",
+		(double)durationUs / 1000.0, correlated ? ", other streams lost at the same time" : "");
+	display_doc_append_with_time(&di->doc_stream_log, msg, NULL);
+}
+
+/* Called on the pcap thread, once per datagram. */
+void nic_monitor_loss_write(struct tool_context_s *ctx, struct discovered_item_s *di,
+	const uint8_t *pkts, uint32_t pktCount, const struct timeval *ts)
+{
+	struct loss_engine_s *l = &di->loss;
+
+	if (l->streamId == 0) {
+		pthread_mutex_lock(&ctx->lossEpisodes.lock);
+		l->streamId = ++ctx->lossEpisodes.nextStreamId;
+		pthread_mutex_unlock(&ctx->lossEpisodes.lock);
+	}
+
+	uint64_t lost;
+	if (di->payloadType == PAYLOAD_RTP_TS)
+		lost = _rtp_lost(l, pkts);
+	else
+		lost = _cc_lost(l, pkts, pktCount);
+
+	if (lost || __atomic_load_n(&l->open, __ATOMIC_ACQUIRE)) {
+		pthread_mutex_lock(&l->lock);
+		if (lost) {
+			if (!l->open) {
+				l->open = 1;
+				l->episodeStart = l->lastArrival.tv_sec ? l->lastArrival : *ts;
+				l->episodeLost = 0;
+				l->episodeGap = l->clean;
+			}
+			l->episodeLost += lost;
+			l->episodeEnd = *ts; /* The datagram that revealed the loss arrived after it */
+			l->quiet = 0;
+		} else
+		if (l->open) {
+			if (++l->quiet >= LOSS_EPISODE_QUIET)
+				_close_episode(ctx, di);
+		} else {
+			l->clean++; /* The stats thread closed it while we waited */
+		}
+		pthread_mutex_unlock(&l->lock);
+	} else {
+		l->clean++;
+	}
+
+	l->lastArrival = *ts;
+}
+
+/* Close any open episode, the stream has gone quiet or is being removed. */
+void nic_monitor_loss_close(struct tool_context_s *ctx, struct discovered_item_s *di)
+{
+	struct loss_engine_s *l = &di->loss;
+
+	if (!__atomic_load_n(&l->open, __ATOMIC_ACQUIRE))
+		return;
+
+	pthread_mutex_lock(&l->lock);
+	if (l->open)
+		_close_episode(ctx, di);
+	pthread_mutex_unlock(&l->lock);
+}
+
+/* Streams that stopped mid episode never deliver the clean datagrams that close it. */
+static void _close_idle(struct tool_context_s *ctx, time_t now, int all)
+{
+	struct discovered_item_s *e = NULL;
+
+	pthread_mutex_lock(&ctx->lock);
+	xorg_list_for_each_entry(e, &ctx->list, list) {
+		if (all || e->lastUpdated + LOSS_EPISODE_IDLE <= now)
+			nic_monitor_loss_close(ctx, e);
+	}
+	pthread_mutex_unlock(&ctx->lock);
+}
+
+void nic_monitor_loss_reset(struct discovered_item_s *di)
+{
+	struct loss_engine_s *l = &di->loss;
+
+	pthread_mutex_lock(&l->lock);
+	l->episodes = 0;
+	l->lost = 0;
+	l->maxBurst = 0;
+	l->correlated = 0;
+	l->resyncs = 0;
+	memset(&l->burstHist[0], 0, sizeof(l->burstHist));
+	memset(&l->durationHist[0], 0, sizeof(l->durationHist));
+	memset(&l->gapHist[0], 0, sizeof(l->gapHist));
+	memset(&l->recurrenceHist[0], 0, sizeof(l->recurrenceHist));
+	pthread_mutex_unlock(&l->lock);
+}
+
+static void _csv_line(int fd, const struct loss_episode_s *e)
+{
+	struct tm tm;
+	localtime_r(&e->start.tv_sec, &tm);
+
+	dprintf(fd, "%04d%02d%02d-%02d%02d%02d.%06d,%s,%s,%" PRIu64 ",%u,%" PRIu64 ",%u,%" PRIu64 "\n",
+		tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec, (int)e->start.tv_usec,
+		e->stream, e->isRTP ? "datagrams" : "packets",
+		e->lost, e->durationUs, e->gap, e->group, e->captureDrops);
+}
+
+/* Called on the stats thread, closes episodes on streams that went quiet and
+ * appends closed episodes to the CSV log. flushAll closes every open episode.
+ * A later episode on another stream can still join an episode to a group,
+ * so episodes are held back for a couple of seconds, unless flushAll is set.
+ */
+void nic_monitor_loss_service(struct tool_context_s *ctx, int flushAll)
+{
+	time_t now = time(NULL);
+	if (now == ctx->lossEpisodes.lastService && !flushAll)
+		return;
+	ctx->lossEpisodes.lastService = now;
+
+	_close_idle(ctx, now, flushAll);
+
+	if (!ctx->lossEpisodes.logFilename)
+		return;
+
+	struct loss_episode_s *copy = NULL;
+	uint64_t skipped = 0;
+	int count = 0;
+
+	pthread_mutex_lock(&ctx->lossEpisodes.lock);
+	uint64_t total = ctx->lossEpisodes.total;
+	if (total - ctx->lossEpisodes.flushed > LOSS_LOG_DEPTH) {
+		skipped = total - ctx->lossEpisodes.flushed - LOSS_LOG_DEPTH;
+		ctx->lossEpisodes.flushed = total - LOSS_LOG_DEPTH;
+	}
+	if (total > ctx->lossEpisodes.flushed) {
+		copy = malloc((total - ctx->lossEpisodes.flushed) * sizeof(*copy));
+		if (copy) {
+			uint64_t i;
+			for (i = ctx->lossEpisodes.flushed; i < total; i++) {
+				struct loss_episode_s *e = &ctx->lossEpisodes.log[i % LOSS_LOG_DEPTH];
+				if (!flushAll && e->start.tv_sec + 2 > now)
+					break;
+				copy[count++] = *e;
+			}
+			ctx->lossEpisodes.flushed = i;
+		}
+	}
+	pthread_mutex_unlock(&ctx->lossEpisodes.lock);
+
+	if (count == 0 && skipped == 0) {
+		free(copy);
+		return;
+	}
+
+	int fd = open(ctx->lossEpisodes.logFilename, O_CREAT | O_RDWR | O_APPEND, 0644);
+	if (fd < 0) {
+		fprintf(stderr, "Failed to open %s\n", ctx->lossEpisodes.logFilename);
+		free(copy);
+		return;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) == 0 && st.st_size == 0) {
+		dprintf(fd, "start,stream,unit,lost,duration_us,gap_datagrams,group,capture_drops\n");
+	}
+	if (skipped) {
+		dprintf(fd, "# %" PRIu64 " episodes not written, the log wrapped\n", skipped);
+	}
+	for (int i = 0; i < count; i++) {
+		_csv_line(fd, &copy[i]);
+	}
+
+	close(fd);
+	free(copy);
+}
+
+static void _hist_dprintf(int fd, const char *label, const uint64_t *hist)
+{
+	dprintf(fd, "    %-22s", label);
+	for (int i = 0; i < LOSS_HIST_BUCKETS; i++) {
+		if (hist[i] == 0)
+			continue;
+		if (i <= 1)
+			dprintf(fd, " %d:%" PRIu64, i, hist[i]);
+		else
+			dprintf(fd, " %" PRIu64 "-%" PRIu64 ":%" PRIu64, 1ULL << (i - 1), (1ULL << i) - 1, hist[i]);
+	}
+	dprintf(fd, "\n");
+}
+
+void nic_monitor_loss_dprintf(struct discovered_item_s *di, int fd)
+{
+	struct loss_engine_s *l = &di->loss;
+
+	pthread_mutex_lock(&l->lock);
+	if (l->episodes) {
+		const char *unit = di->payloadType == PAYLOAD_RTP_TS ? "datagrams" : "packets";
+		dprintf(fd, "Loss episodes %s -> %s: %" PRIu64 " episodes, %" PRIu64 " %s lost, longest burst %" PRIu64
+			", %" PRIu64 " shared with other streams\n",
+			di->srcaddr, di->dstaddr, l->episodes, l->lost, unit, l->maxBurst, l->correlated);
+		_hist_dprintf(fd, "burst length", l->burstHist);
+		_hist_dprintf(fd, "duration us", l->durationHist);
+		_hist_dprintf(fd, "gap clean datagrams", l->gapHist);
+		_hist_dprintf(fd, "recurrence ms", l->recurrenceHist);
+		if (l->resyncs)
+			dprintf(fd, "    %" PRIu64 " RTP sequence resyncs ignored\n", l->resyncs);
+		dprintf(fd, "\n");
+	}
+	pthread_mutex_unlock(&l->lock);
+}
+
+static json_object *_hist_json(const uint64_t *hist)
+{
+	json_object *a = json_object_new_array();
+	for (int i = 0; i < LOSS_HIST_BUCKETS; i++) {
+		json_object_array_add(a, json_object_new_int64(hist[i]));
+	}
+	return a;
+}
+
+/* Histogram arrays are indexed by bucket, bucket n holds values 2^(n-1) to 2^n - 1, bucket 0 holds zero. */
+void nic_monitor_loss_json(struct discovered_item_s *di, json_object *feed)
+{
+	struct loss_engine_s *l = &di->loss;
+
+	json_object *loss = json_object_new_object();
+
+	pthread_mutex_lock(&l->lock);
+	json_object_object_add(loss, "unit", json_object_new_string(di->payloadType == PAYLOAD_RTP_TS ? "datagrams" : "packets"));
+	json_object_object_add(loss, "episodes", json_object_new_int64(l->episodes));
+	json_object_object_add(loss, "lost", json_object_new_int64(l->lost));
+	json_object_object_add(loss, "max_burst", json_object_new_int64(l->maxBurst));
+	json_object_object_add(loss, "correlated", json_object_new_int64(l->correlated));
+	json_object_object_add(loss, "burst_hist", _hist_json(l->burstHist));
+	json_object_object_add(loss, "duration_us_hist", _hist_json(l->durationHist));
+	json_object_object_add(loss, "gap_hist", _hist_json(l->gapHist));
+	json_object_object_add(loss, "recurrence_ms_hist", _hist_json(l->recurrenceHist));
+	pthread_mutex_unlock(&l->lock);
+
+	json_object_object_add(feed, "loss_episodes", loss);
+}
+
+int nic_monitor_loss_sprintf(struct tool_context_s *ctx, char *dst, int lengthBytes)
+{
+	pthread_mutex_lock(&ctx->lossEpisodes.lock);
+	uint64_t total = ctx->lossEpisodes.total;
+	uint64_t correlated = ctx->lossEpisodes.correlated;
+	uint64_t groups = ctx->lossEpisodes.groups;
+	uint64_t capture = ctx->lossEpisodes.withCaptureDrops;
+	pthread_mutex_unlock(&ctx->lossEpisodes.lock);
+
+	return snprintf(dst, lengthBytes,
+		"Loss episodes: %" PRIu64 " total, %" PRIu64 " in %" PRIu64 " groups shared across streams within %dms (NIC, host or common upstream), "
+		"%" PRIu64 " alongside pcap drops (host), %" PRIu64 " single stream (that streams path)",
+		total, correlated, groups, ctx->lossEpisodes.correlationMs, capture, total - correlated);
+}
+
+/* The most recent episodes, oldest first. */
+void nic_monitor_loss_log_dprintf(struct tool_context_s *ctx, int fd, int maxEpisodes)
+{
+	pthread_mutex_lock(&ctx->lossEpisodes.lock);
+	uint64_t total = ctx->lossEpisodes.total;
+	uint64_t n = total < LOSS_LOG_DEPTH ? total : LOSS_LOG_DEPTH;
+	if (n > (uint64_t)maxEpisodes)
+		n = maxEpisodes;
+
+	if (n) {
+		dprintf(fd, "start,stream,unit,lost,duration_us,gap_datagrams,group,capture_drops\n");
+	}
+	for (uint64_t i = total - n; i < total; i++) {
+		_csv_line(fd, &ctx->lossEpisodes.log[i % LOSS_LOG_DEPTH]);
+	}
+	pthread_mutex_unlock(&ctx->lossEpisodes.lock);
+}
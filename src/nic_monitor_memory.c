@@ -0,0 +1,428 @@
+#include "nic_monitor.h"
+
+/* Memory governor.
+ * Every discovered stream costs several MB, most of it inside libltntstools
+ * where we can't measure it directly. We charge a per subsystem estimate
+ * against a configured budget when a stream is allocated, and release it
+ * when the stream or one of its analyzers is freed.
+ *
+ * When a new stream doesn't fit we:
+ *  1. ask the least important streams to drop their optional analyzers.
+ *  2. admit the new stream with its mandatory stats only (downgraded).
+ *  3. refuse the new stream if even that doesn't fit.
+ * A budget of zero (the default) disables the governor.
+ *
+ * Buffers sized at runtime, audio captures for instance, charge what they
+ * actually allocate, and don't allocate at all when it won't fit.
+ */
+
+static const char *subsystemNames[MEM_SUBSYSTEM_MAX] = {
+	"pidstats",
+	"iat-histogram",
+	"iat-averages",
+	"bitrate-buckets",
+	"streammodel",
+	"ltn-probe",
+	"h264",
+	"frame-stats",
+	"smpte2022-fec",
+	"audio-capture",
+	"loss",
+	"captions",
+	"microburst",
+};
+
+const char *nic_monitor_memory_subsystem_name(enum nic_monitor_mem_subsystem_e s)
+{
+	if (s >= MEM_SUBSYSTEM_MAX)
+		return "???";
+
+	return subsystemNames[s];
+}
+
+/* Estimated cost of each subsystem, per stream. */
+uint64_t nic_monitor_memory_cost(enum nic_monitor_mem_subsystem_e s)
+{
+	switch (s) {
+	case MEM_SUBSYSTEM_PID_STATS:
+		/* di->stats and di->statsToFileSummary */
+		return 2 * sizeof(struct ltntstools_stream_statistics_s);
+	case MEM_SUBSYSTEM_IAT_HISTOGRAM:
+		return 256 * 1024; /* 16000ms histogram */
+	case MEM_SUBSYSTEM_IAT_AVERAGES:
+	case MEM_SUBSYSTEM_BITRATE_BUCKETS:
+		return 20000 * 36; /* 20k hires nodes, 36 bytes each */
+	case MEM_SUBSYSTEM_STREAMMODEL:
+		return 1024 * 1024;
+	case MEM_SUBSYSTEM_LTN_PROBE:
+		return 64 * 1024;
+	case MEM_SUBSYSTEM_H264:
+		return 64 * 1024; /* Slice counter and history, the only H.264 state a stream keeps */
+	case MEM_SUBSYSTEM_FRAME_STATS:
+		return 48 * 1024; /* Header buffers for up to VFS_MAX_PIDS video pids */
+	case MEM_SUBSYSTEM_FEC:
+		return smpte2022_fec_alloc_bytes(); /* Media ring and FEC store */
+	case MEM_SUBSYSTEM_LOSS:
+		return sizeof(struct loss_engine_s); /* Mostly the UDP-TS CC table, part of the stream itself */
+	case MEM_SUBSYSTEM_CAPTIONS:
+		return CAPTION_MAX_PIDS * sizeof(struct caption_pid_s); /* Decoder state, part of the stream itself */
+	case MEM_SUBSYSTEM_MICROBURST:
+		return sizeof(struct microburst_engine_s) + (MICROBURST_RING_STREAM * sizeof(struct microburst_frame_s));
+	default:
+		return 0;
+	}
+}
+
+/* Allocated for every stream, downgraded or not, and never shed. */
+static int _is_mandatory(int s)
+{
+	return s == MEM_SUBSYSTEM_PID_STATS || s == MEM_SUBSYSTEM_LOSS || s == MEM_SUBSYSTEM_CAPTIONS ||
+		s == MEM_SUBSYSTEM_MICROBURST;
+}
+
+/* Would a new stream allocate this subsystem? Mirrors discovered_item_alloc(). */
+static int _is_allocated(struct tool_context_s *ctx, int s)
+{
+	switch (s) {
+	case MEM_SUBSYSTEM_H264:
+		return ctx->gatherH264Metadata;
+	case MEM_SUBSYSTEM_FRAME_STATS:
+		return ctx->videoFrameStats;
+	case MEM_SUBSYSTEM_MICROBURST:
+		return ctx->microburst.windowUs > 0;
+	case MEM_SUBSYSTEM_FEC:
+	case MEM_SUBSYSTEM_AUDIO:
+		return 0; /* Only when a FEC flow shows up, or a capture is sized, both charged as they happen */
+	default:
+		return 1;
+	}
+}
+
+static uint64_t _cost_mandatory(struct tool_context_s *ctx)
+{
+	uint64_t total = 0;
+	for (int i = 0; i < MEM_SUBSYSTEM_MAX; i++) {
+		if (_is_mandatory(i) && _is_allocated(ctx, i))
+			total += nic_monitor_memory_cost(i);
+	}
+	return total;
+}
+
+static uint64_t _cost_full(struct tool_context_s *ctx)
+{
+	uint64_t total = 0;
+	for (int i = 0; i < MEM_SUBSYSTEM_MAX; i++) {
+		if (_is_allocated(ctx, i))
+			total += nic_monitor_memory_cost(i);
+	}
+	return total;
+}
+
+static uint64_t _cost_optional(struct discovered_item_s *di)
+{
+	uint64_t total = 0;
+	for (int i = 0; i < MEM_SUBSYSTEM_MAX; i++) {
+		if (_is_mandatory(i) || i == MEM_SUBSYSTEM_FEC)
+			continue; /* Never shed, FEC recovery changes what the stream contains */
+		total += di->memBytes[i];
+	}
+	return total;
+}
+
+void nic_monitor_memory_initialize(struct tool_context_s *ctx)
+{
+	struct memory_governor_s *g = &ctx->memGovernor;
+
+	uint64_t budget = g->budgetBytes;
+	memset(g, 0, sizeof(*g));
+	g->budgetBytes = budget;
+
+	pthread_mutex_init(&g->lock, NULL);
+}
+
+void nic_monitor_memory_charge(struct discovered_item_s *di, enum nic_monitor_mem_subsystem_e s)
+{
+	struct memory_governor_s *g = &di->ctx->memGovernor;
+	uint64_t bytes = nic_monitor_memory_cost(s);
+
+	pthread_mutex_lock(&g->lock);
+	di->memBytes[s] += bytes;
+	g->subsystemBytes[s] += bytes;
+	g->usedBytes += bytes;
+	pthread_mutex_unlock(&g->lock);
+}
+
+void nic_monitor_memory_release(struct discovered_item_s *di, enum nic_monitor_mem_subsystem_e s)
+{
+	struct memory_governor_s *g = &di->ctx->memGovernor;
+
+	pthread_mutex_lock(&g->lock);
+	g->subsystemBytes[s] -= di->memBytes[s];
+	g->usedBytes -= di->memBytes[s];
+	di->memBytes[s] = 0;
+	pthread_mutex_unlock(&g->lock);
+}
+
+/* Charge an allocation sized at runtime. di is NULL for memory no stream owns,
+ * a sample queued for the audio workers for instance.
+ * Returns -1, charging nothing, when the bytes don't fit in the budget.
+ */
+int nic_monitor_memory_charge_bytes(struct tool_context_s *ctx, struct discovered_item_s *di, enum nic_monitor_mem_subsystem_e s, uint64_t bytes)
+{
+	struct memory_governor_s *g = &ctx->memGovernor;
+
+	pthread_mutex_lock(&g->lock);
+	if (g->budgetBytes && g->usedBytes + bytes > g->budgetBytes) {
+		pthread_mutex_unlock(&g->lock);
+		return -1;
+	}
+	if (di)
+		di->memBytes[s] += bytes;
+	g->subsystemBytes[s] += bytes;
+	g->usedBytes += bytes;
+	pthread_mutex_unlock(&g->lock);
+
+	return 0;
+}
+
+void nic_monitor_memory_release_bytes(struct tool_context_s *ctx, struct discovered_item_s *di, enum nic_monitor_mem_subsystem_e s, uint64_t bytes)
+{
+	struct memory_governor_s *g = &ctx->memGovernor;
+
+	pthread_mutex_lock(&g->lock);
+	if (di) {
+		/* Already gone if the stream released everything. */
+		if (bytes > di->memBytes[s])
+			bytes = di->memBytes[s];
+		di->memBytes[s] -= bytes;
+	}
+	g->subsystemBytes[s] -= bytes;
+	g->usedBytes -= bytes;
+	pthread_mutex_unlock(&g->lock);
+}
+
+/* The stream hands bytes it was charged for to someone else, they stay
+ * charged until released with a NULL di.
+ */
+void nic_monitor_memory_disown_bytes(struct discovered_item_s *di, enum nic_monitor_mem_subsystem_e s, uint64_t bytes)
+{
+	struct memory_governor_s *g = &di->ctx->memGovernor;
+
+	pthread_mutex_lock(&g->lock);
+	if (bytes > di->memBytes[s])
+		bytes = di->memBytes[s];
+	di->memBytes[s] -= bytes;
+	pthread_mutex_unlock(&g->lock);
+}
+
+void nic_monitor_memory_release_all(struct discovered_item_s *di)
+{
+	for (int i = 0; i < MEM_SUBSYSTEM_MAX; i++)
+		nic_monitor_memory_release(di, i);
+}
+
+/* Lower is less important, and the first to lose its optional analyzers.
+ * Streams the operator is actively looking at, recording or forwarding
+ * are never shed.
+ */
+static int _importance(struct discovered_item_s *di)
+{
+	unsigned int protect = DI_STATE_SELECTED | DI_STATE_PCAP_RECORDING | DI_STATE_PCAP_RECORD_START |
+		DI_STATE_STREAM_FORWARDING | DI_STATE_STREAM_FORWARD_START | DI_STATE_JSON_PROBE_ACTIVE |
+		DI_STATE_SHOW_PIDS | DI_STATE_SHOW_STREAMMODEL | DI_STATE_SHOW_CLOCKS | DI_STATE_SHOW_IAT_HISTOGRAM;
+
+	if (discovered_item_state_get(di, protect))
+		return -1;
+
+	if (discovered_item_state_get(di, DI_STATE_HIDDEN))
+		return 0;
+
+	if ((di->payloadType != PAYLOAD_UDP_TS) && (di->payloadType != PAYLOAD_RTP_TS))
+		return 1;
+
+	/* Anything with errors is more interesting than a clean stream. */
+	if (di->stats->ccErrors)
+		return 3;
+
+	return 2;
+}
+
+/* Mark enough of the least important streams for shedding to free 'needed' bytes.
+ * Called with ctx->lock held. The actual free happens on the pcap thread,
+ * the only thread that writes into these analyzers, via nic_monitor_memory_shed().
+ */
+static uint64_t _request_shedding(struct tool_context_s *ctx, uint64_t needed)
+{
+	uint64_t requested = 0;
+
+	for (int level = 0; level <= 3 && requested < needed; level++) {
+		struct discovered_item_s *e = NULL;
+		xorg_list_for_each_entry(e, &ctx->list, list) {
+			if (requested >= needed)
+				break;
+			if (e->memShedPending || e->memReduced)
+				continue;
+			if (_importance(e) != level)
+				continue;
+
+			uint64_t bytes = _cost_optional(e);
+			if (bytes == 0)
+				continue;
+
+			e->memShedPending = 1;
+			requested += bytes;
+		}
+	}
+
+	return requested;
+}
+
+/* Called with ctx->lock held, before a new stream is allocated. */
+enum nic_monitor_mem_admit_e nic_monitor_memory_admit(struct tool_context_s *ctx)
+{
+	struct memory_governor_s *g = &ctx->memGovernor;
+	if (g->budgetBytes == 0)
+		return MEM_ADMIT_FULL;
+
+	time_t now = time(NULL);
+	uint64_t full = _cost_full(ctx);
+	uint64_t mandatory = _cost_mandatory(ctx);
+
+	pthread_mutex_lock(&g->lock);
+	uint64_t used = g->usedBytes;
+	pthread_mutex_unlock(&g->lock);
+
+	if (used + full <= g->budgetBytes) {
+		g->streamsAdmitted++;
+		return MEM_ADMIT_FULL;
+	}
+
+	/* Make room for the future, the shed happens asynchronously and is counted when it does. */
+	_request_shedding(ctx, (used + full) - g->budgetBytes);
+
+	if (used + mandatory <= g->budgetBytes) {
+		g->streamsAdmitted++;
+		g->streamsDowngraded++;
+		return MEM_ADMIT_REDUCED;
+	}
+
+	g->streamsRefused++;
+	if (g->lastRefusalReport + 5 <= now) {
+		g->lastRefusalReport = now;
+		if (ctx->verbose) {
+			printf("Memory budget of %" PRIu64 "MB exhausted, refusing new streams (%" PRIu64 " refused so far)\n",
+				g->budgetBytes / 1048576, g->streamsRefused);
+		}
+	}
+
+	return MEM_ADMIT_REFUSE;
+}
+
+/* Drop all of the optional analyzers for a stream, leaving the pid statistics.
+ * Called on the pcap thread, which is the writer for these objects. We take
+ * ctx->lock to keep the ui/json/file reporting away while we do it.
+ */
+void nic_monitor_memory_shed(struct tool_context_s *ctx, struct discovered_item_s *di)
+{
+	pthread_mutex_lock(&ctx->lock);
+
+	uint64_t before = 0;
+	for (int i = 0; i < MEM_SUBSYSTEM_MAX; i++)
+		before += di->memBytes[i];
+
+	pthread_mutex_lock(&di->bitrateBucketLock);
+	if (di->packetIntervals) {
+		ltn_histogram_free(di->packetIntervals);
+		di->packetIntervals = NULL;
+		nic_monitor_memory_release(di, MEM_SUBSYSTEM_IAT_HISTOGRAM);
+	}
+	if (di->packetIntervalAverages) {
+		throughput_hires_free(di->packetIntervalAverages);
+		di->packetIntervalAverages = NULL;
+		nic_monitor_memory_release(di, MEM_SUBSYSTEM_IAT_AVERAGES);
+	}
+	if (di->packetPayloadSizeBits) {
+		throughput_hires_free(di->packetPayloadSizeBits);
+		di->packetPayloadSizeBits = NULL;
+		nic_monitor_memory_release(di, MEM_SUBSYSTEM_BITRATE_BUCKETS);
+	}
+	pthread_mutex_unlock(&di->bitrateBucketLock);
+
+	if (di->streamModel) {
+		ltntstools_streammodel_free(di->streamModel);
+		di->streamModel = NULL;
+		nic_monitor_memory_release(di, MEM_SUBSYSTEM_STREAMMODEL);
+	}
+	if (di->LTNLatencyProbe) {
+		ltntstools_probe_ltnencoder_free(di->LTNLatencyProbe);
+		di->LTNLatencyProbe = NULL;
+		nic_monitor_memory_release(di, MEM_SUBSYSTEM_LTN_PROBE);
+	}
+
+	pthread_mutex_lock(&di->h264_sliceLock);
+	if (di->h264_slices) {
+		h264_slice_counter_free(di->h264_slices);
+		di->h264_slices = NULL;
+		nic_monitor_memory_release(di, MEM_SUBSYSTEM_H264);
+	}
+	pthread_mutex_unlock(&di->h264_sliceLock);
+
+	pthread_mutex_lock(&di->frameStatsLock);
+	if (di->frameStats) {
+		video_frame_stats_free(di->frameStats);
+		di->frameStats = NULL;
+		nic_monitor_memory_release(di, MEM_SUBSYSTEM_FRAME_STATS);
+	}
+	pthread_mutex_unlock(&di->frameStatsLock);
+
+	nic_monitor_audio_release_buffers(di);
+
+	di->memShedPending = 0;
+	di->memReduced = 1;
+
+	uint64_t after = 0;
+	for (int i = 0; i < MEM_SUBSYSTEM_MAX; i++)
+		after += di->memBytes[i];
+	if (after < before)
+		ctx->memGovernor.streamsShed++;
+
+	pthread_mutex_unlock(&ctx->lock);
+
+	display_doc_append_with_time(&di->doc_stream_log, "Memory budget reached, optional analyzers disabled", NULL);
+}
+
+/* One line summary for the UI header and console reports. */
+int nic_monitor_memory_sprintf(struct tool_context_s *ctx, char *dst, int lengthBytes)
+{
+	struct memory_governor_s *g = &ctx->memGovernor;
+
+	if (g->budgetBytes == 0) {
+		return snprintf(dst, lengthBytes, "Memory: governor disabled, estimated %" PRIu64 "MB in use",
+			g->usedBytes / 1048576);
+	}
+
+	return snprintf(dst, lengthBytes, "Memory: %" PRIu64 "/%" PRIu64 "MB (%.0f%%) admitted %" PRIu64 " downgraded %" PRIu64 " refused %" PRIu64 " shed %" PRIu64,
+		g->usedBytes / 1048576,
+		g->budgetBytes / 1048576,
+		((double)g->usedBytes / (double)g->budgetBytes) * 100.0,
+		g->streamsAdmitted,
+		g->streamsDowngraded,
+		g->streamsRefused,
+		g->streamsShed);
+}
+
+void nic_monitor_memory_dprintf(struct tool_context_s *ctx, int fd)
+{
+	struct memory_governor_s *g = &ctx->memGovernor;
+	char line[256];
+
+	nic_monitor_memory_sprintf(ctx, &line[0], sizeof(line));
+	dprintf(fd, "%s\n", line);
+
+	pthread_mutex_lock(&g->lock);
+	for (int i = 0; i < MEM_SUBSYSTEM_MAX; i++) {
+		dprintf(fd, "  %-16s %8.2fMB\n", nic_monitor_memory_subsystem_name(i),
+			(double)g->subsystemBytes[i] / 1048576.0);
+	}
+	pthread_mutex_unlock(&g->lock);
+}
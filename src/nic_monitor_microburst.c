@@ -0,0 +1,347 @@
+#include "nic_monitor.h"
+
+/* Microbursts.
+ * A stream that averages 20Mbps can still deliver a full frame's worth of
+ * datagrams back to back at line rate, and it's those bursts, not the average,
+ * that overflow switch port buffers and receive rings. The 10ms and 100ms
+ * bitrate high water marks average them away.
+ *
+ * Each stream, and the interface as a whole, keeps a ring of the frames that
+ * arrived within the last window (100us to 1ms, --microburst-us). The sum over
+ * the ring is the exact sliding window peak, moving with every frame. Once a
+ * second the largest window is compared against the mean bytes per window for
+ * that same second, giving the burst to mean ratio, and the peak less the mean
+ * is the buffer a downstream device draining at the mean rate would need.
+ *
+ * Separately, capture time is cut into aligned windows and each one goes into a
+ * histogram by its bytes against the previous second's mean, so a stream that
+ * is smooth most of the time with the odd burst looks different from a stream
+ * that is always bursty.
+ *
+ * Timestamps are capture timestamps, with nanoseconds where the capture supports
+ * them. Bytes are whole frames as captured, Ethernet header included.
+ *
+ * The interface detector runs on the pcap thread, ahead of FEC and admission
+ * control, so it sees every UDP frame on the wire, including FEC flows and
+ * flows that never become streams. Per stream detectors run on the stats thread,
+ * fed from the deferred queue, so how late it gets to a frame doesn't matter.
+ * A stream with FEC counts its media as released by the engine, but not the
+ * packets the engine recovered, they never crossed the wire.
+ *
+ * Each engine has a single writer, on every frame, and only takes the lock
+ * once a second to publish.
+ */
+
+#define NSEC_PER_SEC 1000000000ULL
+
+/* Bucket 0 holds empty windows, 1 holds windows under a quarter of the mean,
+ * then a power of two per bucket from 1/4-1/2 up to 32x and above.
+ */
+static const char *bucketLabels[MICROBURST_HIST_BUCKETS] =
+	{ "0", "<1/4", "1/4-1/2", "1/2-1", "1-2", "2-4", "4-8", "8-16", "16-32", "32+" };
+
+static int _bucket(uint64_t bytes, double mean)
+{
+	if (bytes == 0)
+		return 0;
+
+	double ratio = (double)bytes / mean;
+	double threshold = 0.25;
+	int b = 1;
+	while (b < MICROBURST_HIST_BUCKETS - 1 && ratio >= threshold) {
+		threshold *= 2;
+		b++;
+	}
+	return b;
+}
+
+static double _mbps(uint64_t bytes, uint64_t windowNs)
+{
+	return (double)(bytes * 8) * 1000.0 / (double)windowNs;
+}
+
+static struct microburst_engine_s *_engine_alloc(int windowUs, uint32_t ringSize)
+{
+	struct microburst_engine_s *e = calloc(1, sizeof(*e));
+	if (!e)
+		return NULL;
+
+	e->ring = malloc(ringSize * sizeof(struct microburst_frame_s));
+	if (!e->ring) {
+		free(e);
+		return NULL;
+	}
+
+	pthread_mutex_init(&e->lock, NULL);
+	e->ringSize = ringSize;
+	e->windowNs = (uint64_t)windowUs * 1000ULL;
+
+	return e;
+}
+
+static void _engine_free(struct microburst_engine_s *e)
+{
+	pthread_mutex_destroy(&e->lock);
+	free(e->ring);
+	free(e);
+}
+
+int nic_monitor_microburst_start(struct tool_context_s *ctx)
+{
+	if (ctx->microburst.windowUs <= 0)
+		return 0;
+
+	ctx->microburst.aggregate = _engine_alloc(ctx->microburst.windowUs, MICROBURST_RING_INTERFACE);
+	if (!ctx->microburst.aggregate)
+		return -1;
+
+	return 0;
+}
+
+void nic_monitor_microburst_stop(struct tool_context_s *ctx)
+{
+	if (!ctx->microburst.aggregate)
+		return;
+
+	_engine_free(ctx->microburst.aggregate);
+	ctx->microburst.aggregate = NULL;
+}
+
+int nic_monitor_microburst_alloc(struct discovered_item_s *di)
+{
+	if (di->ctx->microburst.windowUs <= 0)
+		return 0;
+
+	di->microburst = _engine_alloc(di->ctx->microburst.windowUs, MICROBURST_RING_STREAM);
+	if (!di->microburst)
+		return -1;
+
+	nic_monitor_memory_charge(di, MEM_SUBSYSTEM_MICROBURST);
+
+	return 0;
+}
+
+void nic_monitor_microburst_free(struct discovered_item_s *di)
+{
+	if (!di->microburst)
+		return;
+
+	_engine_free(di->microburst);
+	di->microburst = NULL;
+	nic_monitor_memory_release(di, MEM_SUBSYSTEM_MICROBURST);
+}
+
+/* The aligned window is done, nextSlot is the first window after it that has traffic. */
+static void _close_slot(struct microburst_engine_s *e, uint64_t nextSlot)
+{
+	if (e->windowMean <= 0)
+		return;
+
+	e->secondHist[_bucket(e->slotBytes, e->windowMean)]++;
+	if (nextSlot > e->slot + 1)
+		e->secondHist[0] += nextSlot - e->slot - 1;
+}
+
+static void _close_second(struct microburst_engine_s *e, uint64_t nextSecond)
+{
+	/* Windows belong to the second they start in */
+	_close_slot(e, (((e->second + 1) * NSEC_PER_SEC) - 1) / e->windowNs + 1);
+
+	double mean = (double)e->secondBytes * (double)e->windowNs / (double)NSEC_PER_SEC;
+	int primed = e->primed;
+
+	if (primed && e->secondBytes) {
+		pthread_mutex_lock(&e->lock);
+		e->seconds++;
+		e->lastPeakBytes = e->secondPeak;
+		e->lastMeanBytes = mean;
+		if (e->secondPeak > e->maxPeakBytes)
+			e->maxPeakBytes = e->secondPeak;
+
+		double ratio = (double)e->secondPeak / mean;
+		if (ratio > e->maxRatio) {
+			e->maxRatio = ratio;
+			e->maxRatioTime = (time_t)e->second;
+		}
+		if (e->secondPeak > mean && e->secondPeak - (uint64_t)mean > e->maxExcessBytes)
+			e->maxExcessBytes = e->secondPeak - (uint64_t)mean;
+
+		for (int i = 0; i < MICROBURST_HIST_BUCKETS; i++)
+			e->hist[i] += e->secondHist[i];
+		pthread_mutex_unlock(&e->lock);
+	}
+
+	/* The first second we see is partial, its mean is too low to compare against.
+	 * After a gap the stream has effectively restarted, wait for a whole second again.
+	 */
+	e->primed = 1;
+	e->windowMean = (primed && nextSecond == e->second + 1) ? mean : 0;
+
+	e->second = nextSecond;
+	e->secondBytes = 0;
+	e->secondPeak = 0;
+	memset(&e->secondHist[0], 0, sizeof(e->secondHist));
+	e->slot = ((nextSecond * NSEC_PER_SEC) - 1) / e->windowNs + 1;
+	e->slotBytes = 0;
+}
+
+/* Called by the engine's one writer thread, for every frame, in capture order. */
+void nic_monitor_microburst_write(struct microburst_engine_s *e, const struct timeval *ts, uint32_t tsNsec, uint32_t lengthBytes)
+{
+	if (!e)
+		return;
+
+	uint64_t tsNs = ((uint64_t)ts->tv_sec * NSEC_PER_SEC) + tsNsec;
+
+	/* FEC media comes out in sequence order, a reordered frame can be stamped a little behind the frames around it */
+	if (tsNs < e->lastNs)
+		tsNs = e->lastNs;
+
+	uint64_t second = tsNs / NSEC_PER_SEC;
+	if (e->lastNs == 0) {
+		e->second = second;
+		e->slot = tsNs / e->windowNs;
+	} else
+	if (second != e->second) {
+		_close_second(e, second);
+	}
+	e->lastNs = tsNs;
+
+	/* Sliding window, (tsNs - windowNs, tsNs] */
+	while (e->ringCount) {
+		uint32_t tail = (e->ringHead + e->ringSize - e->ringCount) % e->ringSize;
+		if (e->ring[tail].tsNs + e->windowNs > tsNs && e->ringCount < e->ringSize)
+			break;
+		if (e->ring[tail].tsNs + e->windowNs > tsNs)
+			e->overflows++;
+		e->ringBytes -= e->ring[tail].bytes;
+		e->ringCount--;
+	}
+	e->ring[e->ringHead].tsNs = tsNs;
+	e->ring[e->ringHead].bytes = lengthBytes;
+	e->ringHead = (e->ringHead + 1) % e->ringSize;
+	e->ringCount++;
+	e->ringBytes += lengthBytes;
+
+	if (e->ringBytes > e->secondPeak)
+		e->secondPeak = e->ringBytes;
+
+	/* Aligned windows, for the histogram. The tail of a window that straddled
+	 * the second boundary lands in the next window.
+	 */
+	uint64_t slot = tsNs / e->windowNs;
+	if (slot > e->slot) {
+		_close_slot(e, slot);
+		e->slot = slot;
+		e->slotBytes = 0;
+	}
+	e->slotBytes += lengthBytes;
+	e->secondBytes += lengthBytes;
+}
+
+/* Results only, detection carries on undisturbed. */
+void nic_monitor_microburst_reset(struct microburst_engine_s *e)
+{
+	if (!e)
+		return;
+
+	pthread_mutex_lock(&e->lock);
+	e->seconds = 0;
+	e->lastPeakBytes = 0;
+	e->lastMeanBytes = 0;
+	e->maxPeakBytes = 0;
+	e->maxRatio = 0;
+	e->maxRatioTime = 0;
+	e->maxExcessBytes = 0;
+	e->overflows = 0;
+	memset(&e->hist[0], 0, sizeof(e->hist));
+	pthread_mutex_unlock(&e->lock);
+}
+
+/* Caller holds the lock */
+static void _engine_dprintf(struct microburst_engine_s *e, int fd, const char *label)
+{
+	char ts[32] = { 0 };
+	struct tm tm;
+	localtime_r(&e->maxRatioTime, &tm);
+	strftime(&ts[0], sizeof(ts), "%Y%m%d-%H%M%S", &tm);
+
+	uint64_t windowUs = e->windowNs / 1000;
+	dprintf(fd, "Microbursts %s, %" PRIu64 "us windows: peak %" PRIu64 " bytes (%.1f Mbps), worst %.1fx the mean at %s, "
+		"%" PRIu64 " bytes above the mean\n",
+		label, windowUs, e->maxPeakBytes, _mbps(e->maxPeakBytes, e->windowNs), e->maxRatio, ts, e->maxExcessBytes);
+	dprintf(fd, "    last second          peak %" PRIu64 " bytes (%.1f Mbps), mean %.0f bytes (%.1f Mbps), %.1fx\n",
+		e->lastPeakBytes, _mbps(e->lastPeakBytes, e->windowNs),
+		e->lastMeanBytes, _mbps((uint64_t)e->lastMeanBytes, e->windowNs),
+		e->lastMeanBytes > 0 ? (double)e->lastPeakBytes / e->lastMeanBytes : 0);
+
+	dprintf(fd, "    windows x mean      ");
+	for (int i = 0; i < MICROBURST_HIST_BUCKETS; i++) {
+		if (e->hist[i])
+			dprintf(fd, " %s:%" PRIu64, bucketLabels[i], e->hist[i]);
+	}
+	dprintf(fd, "\n");
+	if (e->overflows)
+		dprintf(fd, "    %" PRIu64 " frames beyond the window ring, peaks may be under reported\n", e->overflows);
+	dprintf(fd, "\n");
+}
+
+void nic_monitor_microburst_dprintf(struct discovered_item_s *di, int fd)
+{
+	struct microburst_engine_s *e = di->microburst;
+	if (!e)
+		return;
+
+	char label[128];
+	snprintf(label, sizeof(label), "%s -> %s", di->srcaddr, di->dstaddr);
+
+	pthread_mutex_lock(&e->lock);
+	if (e->seconds)
+		_engine_dprintf(e, fd, label);
+	pthread_mutex_unlock(&e->lock);
+}
+
+void nic_monitor_microburst_interface_dprintf(struct tool_context_s *ctx, int fd)
+{
+	struct microburst_engine_s *e = ctx->microburst.aggregate;
+	if (!e)
+		return;
+
+	pthread_mutex_lock(&e->lock);
+	if (e->seconds)
+		_engine_dprintf(e, fd, "interface");
+	else
+		dprintf(fd, "Microbursts interface: not a whole second of traffic measured\n\n");
+	pthread_mutex_unlock(&e->lock);
+}
+
+/* ratio_hist is indexed by bucket: empty windows, under 1/4 of the mean, then 1/4-1/2, 1/2-1, 1-2 ... 16-32, 32x and above. */
+void nic_monitor_microburst_json(struct discovered_item_s *di, json_object *feed)
+{
+	struct microburst_engine_s *e = di->microburst;
+	if (!e)
+		return;
+
+	json_object *mb = json_object_new_object();
+
+	pthread_mutex_lock(&e->lock);
+	json_object_object_add(mb, "window_us", json_object_new_int64(e->windowNs / 1000));
+	json_object_object_add(mb, "seconds", json_object_new_int64(e->seconds));
+	json_object_object_add(mb, "last_peak_bytes", json_object_new_int64(e->lastPeakBytes));
+	json_object_object_add(mb, "last_mean_bytes", json_object_new_double(e->lastMeanBytes));
+	json_object_object_add(mb, "max_peak_bytes", json_object_new_int64(e->maxPeakBytes));
+	json_object_object_add(mb, "max_peak_mbps", json_object_new_double(_mbps(e->maxPeakBytes, e->windowNs)));
+	json_object_object_add(mb, "max_ratio", json_object_new_double(e->maxRatio));
+	json_object_object_add(mb, "max_ratio_time", json_object_new_int64(e->maxRatioTime));
+	json_object_object_add(mb, "max_excess_bytes", json_object_new_int64(e->maxExcessBytes));
+	json_object_object_add(mb, "overflows", json_object_new_int64(e->overflows));
+
+	json_object *hist = json_object_new_array();
+	for (int i = 0; i < MICROBURST_HIST_BUCKETS; i++) {
+		json_object_array_add(hist, json_object_new_int64(e->hist[i]));
+	}
+	json_object_object_add(mb, "ratio_hist", hist);
+	pthread_mutex_unlock(&e->lock);
+
+	json_object_object_add(feed, "microburst", mb);
+}
@@ -0,0 +1,53 @@
+#include "nic_monitor.h"
+
+/* Candidate pids from a stream's PSI model.
+ * Codec metadata, audio and captions each pick the pids they care about by
+ * stream type. Querying the model copies the whole PAT/PMT tree, and the
+ * services do it while holding ctx->lock, which the pcap thread wants for
+ * every packet, so the queries are rationed.
+ *
+ * A stream that has candidates is looked at again every intervalSecs, in case
+ * the PMT changes. A stream that has none, no PMT yet, or no video, audio or
+ * caption pids at all, backs off: one second, then doubling up to
+ * MODEL_BACKOFF_MAX_SECS. A new stream's PMT is normally in the model within the
+ * first second, so that costs nothing in practice, while a data only stream
+ * stops being queried every second forever.
+ */
+
+/* Returns the number of matching pids, or -1 when it isn't time yet or the model isn't available. */
+int nic_monitor_model_pids(struct discovered_item_s *di, struct model_check_s *check, time_t now, int intervalSecs,
+	int (*match)(uint8_t streamType), struct model_pid_s *pids, int maxPids)
+{
+	if (!di->streamModel || check->next > now)
+		return -1;
+
+	int count = -1;
+
+	struct ltntstools_pat_s *m = NULL;
+	if (ltntstools_streammodel_query_model(di->streamModel, &m) == 0) {
+		count = 0;
+		for (int p = 0; p < m->program_count; p++) {
+			for (int s = 0; s < m->programs[p].pmt.stream_count && count < maxPids; s++) {
+				uint8_t streamType = m->programs[p].pmt.streams[s].stream_type;
+				if (!match(streamType))
+					continue;
+				pids[count].pid = m->programs[p].pmt.streams[s].elementary_PID;
+				pids[count].streamType = streamType;
+				count++;
+			}
+		}
+		ltntstools_pat_free(m);
+	}
+
+	if (count > 0) {
+		check->backoffSecs = 0;
+		check->next = now + intervalSecs;
+	} else {
+		check->backoffSecs = check->backoffSecs ? check->backoffSecs * 2 : 1;
+		if (check->backoffSecs > MODEL_BACKOFF_MAX_SECS)
+			check->backoffSecs = MODEL_BACKOFF_MAX_SECS;
+		check->next = now + check->backoffSecs;
+	}
+
+	return count;
+}
@@ -48,7 +48,7 @@ void pcap_queue_free(struct tool_context_s *ctx)
 	pthread_mutex_unlock(&ctx->lockpcap);
 }
 
-int pcap_queue_push(struct tool_context_s *ctx, const struct pcap_pkthdr *h, const u_char *pkt)
+int pcap_queue_push(struct tool_context_s *ctx, const struct pcap_pkthdr *h, const u_char *pkt, uint32_t tsNsec, uint32_t flags)
 {
 	struct pcap_item_s *item = NULL;
 
@@ -96,6 +96,8 @@ int pcap_queue_push(struct tool_context_s *ctx, const struct pcap_pkthdr *h, con
 
 		memcpy(item->h, h, sizeof(*h));
 		memcpy(item->pkt, pkt, h->len);
+		item->tsNsec = tsNsec;
+		item->flags = flags;
 		xorg_list_append(&item->list, &ctx->listpcapUsed);
 		ctx->listpcapUsedDepth++;
 
@@ -218,10 +220,11 @@ static void _processPackets_Stats(struct tool_context_s *ctx,
 			di->iat_hwm_us_last_nsecond_accumulator = 0;
 		}
 
-		ltn_histogram_interval_update_with_value(di->packetIntervals, di->iat_cur_us / 1000);
-		throughput_hires_write_i64(di->packetIntervalAverages, 0, di->iat_cur_us / 1000, NULL);
+		if (di->packetIntervals) {
+			ltn_histogram_interval_update_with_value(di->packetIntervals, di->iat_cur_us / 1000);
+		}
 		
-		if (di->streamModel &&
+		if (di->streamModel && di->deepActive &&
 			((di->payloadType == PAYLOAD_RTP_TS) || (di->payloadType == PAYLOAD_UDP_TS))) {
 			int complete;
 			ltntstools_streammodel_write(di->streamModel, pkts, pktCount, &complete);
@@ -231,40 +234,47 @@ static void _processPackets_Stats(struct tool_context_s *ctx,
 		/* Work thorugh the hires list, calculate the max IAT for each period and maintain a high-watermark */
 		/* Write the number of bits and a timestamp into a hirres counter */
 		pthread_mutex_lock(&di->bitrateBucketLock);
-		throughput_hires_write_i64(di->packetPayloadSizeBits, 0, lengthPayloadBytes * 8, NULL);
+		if (di->packetIntervalAverages) {
+			throughput_hires_write_i64(di->packetIntervalAverages, 0, di->iat_cur_us / 1000, NULL);
+		}
 
-		struct timeval nowtv;
-		gettimeofday(&nowtv, NULL);
+		/* The memory governor may have removed the buckets, pid statistics only. */
+		if (di->packetPayloadSizeBits) {
+			throughput_hires_write_i64(di->packetPayloadSizeBits, 0, lengthPayloadBytes * 8, NULL);
 
-		struct timeval then10ms;
-		timeval_subtract(&then10ms, &nowtv, 10);
-		int64_t bitrate_max_10ms = throughput_hires_sumtotal_i64(di->packetPayloadSizeBits, 0, &then10ms, &nowtv);
-		if (di->bitrate_hwm_us_10ms <= bitrate_max_10ms)
-			di->bitrate_hwm_us_10ms = bitrate_max_10ms;
+			struct timeval nowtv;
+			gettimeofday(&nowtv, NULL);
 
-		/* Track max IAT for the last N seconds, it's reported in the summary/detailed logs. */
-		if (di->bitrate_hwm_us_10ms > di->bitrate_hwm_us_10ms_last_nsecond_accumulator) {
-			di->bitrate_hwm_us_10ms_last_nsecond_accumulator = bitrate_max_10ms;
-		}
-		if ((di->bitrate_hwm_us_10ms_last_nsecond_time + ctx->file_write_interval) <= now) {
-			di->bitrate_hwm_us_10ms_last_nsecond_time = now;
-			di->bitrate_hwm_us_10ms_last_nsecond = di->bitrate_hwm_us_10ms_last_nsecond_accumulator;
-			di->bitrate_hwm_us_10ms_last_nsecond_accumulator = 0;
-		}
+			struct timeval then10ms;
+			timeval_subtract(&then10ms, &nowtv, 10);
+			int64_t bitrate_max_10ms = throughput_hires_sumtotal_i64(di->packetPayloadSizeBits, 0, &then10ms, &nowtv);
+			if (di->bitrate_hwm_us_10ms <= bitrate_max_10ms)
+				di->bitrate_hwm_us_10ms = bitrate_max_10ms;
+
+			/* Track max IAT for the last N seconds, it's reported in the summary/detailed logs. */
+			if (di->bitrate_hwm_us_10ms > di->bitrate_hwm_us_10ms_last_nsecond_accumulator) {
+				di->bitrate_hwm_us_10ms_last_nsecond_accumulator = bitrate_max_10ms;
+			}
+			if ((di->bitrate_hwm_us_10ms_last_nsecond_time + ctx->file_write_interval) <= now) {
+				di->bitrate_hwm_us_10ms_last_nsecond_time = now;
+				di->bitrate_hwm_us_10ms_last_nsecond = di->bitrate_hwm_us_10ms_last_nsecond_accumulator;
+				di->bitrate_hwm_us_10ms_last_nsecond_accumulator = 0;
+			}
 
-		struct timeval then100ms;
-		timeval_subtract(&then100ms, &nowtv, 100);
-		int64_t bitrate_max_100ms = throughput_hires_sumtotal_i64(di->packetPayloadSizeBits, 0, &then100ms, &nowtv);
-		if (di->bitrate_hwm_us_100ms <= bitrate_max_100ms)
-			di->bitrate_hwm_us_100ms = bitrate_max_100ms;
+			struct timeval then100ms;
+			timeval_subtract(&then100ms, &nowtv, 100);
+			int64_t bitrate_max_100ms = throughput_hires_sumtotal_i64(di->packetPayloadSizeBits, 0, &then100ms, &nowtv);
+			if (di->bitrate_hwm_us_100ms <= bitrate_max_100ms)
+				di->bitrate_hwm_us_100ms = bitrate_max_100ms;
 
-		if (di->bitrate_hwm_us_100ms > di->bitrate_hwm_us_10ms_last_nsecond_accumulator) {
-			di->bitrate_hwm_us_100ms_last_nsecond_accumulator = bitrate_max_100ms;
-		}
-		if ((di->bitrate_hwm_us_100ms_last_nsecond_time + ctx->file_write_interval) <= now) {
-			di->bitrate_hwm_us_100ms_last_nsecond_time = now;
-			di->bitrate_hwm_us_100ms_last_nsecond = di->bitrate_hwm_us_100ms_last_nsecond_accumulator;
-			di->bitrate_hwm_us_100ms_last_nsecond_accumulator = 0;
+			if (di->bitrate_hwm_us_100ms > di->bitrate_hwm_us_10ms_last_nsecond_accumulator) {
+				di->bitrate_hwm_us_100ms_last_nsecond_accumulator = bitrate_max_100ms;
+			}
+			if ((di->bitrate_hwm_us_100ms_last_nsecond_time + ctx->file_write_interval) <= now) {
+				di->bitrate_hwm_us_100ms_last_nsecond_time = now;
+				di->bitrate_hwm_us_100ms_last_nsecond = di->bitrate_hwm_us_100ms_last_nsecond_accumulator;
+				di->bitrate_hwm_us_100ms_last_nsecond_accumulator = 0;
+			}
 		}
 		pthread_mutex_unlock(&di->bitrateBucketLock);
 #endif
@@ -289,16 +299,15 @@ static void _processPackets_Stats(struct tool_context_s *ctx,
 // SEGFAULT
 		ltntstools_pid_stats_update(di->stats, pkts, pktCount);
 
-		if (di->isLTNEncoder) {
+		nic_monitor_loss_write(ctx, di, pkts, pktCount, &cb_h->ts);
+
+		/* The probe is NULL when the memory governor has disabled it for this stream. */
+		if (di->LTNLatencyProbe && di->deepActive && (di->isLTNEncoder || ctx->measureSEILatencyAlways)) {
 			/* TODO: This will find the first timestamp in a MPTS and it will be rendered as an identical
 			 * measurement for every service in the mux. This would be factually wrong. The right approach
 			 * is to have a sense of 'which video pid' the latency is associated with, and render that.
 			 */
 			ltntstools_probe_ltnencoder_sei_timestamp_query(di->LTNLatencyProbe, pkts, pktCount * 188);
-		} else {
-			if (ctx->measureSEILatencyAlways) {
-				ltntstools_probe_ltnencoder_sei_timestamp_query(di->LTNLatencyProbe, pkts, pktCount * 188);
-			}
 		}
 
 		if (di->stats->ccErrors != di->statsToUI_ccErrors) {
@@ -334,16 +343,85 @@ static void _processPackets_Stats(struct tool_context_s *ctx,
 	}
 }
 
+/* The expensive analyzers. Called on the stats thread, only while the stream holds a deep inspection slot. */
+static void _processPackets_Deep(struct discovered_item_s *di, const uint8_t *pkts, uint32_t pktCount)
+{
+	pthread_mutex_lock(&di->h264_sliceLock);
+	if (di->h264_slices) {
+		h264_slice_counter_write(di->h264_slices, pkts, pktCount);
+
+		// We need to decide how to render these, and when.
+		//h264_slice_counter_dprintf(di->h264_slices, 0, 0);
+	}
+	pthread_mutex_unlock(&di->h264_sliceLock);
+
+	pthread_mutex_lock(&di->frameStatsLock);
+	if (di->frameStats) {
+		video_frame_stats_write(di->frameStats, pkts, pktCount);
+	}
+	pthread_mutex_unlock(&di->frameStatsLock);
+
+	nic_monitor_codec_write(di, pkts, pktCount);
+	nic_monitor_audio_write(di, pkts, pktCount);
+}
+
+/* Stuffing removal scratch space for forwarding, the largest UDP payload. Only used from the IO thread. */
+static uint8_t forwardBuf[(65536 / 188) * 188];
+
+/* Interface statistics block, capture counters since startup. */
+static void _pcapng_write_stats(struct tool_context_s *ctx, struct discovered_item_s *di)
+{
+	uint8_t isb[128];
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+
+	int len = pcapng_writer_isb(di->pcapng, &isb[0], ((uint64_t)tv.tv_sec * 1000000000ULL) + (tv.tv_usec * 1000ULL),
+		ctx->pcap_stats.ps_recv, ctx->pcap_stats.ps_drop, ctx->pcap_stats.ps_ifdrop);
+	ltntstools_segmentwriter_write(di->pcapRecorder, &isb[0], len);
+}
+
+/* Stop a recording. pcapng recordings end with final drop counters and, for single
+ * file recordings, the flow index. Segment offsets restart in every file, so segmented
+ * recordings don't get an index.
+ */
+void nic_monitor_recording_free(struct tool_context_s *ctx, struct discovered_item_s *di)
+{
+	if (di->pcapng && di->pcapRecorder) {
+		_pcapng_write_stats(ctx, di);
+
+		int len = pcapng_writer_index_length(di->pcapng);
+		uint8_t *index = NULL;
+		if (!ctx->recordWithSegments && (index = malloc(len))) {
+			pcapng_writer_index(di->pcapng, index);
+			ltntstools_segmentwriter_write(di->pcapRecorder, index, len);
+			free(index);
+		}
+	}
+	if (di->pcapng) {
+		pcapng_writer_free(di->pcapng);
+		di->pcapng = NULL;
+	}
+	if (di->pcapRecorder) {
+		ltntstools_segmentwriter_free(di->pcapRecorder);
+		di->pcapRecorder = NULL;
+	}
+}
+
 /* Called on the stats thread, blocking and stalling is tolerated. */
 static void _processPackets_IO(struct tool_context_s *ctx,
 	struct ether_header *ethhdr, struct iphdr *iphdr, struct udphdr *udphdr,
 	const uint8_t *pkts, uint32_t pktCount, int isRTP,
-	const struct pcap_pkthdr *cb_h, const u_char *cb_pkt, int lengthBytes)
+	const struct pcap_pkthdr *cb_h, const u_char *cb_pkt, uint32_t tsNsec, uint32_t flags, int lengthBytes)
 {
-	struct discovered_item_s *di = discovered_item_findcreate(ctx, ethhdr, iphdr, udphdr);
+	/* The pcap thread has already created (admitted) the stream, or chose not to. */
+	struct discovered_item_s *di = discovered_item_find(ctx, iphdr, udphdr);
 	if (!di)
 		return;
 
+	/* Bursts are a property of the wire, FEC recovered packets never crossed it. */
+	if ((flags & PCAP_ITEM_FEC_RECOVERED) == 0)
+		nic_monitor_microburst_write(di->microburst, &cb_h->ts, tsNsec, cb_h->len);
+
 	time_t now;
 	time(&now);
 
@@ -351,8 +429,12 @@ static void _processPackets_IO(struct tool_context_s *ctx,
 
 	if (now >= di->packetIntervalAveragesLastExpire + 5) {
 		di->packetIntervalAveragesLastExpire = now;
-		throughput_hires_expire(di->packetIntervalAverages, NULL); /* Expire anything older than 2 seconds. */
-		throughput_hires_expire(di->packetPayloadSizeBits, NULL); /* Expire anything older than 2 seconds. */
+		pthread_mutex_lock(&di->bitrateBucketLock);
+		if (di->packetIntervalAverages)
+			throughput_hires_expire(di->packetIntervalAverages, NULL); /* Expire anything older than 2 seconds. */
+		if (di->packetPayloadSizeBits)
+			throughput_hires_expire(di->packetPayloadSizeBits, NULL); /* Expire anything older than 2 seconds. */
+		pthread_mutex_unlock(&di->bitrateBucketLock);
 	}
 
 	if (di->payloadType == PAYLOAD_RTP_TS) {
@@ -423,7 +505,16 @@ static void _processPackets_IO(struct tool_context_s *ctx,
 	if (discovered_item_state_get(di, DI_STATE_STREAM_FORWARDING)) {
 		/* Do actual forwarding. */
 #if 1
-		avio_write(di->forwardAVIO, pkts, pktCount * 188);
+		if (ctx->forwardStrip.enabled && pktCount <= (int)(sizeof(forwardBuf) / 188)) {
+			/* Drop the stuffing, the surviving packets leave as they arrived so PCR timing is kept.
+			 * A datagram of nothing but stuffing isn't sent at all.
+			 */
+			int count = stuffing_strip(&ctx->forwardStrip, &di->forwardStripStats, pkts, &forwardBuf[0], pktCount);
+			if (count)
+				avio_write(di->forwardAVIO, &forwardBuf[0], count * 188);
+		} else {
+			avio_write(di->forwardAVIO, pkts, pktCount * 188);
+		}
 #else
 		/* Drop all pids except video, so we can measure video pid jitter.
 		 * TODO: Hardcoded to 0x100, lab use only.
@@ -444,10 +535,7 @@ static void _processPackets_IO(struct tool_context_s *ctx,
 		discovered_item_state_clr(di, DI_STATE_PCAP_RECORD_STOP);
 		discovered_item_state_clr(di, DI_STATE_PCAP_RECORDING);
 
-		if (di->pcapRecorder) {
-			ltntstools_segmentwriter_free(di->pcapRecorder);
-			di->pcapRecorder = NULL;
-		}
+		nic_monitor_recording_free(ctx, di);
 	}
 	if (discovered_item_state_get(di, DI_STATE_PCAP_RECORD_START)) {
 		discovered_item_state_clr(di, DI_STATE_PCAP_RECORD_START);
@@ -487,8 +575,8 @@ static void _processPackets_IO(struct tool_context_s *ctx,
 		/* Substitute : for . */
 		character_replace(prefix, ':', '.');
 
-		char *suffixNames[2] = { ".pcap", ".ts" };
-		char *suffix = suffixNames[0];
+		char *suffixNames[3] = { ".pcap", ".ts", ".pcapng" };
+		char *suffix = suffixNames[ctx->recordPcapng ? 2 : 0];
 
 		/* A/324  and generic streams are always recorded as PCAP, regardless. */
 		if ((di->payloadType == PAYLOAD_BYTE_STREAM ) || (di->payloadType == PAYLOAD_A324_CTP) ||
@@ -511,6 +599,20 @@ static void _processPackets_IO(struct tool_context_s *ctx,
 			exit(1);
 		}
 
+		if (!di->recordAsTS && ctx->recordPcapng) {
+			char description[128];
+			snprintf(description, sizeof(description), "nic_monitor recording of %s", di->dstaddr);
+			if (pcapng_writer_alloc(&di->pcapng, ctx->iftype == IF_TYPE_PCAP ? ctx->ifname : NULL,
+				description, DLT_EN10MB) < 0) {
+				fprintf(stderr, "%s() unable to allocate a pcapng writer\n", __func__);
+				exit(1);
+			}
+			di->pcapngLastStats = now;
+
+			int len = 0;
+			const uint8_t *hdr = pcapng_writer_get_header(di->pcapng, &len);
+			ltntstools_segmentwriter_set_header(di->pcapRecorder, hdr, len);
+		} else
 		if (!di->recordAsTS) {
 			struct pcap_file_header hdr;
 			hdr.magic = 0xa1b2c3d4;
@@ -531,18 +633,33 @@ static void _processPackets_IO(struct tool_context_s *ctx,
 
 		void *obj = NULL;
 		uint8_t *ptr = NULL;
-		int ret = ltntstools_segmentwriter_object_alloc(di->pcapRecorder, 16 + cb_h->len, &obj, &ptr);
-		if (ret < 0 || !ptr || !obj) {
-			return;
-		}
+		if (di->pcapng) {
+			/* Drop counters first, every 5 seconds, so they land ahead of the packets they relate to. */
+			if (di->pcapngLastStats + 5 <= now) {
+				di->pcapngLastStats = now;
+				_pcapng_write_stats(ctx, di);
+			}
 
-		uint8_t *dst = ptr;
-		uint8_t *src = (uint8_t *)cb_h;
+			int ret = ltntstools_segmentwriter_object_alloc(di->pcapRecorder, pcapng_writer_epb_length(cb_h->caplen), &obj, &ptr);
+			if (ret < 0 || !ptr || !obj) {
+				return;
+			}
+			pcapng_writer_epb(di->pcapng, ptr, ((uint64_t)cb_h->ts.tv_sec * 1000000000ULL) + tsNsec,
+				cb_pkt, cb_h->caplen, cb_h->len);
+		} else {
+			int ret = ltntstools_segmentwriter_object_alloc(di->pcapRecorder, 16 + cb_h->len, &obj, &ptr);
+			if (ret < 0 || !ptr || !obj) {
+				return;
+			}
+
+			uint8_t *dst = ptr;
+			uint8_t *src = (uint8_t *)cb_h;
 
-		memcpy(dst +  0, src +  0, 4);
-		memcpy(dst +  4, src +  8, 4);
-		memcpy(dst +  8, src + 16, 8);
-		memcpy(dst + 16, cb_pkt, cb_h->len);
+			memcpy(dst +  0, src +  0, 4);
+			memcpy(dst +  4, src +  8, 4);
+			memcpy(dst +  8, src + 16, 8);
+			memcpy(dst + 16, cb_pkt, cb_h->len);
+		}
 
 		ssize_t len = ltntstools_segmentwriter_object_write(di->pcapRecorder, obj);
 		if (len < 0) {
@@ -595,55 +712,127 @@ static void _processPackets_IO(struct tool_context_s *ctx,
 	media_write(pkts, pktCount);
 #endif
 
-	nic_monitor_tr101290_write(di, pkts, pktCount);
+	/* Cheap enough for every stream, regulatory. */
+	if ((di->payloadType == PAYLOAD_RTP_TS) || (di->payloadType == PAYLOAD_UDP_TS)) {
+		nic_monitor_caption_write(di, pkts, pktCount);
+	}
 
-	pthread_mutex_lock(&di->h264_sliceLock);
-	if (di->h264_slices) {
-		h264_slice_counter_write(di->h264_slices, pkts, pktCount);
+	/* TR101290 runs its own timers, PAT, PMT and PCR would alarm on any stream whose
+	 * packets stopped arriving because it lost its deep slot. It's never gated.
+	 */
+	nic_monitor_tr101290_write(di, pkts, pktCount);
 
-		// We need to decide how to render these, and when.
-		//h264_slice_counter_dprintf(di->h264_slices, 0, 0);
+	/* The deep inspection scheduler decides whether the expensive analyzers see this stream right now. */
+	if (di->deepActive) {
+		_processPackets_Deep(di, pkts, pktCount);
 	}
-	pthread_mutex_unlock(&di->h264_sliceLock);
 
-	pthread_mutex_lock(&di->h264_metadataLock);
-	if (di->h264_metadata_parser) {
-		int complete;
-		ltntstools_h264_codec_metadata_write(di->h264_metadata_parser, pkts, pktCount, &complete);
+	discovered_item_warningindicators_update(ctx, di);
+}
+
+/* SMPTE 2022-1 engine output, media in sequence order with recovered packets back in place.
+ * Called on the pcap thread from inside smpte2022_fec_write_*(), di->fecLock held.
+ * Each packet is rebuilt into a capture frame from the last media headers, then fed
+ * to the statistics and the IO queue, exactly as a packet from the wire would be,
+ * with its own capture time. Recovered packets are flagged, see PCAP_ITEM_FEC_RECOVERED.
+ */
+static void _fec_output_cb(void *userContext, const uint8_t *rtp, int lengthBytes, int recovered, uint64_t timestampNs)
+{
+	struct discovered_item_s *di = (struct discovered_item_s *)userContext;
+	struct tool_context_s *ctx = di->ctx;
+	uint8_t frame[FEC_FRAME_HEADER_SIZE + 1500];
 
-		if (complete) {
-			struct h264_codec_metadata_results_s r;
-			if (ltntstools_h264_codec_metadata_query(di->h264_metadata_parser, &r) == 0) {
-				strcpy(&di->h264_video_colorspace[0], &r.sps.video_colorspace_ascii[0]);
-				strcpy(&di->h264_video_format[0], &r.sps.video_format_ascii[0]);
-			}
+	memcpy(&frame[0], di->fecFrameHeader, FEC_FRAME_HEADER_SIZE);
+	memcpy(&frame[FEC_FRAME_HEADER_SIZE], rtp, lengthBytes);
+
+	struct ether_header *ethhdr = (struct ether_header *)&frame[0];
+	struct iphdr *iphdr = (struct iphdr *)((u_char *)ethhdr + sizeof(struct ether_header));
+	struct udphdr *udphdr = (struct udphdr *)((u_char *)iphdr + sizeof(struct iphdr));
+
+#ifdef __APPLE__
+	iphdr->ip_len = htons(sizeof(struct iphdr) + sizeof(struct udphdr) + lengthBytes);
+	iphdr->ip_sum = 0;
+#endif
+#ifdef __linux__
+	iphdr->tot_len = htons(sizeof(struct iphdr) + sizeof(struct udphdr) + lengthBytes);
+	iphdr->check = 0;
+#endif
+	udphdr->uh_ulen = htons(sizeof(struct udphdr) + lengthBytes);
+	udphdr->uh_sum = 0;
+
+	struct pcap_pkthdr h;
+	memset(&h, 0, sizeof(h));
+	uint32_t tsNsec = timestampNs % 1000000000ULL;
+	h.ts.tv_sec = timestampNs / 1000000000ULL;
+	h.ts.tv_usec = tsNsec / 1000;
+	h.caplen = FEC_FRAME_HEADER_SIZE + lengthBytes;
+	h.len = h.caplen;
+
+	int lengthPayloadBytes = lengthBytes - 12;
+	_processPackets_Stats(ctx, ethhdr, iphdr, udphdr, &frame[FEC_FRAME_HEADER_SIZE + 12], lengthPayloadBytes / 188,
+		PAYLOAD_UNDEFINED, &h, &frame[0], lengthPayloadBytes, di);
+
+	/* Forwarding, recording and the RTP analyzer see the recovered stream too. */
+	pcap_queue_push(ctx, &h, &frame[0], tsNsec, recovered ? PCAP_ITEM_FEC_RECOVERED : 0);
+}
+
+/* A FEC packet for a stream we already know, hand it to that streams engine.
+ * Returns 1 if the packet was consumed.
+ */
+static int _process_fec(struct tool_context_s *ctx, uint64_t timestampNs,
+	struct iphdr *iphdr, struct udphdr *udphdr, const uint8_t *ptr, int lengthPayloadBytes)
+{
+	/* Cheap checks first, this runs for anything that merely looks like FEC. */
+	if (!smpte2022_fec_is_fec_packet(ptr, lengthPayloadBytes))
+		return 0;
+
+	struct discovered_item_s *self = NULL;
+	struct discovered_item_s *di = discovered_item_find_fec_media(ctx, iphdr, udphdr, &self);
+	if (!di)
+		return 0;
+
+	/* The FEC flow beat its media flow and became a stream of its own, it's part of di now. */
+	if (self)
+		discovered_item_fec_retire(ctx, self);
+
+	pthread_mutex_lock(&di->fecLock);
+	if (di->fec == NULL) {
+		if (di->fecRefused) {
+			pthread_mutex_unlock(&di->fecLock);
+			return 1; /* No recovery, and no stream of its own either */
 		}
-	}
-	pthread_mutex_unlock(&di->h264_metadataLock);
 
-	pthread_mutex_lock(&di->h265_metadataLock);
-	if (di->h265_metadata_parser) {
-		int complete;
-		ltntstools_h265_codec_metadata_write(di->h265_metadata_parser, pkts, pktCount, &complete);
+		uint64_t bytes = smpte2022_fec_alloc_bytes();
+		if (nic_monitor_memory_charge_bytes(ctx, di, MEM_SUBSYSTEM_FEC, bytes) < 0) {
+			di->fecRefused = 1;
+			pthread_mutex_unlock(&di->fecLock);
 
-		if (complete) {
-			struct h265_codec_metadata_results_s r;
-			if (ltntstools_h265_codec_metadata_query(di->h265_metadata_parser, &r) == 0) {
-				strcpy(&di->h265_video_colorspace[0], &r.video_colorspace_ascii[0]);
-				strcpy(&di->h265_video_format[0], &r.video_format_ascii[0]);
-			}
+			char msg[96];
+			sprintf(msg, "SMPTE 2022-1 FEC found on port %d, memory budget reached, not recovering", ntohs(udphdr->uh_dport));
+			display_doc_append_with_time(&di->doc_stream_log, msg, NULL);
+			return 1;
 		}
+		if (smpte2022_fec_alloc(&di->fec, _fec_output_cb, di) < 0) {
+			nic_monitor_memory_release_bytes(ctx, di, MEM_SUBSYSTEM_FEC, bytes);
+			pthread_mutex_unlock(&di->fecLock);
+			return 0;
+		}
+
+		char msg[64];
+		sprintf(msg, "SMPTE 2022-1 FEC found on port %d", ntohs(udphdr->uh_dport));
+		display_doc_append_with_time(&di->doc_stream_log, msg, NULL);
 	}
-	pthread_mutex_unlock(&di->h265_metadataLock);
+	smpte2022_fec_write_fec(di->fec, ptr, lengthPayloadBytes, timestampNs);
+	pthread_mutex_unlock(&di->fecLock);
 
-	discovered_item_warningindicators_update(ctx, di);
+	return 1;
 }
 
 /* Called on the UI stream, and writes files to disk, handles recordings etc.
  * You can stall this thread a little, most of the work done here is designed to be blocking,
  * sleeping (a little), io writes, non-realtime work.
  */
-static void pcap_io_process(struct tool_context_s *ctx, const struct pcap_pkthdr *h, const u_char *pkt) 
+static void pcap_io_process(struct tool_context_s *ctx, const struct pcap_pkthdr *h, const u_char *pkt, uint32_t tsNsec, uint32_t flags)
 {
 	int isRTP = 0;
 
@@ -681,7 +870,7 @@ static void pcap_io_process(struct tool_context_s *ctx, const struct pcap_pkthdr
 			sprintf(src, "%s:%d", inet_ntoa(srcaddr), ntohs(udp->uh_sport));
 			sprintf(dst, "%s:%d", inet_ntoa(dstaddr), ntohs(udp->uh_dport));
 
-			printf("%s -> %s : %4d : %02x %02x %02x %02x\n",
+			ASYNC_LOG_RATE(1000, "%s -> %s : %4d : %02x %02x %02x %02x\n",
 				src, dst,
 				ntohs(udp->uh_ulen),
 				ptr[0], ptr[1], ptr[2], ptr[3]);
@@ -693,7 +882,7 @@ static void pcap_io_process(struct tool_context_s *ctx, const struct pcap_pkthdr
 			}
 		}
 
-		/* TODO: Handle RTP with FEC correctly. */
+		/* RTP with FEC arrives here already recovered and in order, see _fec_output_cb(). */
 
 		if (ptr[0] != 0x47) {
 			/* Make a rash assumption that's it's RTP where possible. */
@@ -707,17 +896,19 @@ static void pcap_io_process(struct tool_context_s *ctx, const struct pcap_pkthdr
 		/* We can safely assume there are len / 188 packets. */
 		int pktCount = ntohs(udp->uh_ulen) / 188;
 		int lengthBytes = ntohs(udp->uh_ulen);
-		_processPackets_IO(ctx, eth, ip, udp, ptr, pktCount, isRTP, h, pkt, lengthBytes);
+		_processPackets_IO(ctx, eth, ip, udp, ptr, pktCount, isRTP, h, pkt, tsNsec, flags, lengthBytes);
 	}
 }
 
-/* Called on the pcap thread. don't linger, be swift else risk, pcap buffer loss under load. */
-void pcap_update_statistics(struct tool_context_s *ctx, const struct pcap_pkthdr *h, const u_char *pkt) 
+/* Called on the pcap thread. don't linger, be swift else risk, pcap buffer loss under load.
+ * Returns 1 when the packet was consumed (FEC) or the flow isn't admitted, the caller must not queue it for IO.
+ */
+int pcap_update_statistics(struct tool_context_s *ctx, const struct pcap_pkthdr *h, const u_char *pkt, uint32_t tsNsec) 
 { 
 	enum payload_type_e payloadType = PAYLOAD_UNDEFINED;
 
 	if (h->len < sizeof(struct ether_header) + sizeof(struct iphdr) + sizeof(struct udphdr))
-		return;
+		return 0;
 
 	struct ether_header *ethhdr = (struct ether_header *)pkt;
 	if (ntohs(ethhdr->ether_type) == ETHERTYPE_IP) {
@@ -725,16 +916,19 @@ void pcap_update_statistics(struct tool_context_s *ctx, const struct pcap_pkthdr
 
 #ifdef __APPLE__
 		if (iphdr->ip_p != IPPROTO_UDP)
-			return;
+			return 0;
 #endif
 #ifdef __linux__
 		if (iphdr->protocol != IPPROTO_UDP)
-			return;
+			return 0;
 #endif
 
 		struct udphdr *udphdr = (struct udphdr *)((u_char *)iphdr + sizeof(struct iphdr));
 		uint8_t *ptr = (uint8_t *)((uint8_t *)udphdr + sizeof(struct udphdr));
 
+		/* Every UDP frame on the wire, ahead of FEC and admission, both of which can keep a frame off the queue. */
+		nic_monitor_microburst_write(ctx->microburst.aggregate, &h->ts, tsNsec, h->len);
+
 		if (ctx->verbose > 2) {
 			struct in_addr dstaddr, srcaddr;
 #ifdef __APPLE__
@@ -750,15 +944,36 @@ void pcap_update_statistics(struct tool_context_s *ctx, const struct pcap_pkthdr
 			sprintf(src, "%s:%d", inet_ntoa(srcaddr), ntohs(udphdr->uh_sport));
 			sprintf(dst, "%s:%d", inet_ntoa(dstaddr), ntohs(udphdr->uh_dport));
 
-			printf("%s -> %s : %4d : %02x %02x %02x %02x\n",
+			ASYNC_LOG_RATE(1000, "%s -> %s : %4d : %02x %02x %02x %02x\n",
 				src, dst,
 				ntohs(udphdr->uh_ulen),
 				ptr[0], ptr[1], ptr[2], ptr[3]);
 		}
 
-		struct discovered_item_s *di = discovered_item_findcreate(ctx, ethhdr, iphdr, udphdr);
+		/* FEC flows belong to their media stream, they never become streams of their own. */
+		uint64_t timestampNs = ((uint64_t)h->ts.tv_sec * 1000000000ULL) + tsNsec;
+		if (_process_fec(ctx, timestampNs, iphdr, udphdr, ptr, ntohs(udphdr->uh_ulen) - sizeof(struct udphdr)))
+			return 1;
+
+		/* Unknown flows have to earn a discovered item, before we spend memory on them,
+		 * or the deferred queue's copy of them.
+		 */
+		struct discovered_item_s *di = NULL;
+		if (ctx->admission.enabled) {
+			di = discovered_item_find(ctx, iphdr, udphdr);
+			if (di == NULL && nic_monitor_admission_check(ctx, &h->ts, iphdr, udphdr, ptr, ntohs(udphdr->uh_ulen) - sizeof(struct udphdr)) == 0)
+				return 1;
+		}
+
 		if (!di)
-			return;
+			di = discovered_item_findcreate(ctx, ethhdr, iphdr, udphdr);
+		if (!di)
+			return 0;
+
+		/* We're the writer for all of the analyzers, so we're the safe place to drop them. */
+		if (di->memShedPending) {
+			nic_monitor_memory_shed(ctx, di);
+		}
 
 		/* Flag the fact we've seen the object have data, at this time.
 		 * lastUpdated will be noticed during housekeeping and lack of activity
@@ -776,10 +991,18 @@ void pcap_update_statistics(struct tool_context_s *ctx, const struct pcap_pkthdr
 		}
 #endif
 
-		/* TODO: Handle RTP with FEC correctly. */
 		if (di->payloadType == PAYLOAD_UNDEFINED)
 			di->payloadType = determinePayloadType(di, ptr, lengthPayloadBytes);
 
+		if (di->payloadType == PAYLOAD_RTP_TS && di->fec) {
+			/* Everything downstream of here sees the engine output instead. */
+			memcpy(di->fecFrameHeader, pkt, FEC_FRAME_HEADER_SIZE);
+			pthread_mutex_lock(&di->fecLock);
+			smpte2022_fec_write_media(di->fec, ptr, lengthPayloadBytes, ((uint64_t)h->ts.tv_sec * 1000000000ULL) + tsNsec);
+			pthread_mutex_unlock(&di->fecLock);
+			return 1;
+		}
+
 		if (di->payloadType == PAYLOAD_RTP_TS) {
 			lengthPayloadBytes -= 12;
 			ptr += 12;
@@ -790,6 +1013,8 @@ void pcap_update_statistics(struct tool_context_s *ctx, const struct pcap_pkthdr
 		int pktCount = lengthPayloadBytes / 188;
 		_processPackets_Stats(ctx, ethhdr, iphdr, udphdr, ptr, pktCount, payloadType, h, pkt, lengthPayloadBytes, di);
 	}
+
+	return 0;
 }
 
 /* Return the number of list items processed.
@@ -829,7 +1054,7 @@ int pcap_queue_service(struct tool_context_s *ctx)
 
 		if (item->h && item->pkt) {
 			/* safety */
-			pcap_io_process(ctx, item->h, item->pkt);
+			pcap_io_process(ctx, item->h, item->pkt, item->tsNsec, item->flags);
 		} else {
 			ctx->pcap_mangled_list_items++;
 		}
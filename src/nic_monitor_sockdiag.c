@@ -0,0 +1,561 @@
+#include "nic_monitor.h"
+
+/* Receiver side UDP socket drops.
+ * A collector thread dumps every UDP socket on the host through netlink sock_diag
+ * (INET_DIAG with SK_MEMINFO), about once a second. That replaces parsing
+ * /proc/net/udp from the UI thread, and runs whether or not anybody is looking.
+ * Connected sockets are ignored, multicast and unicast receivers are bound but
+ * not connected. The snapshot is kept sorted by inode and doubles as the
+ * inode to owning process cache: owners carry over from one snapshot to the
+ * next, only sockets we haven't seen before need a /proc scan, and those scans
+ * are rate limited.
+ *
+ * The stats thread attributes each new snapshot to the discovered streams,
+ * sockets bound to the stream's group (or the wildcard address) and port.
+ * A wildcard socket on a port that several streams share could be receiving
+ * any of them, its drops go into an ambiguous total rather than to each
+ * stream. The snapshot is indexed by port before ctx->lock is taken.
+ */
+
+#ifdef __linux__
+
+#include <dirent.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/sock_diag.h>
+#include <linux/inet_diag.h>
+
+extern int ltnpthread_setname_np(pthread_t thread, const char *name);
+
+struct sockdiag_socket_s
+{
+	uint64_t inode;
+	uint32_t addr;             /* Network order, 0 for the wildcard address */
+	uint16_t port;
+	int resolved;              /* Owner lookup done, successful or not */
+	int pid;
+	char comm[16];
+	uint32_t rmemAlloc;
+	uint32_t rcvBuf;
+	uint32_t drops;
+};
+
+struct snapshot_s
+{
+	struct sockdiag_socket_s *sockets;
+	int count;
+	int allocated;
+};
+
+static int _cmp_inode(const void *a, const void *b)
+{
+	const struct sockdiag_socket_s *x = a, *y = b;
+	if (x->inode < y->inode)
+		return -1;
+	return x->inode > y->inode;
+}
+
+static int _cmp_port(const void *a, const void *b)
+{
+	const struct sockdiag_socket_s *x = a, *y = b;
+	if (x->port != y->port)
+		return x->port < y->port ? -1 : 1;
+	return _cmp_inode(a, b);
+}
+
+/* First socket on port, in a snapshot sorted by port. */
+static int _port_first(const struct sockdiag_socket_s *sockets, int count, uint16_t port)
+{
+	int lo = 0, hi = count;
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+		if (sockets[mid].port < port)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+static struct sockdiag_socket_s *_find(struct sockdiag_socket_s *sockets, int count, uint64_t inode)
+{
+	struct sockdiag_socket_s key = { .inode = inode };
+	return bsearch(&key, sockets, count, sizeof(key), _cmp_inode);
+}
+
+static void _parse(struct snapshot_s *snap, struct nlmsghdr *nlh)
+{
+	struct inet_diag_msg *m = NLMSG_DATA(nlh);
+
+	if (m->id.idiag_dport)
+		return; /* Connected, not a stream receiver */
+
+	uint32_t addr;
+	if (m->idiag_family == AF_INET) {
+		addr = m->id.idiag_src[0];
+	} else
+	if (m->id.idiag_src[0] == 0 && m->id.idiag_src[1] == 0 &&
+		(m->id.idiag_src[2] == 0 || m->id.idiag_src[2] == htonl(0xffff))) {
+		addr = m->id.idiag_src[3]; /* :: or IPv4 mapped */
+	} else {
+		return;
+	}
+
+	if (snap->count == snap->allocated) {
+		int n = snap->allocated ? snap->allocated * 2 : 256;
+		struct sockdiag_socket_s *p = realloc(snap->sockets, n * sizeof(*p));
+		if (!p)
+			return;
+		snap->sockets = p;
+		snap->allocated = n;
+	}
+
+	struct sockdiag_socket_s *s = &snap->sockets[snap->count++];
+	memset(s, 0, sizeof(*s));
+	s->inode = m->idiag_inode;
+	s->addr = addr;
+	s->port = ntohs(m->id.idiag_sport);
+
+	int len = nlh->nlmsg_len - NLMSG_LENGTH(sizeof(*m));
+	for (struct rtattr *a = (struct rtattr *)(m + 1); RTA_OK(a, len); a = RTA_NEXT(a, len)) {
+		if (a->rta_type != INET_DIAG_SKMEMINFO)
+			continue;
+
+		uint32_t *mem = RTA_DATA(a);
+		int count = RTA_PAYLOAD(a) / sizeof(uint32_t);
+		if (count > SK_MEMINFO_RCVBUF) {
+			s->rmemAlloc = mem[SK_MEMINFO_RMEM_ALLOC];
+			s->rcvBuf = mem[SK_MEMINFO_RCVBUF];
+		}
+		if (count > SK_MEMINFO_DROPS)
+			s->drops = mem[SK_MEMINFO_DROPS];
+	}
+}
+
+/* Dump every UDP socket of one address family into snap. */
+static int _query(int fd, int family, struct snapshot_s *snap)
+{
+	struct {
+		struct nlmsghdr nlh;
+		struct inet_diag_req_v2 req;
+	} msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.nlh.nlmsg_len = sizeof(msg);
+	msg.nlh.nlmsg_type = SOCK_DIAG_BY_FAMILY;
+	msg.nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+	msg.req.sdiag_family = family;
+	msg.req.sdiag_protocol = IPPROTO_UDP;
+	msg.req.idiag_states = ~0U;
+	msg.req.idiag_ext = 1 << (INET_DIAG_SKMEMINFO - 1);
+
+	struct sockaddr_nl sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.nl_family = AF_NETLINK;
+
+	if (sendto(fd, &msg, sizeof(msg), 0, (struct sockaddr *)&sa, sizeof(sa)) < 0)
+		return -1;
+
+	long buf[8192]; /* Aligned for the netlink headers */
+	while (1) {
+		ssize_t len = recv(fd, buf, sizeof(buf), 0);
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		if (len == 0)
+			return -1;
+
+		for (struct nlmsghdr *nlh = (struct nlmsghdr *)buf; NLMSG_OK(nlh, len); nlh = NLMSG_NEXT(nlh, len)) {
+			if (nlh->nlmsg_type == NLMSG_DONE)
+				return 0;
+			if (nlh->nlmsg_type == NLMSG_ERROR)
+				return -1;
+			if (nlh->nlmsg_type == SOCK_DIAG_BY_FAMILY)
+				_parse(snap, nlh);
+		}
+	}
+}
+
+static void _read_comm(int pid, char *comm, int lengthBytes)
+{
+	char path[64];
+	snprintf(path, sizeof(path), "/proc/%d/comm", pid);
+
+	comm[0] = 0;
+	FILE *fh = fopen(path, "r");
+	if (!fh)
+		return;
+	if (fgets(comm, lengthBytes, fh)) {
+		char *nl = strchr(comm, '\n');
+		if (nl)
+			*nl = 0;
+	}
+	fclose(fh);
+}
+
+/* Walk every process's fd table once, naming the owner of each unresolved socket. */
+static void _resolve(struct sockdiag_socket_s *sockets, int count)
+{
+	DIR *proc = opendir("/proc");
+	if (!proc)
+		return;
+
+	struct dirent *pe;
+	while ((pe = readdir(proc))) {
+		int pid = atoi(pe->d_name);
+		if (pid <= 0)
+			continue;
+
+		char path[64];
+		snprintf(path, sizeof(path), "/proc/%d/fd", pid);
+		DIR *fds = opendir(path);
+		if (!fds)
+			continue;
+
+		char comm[16] = { 0 };
+		struct dirent *fe;
+		while ((fe = readdir(fds))) {
+			if (fe->d_name[0] == '.')
+				continue;
+
+			char link[320], target[64];
+			snprintf(link, sizeof(link), "%s/%s", path, fe->d_name);
+			ssize_t n = readlink(link, target, sizeof(target) - 1);
+			if (n <= 0)
+				continue;
+			target[n] = 0;
+
+			uint64_t inode;
+			if (sscanf(target, "socket:[%" SCNu64 "]", &inode) != 1)
+				continue;
+
+			struct sockdiag_socket_s *s = _find(sockets, count, inode);
+			if (!s || s->resolved || s->pid)
+				continue;
+
+			if (comm[0] == 0)
+				_read_comm(pid, &comm[0], sizeof(comm));
+			s->pid = pid;
+			strcpy(s->comm, comm);
+		}
+		closedir(fds);
+	}
+	closedir(proc);
+
+	/* Sockets nobody owns (kernel, other namespaces) stay unknown rather than forcing rescans. */
+	for (int i = 0; i < count; i++)
+		sockets[i].resolved = 1;
+}
+
+static void _collect(struct tool_context_s *ctx, int fd)
+{
+	struct snapshot_s snap = { 0 };
+
+	if (_query(fd, AF_INET, &snap) < 0 || _query(fd, AF_INET6, &snap) < 0) {
+		ctx->sockDiag.queryErrors++;
+		free(snap.sockets);
+		return;
+	}
+	qsort(snap.sockets, snap.count, sizeof(*snap.sockets), _cmp_inode);
+
+	/* Only this thread replaces the published snapshot, reading it here needs no lock. */
+	int unresolved = 0;
+	for (int i = 0; i < snap.count; i++) {
+		struct sockdiag_socket_s *s = &snap.sockets[i];
+		struct sockdiag_socket_s *prev = _find(ctx->sockDiag.sockets, ctx->sockDiag.socketCount, s->inode);
+		if (prev && prev->resolved) {
+			s->resolved = 1;
+			s->pid = prev->pid;
+			strcpy(s->comm, prev->comm);
+		} else {
+			unresolved++;
+		}
+	}
+
+	time_t now = time(NULL);
+	if (unresolved && ctx->sockDiag.lastResolve + SOCKDIAG_RESOLVE_SECS <= now) {
+		ctx->sockDiag.lastResolve = now;
+		ctx->sockDiag.resolveScans++;
+		_resolve(snap.sockets, snap.count);
+	}
+
+	pthread_mutex_lock(&ctx->sockDiag.lock);
+	struct sockdiag_socket_s *old = ctx->sockDiag.sockets;
+	ctx->sockDiag.sockets = snap.sockets;
+	ctx->sockDiag.socketCount = snap.count;
+	ctx->sockDiag.generation++;
+	ctx->sockDiag.queries++;
+	pthread_mutex_unlock(&ctx->sockDiag.lock);
+
+	free(old);
+}
+
+static void *_collector_func(void *p)
+{
+	struct tool_context_s *ctx = p;
+
+	ltnpthread_setname_np(pthread_self(), "tstools-sockdiag");
+
+	int fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_SOCK_DIAG);
+	if (fd < 0) {
+		fprintf(stderr, "Unable to open a sock_diag socket, receiver drops won't be reported.\n");
+		ctx->sockDiag.queryErrors++;
+		return NULL;
+	}
+
+	while (!ctx->sockDiag.threadTerminate) {
+		_collect(ctx, fd);
+
+		for (int ms = 0; ms < ctx->sockDiag.intervalMs && !ctx->sockDiag.threadTerminate; ms += 50)
+			usleep(50 * 1000);
+	}
+
+	close(fd);
+	return NULL;
+}
+
+int nic_monitor_sockdiag_start(struct tool_context_s *ctx)
+{
+	if (ctx->sockDiag.intervalMs <= 0)
+		return 0;
+
+	pthread_mutex_init(&ctx->sockDiag.lock, NULL);
+
+	if (pthread_create(&ctx->sockDiag.threadId, NULL, _collector_func, ctx) != 0)
+		return -1;
+	ctx->sockDiag.threadRunning = 1;
+
+	return 0;
+}
+
+void nic_monitor_sockdiag_stop(struct tool_context_s *ctx)
+{
+	if (!ctx->sockDiag.threadRunning)
+		return;
+
+	ctx->sockDiag.threadTerminate = 1;
+	pthread_join(ctx->sockDiag.threadId, NULL);
+	ctx->sockDiag.threadRunning = 0;
+
+	free(ctx->sockDiag.sockets);
+	ctx->sockDiag.sockets = NULL;
+	ctx->sockDiag.socketCount = 0;
+	free(ctx->sockDiag.previous);
+	ctx->sockDiag.previous = NULL;
+	ctx->sockDiag.previousCount = 0;
+}
+
+static int _matches(const struct discovered_item_s *di, const struct sockdiag_socket_s *s)
+{
+	return s->port == di->dstport && (s->addr == 0 || s->addr == di->iphdr.daddr);
+}
+
+/* Called with ctx->lock held. How many streams each socket could be receiving. */
+static void _count_streams(struct discovered_item_s *di, const struct sockdiag_socket_s *sockets, int count, int *sharedBy)
+{
+	for (int i = _port_first(sockets, count, di->dstport); i < count && sockets[i].port == di->dstport; i++) {
+		if (_matches(di, &sockets[i]))
+			sharedBy[i]++;
+	}
+}
+
+/* Called with ctx->lock held, sockets sorted by port. */
+static void _attribute(struct discovered_item_s *di, const struct sockdiag_socket_s *sockets, int socketCount,
+	const int *sharedBy, time_t now)
+{
+	struct sockdiag_receiver_s receivers[SOCKDIAG_MAX_RECEIVERS];
+	int count = 0;
+	int worst = -1;
+
+	pthread_mutex_lock(&di->receiverLock);
+	for (int i = _port_first(sockets, socketCount, di->dstport);
+		i < socketCount && sockets[i].port == di->dstport && count < SOCKDIAG_MAX_RECEIVERS; i++) {
+		const struct sockdiag_socket_s *s = &sockets[i];
+		if (!_matches(di, s))
+			continue;
+
+		struct sockdiag_receiver_s *r = &receivers[count];
+		r->inode = s->inode;
+		r->pid = s->pid;
+		strcpy(r->comm, s->comm);
+		r->rmemAlloc = s->rmemAlloc;
+		r->rcvBuf = s->rcvBuf;
+		r->drops = s->drops;
+
+		/* Drops from before we first saw the socket aren't this stream's. */
+		uint32_t last = s->drops;
+		for (int j = 0; j < di->receiverCount; j++) {
+			if (di->receivers[j].inode == s->inode) {
+				last = di->receivers[j].drops;
+				break;
+			}
+		}
+		r->dropsDelta = s->drops - last;
+		r->sharedBy = sharedBy[i];
+
+		if (r->sharedBy == 1) {
+			di->receiverDrops += r->dropsDelta;
+			di->receiverDropsUnlogged += r->dropsDelta;
+			if (worst < 0 || r->dropsDelta > receivers[worst].dropsDelta)
+				worst = count;
+		}
+		count++;
+	}
+	memcpy(di->receivers, receivers, count * sizeof(receivers[0]));
+	di->receiverCount = count;
+	pthread_mutex_unlock(&di->receiverLock);
+
+	if (di->receiverDropsUnlogged && worst >= 0 && di->receiverDropsLastLog + SOCKDIAG_LOG_SECS <= now) {
+		struct sockdiag_receiver_s *r = &receivers[worst];
+
+		char msg[160];
+		snprintf(msg, sizeof(msg), "Receiver socket drops: %" PRIu64 " datagrams, pid %d (%s), buffer %u/%u bytes",
+			di->receiverDropsUnlogged, r->pid, r->comm[0] ? r->comm : "unknown", r->rmemAlloc, r->rcvBuf);
+		display_doc_append_with_time(&di->doc_stream_log, msg, NULL);
+
+		di->receiverDropsLastLog = now;
+		di->receiverDropsUnlogged = 0;
+	}
+}
+
+void nic_monitor_sockdiag_service(struct tool_context_s *ctx)
+{
+	if (!ctx->sockDiag.threadRunning)
+		return;
+
+	pthread_mutex_lock(&ctx->sockDiag.lock);
+	if (ctx->sockDiag.generation == ctx->sockDiag.serviced) {
+		pthread_mutex_unlock(&ctx->sockDiag.lock);
+		return;
+	}
+	ctx->sockDiag.serviced = ctx->sockDiag.generation;
+
+	int count = ctx->sockDiag.socketCount;
+	struct sockdiag_socket_s *sockets = malloc((count ? count : 1) * sizeof(*sockets));
+	if (sockets)
+		memcpy(sockets, ctx->sockDiag.sockets, count * sizeof(*sockets));
+	pthread_mutex_unlock(&ctx->sockDiag.lock);
+
+	int *sharedBy = calloc(count ? count : 1, sizeof(int));
+	if (!sockets || !sharedBy) {
+		free(sockets);
+		free(sharedBy);
+		return;
+	}
+
+	/* Index by port, so each stream only looks at the sockets on its own port. */
+	qsort(sockets, count, sizeof(*sockets), _cmp_port);
+
+	time_t now = time(NULL);
+	struct discovered_item_s *e = NULL;
+
+	pthread_mutex_lock(&ctx->lock);
+	xorg_list_for_each_entry(e, &ctx->list, list) {
+		_count_streams(e, sockets, count, sharedBy);
+	}
+	xorg_list_for_each_entry(e, &ctx->list, list) {
+		_attribute(e, sockets, count, sharedBy, now);
+	}
+	pthread_mutex_unlock(&ctx->lock);
+
+	/* Totals count each socket once, against the last snapshot we serviced. */
+	for (int i = 0; i < count; i++) {
+		if (!sharedBy[i])
+			continue;
+		struct sockdiag_socket_s *prev = _find(ctx->sockDiag.previous, ctx->sockDiag.previousCount, sockets[i].inode);
+		if (!prev)
+			continue;
+		uint32_t delta = sockets[i].drops - prev->drops;
+		if (sharedBy[i] > 1)
+			ctx->sockDiag.ambiguousDrops += delta;
+		else
+			ctx->sockDiag.drops += delta;
+	}
+	free(sharedBy);
+
+	qsort(sockets, count, sizeof(*sockets), _cmp_inode);
+	free(ctx->sockDiag.previous);
+	ctx->sockDiag.previous = sockets;
+	ctx->sockDiag.previousCount = count;
+}
+
+#else
+
+/* sock_diag is Linux only, other platforms report no receivers. */
+int nic_monitor_sockdiag_start(struct tool_context_s *ctx)
+{
+	ctx->sockDiag.intervalMs = 0;
+	return 0;
+}
+
+void nic_monitor_sockdiag_stop(struct tool_context_s *ctx)
+{
+}
+
+void nic_monitor_sockdiag_service(struct tool_context_s *ctx)
+{
+}
+
+#endif
+
+void nic_monitor_sockdiag_reset(struct discovered_item_s *di)
+{
+	pthread_mutex_lock(&di->receiverLock);
+	di->receiverDrops = 0;
+	di->receiverDropsUnlogged = 0;
+	pthread_mutex_unlock(&di->receiverLock);
+}
+
+void nic_monitor_sockdiag_dprintf(struct discovered_item_s *di, int fd)
+{
+	pthread_mutex_lock(&di->receiverLock);
+	for (int i = 0; i < di->receiverCount; i++) {
+		struct sockdiag_receiver_s *r = &di->receivers[i];
+		dprintf(fd, "Receiver pid %d (%s): %u socket drops (%u last interval), buffer %u/%u bytes",
+			r->pid, r->comm[0] ? r->comm : "unknown", r->drops, r->dropsDelta, r->rmemAlloc, r->rcvBuf);
+		if (r->sharedBy > 1)
+			dprintf(fd, ", wildcard socket shared by %d streams, drops not attributed", r->sharedBy);
+		dprintf(fd, "\n");
+	}
+	if (di->receiverCount || di->receiverDrops)
+		dprintf(fd, "Receiver socket drops: %" PRIu64 "\n", di->receiverDrops);
+	pthread_mutex_unlock(&di->receiverLock);
+}
+
+void nic_monitor_sockdiag_json(struct discovered_item_s *di, json_object *feed)
+{
+	json_object *array = json_object_new_array();
+
+	pthread_mutex_lock(&di->receiverLock);
+	for (int i = 0; i < di->receiverCount; i++) {
+		struct sockdiag_receiver_s *r = &di->receivers[i];
+
+		json_object *item = json_object_new_object();
+		json_object_object_add(item, "pid", json_object_new_int(r->pid));
+		json_object_object_add(item, "command", json_object_new_string(r->comm));
+		json_object_object_add(item, "inode", json_object_new_int64(r->inode));
+		json_object_object_add(item, "drops", json_object_new_int64(r->drops));
+		json_object_object_add(item, "drops_delta", json_object_new_int64(r->dropsDelta));
+		json_object_object_add(item, "rmem_alloc", json_object_new_int64(r->rmemAlloc));
+		json_object_object_add(item, "rcvbuf", json_object_new_int64(r->rcvBuf));
+		json_object_object_add(item, "ambiguous", json_object_new_boolean(r->sharedBy > 1));
+		json_object_object_add(item, "shared_by", json_object_new_int(r->sharedBy));
+		json_object_array_add(array, item);
+	}
+	json_object_object_add(feed, "receiver_drops", json_object_new_int64(di->receiverDrops));
+	pthread_mutex_unlock(&di->receiverLock);
+
+	json_object_object_add(feed, "receivers", array);
+}
+
+int nic_monitor_sockdiag_sprintf(struct tool_context_s *ctx, char *dst, int lengthBytes)
+{
+	if (ctx->sockDiag.intervalMs <= 0)
+		return snprintf(dst, lengthBytes, "Receiver sockets: disabled");
+
+	return snprintf(dst, lengthBytes, "Receiver sockets: %" PRIu64 " drops attributed, %" PRIu64 " ambiguous, %" PRIu64 " snapshots, %" PRIu64 " errors, %" PRIu64 " owner scans",
+		ctx->sockDiag.drops, ctx->sockDiag.ambiguousDrops, ctx->sockDiag.queries, ctx->sockDiag.queryErrors, ctx->sockDiag.resolveScans);
+}
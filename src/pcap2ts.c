@@ -13,6 +13,7 @@
 #include <arpa/inet.h>
 #include <pcap.h>
 #include <libltntstools/ltntstools.h>
+#include "smpte2022_fec.h"
 
 static FILE *ofh = NULL;
 static int count = 0;
@@ -22,6 +23,7 @@ static int verbose = 0;
 static int doRaw = 0;
 static struct sockaddr_in sa;
 static uint64_t tspkt_count_output = 0;
+static void *fec = NULL;
 
 static struct timeval lastPacketTime;
 static uint64_t packetCount = 0;
@@ -34,6 +36,15 @@ static void hexdump(unsigned char *buf, unsigned int len, int bytesPerRow /* Typ
         printf("\n");
 }
 
+/* Media from the FEC engine, in order, with recovered packets put back. */
+static void fec_output_cb(void *userContext, const uint8_t *rtp, int lengthBytes, int recovered, uint64_t timestampNs)
+{
+	if (ofh) {
+		tspkt_count_output += ((lengthBytes - 12) / 188);
+		fwrite(rtp + 12, 1, lengthBytes - 12, ofh);
+	}
+}
+
 static void pkt_handler(u_char *tmp, struct pcap_pkthdr *hdr, u_char *buf)
 {
 	packetCount++;
@@ -132,9 +143,6 @@ static void pkt_handler(u_char *tmp, struct pcap_pkthdr *hdr, u_char *buf)
 		hexdump(buf, 31, 32);
 	}
 
-	if (ntohs(udp->uh_dport) != port)
-		return;
-
 #if defined(__linux__)
 	if (ip->daddr != sa.sin_addr.s_addr)
 #endif
@@ -143,6 +151,15 @@ static void pkt_handler(u_char *tmp, struct pcap_pkthdr *hdr, u_char *buf)
 #endif
 		return;
 
+	if (fec && (ntohs(udp->uh_dport) == port + 2 || ntohs(udp->uh_dport) == port + 4)) {
+		/* SMPTE 2022-1 column (port + 2) and row (port + 4) FEC */
+		smpte2022_fec_write_fec(fec, data, len, ((uint64_t)hdr->ts.tv_sec * 1000000000ULL) + (hdr->ts.tv_usec * 1000));
+		return;
+	}
+
+	if (ntohs(udp->uh_dport) != port)
+		return;
+
 	count++;
 	int tsoffset = 0;
 	if (doRaw == 1) {
@@ -150,6 +167,9 @@ static void pkt_handler(u_char *tmp, struct pcap_pkthdr *hdr, u_char *buf)
 			tspkt_count_output++;
 			fwrite(data, 1, len, ofh);
 		}
+	} else
+	if (fec && *data != 0x47) {
+		smpte2022_fec_write_media(fec, data, len, ((uint64_t)hdr->ts.tv_sec * 1000000000ULL) + (hdr->ts.tv_usec * 1000));
 	} else {
 		if (*data != 0x47) {
 			if ((*data != 0x80) && (*(data + 12) != 0x47)) {
@@ -177,6 +197,7 @@ static void _usage(const char *prog)
 	printf("  -v increase verbosity level\n");
 	printf("  -r operate in raw mode, just extract the pcap payload without consdieration for TS packets.\n");
 	printf("     Useful for extracting RTP or A/324 streams and preserving headers.\n");
+	printf("  -F recover lost RTP packets using the SMPTE 2022-1 FEC streams on port +2 (column) and +4 (row)\n");
 }
 
 int pcap2ts(int argc, char* argv[])
@@ -188,7 +209,7 @@ int pcap2ts(int argc, char* argv[])
 
 	ltn_histogram_alloc_video_defaults(&packetIntervals, "UDP Packet intervals");
 
-	while ((ch = getopt(argc, argv, "?hi:o:a:p:vr")) != -1) {
+	while ((ch = getopt(argc, argv, "?hi:o:a:p:vrF")) != -1) {
 		switch(ch) {
 		case 'a':
 			addr = optarg;
@@ -213,6 +234,12 @@ int pcap2ts(int argc, char* argv[])
 		case 'r':
 			doRaw = 1;
 			break;
+		case 'F':
+			if (!fec && smpte2022_fec_alloc(&fec, fec_output_cb, NULL) < 0) {
+				fprintf(stderr, "\nUnable to allocate FEC engine, aborting.\n\n");
+				exit(1);
+			}
+			break;
 		case 'h':
 		case '?':
 		default:
@@ -239,6 +266,12 @@ int pcap2ts(int argc, char* argv[])
 		exit(1);
 	}
 
+	if (fec && (!port || doRaw)) {
+		_usage(argv[0]);
+		fprintf(stderr, "\n *** -F needs -a and -p, and can't be combined with -r ***\n");
+		exit(1);
+	}
+
 	if (oname) {
 		ofh = fopen(oname, "wb");
 		if (!ofh) {
@@ -261,6 +294,18 @@ int pcap2ts(int argc, char* argv[])
 	}
 	pcap_close(pcap);
 
+	if (fec) {
+		struct smpte2022_fec_stats_s stats;
+		char line[256];
+
+		smpte2022_fec_flush(fec);
+		smpte2022_fec_get_stats(fec, &stats);
+		smpte2022_fec_sprintf(&stats, &line[0], sizeof(line));
+		printf("SMPTE 2022-1 %s\n", line);
+		smpte2022_fec_free(fec);
+		fec = NULL;
+	}
+
 	if (ofh)
 		fclose(ofh);
 
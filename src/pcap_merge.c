@@ -0,0 +1,638 @@
+/* Merge pcap recordings into one file in timestamp order, at disk speed.
+ *
+ * A streaming k-way merge: each input contributes only its next packet to a min-heap keyed
+ * on timestamp, so memory stays constant however large the inputs are. Classic pcap inputs
+ * are memory mapped and read in place, pages behind the read position are released as we go.
+ * pcapng inputs (nic_monitor --record-pcapng) are read through libpcap with a large buffer.
+ * Timestamps are kept to the nanosecond throughout.
+ *
+ * Optionally:
+ *  - a pcap filter expression (-f) selects flows, applied to every input,
+ *  - identical packets seen on two inputs within a window (-d) are written once. Link layer
+ *    headers, the IPv4 TTL and header checksum are ignored, so a packet captured either side
+ *    of a router still matches. Repeats within the same input are never dropped.
+ *
+ * Inputs are expected to be in timestamp order individually, packets that go backwards are
+ * written where they fall and counted.
+ *
+ * Example, merge the hourly recordings of two probes, keep one stream:
+ *   tstools_pcap_merge -o merged.pcapng -f "udp and dst port 4001" -d 500 probe1-*.pcap probe2-*.pcap
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <pcap.h>
+
+#include "pcapng_writer.h"
+
+#define PM_MAX_SNAPLEN 262144
+#define PM_RELEASE_BYTES (64 * 1048576)  /* Release mapped pages behind the reader in steps of this */
+#define PM_DEDUP_SLOTS (1 << 20)         /* Fingerprints held for -d, 4 ways per bucket */
+#define PM_DEDUP_WAYS 4
+#define PM_IO_BUFFER (4 * 1048576)
+
+#define PCAP_MAGIC_USEC 0xa1b2c3d4
+#define PCAP_MAGIC_NSEC 0xa1b23c4d
+
+static int gRunning = 1;
+
+struct pcap_file_hdr_s
+{
+	uint32_t magic;
+	uint16_t versionMajor;
+	uint16_t versionMinor;
+	int32_t  thiszone;
+	uint32_t sigfigs;
+	uint32_t snaplen;
+	uint32_t linktype;
+};
+
+struct pcap_rec_hdr_s
+{
+	uint32_t tsSec;
+	uint32_t tsFrac; /* usec or nsec, per the file magic */
+	uint32_t caplen;
+	uint32_t origlen;
+};
+
+struct pm_source_s
+{
+	int idx;
+	const char *name;
+
+	/* Classic pcap, mapped */
+	const uint8_t *map;
+	uint64_t size;
+	uint64_t pos;
+	uint64_t released;
+	int swapped;
+	int nsec;
+
+	/* Anything else, through libpcap */
+	pcap_t *pcap;
+
+	int linktype;
+	uint32_t snaplen;
+
+	/* The packet at the head of this input */
+	uint64_t tsNs;
+	uint32_t caplen;
+	uint32_t origlen;
+	const uint8_t *data;
+
+	uint64_t packets;
+	uint64_t outOfOrder;
+};
+
+struct pm_dedup_entry_s
+{
+	uint64_t fp;
+	uint64_t tsNs;
+	int32_t  src;
+};
+
+struct tool_ctx_s
+{
+	int verbose;
+	FILE *ofh;
+	int pcapng;
+	void *pcapngWriter;
+	uint8_t *epb;
+
+	int sourceCount;
+	struct pm_source_s *sources;
+
+	/* Min-heap of inputs with a packet pending, by timestamp then input order */
+	struct pm_source_s **heap;
+	int heapCount;
+
+	pcap_t *filterPcap;
+	struct bpf_program filter;
+	int filtering;
+
+	uint64_t dedupWindowNs;
+	struct pm_dedup_entry_s *dedup;
+
+	uint64_t packetsIn;
+	uint64_t packetsOut;
+	uint64_t bytesOut;
+	uint64_t packetsFiltered;
+	uint64_t packetsDuplicate;
+};
+
+static void signal_handler(int signum)
+{
+	gRunning = 0;
+}
+
+static uint32_t _swap32(uint32_t v, int swapped)
+{
+	return swapped ? __builtin_bswap32(v) : v;
+}
+
+static int _open_mapped(struct pm_source_s *src, int fd, uint64_t size)
+{
+	if (size < sizeof(struct pcap_file_hdr_s))
+		return -1;
+
+	const uint8_t *map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED)
+		return -1;
+
+	struct pcap_file_hdr_s hdr;
+	memcpy(&hdr, map, sizeof(hdr));
+	switch (hdr.magic) {
+	case PCAP_MAGIC_USEC:                    src->swapped = 0; src->nsec = 0; break;
+	case PCAP_MAGIC_NSEC:                    src->swapped = 0; src->nsec = 1; break;
+	case __builtin_bswap32(PCAP_MAGIC_USEC): src->swapped = 1; src->nsec = 0; break;
+	case __builtin_bswap32(PCAP_MAGIC_NSEC): src->swapped = 1; src->nsec = 1; break;
+	default:
+		/* pcapng or something else libpcap may know. */
+		munmap((void *)map, size);
+		return -1;
+	}
+
+	madvise((void *)map, size, MADV_SEQUENTIAL);
+	src->map = map;
+	src->size = size;
+	src->pos = sizeof(hdr);
+	src->linktype = _swap32(hdr.linktype, src->swapped) & 0x0fffffff; /* Top bits are FCS flags */
+	src->snaplen = _swap32(hdr.snaplen, src->swapped);
+
+	return 0;
+}
+
+static int _open(struct pm_source_s *src)
+{
+	char errbuf[PCAP_ERRBUF_SIZE];
+
+	int fd = open(src->name, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "Cannot open input file %s\n", src->name);
+		return -1;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && _open_mapped(src, fd, st.st_size) == 0) {
+		close(fd); /* The mapping holds its own reference */
+		return 0;
+	}
+	close(fd);
+
+	FILE *fh = fopen(src->name, "rb");
+	if (!fh) {
+		fprintf(stderr, "Cannot open input file %s\n", src->name);
+		return -1;
+	}
+	setvbuf(fh, NULL, _IOFBF, PM_IO_BUFFER);
+
+	src->pcap = pcap_fopen_offline_with_tstamp_precision(fh, PCAP_TSTAMP_PRECISION_NANO, errbuf);
+	if (!src->pcap) {
+		fprintf(stderr, "Cannot open pcap file %s: %s\n", src->name, errbuf);
+		fclose(fh);
+		return -1;
+	}
+	src->linktype = pcap_datalink(src->pcap);
+	src->snaplen = pcap_snapshot(src->pcap);
+
+	return 0;
+}
+
+static void _close(struct pm_source_s *src)
+{
+	if (src->map) {
+		munmap((void *)src->map, src->size);
+		src->map = NULL;
+	}
+	if (src->pcap) {
+		pcap_close(src->pcap); /* Closes the FILE too */
+		src->pcap = NULL;
+	}
+}
+
+/* Advance an input to its next packet. Returns 0, or -1 at the end of the input. */
+static int _next(struct pm_source_s *src)
+{
+	uint64_t lastNs = src->tsNs;
+
+	if (src->map) {
+		if (src->pos + sizeof(struct pcap_rec_hdr_s) > src->size)
+			return -1;
+
+		struct pcap_rec_hdr_s rec;
+		memcpy(&rec, src->map + src->pos, sizeof(rec));
+		uint32_t caplen = _swap32(rec.caplen, src->swapped);
+		if (caplen > PM_MAX_SNAPLEN || src->pos + sizeof(rec) + caplen > src->size) {
+			fprintf(stderr, "%s: truncated or corrupt record at offset %" PRIu64 ", ignoring the rest of the file\n",
+				src->name, src->pos);
+			return -1;
+		}
+
+		src->tsNs = (_swap32(rec.tsSec, src->swapped) * 1000000000ULL) +
+			(_swap32(rec.tsFrac, src->swapped) * (src->nsec ? 1ULL : 1000ULL));
+		src->caplen = caplen;
+		src->origlen = _swap32(rec.origlen, src->swapped);
+		src->data = src->map + src->pos + sizeof(rec);
+		src->pos += sizeof(rec) + caplen;
+
+		/* Nothing behind the previous packet is needed again. */
+		uint64_t behind = (src->data - src->map) & ~(uint64_t)(PM_RELEASE_BYTES - 1);
+		if (behind > src->released) {
+			madvise((void *)(src->map + src->released), behind - src->released, MADV_DONTNEED);
+			src->released = behind;
+		}
+	} else {
+		struct pcap_pkthdr *h;
+		const u_char *data;
+		if (pcap_next_ex(src->pcap, &h, &data) != 1)
+			return -1;
+
+		src->tsNs = (h->ts.tv_sec * 1000000000ULL) + h->ts.tv_usec; /* Nanosecond precision was requested */
+		src->caplen = h->caplen;
+		src->origlen = h->len;
+		src->data = data;
+	}
+
+	if (src->packets && src->tsNs < lastNs)
+		src->outOfOrder++;
+	src->packets++;
+
+	return 0;
+}
+
+static int _heap_less(const struct pm_source_s *a, const struct pm_source_s *b)
+{
+	if (a->tsNs != b->tsNs)
+		return a->tsNs < b->tsNs;
+	return a->idx < b->idx; /* Stable, equal timestamps keep the command line order */
+}
+
+static void _heap_down(struct tool_ctx_s *ctx, int i)
+{
+	struct pm_source_s **h = ctx->heap;
+	while (1) {
+		int l = (i * 2) + 1, r = l + 1, m = i;
+		if (l < ctx->heapCount && _heap_less(h[l], h[m]))
+			m = l;
+		if (r < ctx->heapCount && _heap_less(h[r], h[m]))
+			m = r;
+		if (m == i)
+			return;
+		struct pm_source_s *t = h[i];
+		h[i] = h[m];
+		h[m] = t;
+		i = m;
+	}
+}
+
+static void _heap_up(struct tool_ctx_s *ctx, int i)
+{
+	struct pm_source_s **h = ctx->heap;
+	while (i > 0) {
+		int parent = (i - 1) / 2;
+		if (!_heap_less(h[i], h[parent]))
+			return;
+		struct pm_source_s *t = h[i];
+		h[i] = h[parent];
+		h[parent] = t;
+		i = parent;
+	}
+}
+
+static uint64_t _hash(uint64_t h, const uint8_t *p, uint32_t len)
+{
+	while (len >= 8) {
+		uint64_t v;
+		memcpy(&v, p, sizeof(v));
+		h = (h ^ v) * 0xff51afd7ed558ccdULL;
+		h ^= h >> 32;
+		p += 8;
+		len -= 8;
+	}
+	while (len--)
+		h = (h ^ *p++) * 0x100000001b3ULL;
+	return h;
+}
+
+/* From the network header on, skipping what a router rewrites. Ethernet with optional VLAN tags, anything else whole. */
+static uint64_t _fingerprint(int linktype, const uint8_t *pkt, uint32_t caplen)
+{
+	uint64_t h = 0x9e3779b97f4a7c15ULL ^ caplen;
+	uint32_t offset = 0;
+
+	if (linktype == DLT_EN10MB && caplen >= 14) {
+		offset = 12;
+		while (offset + 6 <= caplen && pkt[offset] == 0x81 && pkt[offset + 1] == 0x00)
+			offset += 4;
+		int ipv4 = pkt[offset] == 0x08 && pkt[offset + 1] == 0x00;
+		offset += 2;
+		if (ipv4 && offset + 20 <= caplen && (pkt[offset] >> 4) == 4) {
+			h = _hash(h, pkt + offset, 8);           /* Version to fragment offset */
+			h = _hash(h, pkt + offset + 9, 1);       /* Protocol */
+			offset += 12;                            /* TTL and checksum skipped */
+		}
+	}
+
+	return _hash(h, pkt + offset, caplen - offset);
+}
+
+/* Returns 1 if the packet was already seen on another input inside the window. */
+static int _dedup(struct tool_ctx_s *ctx, struct pm_source_s *src)
+{
+	uint64_t fp = _fingerprint(src->linktype, src->data, src->caplen);
+	struct pm_dedup_entry_s *bucket = &ctx->dedup[fp & (PM_DEDUP_SLOTS - PM_DEDUP_WAYS)];
+	struct pm_dedup_entry_s *oldest = &bucket[0];
+
+	for (int i = 0; i < PM_DEDUP_WAYS; i++) {
+		struct pm_dedup_entry_s *e = &bucket[i];
+		if (e->fp == fp && e->src != src->idx && src->tsNs - e->tsNs <= ctx->dedupWindowNs) {
+			e->fp = 0; /* Each copy is matched once, a third input is a duplicate of the first again */
+			return 1;
+		}
+		if (e->tsNs < oldest->tsNs)
+			oldest = e;
+	}
+
+	oldest->fp = fp;
+	oldest->tsNs = src->tsNs;
+	oldest->src = src->idx;
+
+	return 0;
+}
+
+static int _write_header(struct tool_ctx_s *ctx, int linktype, uint32_t snaplen)
+{
+	if (ctx->pcapng) {
+		if (pcapng_writer_alloc(&ctx->pcapngWriter, NULL, "tstools_pcap_merge", linktype) < 0)
+			return -1;
+		ctx->epb = malloc(pcapng_writer_epb_length(PM_MAX_SNAPLEN));
+		if (!ctx->epb)
+			return -1;
+
+		int len;
+		const uint8_t *hdr = pcapng_writer_get_header(ctx->pcapngWriter, &len);
+		return fwrite(hdr, 1, len, ctx->ofh) == (size_t)len ? 0 : -1;
+	}
+
+	struct pcap_file_hdr_s hdr = {
+		.magic = PCAP_MAGIC_NSEC,
+		.versionMajor = 2,
+		.versionMinor = 4,
+		.snaplen = snaplen,
+		.linktype = linktype,
+	};
+	return fwrite(&hdr, sizeof(hdr), 1, ctx->ofh) == 1 ? 0 : -1;
+}
+
+static int _write_packet(struct tool_ctx_s *ctx, struct pm_source_s *src)
+{
+	if (ctx->pcapng) {
+		pcapng_writer_epb(ctx->pcapngWriter, ctx->epb, src->tsNs, src->data, src->caplen, src->origlen);
+		size_t len = pcapng_writer_epb_length(src->caplen);
+		if (fwrite(ctx->epb, 1, len, ctx->ofh) != len)
+			return -1;
+	} else {
+		struct pcap_rec_hdr_s rec = {
+			.tsSec = src->tsNs / 1000000000ULL,
+			.tsFrac = src->tsNs % 1000000000ULL,
+			.caplen = src->caplen,
+			.origlen = src->origlen,
+		};
+		if (fwrite(&rec, sizeof(rec), 1, ctx->ofh) != 1 || fwrite(src->data, 1, src->caplen, ctx->ofh) != src->caplen)
+			return -1;
+	}
+
+	ctx->packetsOut++;
+	ctx->bytesOut += src->caplen;
+	return 0;
+}
+
+static int _write_trailer(struct tool_ctx_s *ctx)
+{
+	if (!ctx->pcapng)
+		return 0;
+
+	/* The flow index, so tools that know it can seek straight to a stream. */
+	int len = pcapng_writer_index_length(ctx->pcapngWriter);
+	uint8_t *buf = malloc(len);
+	if (!buf)
+		return -1;
+	pcapng_writer_index(ctx->pcapngWriter, buf);
+	int ret = fwrite(buf, 1, len, ctx->ofh) == (size_t)len ? 0 : -1;
+	free(buf);
+
+	return ret;
+}
+
+static int _merge(struct tool_ctx_s *ctx)
+{
+	time_t lastReport = time(NULL);
+
+	while (gRunning && ctx->heapCount) {
+		struct pm_source_s *src = ctx->heap[0];
+		ctx->packetsIn++;
+
+		struct pcap_pkthdr h = { .caplen = src->caplen, .len = src->origlen };
+		if (ctx->filtering && pcap_offline_filter(&ctx->filter, &h, src->data) == 0) {
+			ctx->packetsFiltered++;
+		} else if (ctx->dedup && _dedup(ctx, src)) {
+			ctx->packetsDuplicate++;
+		} else if (_write_packet(ctx, src) < 0) {
+			fprintf(stderr, "Error writing output, aborting.\n");
+			return -1;
+		}
+
+		if (_next(src) < 0) {
+			ctx->heap[0] = ctx->heap[--ctx->heapCount];
+		}
+		_heap_down(ctx, 0);
+
+		if (ctx->verbose && (ctx->packetsIn & 0xfffff) == 0 && time(NULL) != lastReport) {
+			lastReport = time(NULL);
+			fprintf(stderr, "%" PRIu64 " packets in, %" PRIu64 " written, %d inputs open\n",
+				ctx->packetsIn, ctx->packetsOut, ctx->heapCount);
+		}
+	}
+
+	return 0;
+}
+
+static void _usage(const char *prog)
+{
+	printf("%s\n", prog);
+	printf("Merge pcap and pcapng recordings into one file in timestamp order, streaming, in constant memory.\n");
+	printf("Usage:\n");
+	printf("  %s [options] -o <output.pcap> <input.pcap> [input.pcap ...]\n", prog);
+	printf("  -o <output.pcap>              Output file, - for stdout.\n");
+	printf("  -N                            Write pcapng, with a trailing per flow index [def: pcap, nanosecond timestamps]\n");
+	printf("                                Implied by an output name ending .pcapng\n");
+	printf("  -f \"<filter>\"                 Only keep packets matching this pcap filter expression. Eg. \"udp dst port 4001\"\n");
+	printf("  -d <us>                       Write packets seen identically on two inputs within this window once.\n");
+	printf("  -v                            Increase verbosity, report progress and per input counts.\n");
+}
+
+int pcap_merge(int argc, char *argv[])
+{
+	int ch;
+	const char *ofn = NULL;
+	const char *filterExpr = NULL;
+
+	struct tool_ctx_s *ctx = calloc(1, sizeof(*ctx));
+
+	while ((ch = getopt(argc, argv, "?hd:f:No:v")) != -1) {
+		switch (ch) {
+		case 'd':
+			if (atoi(optarg) <= 0) {
+				_usage(argv[0]);
+				fprintf(stderr, "\n *** -d must be 1 or more us ***\n");
+				exit(1);
+			}
+			ctx->dedupWindowNs = atoi(optarg) * 1000ULL;
+			break;
+		case 'f':
+			filterExpr = optarg;
+			break;
+		case 'N':
+			ctx->pcapng = 1;
+			break;
+		case 'o':
+			ofn = optarg;
+			break;
+		case 'v':
+			ctx->verbose++;
+			break;
+		case 'h':
+		case '?':
+		default:
+			_usage(argv[0]);
+			exit(1);
+		}
+	}
+
+	if (!ofn || optind >= argc) {
+		_usage(argv[0]);
+		fprintf(stderr, "\n *** -o and at least one input are mandatory ***\n");
+		exit(1);
+	}
+	size_t ofnLen = strlen(ofn);
+	if (ofnLen > 7 && strcmp(ofn + ofnLen - 7, ".pcapng") == 0)
+		ctx->pcapng = 1;
+
+	ctx->sourceCount = argc - optind;
+	ctx->sources = calloc(ctx->sourceCount, sizeof(struct pm_source_s));
+	ctx->heap = calloc(ctx->sourceCount, sizeof(struct pm_source_s *));
+
+	uint32_t snaplen = 0;
+	for (int i = 0; i < ctx->sourceCount; i++) {
+		struct pm_source_s *src = &ctx->sources[i];
+		src->idx = i;
+		src->name = argv[optind + i];
+		if (_open(src) < 0)
+			exit(1);
+
+		if (src->linktype != ctx->sources[0].linktype) {
+			fprintf(stderr, "%s: link type %d differs from %s, %d, they can't be merged into one file\n",
+				src->name, src->linktype, ctx->sources[0].name, ctx->sources[0].linktype);
+			exit(1);
+		}
+		if (src->snaplen > snaplen)
+			snaplen = src->snaplen;
+
+		if (_next(src) == 0) {
+			ctx->heap[ctx->heapCount++] = src;
+			_heap_up(ctx, ctx->heapCount - 1);
+		}
+	}
+
+	if (filterExpr) {
+		ctx->filterPcap = pcap_open_dead_with_tstamp_precision(ctx->sources[0].linktype, PM_MAX_SNAPLEN, PCAP_TSTAMP_PRECISION_NANO);
+		if (!ctx->filterPcap || pcap_compile(ctx->filterPcap, &ctx->filter, filterExpr, 1, PCAP_NETMASK_UNKNOWN) < 0) {
+			fprintf(stderr, "Error, pcap_compile, %s\n", ctx->filterPcap ? pcap_geterr(ctx->filterPcap) : "no memory");
+			exit(1);
+		}
+		ctx->filtering = 1;
+	}
+
+	if (ctx->dedupWindowNs) {
+		ctx->dedup = calloc(PM_DEDUP_SLOTS, sizeof(struct pm_dedup_entry_s));
+		if (!ctx->dedup) {
+			fprintf(stderr, "Unable to allocate the duplicate table, aborting.\n");
+			exit(1);
+		}
+	}
+
+	if (strcmp(ofn, "-") == 0) {
+		ctx->ofh = stdout;
+	} else {
+		ctx->ofh = fopen(ofn, "wb");
+		if (!ctx->ofh) {
+			fprintf(stderr, "Cannot open output file %s\n", ofn);
+			exit(1);
+		}
+	}
+	setvbuf(ctx->ofh, NULL, _IOFBF, PM_IO_BUFFER);
+	FILE *report = ctx->ofh == stdout ? stderr : stdout;
+
+	if (_write_header(ctx, ctx->sources[0].linktype, snaplen ? snaplen : PM_MAX_SNAPLEN) < 0) {
+		fprintf(stderr, "Error writing output, aborting.\n");
+		exit(1);
+	}
+
+	signal(SIGINT, signal_handler);
+	signal(SIGTERM, signal_handler);
+
+	struct timeval start, end;
+	gettimeofday(&start, NULL);
+
+	int ret = _merge(ctx);
+	if (ret == 0)
+		ret = _write_trailer(ctx);
+	if (fflush(ctx->ofh) != 0)
+		ret = -1;
+	if (ctx->ofh != stdout)
+		fclose(ctx->ofh);
+
+	gettimeofday(&end, NULL);
+	double secs = (end.tv_sec - start.tv_sec) + ((end.tv_usec - start.tv_usec) / 1000000.0);
+	double mb = ctx->bytesOut / 1048576.0;
+
+	uint64_t outOfOrder = 0;
+	for (int i = 0; i < ctx->sourceCount; i++) {
+		struct pm_source_s *src = &ctx->sources[i];
+		outOfOrder += src->outOfOrder;
+		if (ctx->verbose)
+			fprintf(report, "%s: %" PRIu64 " packets, %" PRIu64 " out of order\n", src->name, src->packets, src->outOfOrder);
+		_close(src);
+	}
+
+	fprintf(report, "%d files, %" PRIu64 " packets in, %" PRIu64 " written (%.1f MB in %.2fs, %.0f MB/s), %" PRIu64 " filtered, %" PRIu64 " duplicates\n",
+		ctx->sourceCount, ctx->packetsIn, ctx->packetsOut, mb, secs, secs > 0 ? mb / secs : 0.0,
+		ctx->packetsFiltered, ctx->packetsDuplicate);
+	if (outOfOrder)
+		fprintf(report, "%" PRIu64 " packets were earlier than the one before them in the same input, written in input order\n", outOfOrder);
+	if (!gRunning)
+		fprintf(report, "Interrupted, the output is complete up to the last packet written.\n");
+
+	if (ctx->filtering) {
+		pcap_freecode(&ctx->filter);
+		pcap_close(ctx->filterPcap);
+	}
+	pcapng_writer_free(ctx->pcapngWriter);
+	free(ctx->epb);
+	free(ctx->dedup);
+	free(ctx->heap);
+	free(ctx->sources);
+	free(ctx);
+
+	return ret < 0 ? 1 : 0;
+}
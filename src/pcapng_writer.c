@@ -0,0 +1,358 @@
+/* pcapng block builder with a trailing per flow offset index, see pcapng_writer.h */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "pcapng_writer.h"
+
+#define BLOCK_TYPE_SHB 0x0a0d0d0a
+#define BLOCK_TYPE_IDB 0x00000001
+#define BLOCK_TYPE_ISB 0x00000005
+#define BLOCK_TYPE_EPB 0x00000006
+
+#define OPT_ENDOFOPT      0
+#define OPT_SHB_USERAPPL  4
+#define OPT_IF_NAME       2
+#define OPT_IF_DESCRIPTION 3
+#define OPT_IF_TSRESOL    9
+#define OPT_ISB_STARTTIME 2
+#define OPT_ISB_ENDTIME   3
+#define OPT_ISB_IFDROP    5
+#define OPT_ISB_FILTERACCEPT 6
+#define OPT_ISB_OSDROP    7
+
+#define LINKTYPE_ETHERNET 1          /* DLT_EN10MB */
+
+#define MAX_FLOWS 64
+#define MAX_SEEK 4096                /* Per flow, then the interval doubles */
+#define SEEK_INTERVAL_NS 1000000000ULL
+
+#define PAD4(n) (((n) + 3) & ~3)
+
+struct flow_s
+{
+	uint32_t srcAddr, dstAddr;
+	uint16_t srcPort, dstPort;
+	uint64_t packets;
+	uint64_t bytes;
+	uint64_t firstOffset;
+	uint64_t lastOffset;
+
+	uint64_t seekIntervalNs;
+	uint64_t nextSeekNs;
+	uint32_t seekCount;
+	struct {
+		uint64_t timestampNs;
+		uint64_t offset;
+	} seek[MAX_SEEK];
+};
+
+struct pcapng_writer_s
+{
+	uint8_t header[512];
+	int headerLength;
+	int linktype;
+
+	uint64_t offset;      /* Of the next block, from the start of the file */
+	uint64_t startNs;     /* First packet, for isb_starttime */
+
+	int flowCount;
+	struct flow_s *flows[MAX_FLOWS];
+};
+
+static uint8_t *_put32(uint8_t *p, uint32_t v)
+{
+	memcpy(p, &v, 4);
+	return p + 4;
+}
+
+static uint8_t *_put16(uint8_t *p, uint16_t v)
+{
+	memcpy(p, &v, 2);
+	return p + 2;
+}
+
+static uint8_t *_put64(uint8_t *p, uint64_t v)
+{
+	memcpy(p, &v, 8);
+	return p + 8;
+}
+
+/* pcapng timestamps are two 32 bit halves, high word first. */
+static uint8_t *_put_ts(uint8_t *p, uint64_t ts)
+{
+	p = _put32(p, ts >> 32);
+	return _put32(p, ts & 0xffffffff);
+}
+
+static uint8_t *_put_option(uint8_t *p, uint16_t code, const void *value, uint16_t length)
+{
+	p = _put16(p, code);
+	p = _put16(p, length);
+	memcpy(p, value, length);
+	memset(p + length, 0, PAD4(length) - length);
+	return p + PAD4(length);
+}
+
+static uint8_t *_put_option64(uint8_t *p, uint16_t code, uint64_t v)
+{
+	p = _put16(p, code);
+	p = _put16(p, 8);
+	return _put64(p, v);
+}
+
+static uint8_t *_put_option_ts(uint8_t *p, uint16_t code, uint64_t ts)
+{
+	p = _put16(p, code);
+	p = _put16(p, 8);
+	return _put_ts(p, ts);
+}
+
+/* Fill in the leading and trailing lengths of a block built from start to end. */
+static int _close_block(uint8_t *start, uint8_t *end)
+{
+	uint32_t length = (end - start) + 4;
+	_put32(start + 4, length);
+	_put32(end, length);
+	return length;
+}
+
+static int _build_header(struct pcapng_writer_s *w, const char *ifname, const char *description, int linktype)
+{
+	uint8_t *start = &w->header[0];
+	uint8_t *p = start;
+	const char *appl = "ltntstools";
+
+	/* Section header */
+	p = _put32(p, BLOCK_TYPE_SHB);
+	p = _put32(p, 0);
+	p = _put32(p, 0x1a2b3c4d);
+	p = _put16(p, 1);
+	p = _put16(p, 0);
+	p = _put64(p, 0xffffffffffffffffULL); /* Section length unknown */
+	p = _put_option(p, OPT_SHB_USERAPPL, appl, strlen(appl));
+	p = _put32(p, OPT_ENDOFOPT);
+	_close_block(start, p);
+	p += 4;
+
+	/* Interface description, nanosecond resolution */
+	start = p;
+	uint8_t tsresol = 9;
+	p = _put32(p, BLOCK_TYPE_IDB);
+	p = _put32(p, 0);
+	p = _put16(p, linktype);
+	p = _put16(p, 0);
+	p = _put32(p, 0); /* No snaplen */
+	if (ifname)
+		p = _put_option(p, OPT_IF_NAME, ifname, strnlen(ifname, 128));
+	if (description)
+		p = _put_option(p, OPT_IF_DESCRIPTION, description, strnlen(description, 128));
+	p = _put_option(p, OPT_IF_TSRESOL, &tsresol, 1);
+	p = _put32(p, OPT_ENDOFOPT);
+	_close_block(start, p);
+	p += 4;
+
+	return p - &w->header[0];
+}
+
+int pcapng_writer_alloc(void **hdl, const char *ifname, const char *description, int linktype)
+{
+	struct pcapng_writer_s *w = calloc(1, sizeof(*w));
+	if (!w)
+		return -1;
+
+	w->linktype = linktype;
+	w->headerLength = _build_header(w, ifname, description, linktype);
+	w->offset = w->headerLength;
+
+	*hdl = w;
+	return 0;
+}
+
+void pcapng_writer_free(void *hdl)
+{
+	struct pcapng_writer_s *w = (struct pcapng_writer_s *)hdl;
+	if (!w)
+		return;
+
+	for (int i = 0; i < w->flowCount; i++)
+		free(w->flows[i]);
+	free(w);
+}
+
+const uint8_t *pcapng_writer_get_header(void *hdl, int *lengthBytes)
+{
+	struct pcapng_writer_s *w = (struct pcapng_writer_s *)hdl;
+	*lengthBytes = w->headerLength;
+	return &w->header[0];
+}
+
+int pcapng_writer_epb_length(uint32_t caplen)
+{
+	return 32 + PAD4(caplen);
+}
+
+/* IPv4 UDP over ethernet, optionally 802.1Q tagged. Anything else isn't indexed. */
+static struct flow_s *_flow_lookup(struct pcapng_writer_s *w, int linktype, const uint8_t *pkt, uint32_t caplen)
+{
+	if (linktype != LINKTYPE_ETHERNET)
+		return NULL;
+
+	int offset = 14;
+	if (caplen >= 18 && pkt[12] == 0x81 && pkt[13] == 0x00)
+		offset += 4;
+	if (caplen < (uint32_t)offset + 28 || pkt[offset - 2] != 0x08 || pkt[offset - 1] != 0x00)
+		return NULL;
+
+	const uint8_t *ip = pkt + offset;
+	if ((ip[0] >> 4) != 4 || ip[9] != 17)
+		return NULL;
+	const uint8_t *udp = ip + ((ip[0] & 0x0f) * 4);
+	if (udp + 4 > pkt + caplen)
+		return NULL;
+
+	uint32_t srcAddr, dstAddr;
+	memcpy(&srcAddr, ip + 12, 4);
+	memcpy(&dstAddr, ip + 16, 4);
+	uint16_t srcPort = (udp[0] << 8) | udp[1];
+	uint16_t dstPort = (udp[2] << 8) | udp[3];
+
+	for (int i = 0; i < w->flowCount; i++) {
+		struct flow_s *f = w->flows[i];
+		if (f->srcAddr == srcAddr && f->dstAddr == dstAddr && f->srcPort == srcPort && f->dstPort == dstPort)
+			return f;
+	}
+
+	if (w->flowCount == MAX_FLOWS)
+		return NULL;
+
+	struct flow_s *f = calloc(1, sizeof(*f));
+	if (!f)
+		return NULL;
+	f->srcAddr = srcAddr;
+	f->dstAddr = dstAddr;
+	f->srcPort = srcPort;
+	f->dstPort = dstPort;
+	f->seekIntervalNs = SEEK_INTERVAL_NS;
+	w->flows[w->flowCount++] = f;
+
+	return f;
+}
+
+static void _flow_update(struct flow_s *f, uint64_t offset, uint64_t timestampNs, uint32_t origlen)
+{
+	if (f->packets == 0)
+		f->firstOffset = offset;
+	f->lastOffset = offset;
+	f->packets++;
+	f->bytes += origlen;
+
+	if (timestampNs < f->nextSeekNs)
+		return;
+
+	if (f->seekCount == MAX_SEEK) {
+		/* Full, keep every other entry and seek half as often from here on. */
+		for (uint32_t i = 0; i < MAX_SEEK / 2; i++)
+			f->seek[i] = f->seek[i * 2];
+		f->seekCount = MAX_SEEK / 2;
+		f->seekIntervalNs *= 2;
+	}
+	f->seek[f->seekCount].timestampNs = timestampNs;
+	f->seek[f->seekCount].offset = offset;
+	f->seekCount++;
+	f->nextSeekNs = timestampNs + f->seekIntervalNs;
+}
+
+void pcapng_writer_epb(void *hdl, uint8_t *dst, uint64_t timestampNs, const uint8_t *pkt, uint32_t caplen, uint32_t origlen)
+{
+	struct pcapng_writer_s *w = (struct pcapng_writer_s *)hdl;
+	uint8_t *p = dst;
+
+	p = _put32(p, BLOCK_TYPE_EPB);
+	p = _put32(p, 0);
+	p = _put32(p, 0); /* Interface */
+	p = _put_ts(p, timestampNs);
+	p = _put32(p, caplen);
+	p = _put32(p, origlen);
+	memcpy(p, pkt, caplen);
+	memset(p + caplen, 0, PAD4(caplen) - caplen);
+	p += PAD4(caplen);
+	_close_block(dst, p);
+
+	if (w->startNs == 0)
+		w->startNs = timestampNs;
+
+	struct flow_s *f = _flow_lookup(w, w->linktype, pkt, caplen);
+	if (f)
+		_flow_update(f, w->offset, timestampNs, origlen);
+
+	w->offset += pcapng_writer_epb_length(caplen);
+}
+
+int pcapng_writer_isb(void *hdl, uint8_t *dst, uint64_t timestampNs, uint64_t received, uint64_t osDropped, uint64_t ifDropped)
+{
+	struct pcapng_writer_s *w = (struct pcapng_writer_s *)hdl;
+	uint8_t *p = dst;
+
+	p = _put32(p, BLOCK_TYPE_ISB);
+	p = _put32(p, 0);
+	p = _put32(p, 0); /* Interface */
+	p = _put_ts(p, timestampNs);
+	if (w->startNs)
+		p = _put_option_ts(p, OPT_ISB_STARTTIME, w->startNs);
+	p = _put_option_ts(p, OPT_ISB_ENDTIME, timestampNs);
+	p = _put_option64(p, OPT_ISB_FILTERACCEPT, received);
+	p = _put_option64(p, OPT_ISB_OSDROP, osDropped);
+	p = _put_option64(p, OPT_ISB_IFDROP, ifDropped);
+	p = _put32(p, OPT_ENDOFOPT);
+	int length = _close_block(dst, p);
+
+	w->offset += length;
+	return length;
+}
+
+int pcapng_writer_index_length(void *hdl)
+{
+	struct pcapng_writer_s *w = (struct pcapng_writer_s *)hdl;
+
+	int length = 8 + 16 + 4;
+	for (int i = 0; i < w->flowCount; i++)
+		length += 52 + (w->flows[i]->seekCount * 16);
+
+	return length;
+}
+
+void pcapng_writer_index(void *hdl, uint8_t *dst)
+{
+	struct pcapng_writer_s *w = (struct pcapng_writer_s *)hdl;
+	uint8_t *p = dst;
+
+	p = _put32(p, PCAPNG_BLOCK_TYPE_FLOW_INDEX);
+	p = _put32(p, 0);
+	p = _put32(p, PCAPNG_FLOW_INDEX_MAGIC);
+	p = _put32(p, 1);
+	p = _put32(p, w->flowCount);
+	p = _put32(p, 0);
+
+	for (int i = 0; i < w->flowCount; i++) {
+		struct flow_s *f = w->flows[i];
+		memcpy(p, &f->srcAddr, 4);
+		memcpy(p + 4, &f->dstAddr, 4);
+		p += 8;
+		p = _put16(p, f->srcPort);
+		p = _put16(p, f->dstPort);
+		p = _put64(p, f->packets);
+		p = _put64(p, f->bytes);
+		p = _put64(p, f->firstOffset);
+		p = _put64(p, f->lastOffset);
+		p = _put32(p, f->seekCount);
+		p = _put32(p, 0);
+		for (uint32_t j = 0; j < f->seekCount; j++) {
+			p = _put64(p, f->seek[j].timestampNs);
+			p = _put64(p, f->seek[j].offset);
+		}
+	}
+	w->offset += _close_block(dst, p);
+}
@@ -0,0 +1,80 @@
+/**
+ * @file        pcapng_writer.h
+ * @brief       Build pcapng blocks for a single ethernet interface recording, nanosecond timestamps.
+ *              The writer only produces bytes, the caller owns the file (or segment writer):
+ *              write the header once per file, then each block in the order it was built.
+ *
+ *              Alongside the packets the writer keeps a per flow (IPv4 UDP 5-tuple) index of
+ *              file offsets, for ethernet (DLT_EN10MB) captures only, which pcapng_writer_index() emits as a trailing block. The block
+ *              type is in the pcapng local use range, readers that don't know it skip it.
+ *              Tools that do can read the final 4 bytes of the file (the block total length)
+ *              and seek back to the index.
+ *
+ *              Index block body, host byte order like the rest of the section:
+ *                 uint32 magic 'LTNI', uint32 version (1), uint32 flowCount, uint32 reserved
+ *                 Per flow:
+ *                   uint32 srcAddr, uint32 dstAddr (network order), uint16 srcPort, uint16 dstPort
+ *                   uint64 packets, uint64 bytes, uint64 firstOffset, uint64 lastOffset
+ *                   uint32 seekCount, uint32 reserved
+ *                   seekCount x { uint64 timestamp (ns since 1970), uint64 offset of an EPB at or after it }
+ */
+
+#ifndef PCAPNG_WRITER_H
+#define PCAPNG_WRITER_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PCAPNG_BLOCK_TYPE_FLOW_INDEX 0x80000001
+#define PCAPNG_FLOW_INDEX_MAGIC      0x494e544c /* 'LTNI' */
+
+/**
+ * @brief       Allocate a writer and build the section and interface description header.
+ * @param[in]   const char *ifname - Recorded in the interface description, may be NULL.
+ * @param[in]   const char *description - Recorded in the interface description, may be NULL.
+ * @param[in]   int linktype - DLT_EN10MB (1) for everything nic_monitor records. Other link types
+ *              are recorded as is, but their flows aren't indexed.
+ */
+int  pcapng_writer_alloc(void **hdl, const char *ifname, const char *description, int linktype);
+void pcapng_writer_free(void *hdl);
+
+/**
+ * @brief       The SHB and IDB, written at the start of every file.
+ */
+const uint8_t *pcapng_writer_get_header(void *hdl, int *lengthBytes);
+
+/**
+ * @brief       Size of the enhanced packet block for a packet of caplen bytes.
+ */
+int  pcapng_writer_epb_length(uint32_t caplen);
+
+/**
+ * @brief       Build an enhanced packet block into dst, pcapng_writer_epb_length() bytes.
+ * @param[in]   uint64_t timestampNs - Nanoseconds since 1970.
+ */
+void pcapng_writer_epb(void *hdl, uint8_t *dst, uint64_t timestampNs, const uint8_t *pkt, uint32_t caplen, uint32_t origlen);
+
+/**
+ * @brief       Build an interface statistics block, counters are since capture start.
+ *              Returns the length of the block, dst must hold at least 128 bytes.
+ */
+int  pcapng_writer_isb(void *hdl, uint8_t *dst, uint64_t timestampNs, uint64_t received, uint64_t osDropped, uint64_t ifDropped);
+
+/**
+ * @brief       Size of the trailing flow index block, as things stand.
+ */
+int  pcapng_writer_index_length(void *hdl);
+
+/**
+ * @brief       Build the trailing flow index block, pcapng_writer_index_length() bytes.
+ */
+void pcapng_writer_index(void *hdl, uint8_t *dst);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* PCAPNG_WRITER_H */
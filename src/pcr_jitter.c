@@ -0,0 +1,321 @@
+/* PCR arrival jitter, frequency offset and drift rate, see pcr_jitter.h */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <math.h>
+
+#include "pcr_jitter.h"
+
+#define PCR_MAX ((1ULL << 33) * 300)
+#define PCR_HZ 27000000.0
+
+/* PCRs must arrive at least every 100ms, anything over a second is a discontinuity. */
+#define DISCONTINUITY_TICKS ((uint64_t)PCR_HZ)
+#define DISCONTINUITY_NS 1000000000LL
+
+/* Don't measure jitter against a fit that's seen less than this much stream. */
+#define WARMUP_SECS 2.0
+
+/* Log scale histogram, 8 sub buckets per power of two. Fixed size, ~12% resolution. */
+#define LH_SUB_BITS 3
+#define LH_SUB (1 << LH_SUB_BITS)
+#define LH_BUCKETS ((64 - LH_SUB_BITS + 1) * LH_SUB)
+
+struct log_histogram_s
+{
+	uint64_t count;
+	uint64_t max;
+	uint64_t buckets[LH_BUCKETS];
+};
+
+static int _lh_index(uint64_t v)
+{
+	if (v < LH_SUB)
+		return v;
+
+	int msb = 63 - __builtin_clzll(v);
+	int shift = msb - LH_SUB_BITS;
+	return ((shift + 1) * LH_SUB) + ((v >> shift) & (LH_SUB - 1));
+}
+
+/* Midpoint of a bucket. */
+static uint64_t _lh_value(int idx)
+{
+	if (idx < LH_SUB)
+		return idx;
+
+	int shift = (idx / LH_SUB) - 1;
+	uint64_t lower = (uint64_t)(LH_SUB + (idx % LH_SUB)) << shift;
+	return lower + ((1ULL << shift) / 2);
+}
+
+static void _lh_write(struct log_histogram_s *h, uint64_t v)
+{
+	h->buckets[_lh_index(v)]++;
+	h->count++;
+	if (v > h->max)
+		h->max = v;
+}
+
+static uint64_t _lh_percentile(const struct log_histogram_s *h, double pct)
+{
+	if (h->count == 0)
+		return 0;
+
+	uint64_t target = (uint64_t)ceil((pct / 100.0) * h->count);
+	if (target == 0)
+		target = 1;
+
+	uint64_t cum = 0;
+	for (int i = 0; i < LH_BUCKETS; i++) {
+		cum += h->buckets[i];
+		if (cum >= target) {
+			uint64_t v = _lh_value(i);
+			return v > h->max ? h->max : v;
+		}
+	}
+
+	return h->max;
+}
+
+/* Online least squares fit (Welford), numerically stable over days of samples. */
+struct linear_fit_s
+{
+	uint64_t n;
+	double mx, my;
+	double m2x;
+	double cxy;
+};
+
+static void _fit_reset(struct linear_fit_s *f)
+{
+	memset(f, 0, sizeof(*f));
+}
+
+static void _fit_write(struct linear_fit_s *f, double x, double y)
+{
+	f->n++;
+	double dx = x - f->mx;
+	f->mx += dx / f->n;
+	f->my += (y - f->my) / f->n;
+	f->cxy += dx * (y - f->my);
+	f->m2x += dx * (x - f->mx);
+}
+
+static int _fit_slope(const struct linear_fit_s *f, double *slope)
+{
+	if (f->n < 2 || f->m2x <= 0)
+		return -1;
+
+	*slope = f->cxy / f->m2x;
+	return 0;
+}
+
+struct pcr_jitter_ctx_s
+{
+	uint16_t pid;
+	int intervalSecs;
+
+	uint64_t pcrCount;
+	uint64_t discontinuities;
+
+	/* Fit origin, restarted on discontinuity */
+	int established;
+	uint64_t lastPCR;
+	int64_t lastArrivalNs;
+	uint64_t elapsedTicks;
+	int64_t originArrivalNs;
+	struct linear_fit_s fit;
+
+	/* Current interval, frequency offset and drift rate */
+	struct linear_fit_s interval;
+	double intervalStart;
+	int haveIntervalFreq;
+	double intervalFreqPPM;
+
+	/* Signed extremes of the jitter, microseconds */
+	int64_t jitterMinUs;
+	int64_t jitterMaxUs;
+
+	struct log_histogram_s jitter;     /* Absolute microseconds */
+	struct log_histogram_s driftRate;  /* mHz/s */
+};
+
+int pcr_jitter_alloc(void **hdl, uint16_t pid, int intervalSecs)
+{
+	struct pcr_jitter_ctx_s *ctx = calloc(1, sizeof(*ctx));
+	if (!ctx)
+		return -1;
+
+	ctx->pid = pid;
+	ctx->intervalSecs = intervalSecs > 0 ? intervalSecs : PCR_JITTER_DEFAULT_INTERVAL_SECS;
+
+	*hdl = ctx;
+	return 0;
+}
+
+void pcr_jitter_free(void *hdl)
+{
+	free(hdl);
+}
+
+static void _restart(struct pcr_jitter_ctx_s *ctx, uint64_t pcr, int64_t arrivalNs)
+{
+	ctx->established = 1;
+	ctx->lastPCR = pcr;
+	ctx->lastArrivalNs = arrivalNs;
+	ctx->originArrivalNs = arrivalNs;
+	ctx->elapsedTicks = 0;
+	_fit_reset(&ctx->fit);
+	_fit_reset(&ctx->interval);
+	ctx->intervalStart = 0;
+	ctx->haveIntervalFreq = 0;
+	_fit_write(&ctx->fit, 0, 0);
+	_fit_write(&ctx->interval, 0, 0);
+}
+
+static void _interval_complete(struct pcr_jitter_ctx_s *ctx, double x, double y)
+{
+	double slope;
+	if (_fit_slope(&ctx->interval, &slope) == 0) {
+		/* A fast PCR clock runs ahead of arrivals, the offset shrinks, the slope goes negative. */
+		double freqPPM = -slope * 1e6;
+
+		if (ctx->haveIntervalFreq) {
+			double hzPerSec = fabs(freqPPM - ctx->intervalFreqPPM) * (PCR_HZ / 1e6) / (x - ctx->intervalStart);
+			_lh_write(&ctx->driftRate, (uint64_t)(hzPerSec * 1000.0));
+		}
+		ctx->intervalFreqPPM = freqPPM;
+		ctx->haveIntervalFreq = 1;
+	}
+
+	_fit_reset(&ctx->interval);
+	_fit_write(&ctx->interval, x, y);
+	ctx->intervalStart = x;
+}
+
+void pcr_jitter_write(void *hdl, uint64_t pcr, const struct timespec *arrival)
+{
+	struct pcr_jitter_ctx_s *ctx = (struct pcr_jitter_ctx_s *)hdl;
+	int64_t arrivalNs = ((int64_t)arrival->tv_sec * 1000000000LL) + arrival->tv_nsec;
+
+	ctx->pcrCount++;
+
+	if (!ctx->established) {
+		_restart(ctx, pcr, arrivalNs);
+		return;
+	}
+
+	uint64_t diffTicks = (pcr + PCR_MAX - ctx->lastPCR) % PCR_MAX;
+	int64_t diffNs = arrivalNs - ctx->lastArrivalNs;
+	int64_t skewNs = diffNs - (int64_t)((diffTicks * 1000) / 27);
+
+	if (diffTicks > DISCONTINUITY_TICKS || llabs(skewNs) > DISCONTINUITY_NS) {
+		ctx->discontinuities++;
+		_restart(ctx, pcr, arrivalNs);
+		return;
+	}
+
+	ctx->lastPCR = pcr;
+	ctx->lastArrivalNs = arrivalNs;
+	ctx->elapsedTicks += diffTicks;
+
+	/* x: stream time according to the PCR, y: how far the arrivals are behind it. */
+	double x = (double)ctx->elapsedTicks / PCR_HZ;
+	double y = ((double)(arrivalNs - ctx->originArrivalNs) / 1e9) - x;
+
+	_fit_write(&ctx->fit, x, y);
+	_fit_write(&ctx->interval, x, y);
+
+	if (x - ctx->intervalStart >= ctx->intervalSecs) {
+		_interval_complete(ctx, x, y);
+	}
+
+	if (x < WARMUP_SECS)
+		return;
+
+	double slope;
+	if (_fit_slope(&ctx->fit, &slope) < 0)
+		return;
+
+	double predicted = ctx->fit.my + (slope * (x - ctx->fit.mx));
+	int64_t jitterUs = (int64_t)llround((y - predicted) * 1e6);
+
+	if (ctx->jitter.count == 0 || jitterUs < ctx->jitterMinUs)
+		ctx->jitterMinUs = jitterUs;
+	if (ctx->jitter.count == 0 || jitterUs > ctx->jitterMaxUs)
+		ctx->jitterMaxUs = jitterUs;
+
+	_lh_write(&ctx->jitter, llabs(jitterUs));
+}
+
+void pcr_jitter_query(void *hdl, struct pcr_jitter_results_s *r)
+{
+	struct pcr_jitter_ctx_s *ctx = (struct pcr_jitter_ctx_s *)hdl;
+
+	memset(r, 0, sizeof(*r));
+	r->pid = ctx->pid;
+	r->pcrCount = ctx->pcrCount;
+	r->discontinuities = ctx->discontinuities;
+
+	r->jitterP50us = _lh_percentile(&ctx->jitter, 50.0);
+	r->jitterP90us = _lh_percentile(&ctx->jitter, 90.0);
+	r->jitterP99us = _lh_percentile(&ctx->jitter, 99.0);
+	r->jitterP999us = _lh_percentile(&ctx->jitter, 99.9);
+	r->jitterMaxUs = ctx->jitter.max;
+	r->jitterPeakToPeakUs = ctx->jitterMaxUs - ctx->jitterMinUs;
+
+	double slope;
+	if (_fit_slope(&ctx->fit, &slope) == 0) {
+		r->freqOffsetPPM = -slope * 1e6;
+		r->freqOffsetHz = r->freqOffsetPPM * (PCR_HZ / 1e6);
+	}
+	r->intervalFreqOffsetPPM = ctx->intervalFreqPPM;
+
+	r->driftRateCount = ctx->driftRate.count;
+	r->driftRateP50mHzs = _lh_percentile(&ctx->driftRate, 50.0);
+	r->driftRateP99mHzs = _lh_percentile(&ctx->driftRate, 99.0);
+	r->driftRateMaxmHzs = ctx->driftRate.max;
+}
+
+int pcr_jitter_sprintf(const struct pcr_jitter_results_s *r, char *dst, int lengthBytes)
+{
+	return snprintf(dst, lengthBytes,
+		"PCR 0x%04x jitter us p50 %" PRIi64 " p99 %" PRIi64 " p99.9 %" PRIi64 " max %" PRIi64 " pk-pk %" PRIi64
+		", freq offset %+.3f ppm (%+.1f Hz, interval %+.3f ppm), drift mHz/s p50 %" PRIi64 " p99 %" PRIi64 " max %" PRIi64,
+		r->pid,
+		r->jitterP50us, r->jitterP99us, r->jitterP999us, r->jitterMaxUs, r->jitterPeakToPeakUs,
+		r->freqOffsetPPM, r->freqOffsetHz, r->intervalFreqOffsetPPM,
+		r->driftRateP50mHzs, r->driftRateP99mHzs, r->driftRateMaxmHzs);
+}
+
+void pcr_jitter_dprintf(void *hdl, int fd)
+{
+	struct pcr_jitter_ctx_s *ctx = (struct pcr_jitter_ctx_s *)hdl;
+	struct pcr_jitter_results_s r;
+	pcr_jitter_query(hdl, &r);
+
+	dprintf(fd, "PCR arrival analysis, pid 0x%04x, %" PRIu64 " PCRs, %" PRIu64 " discontinuities\n",
+		r.pid, r.pcrCount, r.discontinuities);
+	dprintf(fd, "  Overall jitter (us)   p50 %" PRIi64 "  p90 %" PRIi64 "  p99 %" PRIi64 "  p99.9 %" PRIi64 "  max %" PRIi64 "  peak to peak %" PRIi64 "\n",
+		r.jitterP50us, r.jitterP90us, r.jitterP99us, r.jitterP999us, r.jitterMaxUs, r.jitterPeakToPeakUs);
+	dprintf(fd, "  Frequency offset      %+.3f ppm (%+.1f Hz), last %ds interval %+.3f ppm\n",
+		r.freqOffsetPPM, r.freqOffsetHz, ctx->intervalSecs, r.intervalFreqOffsetPPM);
+	dprintf(fd, "  Drift rate (mHz/s)    p50 %" PRIi64 "  p99 %" PRIi64 "  max %" PRIi64 "  over %" PRIu64 " intervals\n",
+		r.driftRateP50mHzs, r.driftRateP99mHzs, r.driftRateMaxmHzs, r.driftRateCount);
+
+	if (ctx->jitter.count == 0)
+		return;
+
+	dprintf(fd, "  Jitter distribution    ~us        count     pct\n");
+	for (int i = 0; i < LH_BUCKETS; i++) {
+		if (ctx->jitter.buckets[i] == 0)
+			continue;
+		dprintf(fd, "                      %8" PRIu64 " %12" PRIu64 "  %6.2f\n",
+			_lh_value(i), ctx->jitter.buckets[i],
+			((double)ctx->jitter.buckets[i] / (double)ctx->jitter.count) * 100.0);
+	}
+}
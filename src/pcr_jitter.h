@@ -0,0 +1,88 @@
+/**
+ * @file        pcr_jitter.h
+ * @brief       Continuous PCR timing analysis against datagram arrival times.
+ *              For every PCR the arrival time is compared with the arrival the PCR predicts,
+ *              relative to a linear fit of the two clocks:
+ *                overall jitter    - deviation of each arrival from the fit (PCR_OJ, ETSI TR 101 290)
+ *                frequency offset  - slope of the fit, PCR clock vs the receive clock (PCR_FO)
+ *                drift rate        - change of frequency offset between intervals (PCR_DR)
+ *
+ *              Distributions are kept in fixed size log scale histograms (~12% resolution),
+ *              so memory doesn't grow no matter how long the analysis runs.
+ *              Arrival times must come from the kernel (udp_receiver.h), userspace read
+ *              times measure the tool, not the stream.
+ *
+ *              Interpretation: jitter with a steady frequency offset and low drift points at
+ *              the network, a wandering frequency offset or drift rate points at the encoder clock.
+ */
+
+#ifndef PCR_JITTER_H
+#define PCR_JITTER_H
+
+#include <stdint.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PCR_JITTER_DEFAULT_INTERVAL_SECS 10
+
+struct pcr_jitter_results_s
+{
+	uint16_t pid;
+	uint64_t pcrCount;
+	uint64_t discontinuities;     /* PCR or arrival jumps, the clock fit restarted */
+
+	/* Overall jitter, absolute deviation from the fit, microseconds */
+	int64_t  jitterP50us;
+	int64_t  jitterP90us;
+	int64_t  jitterP99us;
+	int64_t  jitterP999us;
+	int64_t  jitterMaxUs;
+	int64_t  jitterPeakToPeakUs;  /* Most late minus most early */
+
+	/* Frequency offset, PCR clock relative to the receive clock */
+	double   freqOffsetPPM;       /* Since the last discontinuity */
+	double   freqOffsetHz;        /* Same, at 27MHz */
+	double   intervalFreqOffsetPPM; /* Last complete interval only */
+
+	/* Drift rate, absolute change of frequency offset per second, millihertz per second */
+	uint64_t driftRateCount;
+	int64_t  driftRateP50mHzs;
+	int64_t  driftRateP99mHzs;
+	int64_t  driftRateMaxmHzs;
+};
+
+/**
+ * @brief       Allocate an analyzer for the PCRs on a single pid.
+ * @param[out]  void **hdl - returned object.
+ * @param[in]   uint16_t pid - informational, the caller filters packets.
+ * @param[in]   int intervalSecs - frequency offset / drift rate interval, 0 for the default.
+ * @return      0 - Success, else < 0 on error.
+ */
+int  pcr_jitter_alloc(void **hdl, uint16_t pid, int intervalSecs);
+void pcr_jitter_free(void *hdl);
+
+/**
+ * @brief       Account for a PCR, arrival is the receive time of the datagram that carried it.
+ */
+void pcr_jitter_write(void *hdl, uint64_t pcr, const struct timespec *arrival);
+
+void pcr_jitter_query(void *hdl, struct pcr_jitter_results_s *results);
+
+/**
+ * @brief       One line summary.
+ */
+int  pcr_jitter_sprintf(const struct pcr_jitter_results_s *results, char *dst, int lengthBytes);
+
+/**
+ * @brief       Full report, including the jitter distribution.
+ */
+void pcr_jitter_dprintf(void *hdl, int fd);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* PCR_JITTER_H */
@@ -41,11 +41,11 @@ Your may also be interested in, from ffmpeg, these files:
        put_bits.h
 */
 #include "golomb.h"
-static time_t g_nextThumbnailTime = 0;
 #endif
 
 #define DEFAULT_STREAMID 0xe0
 #define DEFAULT_PID 0x31
+#define MAX_PES_PIDS 32
 
 static int g_running = 1;
 
@@ -87,10 +87,10 @@ static void nal_throughput_free(struct nal_throughput_s *ctx)
 	}
 }
 
-static void nal_throughput_report(struct nal_throughput_s *ctx, time_t now, int doH264NalThroughput, int doH265NalThroughput)
+static void nal_throughput_report(struct nal_throughput_s *ctx, int pid, time_t now, int doH264NalThroughput, int doH265NalThroughput)
 {
-	printf("UnitType                                               Name   Mb/ps  Count @ %s",
-		ctime(&now));
+	printf("UnitType                                    PID 0x%04x Name   Mb/ps  Count @ %s",
+		pid, ctime(&now));
 
 	int64_t summed_bps = 0;
 
@@ -129,6 +129,7 @@ struct ltntstools_h264_iframe_thumbnailer_ctx_s
 {
 	void *userContext;
 	int verbose;
+	time_t nextThumbnailTime; /* Decode nothing until then */
 
 	/* AVCodec Decoding to AVFrame */
 	struct {
@@ -374,7 +375,7 @@ static int ltntstools_h264_iframe_thumbnailer_avframe_encode(struct ltntstools_h
 			fclose(fh);
 		}
 
-		g_nextThumbnailTime = time(0) + 5;
+		ctx->nextThumbnailTime = time(0) + 5;
 
         av_packet_unref(ctx->dec.pkt);
     }
@@ -457,34 +458,72 @@ int ltntstools_h264_iframe_thumbnailer_write(void *handle, const uint8_t *buf, i
 	return 0; /* Success */
 }
 
+/* Nals written before this are wasted, the last thumbnail is still fresh. */
+time_t ltntstools_h264_iframe_thumbnailer_next_time(void *handle)
+{
+	struct ltntstools_h264_iframe_thumbnailer_ctx_s *ctx = (struct ltntstools_h264_iframe_thumbnailer_ctx_s *)handle;
+	return ctx ? ctx->nextThumbnailTime : 0;
+}
+
 /* END: Code that belons in a core library, eventually once its working... */
 #endif /* H264_IFRAME_THUMBNAILING */
 
+struct tool_ctx_s;
+
+/* Every pid gets its own extractor, output and statistics. They all share one read and demux loop. */
+struct pes_pid_s
+{
+	struct tool_ctx_s *ctx;
+	int pid;
+	int streamId;
+	void *pe;
+	FILE *esfh; /* -O, the elementary stream for this pid */
+
+	uint64_t pesCount;
+	uint64_t pesBytes;
+	uint32_t pesBytesMin;
+	uint32_t pesBytesMax;
+	uint64_t ptsCount;
+	uint64_t dtsCount;
+
+	int isVideo;  /* Boolean. PES stream id 0xe0-0xef, the NAL writers and thumbnailer only run on these. */
+	int nalStats; /* Boolean. -4 / -5 apply to this pid, it carries video. */
+	struct nal_throughput_s throughput;
+
+#if H264_IFRAME_THUMBNAILING
+	void *thumbnailer; /* -T, one decoder per video pid, they can't share reference frames */
+#endif
+};
+
 struct tool_ctx_s
 {
 	int doH264NalThroughput;
 	int doH265NalThroughput;
 	int verbose;
-	int pid;
 	int streamId;
-	void *pe;
+	int headersOnly;
 	int writeES_h264;
 	int writeES_h265;
 	int writeThumbnails;
 	uint64_t esSeqNr;
+	const char *esPrefix;
 
-	struct nal_throughput_s throughput;
+	/* -P 0x2000, every PES pid found in the PMTs */
+	int allPids;
+	void *sm;
+	int smComplete;
 
-#if H264_IFRAME_THUMBNAILING
-	void *h264Thumbnailer;
-#endif
+	int pidCount;
+	struct pes_pid_s pids[MAX_PES_PIDS];
+	struct pes_pid_s *pidTable[8192];
 };
 
-static void _pes_packet_measure_nal_throughput(struct tool_ctx_s *ctx, struct ltn_pes_packet_s *pes, struct nal_throughput_s *s)
+static void _pes_packet_measure_nal_throughput(struct pes_pid_s *p, struct ltn_pes_packet_s *pes)
 {
+	struct tool_ctx_s *ctx = p->ctx;
 	struct nal_statistic_s *prevNal = NULL;
 
-	throughput_hires_write_i64(ctx->throughput.throughputCtx, 0, pes->dataLengthBytes * 8, NULL);
+	throughput_hires_write_i64(p->throughput.throughputCtx, 0, pes->dataLengthBytes * 8, NULL);
 
     /* Pes payload may contain zero or more complete H264 nals. */ 
     int offset = -1, lastOffset = 0;
@@ -527,7 +566,7 @@ static void _pes_packet_measure_nal_throughput(struct tool_ctx_s *ctx, struct lt
         printf(": NalType %02x : %s\n", nalType, nalName);
 #endif
 
-		struct nal_statistic_s *nt = &ctx->throughput.stats[nalType];
+		struct nal_statistic_s *nt = &p->throughput.stats[nalType];
 		nt->enabled = 1;
 		nt->totalCount++;
 
@@ -545,11 +584,11 @@ static void _pes_packet_measure_nal_throughput(struct tool_ctx_s *ctx, struct lt
 
 	/* Summary report once per second */
 	time_t now = time(NULL);
-	if (now != ctx->throughput.lastReport) {
-		ctx->throughput.lastReport = now;
+	if (now != p->throughput.lastReport) {
+		p->throughput.lastReport = now;
 
 		for (int i = 0; i < MAX_NALS; i++) {
-			struct nal_statistic_s *nt = &ctx->throughput.stats[i];
+			struct nal_statistic_s *nt = &p->throughput.stats[i];
 			if (!nt->enabled)
 				continue;
 
@@ -558,35 +597,57 @@ static void _pes_packet_measure_nal_throughput(struct tool_ctx_s *ctx, struct lt
 			throughput_hires_expire(nt->throughputCtx, NULL);
 		}
 
-		ctx->throughput.bps = throughput_hires_sumtotal_i64(ctx->throughput.throughputCtx, 0, NULL, NULL);
+		p->throughput.bps = throughput_hires_sumtotal_i64(p->throughput.throughputCtx, 0, NULL, NULL);
 
 		if (ctx->doH264NalThroughput || ctx->doH265NalThroughput) {
-			nal_throughput_report(&ctx->throughput, now, ctx->doH264NalThroughput, ctx->doH265NalThroughput);
+			nal_throughput_report(&p->throughput, p->pid, now, ctx->doH264NalThroughput, ctx->doH265NalThroughput);
 		}
-		throughput_hires_expire(ctx->throughput.throughputCtx, NULL);
+		throughput_hires_expire(p->throughput.throughputCtx, NULL);
 	}
 }
 
 static void *callback(void *userContext, struct ltn_pes_packet_s *pes)
 {
-	struct tool_ctx_s *ctx = (struct tool_ctx_s *)userContext;
+	struct pes_pid_s *p = (struct pes_pid_s *)userContext;
+	struct tool_ctx_s *ctx = p->ctx;
 #if H264_IFRAME_THUMBNAILING
 	GetBitContext gb;
 	time_t now = time(0);
 #endif
 
 	if (ctx->verbose > 1) {
-		printf("PES Extractor callback\n");
+		printf("PES Extractor callback, pid 0x%04x\n", p->pid);
 	}
+
+	p->pesCount++;
+	p->pesBytes += pes->dataLengthBytes;
+	if (p->pesCount == 1 || (uint32_t)pes->dataLengthBytes < p->pesBytesMin)
+		p->pesBytesMin = pes->dataLengthBytes;
+	if ((uint32_t)pes->dataLengthBytes > p->pesBytesMax)
+		p->pesBytesMax = pes->dataLengthBytes;
+	if (pes->PTS_DTS_flags & 2)
+		p->ptsCount++;
+	if (pes->PTS_DTS_flags == 3)
+		p->dtsCount++;
+
+	if (p->esfh && pes->data && pes->dataLengthBytes) {
+		fwrite(pes->data, 1, pes->dataLengthBytes, p->esfh);
+	}
+
 	/* If we're analyzing NALs then ONLY do this.... */
 	if (ctx->doH264NalThroughput || ctx->doH265NalThroughput) {
-		_pes_packet_measure_nal_throughput(ctx, pes, &ctx->throughput);
+		if (p->nalStats) {
+			_pes_packet_measure_nal_throughput(p, pes);
+		}
 	} else {
 		/* Else, dump all the PES packets */
+		if (ctx->pidCount > 1 || ctx->allPids) {
+			printf("PID 0x%04x\n", p->pid);
+		}
 		ltn_pes_packet_dump(pes, "");
 	}
 
-	if (ctx->writeES_h265) {
+	if (ctx->writeES_h265 && p->isVideo) {
 		int arrayLength = 0;
 		struct ltn_nal_headers_s *array = NULL;
 		if (ltn_nal_h265_find_headers(pes->data, pes->dataLengthBytes, &array, &arrayLength) == 0) {
@@ -597,8 +658,8 @@ static void *callback(void *userContext, struct ltn_pes_packet_s *pes)
 				char fn[256];
 				sprintf(&fn[0], "%014" PRIu64 "-es-pid-%04x-streamId-%02x-nal-%02x-name-%s.bin",
 					ctx->esSeqNr++,
-					ctx->pid,
-					ctx->streamId,
+					p->pid,
+					p->streamId,
 					e->nalType,
 					e->nalName);
 				printf("Writing %s length %9d bytes\n", fn, e->lengthBytes);
@@ -613,7 +674,7 @@ static void *callback(void *userContext, struct ltn_pes_packet_s *pes)
 
 	}
 
-	if (ctx->writeThumbnails || ctx->writeES_h264) {
+	if (p->isVideo && (ctx->writeThumbnails || ctx->writeES_h264)) {
 
 		int arrayLength = 0;
 		struct ltn_nal_headers_s *array = NULL;
@@ -626,8 +687,8 @@ static void *callback(void *userContext, struct ltn_pes_packet_s *pes)
 					char fn[256];
 					sprintf(&fn[0], "%014" PRIu64 "-es-pid-%04x-streamId-%02x-nal-%02x-name-%s.bin",
 						ctx->esSeqNr++,
-						ctx->pid,
-						ctx->streamId,
+						p->pid,
+						p->streamId,
 						e->nalType,
 						e->nalName);
 					printf("Writing %s length %9d bytes\n", fn, e->lengthBytes);
@@ -640,7 +701,7 @@ static void *callback(void *userContext, struct ltn_pes_packet_s *pes)
 			}
 
 #if H264_IFRAME_THUMBNAILING
-			if (ctx->writeThumbnails && (now >= g_nextThumbnailTime)) {
+			if (p->thumbnailer && (now >= ltntstools_h264_iframe_thumbnailer_next_time(p->thumbnailer))) {
 
 				/* Send the entire stream to the decoder until the
 				 * first key_frame drops out of the decoder. At this we grab the first
@@ -660,7 +721,7 @@ static void *callback(void *userContext, struct ltn_pes_packet_s *pes)
 
 						//if ((slice_type == 2) || (slice_type == 4) || (slice_type == 7) || (slice_type == 9))
 						{
-							if (ltntstools_h264_iframe_thumbnailer_write(ctx->h264Thumbnailer, e->ptr, e->lengthBytes) < 0) {
+							if (ltntstools_h264_iframe_thumbnailer_write(p->thumbnailer, e->ptr, e->lengthBytes) < 0) {
 								fprintf(stderr, "Unable to decode during write to thumbnailer\n");
 							}
 						}
@@ -669,7 +730,7 @@ static void *callback(void *userContext, struct ltn_pes_packet_s *pes)
 					case 7: /* SPS */
 					case 8: /* PPS */
 					default:
-						if (ltntstools_h264_iframe_thumbnailer_write(ctx->h264Thumbnailer, e->ptr, e->lengthBytes) < 0) {
+						if (ltntstools_h264_iframe_thumbnailer_write(p->thumbnailer, e->ptr, e->lengthBytes) < 0) {
 							fprintf(stderr, "Unable to decode during write to thumbnailer\n");
 						}
 					}
@@ -687,15 +748,218 @@ static void *callback(void *userContext, struct ltn_pes_packet_s *pes)
 	return NULL;
 }
 
+/* Map a PMT stream_type to the PES stream id its extractor should match, zero for pids that don't carry PES. */
+static int _stream_type_to_stream_id(uint8_t stream_type)
+{
+	switch (stream_type) {
+	case 0x01: /* MPEG1 video */
+	case 0x02: /* MPEG2 video */
+	case 0x10: /* MPEG4 part 2 video */
+	case 0x1b: /* H.264 */
+	case 0x24: /* H.265 */
+		return 0xe0;
+	case 0x03: /* MPEG1 audio */
+	case 0x04: /* MPEG2 audio */
+	case 0x0f: /* AAC ADTS */
+	case 0x11: /* AAC LATM */
+		return 0xc0;
+	case 0x06: /* Private PES: DVB AC3, teletext, subtitles, SMPTE2038 */
+	case 0x81: /* ATSC AC3 */
+	case 0x87: /* ATSC EAC3 */
+		return 0xbd;
+	case 0x15: /* Metadata in PES */
+		return 0xfc;
+	default:
+		/* Sections (SCTE35, DSM-CC, private sections), no PES to extract. */
+		return 0;
+	}
+}
+
+static int _pid_add(struct tool_ctx_s *ctx, int pid, int streamId)
+{
+	if (ctx->pidTable[pid])
+		return 0; /* Already extracting */
+
+	if (ctx->pidCount >= MAX_PES_PIDS) {
+		fprintf(stderr, "Too many pids, ignoring pid 0x%04x\n", pid);
+		return -1;
+	}
+
+	struct pes_pid_s *p = &ctx->pids[ctx->pidCount];
+	p->ctx = ctx;
+	p->pid = pid;
+	p->streamId = streamId;
+
+	if (ltntstools_pes_extractor_alloc(&p->pe, p->pid, p->streamId, (pes_extractor_callback)callback, p) < 0) {
+		fprintf(stderr, "\nUnable to allocate pes_extractor object for pid 0x%04x.\n\n", pid);
+		return -1;
+	}
+	ltntstools_pes_extractor_set_skip_data(p->pe, ctx->headersOnly);
+
+	p->isVideo = (streamId & 0xf0) == 0xe0;
+
+	if ((ctx->doH264NalThroughput || ctx->doH265NalThroughput) && p->isVideo) {
+		p->nalStats = 1;
+		nal_throughput_init(&p->throughput);
+	}
+
+#if H264_IFRAME_THUMBNAILING
+	if (ctx->writeThumbnails && p->isVideo) {
+		if (ltntstools_h264_iframe_thumbnailer_alloc(&p->thumbnailer, p, ctx->verbose) < 0) {
+			fprintf(stderr, "\nUnable to allocate thumbnailer for pid 0x%04x.\n\n", pid);
+			return -1;
+		}
+	}
+#endif
+
+	if (ctx->esPrefix) {
+		char fn[256];
+		snprintf(fn, sizeof(fn), "%s-pid-0x%04x-streamId-0x%02x.es", ctx->esPrefix, p->pid, p->streamId);
+		p->esfh = fopen(fn, "wb");
+		if (!p->esfh) {
+			fprintf(stderr, "Unable to create '%s'\n", fn);
+		}
+	}
+
+	ctx->pidCount++;
+	ctx->pidTable[pid] = p;
+
+	return 0;
+}
+
+static void _pid_free(struct pes_pid_s *p)
+{
+	ltntstools_pes_extractor_free(p->pe);
+	if (p->nalStats)
+		nal_throughput_free(&p->throughput);
+	if (p->esfh)
+		fclose(p->esfh);
+#if H264_IFRAME_THUMBNAILING
+	if (p->thumbnailer)
+		ltntstools_h264_iframe_thumbnailer_free(p->thumbnailer);
+#endif
+}
+
+/* -P 0x2000, watch the PSI until the model is complete, then add an extractor for every PES pid in every PMT. */
+static void _discover_pids(struct tool_ctx_s *ctx, const uint8_t *pkts, int packetCount)
+{
+	ltntstools_streammodel_write(ctx->sm, pkts, packetCount, &ctx->smComplete);
+	if (!ctx->smComplete)
+		return;
+
+	struct ltntstools_pat_s *m = NULL;
+	if (ltntstools_streammodel_query_model(ctx->sm, &m) < 0)
+		return;
+
+	for (int p = 0; p < m->program_count; p++) {
+		if (m->programs[p].program_number == 0)
+			continue; /* NIT */
+
+		for (int s = 0; s < m->programs[p].pmt.stream_count; s++) {
+			int pid = m->programs[p].pmt.streams[s].elementary_PID;
+			uint8_t estype = m->programs[p].pmt.streams[s].stream_type;
+			int streamId = _stream_type_to_stream_id(estype);
+
+			printf("Program %5d pid 0x%04x stream_type 0x%02x %-40s ",
+				m->programs[p].program_number, pid, estype,
+				ltntstools_GetESPayloadTypeDescription(estype));
+			if (streamId == 0) {
+				printf("not PES, skipped\n");
+				continue;
+			}
+			printf("extracting stream id 0x%02x\n", streamId);
+
+			_pid_add(ctx, pid, streamId);
+		}
+	}
+	ltntstools_pat_free(m);
+
+	if (ctx->pidCount == 0) {
+		printf("\nNo PES pids found in the PMTs, terminating\n\n");
+		g_running = 0;
+	}
+}
+
 static void *_avio_raw_callback(void *userContext, const uint8_t *pkts, int packetCount)
 {
 	struct tool_ctx_s *ctx = (struct tool_ctx_s *)userContext;
-	
-	ltntstools_pes_extractor_write(ctx->pe, pkts, packetCount);
+
+	if (ctx->allPids && !ctx->smComplete) {
+		_discover_pids(ctx, pkts, packetCount);
+	}
+
+	/* Single pass demux. Runs of packets for the same pid go to its extractor in one write. */
+	int i = 0;
+	while (i < packetCount) {
+		struct pes_pid_s *p = ctx->pidTable[ltntstools_pid(pkts + (i * 188))];
+		int run = 1;
+		while (i + run < packetCount && ctx->pidTable[ltntstools_pid(pkts + ((i + run) * 188))] == p)
+			run++;
+
+		if (p) {
+			ltntstools_pes_extractor_write(p->pe, pkts + (i * 188), run);
+		}
+		i += run;
+	}
 
 	return NULL;
 }
 
+static void _summary(struct tool_ctx_s *ctx)
+{
+	printf("\n   PID  StreamId   PES packets          Bytes   Min bytes   Max bytes   Avg bytes     PTS count     DTS count\n");
+	for (int i = 0; i < ctx->pidCount; i++) {
+		struct pes_pid_s *p = &ctx->pids[i];
+		printf("0x%04x      0x%02x  %12" PRIu64 "  %13" PRIu64 "  %10u  %10u  %10" PRIu64 "  %12" PRIu64 "  %12" PRIu64 "\n",
+			p->pid, p->streamId, p->pesCount, p->pesBytes,
+			p->pesBytesMin, p->pesBytesMax,
+			p->pesCount ? p->pesBytes / p->pesCount : 0,
+			p->ptsCount, p->dtsCount);
+	}
+	printf("\n");
+
+	if (!ctx->doH264NalThroughput && !ctx->doH265NalThroughput)
+		return;
+
+	time_t now = time(NULL);
+	for (int i = 0; i < ctx->pidCount; i++) {
+		struct pes_pid_s *p = &ctx->pids[i];
+		if (p->nalStats) {
+			nal_throughput_report(&p->throughput, p->pid, now, ctx->doH264NalThroughput, ctx->doH265NalThroughput);
+		}
+	}
+}
+
+/* -P 0x31 or -P 0x31,0x32:0xc0 with an optional stream id per pid, or -P 0x2000 for every PES pid. */
+static int _parse_pids(struct tool_ctx_s *ctx, const char *arg, int *list, int *streamIds, int *count)
+{
+	char *s = strdup(arg);
+	char *save = NULL;
+
+	for (char *t = strtok_r(s, ",", &save); t; t = strtok_r(NULL, ",", &save)) {
+		int pid, sid = -1;
+		int n = sscanf(t, "0x%x:0x%x", &pid, &sid);
+		if (n < 1 || pid > 0x2000 || (n == 2 && sid > 0xff)) {
+			free(s);
+			return -1;
+		}
+		if (pid == 0x2000) {
+			ctx->allPids = 1;
+			continue;
+		}
+		if (*count >= MAX_PES_PIDS) {
+			free(s);
+			return -1;
+		}
+		list[*count] = pid;
+		streamIds[*count] = sid;
+		(*count)++;
+	}
+
+	free(s);
+	return 0;
+}
+
 static void *_avio_raw_callback_status(void *userContext, enum source_avio_status_e status)
 {
 	switch (status) {
@@ -721,7 +985,11 @@ static void usage(const char *progname)
 	printf("  -v Increase level of verbosity.\n");
 	printf("  -h Display command line help.\n");
 	printf("  -P 0xnnnn PID containing the program elementary stream [def: 0x%02x]\n", DEFAULT_PID);
+	printf("     Repeat -P or use a list to extract several pids in one pass, up to %d.\n", MAX_PES_PIDS);
+	printf("     Each pid takes an optional stream id, otherwise -S applies. Eg. -P 0x31,0x32:0xc0\n");
+	printf("     -P 0x2000 extracts every PES pid found in the PMTs, with stream ids from the stream types.\n");
 	printf("  -S PES Stream Id. Eg. 0xe0 or 0xc0 [def: 0x%02x]\n", DEFAULT_STREAMID);
+	printf("  -O <prefix> write each pids PES payload to <prefix>-pid-0xnnnn-streamId-0xnn.es [def: no]\n");
 #if H264_IFRAME_THUMBNAILING
 	printf("  -T Decode H264 I-Frames into local .jpg thumbnail files [def: no]\n");
 #endif
@@ -746,16 +1014,15 @@ int pes_inspector(int argc, char *argv[])
 	ctx = &myctx;
 	memset(ctx, 0, sizeof(*ctx));
 
-	nal_throughput_init(&ctx->throughput);
-
 	ctx->streamId = DEFAULT_STREAMID;
-	ctx->pid = DEFAULT_PID;
 
 	int ch;
 	char *iname = NULL;
-	int headersOnly = 0;
+	int pidList[MAX_PES_PIDS];
+	int pidStreamIds[MAX_PES_PIDS];
+	int pidListCount = 0;
 
-	while ((ch = getopt(argc, argv, "45?EFHhvi:P:S:T")) != -1) {
+	while ((ch = getopt(argc, argv, "45?EFHhvi:O:P:S:T")) != -1) {
 		switch (ch) {
 		case '?':
 		case 'h':
@@ -779,13 +1046,16 @@ int pes_inspector(int argc, char *argv[])
 			ctx->writeES_h265 = 1;
 			break;
 		case 'H':
-			headersOnly = 1;
+			ctx->headersOnly = 1;
 			break;
 		case 'i':
 			iname = optarg;
 			break;
+		case 'O':
+			ctx->esPrefix = optarg;
+			break;
 		case 'P':
-			if ((sscanf(optarg, "0x%x", &ctx->pid) != 1) || (ctx->pid > 0x1fff)) {
+			if (_parse_pids(ctx, optarg, &pidList[0], &pidStreamIds[0], &pidListCount) < 0) {
 				usage(argv[0]);
 				exit(1);
 			}
@@ -810,10 +1080,9 @@ int pes_inspector(int argc, char *argv[])
 		}
 	}
 
-	if (ctx->pid == 0) {
-		usage(argv[0]);
-		fprintf(stderr, "\n-P is mandatory.\n\n");
-		exit(1);
+	if (pidListCount == 0 && !ctx->allPids) {
+		pidList[pidListCount] = DEFAULT_PID;
+		pidStreamIds[pidListCount++] = -1;
 	}
 
 	if (iname == NULL) {
@@ -822,22 +1091,18 @@ int pes_inspector(int argc, char *argv[])
 		exit(1);
 	}
 
-#if H264_IFRAME_THUMBNAILING
-	if (ctx->writeThumbnails) {
-		if (ltntstools_h264_iframe_thumbnailer_alloc(&ctx->h264Thumbnailer, NULL, ctx->verbose) < 0) {
-			fprintf(stderr, "\nUnable to allocate thumbnailer, aborting.\n\n");
+	for (int i = 0; i < pidListCount; i++) {
+		if (_pid_add(ctx, pidList[i], pidStreamIds[i] >= 0 ? pidStreamIds[i] : ctx->streamId) < 0) {
 			exit(1);
 		}
 	}
-#endif
 
-	if (ltntstools_pes_extractor_alloc(&ctx->pe, ctx->pid, ctx->streamId,
-			(pes_extractor_callback)callback, ctx) < 0) {
-		fprintf(stderr, "\nUnable to allocate pes_extractor object.\n\n");
-		exit(1);
+	if (ctx->allPids) {
+		if (ltntstools_streammodel_alloc(&ctx->sm, NULL) < 0) {
+			fprintf(stderr, "\nUnable to allocate streammodel object.\n\n");
+			exit(1);
+		}
 	}
-	
-	ltntstools_pes_extractor_set_skip_data(ctx->pe, headersOnly);
 
 	struct ltntstools_source_avio_callbacks_s cbs = { 0 };
 	cbs.raw = (ltntstools_source_avio_raw_callback)_avio_raw_callback;
@@ -856,11 +1121,14 @@ int pes_inspector(int argc, char *argv[])
 
 	ltntstools_source_avio_free(srcctx);
 
-	ltntstools_pes_extractor_free(ctx->pe);
-	nal_throughput_free(&ctx->throughput);
-#if H264_IFRAME_THUMBNAILING
-	ltntstools_h264_iframe_thumbnailer_free(ctx->h264Thumbnailer);
-#endif
+	_summary(ctx);
+
+	for (int i = 0; i < ctx->pidCount; i++) {
+		_pid_free(&ctx->pids[i]);
+	}
+	if (ctx->sm) {
+		ltntstools_streammodel_free(ctx->sm);
+	}
 
 	return 0;
 }
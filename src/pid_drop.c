@@ -10,12 +10,14 @@
 #include <time.h>
 
 #include "klbitstream_readwriter.h"
+#include "tsfile_reader.h"
 #include <libltntstools/ltntstools.h>
 
 struct tool_context_s
 {
 	const char *ifn, *ofn;
-	FILE *ifh, *ofh;
+	void *reader;
+	FILE *ofh;
 
 	unsigned int pid;
 	unsigned int doFixups;
@@ -35,7 +37,7 @@ struct tool_context_s
 static void usage(const char *progname)
 {
 	printf("A tool to drop packets from an ISO13818 MPEGTS file, by pid.\n");
-	printf("Input file is assumed to be properly packet aligned.\n");
+	printf("Input file may contain 188, 192 (M2TS) or 204 byte packets, output is always 188.\n");
 	printf("Usage:\n");
 	printf("  -i <input.ts>\n");
 	printf("  -o <output.ts>\n");
@@ -122,9 +124,8 @@ int pid_drop(int argc, char *argv[])
 		}
 	}
 
-	/* File is assumed to have properly aligned packets. */
-	ctx->ifh = fopen(ctx->ifn, "rb");
-	if (!ctx->ifh) {
+	/* Packet size and alignment are detected by the reader. */
+	if (tsfile_reader_alloc(&ctx->reader, ctx->ifn, 0) < 0) {
 		fprintf(stderr, "Unable to open input file '%s'\n", ctx->ifn);
 		exit(1);
 	}
@@ -132,15 +133,15 @@ int pid_drop(int argc, char *argv[])
 	ctx->ofh = fopen(ctx->ofn, "wb");
 	if (!ctx->ofh) {
 		fprintf(stderr, "Unable to open output file '%s'\n", ctx->ofn);
-		fclose(ctx->ifh);
+		tsfile_reader_free(ctx->reader);
 		exit(1);
 	}
 
-	int max_packets = 32;
-	uint8_t *buf = malloc(188 * max_packets);
-	if (!buf) {
+	int max_packets = 1024;
+	const uint8_t **pkts = malloc(sizeof(uint8_t *) * max_packets);
+	if (!pkts) {
 		fclose(ctx->ofh);
-		fclose(ctx->ifh);
+		tsfile_reader_free(ctx->reader);
 		fprintf(stderr, "Unable to allocate buffer\n");
 		exit(1);
 	}
@@ -149,14 +150,14 @@ int pid_drop(int argc, char *argv[])
 		ctx->pidPacketDropCount, ctx->pid, ctx->pidPacketDropPosition,
 		ctx->doFixups ? "will" : "WILL NOT");
 
-	while (!feof(ctx->ifh)) {
-		size_t rlen = fread(buf, 188, max_packets, ctx->ifh);
+	while (1) {
+		int rlen = tsfile_reader_read(ctx->reader, pkts, NULL, max_packets);
 		if (rlen <= 0)
 			break;
 
 		for (int i = 0; i < rlen; i++) {
 
-			uint8_t *p = buf + (i * 188);
+			uint8_t *p = (uint8_t *)pkts[i];
 			ctx->ts_total_packets++;
 
 			uint16_t pid = ltntstools_pid(p);
@@ -196,9 +197,16 @@ int pid_drop(int argc, char *argv[])
 		}
 	}
 
-	free(buf);
+	struct tsfile_reader_stats_s stats;
+	tsfile_reader_get_stats(ctx->reader, &stats);
+	if (stats.bytesLost) {
+		printf("Input packet size %d, discarded %" PRIu64 " bytes during %" PRIu64 " resync(s)\n",
+			tsfile_reader_get_packet_size(ctx->reader), stats.bytesLost, stats.resyncCount);
+	}
+
+	free(pkts);
 
 	fclose(ctx->ofh);
-	fclose(ctx->ifh);
+	tsfile_reader_free(ctx->reader);
 	return 0;
 }
@@ -0,0 +1,955 @@
+/* SCTE-35 cue index across a recording archive, see scte35_index.h.
+ *
+ * Indexing (tstools_scte35_inspector -I) scans recordings in parallel, one file per worker.
+ * SCTE-35 pids are found from the sections themselves, any pid carrying table_id 0xFC with a
+ * valid CRC, so MPTS recordings and files that start without a PAT/PMT are covered from their
+ * first packet. Only the handful of fields the index needs are parsed, no allocation per cue.
+ *
+ * Wallclock comes from the recording start time plus elapsed PCR. The start time is taken from
+ * a YYYYMMDD-HHMMSS stamp in the file name (nic_monitor and segmentwriter recordings carry one),
+ * otherwise the file mtime less the recording duration.
+ *
+ * Querying (tstools_scte35_query) only reads the sidecars, a few KB per recording.
+ *
+ * Example, index a month of recordings, find every break on the 14th between 8 and 9pm:
+ *   tstools_scte35_inspector -I /archive/wxyz -j 8
+ *   tstools_scte35_query -b -s "2026-10-14 20:00:00" -t "2026-10-14 21:00:00" /archive/wxyz
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/stat.h>
+
+#include <libltntstools/ltntstools.h>
+#include "tsfile_reader.h"
+#include "scte35_index.h"
+
+#define SI_BATCH_PACKETS 4096
+#define SI_MAX_PIDS 16
+#define SI_PCR_WRAP (0x200000000LL * 300)
+#define SI_PCR_MAX_STEP (10LL * 27000000) /* Larger steps are discontinuities, not elapsed time */
+#define SI_PTS_WRAP 0x200000000ULL
+#define SI_INDEX_CURRENT -2 /* _index_file(), the sidecar was already up to date */
+
+struct si_pid_s
+{
+	uint16_t pid;
+	void *se; /* SectionExtractor Context */
+	uint64_t startOffset;
+};
+
+/* One recording being indexed */
+struct si_file_s
+{
+	const char *name;
+	int verbose;
+
+	uint8_t slot[8192]; /* pid to pids[] + 1, 0 = not SCTE-35 */
+	struct si_pid_s pids[SI_MAX_PIDS];
+	int pidCount;
+
+	int pcrPID;
+	int64_t lastPCR;
+	int64_t elapsedTicks;
+
+	struct scte35_index_entry_s *entries;
+	uint32_t entryCount;
+	uint32_t entryAlloc;
+};
+
+/* Files waiting for a worker */
+struct si_queue_s
+{
+	pthread_mutex_t lock;
+	char **files;
+	int count;
+	int alloc;
+	int next;
+
+	int force;
+	int verbose;
+
+	int indexed;
+	int current;
+	int failed;
+	uint64_t cues;
+	uint64_t bytes;
+};
+
+const char *scte35_index_command_name(uint8_t commandType)
+{
+	switch (commandType) {
+	case 0x00: return "splice_null";
+	case 0x04: return "splice_schedule";
+	case 0x05: return "splice_insert";
+	case 0x06: return "time_signal";
+	case 0x07: return "bandwidth_reservation";
+	case 0xff: return "private_command";
+	default:   return "reserved";
+	}
+}
+
+int scte35_index_is_break_start(const struct scte35_index_entry_s *e)
+{
+	if (e->flags & SCTE35_INDEX_FLAG_CANCEL)
+		return 0;
+
+	if (e->commandType == 0x05 && (e->flags & SCTE35_INDEX_FLAG_OUT_OF_NETWORK))
+		return 1;
+
+	if (e->flags & SCTE35_INDEX_FLAG_SEGMENTATION) {
+		switch (e->segmentationTypeId) {
+		case 0x22: /* Break Start */
+		case 0x30: /* Provider Advertisement Start */
+		case 0x32: /* Distributor Advertisement Start */
+		case 0x34: /* Provider Placement Opportunity Start */
+		case 0x36: /* Distributor Placement Opportunity Start */
+		case 0x38: /* Provider Overlay Placement Opportunity Start */
+		case 0x3a: /* Distributor Overlay Placement Opportunity Start */
+		case 0x44: /* Provider Ad Block Start */
+		case 0x46: /* Distributor Ad Block Start */
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+static uint64_t _get33(const uint8_t *p)
+{
+	return ((uint64_t)(p[0] & 0x01) << 32) | ((uint64_t)p[1] << 24) | (p[2] << 16) | (p[3] << 8) | p[4];
+}
+
+/* splice_time(), returns its length or -1 if it overruns end. */
+static int _splice_time(const uint8_t *p, const uint8_t *end, struct scte35_index_entry_s *e)
+{
+	if (p >= end)
+		return -1;
+	if (!(p[0] & 0x80))
+		return 1;
+	if (p + 5 > end)
+		return -1;
+	e->pts = _get33(p);
+	e->flags |= SCTE35_INDEX_FLAG_PTS;
+	return 5;
+}
+
+static int _splice_insert(const uint8_t *p, const uint8_t *end, struct scte35_index_entry_s *e)
+{
+	const uint8_t *start = p;
+
+	if (p + 5 > end)
+		return -1;
+	e->eventId = (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+	if (p[4] & 0x80) {
+		e->flags |= SCTE35_INDEX_FLAG_CANCEL;
+		return 5;
+	}
+	p += 5;
+
+	if (p >= end)
+		return -1;
+	int outOfNetwork = p[0] & 0x80;
+	int programSplice = p[0] & 0x40;
+	int durationFlag = p[0] & 0x20;
+	int immediate = p[0] & 0x10;
+	p++;
+
+	if (outOfNetwork)
+		e->flags |= SCTE35_INDEX_FLAG_OUT_OF_NETWORK;
+	if (immediate)
+		e->flags |= SCTE35_INDEX_FLAG_IMMEDIATE;
+
+	if (programSplice && !immediate) {
+		int len = _splice_time(p, end, e);
+		if (len < 0)
+			return -1;
+		p += len;
+	}
+	if (!programSplice) {
+		if (p >= end)
+			return -1;
+		int components = *p++;
+		for (int i = 0; i < components; i++) {
+			p++; /* component_tag */
+			if (!immediate) {
+				int len = _splice_time(p, end, e); /* The first component with a time stands for the event */
+				if (len < 0)
+					return -1;
+				p += len;
+			}
+		}
+	}
+	if (durationFlag) {
+		if (p + 5 > end)
+			return -1;
+		e->duration = _get33(p);
+		e->flags |= SCTE35_INDEX_FLAG_DURATION;
+		p += 5;
+	}
+	p += 4; /* unique_program_id, avail_num, avails_expected */
+
+	return p <= end ? p - start : -1;
+}
+
+/* The first segmentation_descriptor. For time_signal cues it's the only place an event id lives,
+ * splice_insert cues keep their splice_event_id.
+ */
+static void _descriptors(const uint8_t *p, const uint8_t *end, struct scte35_index_entry_s *e)
+{
+	while (p + 2 <= end) {
+		int tag = p[0];
+		int len = p[1];
+		const uint8_t *d = p + 2;
+		p += 2 + len;
+		if (p > end)
+			return;
+		if (tag != 0x02 || len < 9 || memcmp(d, "CUEI", 4) != 0)
+			continue;
+
+		struct scte35_index_entry_s s = *e;
+		const uint8_t *dend = d + len;
+		d += 4;
+		if (e->commandType == 0x06)
+			s.eventId = (d[0] << 24) | (d[1] << 16) | (d[2] << 8) | d[3];
+		if (d[4] & 0x80)
+			continue; /* segmentation_event_cancel_indicator */
+		d += 5;
+		if (d >= dend)
+			continue;
+
+		int programSegmentation = d[0] & 0x80;
+		int durationFlag = d[0] & 0x40;
+		d++;
+		if (!programSegmentation && d < dend)
+			d += 1 + (d[0] * 6);
+		if (durationFlag) {
+			if (d + 5 > dend)
+				continue;
+			s.duration = ((uint64_t)d[0] << 32) | ((uint64_t)d[1] << 24) | (d[2] << 16) | (d[3] << 8) | d[4];
+			s.flags |= SCTE35_INDEX_FLAG_DURATION;
+			d += 5;
+		}
+		if (d + 2 > dend)
+			continue;
+		d += 2 + d[1]; /* segmentation_upid_type, length, upid */
+		if (d >= dend)
+			continue;
+
+		s.segmentationTypeId = d[0];
+		s.flags |= SCTE35_INDEX_FLAG_SEGMENTATION;
+		*e = s;
+		return;
+	}
+}
+
+/* Fill e from a complete, CRC checked splice_info_section. Returns 0, or -1 if it's malformed. */
+static int _parse_section(const uint8_t *sec, int len, struct scte35_index_entry_s *e)
+{
+	if (len < 18 || sec[0] != 0xfc)
+		return -1;
+
+	int sectionLength = ((sec[1] & 0x0f) << 8) | sec[2];
+	const uint8_t *end = sec + 3 + sectionLength - 4; /* Before the CRC */
+	if (sectionLength + 3 > len || end < sec + 14)
+		return -1;
+
+	uint64_t ptsAdjustment = _get33(&sec[4]);
+	int commandLength = ((sec[11] & 0x0f) << 8) | sec[12];
+	e->commandType = sec[13];
+
+	if (sec[4] & 0x80) {
+		e->flags |= SCTE35_INDEX_FLAG_ENCRYPTED;
+		return 0;
+	}
+
+	const uint8_t *cmd = sec + 14;
+	int parsedLength = 0;
+	switch (e->commandType) {
+	case 0x05:
+		parsedLength = _splice_insert(cmd, end, e);
+		break;
+	case 0x06:
+		parsedLength = _splice_time(cmd, end, e);
+		break;
+	case 0x00:
+	case 0x07:
+		break;
+	default:
+		parsedLength = commandLength == 0xfff ? -1 : commandLength;
+		break;
+	}
+	if (parsedLength < 0)
+		return -1;
+
+	/* Legacy encoders signal 0xfff, the length we parsed is the one to trust. */
+	const uint8_t *loop = cmd + (commandLength == 0xfff ? parsedLength : commandLength);
+	if (loop + 2 <= end) {
+		int loopLength = (loop[0] << 8) | loop[1];
+		if (loop + 2 + loopLength <= end)
+			_descriptors(loop + 2, loop + 2 + loopLength, e);
+	}
+
+	if (e->flags & SCTE35_INDEX_FLAG_PTS)
+		e->pts = (e->pts + ptsAdjustment) % SI_PTS_WRAP;
+
+	return 0;
+}
+
+static void _add_entry(struct si_file_s *f, struct si_pid_s *p, const uint8_t *sec, int len)
+{
+	struct scte35_index_entry_s e = { 0 };
+	if (_parse_section(sec, len, &e) < 0) {
+		if (f->verbose)
+			printf("%s: malformed splice_info_section on pid 0x%04x @ 0x%" PRIx64 ", skipped\n", f->name, p->pid, p->startOffset);
+		return;
+	}
+	e.offset = p->startOffset;
+	e.pid = p->pid;
+	e.wallclockUs = f->elapsedTicks / 27; /* Elapsed for now, the start time is added once it's known */
+
+	if (f->entryCount == f->entryAlloc) {
+		uint32_t n = f->entryAlloc ? f->entryAlloc * 2 : 64;
+		struct scte35_index_entry_s *a = realloc(f->entries, n * sizeof(*a));
+		if (!a)
+			return;
+		f->entries = a;
+		f->entryAlloc = n;
+	}
+	f->entries[f->entryCount++] = e;
+}
+
+/* Payload of a payload_unit_start packet begins a section with table_id 0xFC. */
+static int _starts_scte35(const uint8_t *pkt)
+{
+	int afc = ltntstools_adaption_field_control(pkt);
+	if (!(afc & 1))
+		return 0;
+	int pos = 4;
+	if (afc & 2)
+		pos += 1 + pkt[4];
+	if (pos >= 188)
+		return 0;
+	pos += 1 + pkt[pos]; /* pointer_field */
+	return pos < 188 && pkt[pos] == 0xfc;
+}
+
+static void _packet(struct si_file_s *f, const uint8_t *pkt, uint64_t offset)
+{
+	uint16_t pid = ltntstools_pid(pkt);
+	if (pid == 0x1fff)
+		return;
+
+	uint64_t pcr;
+	if ((f->pcrPID < 0 || pid == f->pcrPID) && ltntstools_scr((uint8_t *)pkt, &pcr) == 0) {
+		if (f->pcrPID < 0) {
+			f->pcrPID = pid;
+		} else {
+			int64_t d = ((int64_t)pcr - f->lastPCR + SI_PCR_WRAP) % SI_PCR_WRAP;
+			if (d < SI_PCR_MAX_STEP)
+				f->elapsedTicks += d;
+		}
+		f->lastPCR = pcr;
+	}
+
+	int pusi = ltntstools_payload_unit_start_indicator(pkt);
+	if (f->slot[pid] == 0) {
+		if (!pusi || f->pidCount == SI_MAX_PIDS || !_starts_scte35(pkt))
+			return;
+		struct si_pid_s *p = &f->pids[f->pidCount];
+		if (ltntstools_sectionextractor_alloc(&p->se, pid, 0xFC /* SCTE35 Table ID */) < 0)
+			return;
+		p->pid = pid;
+		f->slot[pid] = ++f->pidCount;
+		if (f->verbose > 1)
+			printf("%s: SCTE-35 on pid 0x%04x\n", f->name, pid);
+	}
+
+	struct si_pid_s *p = &f->pids[f->slot[pid] - 1];
+	if (pusi)
+		p->startOffset = offset;
+
+	int complete = 0, crcValid = 0;
+	ltntstools_sectionextractor_write(p->se, pkt, 1, &complete, &crcValid);
+	if (complete && crcValid) {
+		unsigned char sec[1024];
+		int len = ltntstools_sectionextractor_query(p->se, &sec[0], sizeof(sec));
+		if (len > 0)
+			_add_entry(f, p, sec, len);
+	}
+}
+
+/* A YYYYMMDD-HHMMSS stamp anywhere in the base name, local time. */
+static int _name_time(const char *fn, time_t *t)
+{
+	const char *base = strrchr(fn, '/');
+	base = base ? base + 1 : fn;
+
+	for (const char *s = base; strlen(s) >= 15; s++) {
+		struct tm tm = { 0 };
+		int n = 0;
+		if (!isdigit(s[0]) || (s > base && isdigit(s[-1])))
+			continue;
+		if (sscanf(s, "%4d%2d%2d-%2d%2d%2d%n", &tm.tm_year, &tm.tm_mon, &tm.tm_mday,
+				&tm.tm_hour, &tm.tm_min, &tm.tm_sec, &n) != 6 || n != 15)
+			continue;
+		tm.tm_year -= 1900;
+		tm.tm_mon -= 1;
+		tm.tm_isdst = -1;
+		*t = mktime(&tm);
+		return *t == (time_t)-1 ? -1 : 0;
+	}
+
+	return -1;
+}
+
+static int _write_index(const char *fn, struct scte35_index_header_s *hdr, struct scte35_index_entry_s *entries)
+{
+	char ifn[4096], tfn[4096 + 8];
+	snprintf(ifn, sizeof(ifn), "%s" SCTE35_INDEX_SUFFIX, fn);
+	snprintf(tfn, sizeof(tfn), "%s.tmp", ifn);
+
+	/* Written aside and renamed, a query never sees half an index. */
+	FILE *fh = fopen(tfn, "wb");
+	if (!fh) {
+		fprintf(stderr, "Cannot open index file %s\n", tfn);
+		return -1;
+	}
+	int ok = fwrite(hdr, sizeof(*hdr), 1, fh) == 1 &&
+		fwrite(entries, sizeof(*entries), hdr->entryCount, fh) == hdr->entryCount;
+	if (fclose(fh) != 0)
+		ok = 0;
+	if (!ok || rename(tfn, ifn) < 0) {
+		fprintf(stderr, "Error writing index file %s\n", ifn);
+		unlink(tfn);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int _index_current(const char *fn, const struct stat *st)
+{
+	char ifn[4096];
+	snprintf(ifn, sizeof(ifn), "%s" SCTE35_INDEX_SUFFIX, fn);
+
+	FILE *fh = fopen(ifn, "rb");
+	if (!fh)
+		return 0;
+
+	struct scte35_index_header_s hdr;
+	int current = fread(&hdr, sizeof(hdr), 1, fh) == 1 &&
+		hdr.magic == SCTE35_INDEX_MAGIC && hdr.version == SCTE35_INDEX_VERSION &&
+		hdr.recordingSize == (uint64_t)st->st_size && hdr.recordingMtime == (int64_t)st->st_mtime;
+	fclose(fh);
+
+	return current;
+}
+
+/* Returns the number of cues indexed, SI_INDEX_CURRENT if there was nothing to do, or -1 on error. */
+static int _index_file(struct si_queue_s *q, const char *fn)
+{
+	struct stat st;
+	if (stat(fn, &st) < 0) {
+		fprintf(stderr, "Cannot stat %s\n", fn);
+		return -1;
+	}
+	if (!q->force && _index_current(fn, &st)) {
+		if (q->verbose > 1)
+			printf("%s: index is up to date\n", fn);
+		return SI_INDEX_CURRENT;
+	}
+
+	void *reader;
+	if (tsfile_reader_alloc(&reader, fn, 0) < 0) {
+		fprintf(stderr, "Unable to open input file '%s'\n", fn);
+		return -1;
+	}
+
+	struct si_file_s *f = calloc(1, sizeof(*f));
+	const uint8_t **pkts = malloc(SI_BATCH_PACKETS * sizeof(*pkts));
+	uint64_t *offsets = malloc(SI_BATCH_PACKETS * sizeof(*offsets));
+	if (!f || !pkts || !offsets) {
+		fprintf(stderr, "Unable to allocate index context, aborting.\n");
+		exit(1);
+	}
+	f->name = fn;
+	f->verbose = q->verbose;
+	f->pcrPID = -1;
+
+	int count;
+	while ((count = tsfile_reader_read(reader, pkts, offsets, SI_BATCH_PACKETS)) > 0) {
+		for (int i = 0; i < count; i++)
+			_packet(f, pkts[i], offsets[i]);
+	}
+	tsfile_reader_free(reader);
+
+	int ret = count < 0 ? -1 : 0;
+	if (ret < 0)
+		fprintf(stderr, "%s: read error, not indexed\n", fn);
+
+	time_t start;
+	int64_t startUs;
+	if (_name_time(fn, &start) == 0)
+		startUs = start * 1000000LL;
+	else
+		startUs = (st.st_mtime * 1000000LL) - (f->elapsedTicks / 27);
+
+	struct scte35_index_header_s hdr = {
+		.magic = SCTE35_INDEX_MAGIC,
+		.version = SCTE35_INDEX_VERSION,
+		.entryCount = f->entryCount,
+		.recordingSize = st.st_size,
+		.recordingMtime = st.st_mtime,
+		.startUs = startUs,
+		.endUs = startUs + (f->elapsedTicks / 27),
+	};
+	for (uint32_t i = 0; i < f->entryCount; i++)
+		f->entries[i].wallclockUs += startUs;
+
+	if (ret == 0)
+		ret = _write_index(fn, &hdr, f->entries);
+	if (ret == 0) {
+		ret = f->entryCount;
+		if (q->verbose)
+			printf("%s: %d cues on %d pids\n", fn, f->entryCount, f->pidCount);
+	}
+
+	for (int i = 0; i < f->pidCount; i++)
+		ltntstools_sectionextractor_free(f->pids[i].se);
+	free(f->entries);
+	free(f);
+	free(pkts);
+	free(offsets);
+
+	return ret;
+}
+
+static void *_worker(void *arg)
+{
+	struct si_queue_s *q = (struct si_queue_s *)arg;
+
+	while (1) {
+		pthread_mutex_lock(&q->lock);
+		if (q->next == q->count) {
+			pthread_mutex_unlock(&q->lock);
+			return NULL;
+		}
+		const char *fn = q->files[q->next++];
+		pthread_mutex_unlock(&q->lock);
+
+		struct stat st;
+		uint64_t size = stat(fn, &st) == 0 ? st.st_size : 0;
+		int ret = _index_file(q, fn);
+
+		pthread_mutex_lock(&q->lock);
+		if (ret == -1) {
+			q->failed++;
+		} else if (ret == SI_INDEX_CURRENT) {
+			q->current++;
+		} else {
+			q->indexed++;
+			q->cues += ret;
+			q->bytes += size;
+		}
+		pthread_mutex_unlock(&q->lock);
+	}
+}
+
+static int _is_recording(const char *fn)
+{
+	const char *ext = strrchr(fn, '.');
+	return ext && (strcasecmp(ext, ".ts") == 0 || strcasecmp(ext, ".m2ts") == 0 || strcasecmp(ext, ".mts") == 0);
+}
+
+static void _queue_add(struct si_queue_s *q, const char *fn)
+{
+	if (q->count == q->alloc) {
+		q->alloc = q->alloc ? q->alloc * 2 : 256;
+		q->files = realloc(q->files, q->alloc * sizeof(char *));
+		if (!q->files) {
+			fprintf(stderr, "Unable to allocate file list, aborting.\n");
+			exit(1);
+		}
+	}
+	q->files[q->count++] = strdup(fn);
+}
+
+static void _collect(struct si_queue_s *q, const char *path)
+{
+	struct stat st;
+	if (stat(path, &st) < 0)
+		return;
+
+	if (S_ISREG(st.st_mode)) {
+		_queue_add(q, path);
+		return;
+	}
+	if (!S_ISDIR(st.st_mode))
+		return;
+
+	DIR *dir = opendir(path);
+	if (!dir) {
+		fprintf(stderr, "Cannot open directory %s\n", path);
+		return;
+	}
+	struct dirent *de;
+	while ((de = readdir(dir))) {
+		if (de->d_name[0] == '.')
+			continue;
+		char fn[4096];
+		snprintf(fn, sizeof(fn), "%s/%s", path, de->d_name);
+		if (stat(fn, &st) < 0)
+			continue;
+		if (S_ISDIR(st.st_mode))
+			_collect(q, fn);
+		else if (S_ISREG(st.st_mode) && _is_recording(fn))
+			_queue_add(q, fn);
+	}
+	closedir(dir);
+}
+
+int scte35_index_path(const char *path, int threads, int force, int verbose)
+{
+	struct si_queue_s q = { 0 };
+	pthread_mutex_init(&q.lock, NULL);
+	q.force = force;
+	q.verbose = verbose;
+
+	_collect(&q, path);
+	if (q.count == 0) {
+		fprintf(stderr, "No recordings found in %s\n", path);
+		return 1;
+	}
+
+	if (threads < 1)
+		threads = 1;
+	if (threads > q.count)
+		threads = q.count;
+	printf("Indexing %d recordings on %d threads\n", q.count, threads);
+
+	struct timeval start, end;
+	gettimeofday(&start, NULL);
+
+	pthread_t *tids = calloc(threads, sizeof(pthread_t));
+	for (int i = 0; i < threads; i++)
+		pthread_create(&tids[i], NULL, _worker, &q);
+	for (int i = 0; i < threads; i++)
+		pthread_join(tids[i], NULL);
+	free(tids);
+
+	gettimeofday(&end, NULL);
+	double secs = (end.tv_sec - start.tv_sec) + ((end.tv_usec - start.tv_usec) / 1000000.0);
+	double mb = q.bytes / 1048576.0;
+
+	printf("%d indexed, %d already up to date, %d failed, %" PRIu64 " cues, %.1f MB in %.2fs (%.0f MB/s)\n",
+		q.indexed, q.current, q.failed, q.cues, mb, secs, secs > 0 ? mb / secs : 0.0);
+
+	for (int i = 0; i < q.count; i++)
+		free(q.files[i]);
+	free(q.files);
+	pthread_mutex_destroy(&q.lock);
+
+	return q.failed;
+}
+
+/* Query */
+
+struct sq_match_s
+{
+	struct scte35_index_entry_s e;
+	const char *recording;
+};
+
+struct sq_ctx_s
+{
+	int verbose;
+	int breaksOnly;
+	int commandType;   /* -1 = any */
+	int64_t eventId;   /* -1 = any */
+	int64_t fromUs;
+	int64_t toUs;
+
+	char **recordings; /* Names of those with matches, shared by their matches */
+	int recordingCount;
+	int recordingAlloc;
+
+	struct sq_match_s *matches;
+	int matchCount;
+	int matchAlloc;
+
+	int indexes;
+	int stale;
+};
+
+static int _parse_time(const char *s, int64_t *us)
+{
+	char *end;
+	long long v = strtoll(s, &end, 10);
+	if (*end == 0) {
+		*us = v * 1000000LL;
+		return 0;
+	}
+
+	struct tm tm = { 0 };
+	const char *r = strptime(s, "%Y-%m-%d %H:%M:%S", &tm);
+	if (!r)
+		r = strptime(s, "%Y-%m-%dT%H:%M:%S", &tm);
+	if (!r || *r)
+		return -1;
+	tm.tm_isdst = -1;
+	*us = mktime(&tm) * 1000000LL;
+	return 0;
+}
+
+static void _query_index(struct sq_ctx_s *ctx, const char *recording)
+{
+	char ifn[4096];
+	snprintf(ifn, sizeof(ifn), "%s" SCTE35_INDEX_SUFFIX, recording);
+
+	FILE *fh = fopen(ifn, "rb");
+	if (!fh)
+		return;
+
+	struct scte35_index_header_s hdr;
+	if (fread(&hdr, sizeof(hdr), 1, fh) != 1 || hdr.magic != SCTE35_INDEX_MAGIC || hdr.version != SCTE35_INDEX_VERSION) {
+		fprintf(stderr, "%s: not a version %d index, skipped\n", ifn, SCTE35_INDEX_VERSION);
+		fclose(fh);
+		return;
+	}
+	ctx->indexes++;
+
+	struct stat st;
+	if (stat(recording, &st) == 0 && ((uint64_t)st.st_size != hdr.recordingSize || (int64_t)st.st_mtime != hdr.recordingMtime))
+		ctx->stale++;
+
+	/* The whole recording is outside the range, nothing to read. */
+	if (hdr.endUs < ctx->fromUs || hdr.startUs > ctx->toUs) {
+		fclose(fh);
+		return;
+	}
+
+	const char *name = NULL;
+	struct scte35_index_entry_s e;
+	for (uint32_t i = 0; i < hdr.entryCount && fread(&e, sizeof(e), 1, fh) == 1; i++) {
+		if (e.wallclockUs < ctx->fromUs || e.wallclockUs > ctx->toUs)
+			continue;
+		if (ctx->eventId >= 0 && e.eventId != ctx->eventId)
+			continue;
+		if (ctx->commandType >= 0 && e.commandType != ctx->commandType)
+			continue;
+		if (ctx->breaksOnly && !scte35_index_is_break_start(&e))
+			continue;
+
+		if (ctx->matchCount == ctx->matchAlloc) {
+			ctx->matchAlloc = ctx->matchAlloc ? ctx->matchAlloc * 2 : 256;
+			ctx->matches = realloc(ctx->matches, ctx->matchAlloc * sizeof(*ctx->matches));
+			if (!ctx->matches) {
+				fprintf(stderr, "Unable to allocate results, aborting.\n");
+				exit(1);
+			}
+		}
+		if (!name) {
+			if (ctx->recordingCount == ctx->recordingAlloc) {
+				ctx->recordingAlloc = ctx->recordingAlloc ? ctx->recordingAlloc * 2 : 64;
+				ctx->recordings = realloc(ctx->recordings, ctx->recordingAlloc * sizeof(char *));
+				if (!ctx->recordings) {
+					fprintf(stderr, "Unable to allocate results, aborting.\n");
+					exit(1);
+				}
+			}
+			name = ctx->recordings[ctx->recordingCount++] = strdup(recording);
+		}
+		ctx->matches[ctx->matchCount].e = e;
+		ctx->matches[ctx->matchCount].recording = name;
+		ctx->matchCount++;
+	}
+	fclose(fh);
+}
+
+static void _query_collect(struct sq_ctx_s *ctx, const char *path)
+{
+	struct stat st;
+	if (stat(path, &st) < 0) {
+		/* The recording may have been archived away, its index is enough. */
+		_query_index(ctx, path);
+		return;
+	}
+
+	if (!S_ISDIR(st.st_mode)) {
+		size_t len = strlen(path), slen = strlen(SCTE35_INDEX_SUFFIX);
+		if (len > slen && strcmp(path + len - slen, SCTE35_INDEX_SUFFIX) == 0) {
+			char recording[4096];
+			snprintf(recording, sizeof(recording), "%.*s", (int)(len - slen), path);
+			_query_index(ctx, recording);
+		} else {
+			_query_index(ctx, path);
+		}
+		return;
+	}
+
+	DIR *dir = opendir(path);
+	if (!dir) {
+		fprintf(stderr, "Cannot open directory %s\n", path);
+		return;
+	}
+	struct dirent *de;
+	while ((de = readdir(dir))) {
+		if (de->d_name[0] == '.')
+			continue;
+		char fn[4096];
+		snprintf(fn, sizeof(fn), "%s/%s", path, de->d_name);
+		size_t len = strlen(fn), slen = strlen(SCTE35_INDEX_SUFFIX);
+		if (len > slen && strcmp(fn + len - slen, SCTE35_INDEX_SUFFIX) == 0) {
+			fn[len - slen] = 0;
+			_query_index(ctx, fn);
+		} else if (stat(fn, &st) == 0 && S_ISDIR(st.st_mode)) {
+			_query_collect(ctx, fn);
+		}
+	}
+	closedir(dir);
+}
+
+static int _match_compare(const void *a, const void *b)
+{
+	const struct sq_match_s *x = a, *y = b;
+	if (x->e.wallclockUs != y->e.wallclockUs)
+		return x->e.wallclockUs < y->e.wallclockUs ? -1 : 1;
+	return x->e.offset < y->e.offset ? -1 : x->e.offset > y->e.offset;
+}
+
+static void _print_match(struct sq_ctx_s *ctx, const struct sq_match_s *m)
+{
+	const struct scte35_index_entry_s *e = &m->e;
+
+	time_t t = e->wallclockUs / 1000000;
+	struct tm tm;
+	char ts[32];
+	localtime_r(&t, &tm);
+	strftime(ts, sizeof(ts), "%F %T", &tm);
+
+	char detail[128] = "";
+	int len = 0;
+	if (e->flags & SCTE35_INDEX_FLAG_ENCRYPTED)
+		len += sprintf(detail + len, " encrypted");
+	if (e->flags & SCTE35_INDEX_FLAG_CANCEL)
+		len += sprintf(detail + len, " cancel");
+	if (e->commandType == 0x05 && !(e->flags & SCTE35_INDEX_FLAG_CANCEL))
+		len += sprintf(detail + len, (e->flags & SCTE35_INDEX_FLAG_OUT_OF_NETWORK) ? " out" : " in");
+	if (e->flags & SCTE35_INDEX_FLAG_SEGMENTATION)
+		len += sprintf(detail + len, " seg 0x%02x", e->segmentationTypeId);
+	if (e->flags & SCTE35_INDEX_FLAG_IMMEDIATE)
+		len += sprintf(detail + len, " immediate");
+	if (e->flags & SCTE35_INDEX_FLAG_PTS)
+		len += sprintf(detail + len, " pts %" PRIu64, e->pts);
+	if (e->flags & SCTE35_INDEX_FLAG_DURATION)
+		len += sprintf(detail + len, " duration %.3fs", e->duration / 90000.0);
+
+	printf("%s.%03d  %-15s event %10u%s\n", ts, (int)((e->wallclockUs / 1000) % 1000),
+		scte35_index_command_name(e->commandType), e->eventId, detail);
+	printf("    %s @ 0x%" PRIx64 " pid 0x%04x\n", m->recording, e->offset, e->pid);
+}
+
+static void _query_usage(const char *prog)
+{
+	printf("%s\n", prog);
+	printf("Find SCTE-35 cues across indexed recordings, see tstools_scte35_inspector -I to build the indexes.\n");
+	printf("Usage:\n");
+	printf("  %s [options] <directory | recording.ts | recording.ts" SCTE35_INDEX_SUFFIX "> ...\n", prog);
+	printf("  -e <id>                       Only this splice or segmentation event id, decimal or 0x hex.\n");
+	printf("  -s <time>                     From, \"YYYY-MM-DD HH:MM:SS\" local time or seconds since 1970.\n");
+	printf("  -t <time>                     To, as -s.\n");
+	printf("  -b                            Only break starts: out of network splice_insert, or a break/ad/placement\n");
+	printf("                                opportunity start segmentation descriptor.\n");
+	printf("  -c <type>                     Only this splice_command_type, eg. 5 splice_insert, 6 time_signal.\n");
+	printf("  -v                            Increase verbosity.\n");
+	printf("\nExample:\n");
+	printf("  %s -e 1207959553 /archive/wxyz\n", prog);
+	printf("  %s -b -s \"2026-10-14 20:00:00\" -t \"2026-10-14 21:00:00\" /archive/wxyz\n", prog);
+}
+
+int scte35_query(int argc, char *argv[])
+{
+	int ch;
+
+	struct sq_ctx_s s_ctx = { 0 };
+	struct sq_ctx_s *ctx = &s_ctx;
+	ctx->commandType = -1;
+	ctx->eventId = -1;
+	ctx->fromUs = INT64_MIN;
+	ctx->toUs = INT64_MAX;
+
+	while ((ch = getopt(argc, argv, "?hbc:e:s:t:v")) != -1) {
+		switch (ch) {
+		case 'b':
+			ctx->breaksOnly = 1;
+			break;
+		case 'c':
+			ctx->commandType = strtol(optarg, NULL, 0);
+			break;
+		case 'e':
+			ctx->eventId = strtoll(optarg, NULL, 0);
+			break;
+		case 's':
+		case 't':
+			if (_parse_time(optarg, ch == 's' ? &ctx->fromUs : &ctx->toUs) < 0) {
+				_query_usage(argv[0]);
+				fprintf(stderr, "\n *** -%c %s is not a time ***\n", ch, optarg);
+				exit(1);
+			}
+			break;
+		case 'v':
+			ctx->verbose++;
+			break;
+		case 'h':
+		case '?':
+		default:
+			_query_usage(argv[0]);
+			exit(1);
+		}
+	}
+
+	if (optind >= argc) {
+		_query_usage(argv[0]);
+		fprintf(stderr, "\n *** at least one directory or recording is mandatory ***\n");
+		exit(1);
+	}
+
+	struct timeval start, end;
+	gettimeofday(&start, NULL);
+
+	for (int i = optind; i < argc; i++)
+		_query_collect(ctx, argv[i]);
+	qsort(ctx->matches, ctx->matchCount, sizeof(*ctx->matches), _match_compare);
+
+	gettimeofday(&end, NULL);
+	double ms = ((end.tv_sec - start.tv_sec) * 1000.0) + ((end.tv_usec - start.tv_usec) / 1000.0);
+
+	for (int i = 0; i < ctx->matchCount; i++)
+		_print_match(ctx, &ctx->matches[i]);
+
+	printf("%d cues from %d indexes in %.1f ms\n", ctx->matchCount, ctx->indexes, ms);
+	if (ctx->stale)
+		printf("%d recordings changed since they were indexed, run tstools_scte35_inspector -I again.\n", ctx->stale);
+
+	for (int i = 0; i < ctx->recordingCount; i++)
+		free(ctx->recordings[i]);
+	free(ctx->recordings);
+	free(ctx->matches);
+
+	return 0;
+}
@@ -0,0 +1,86 @@
+/**
+ * @file        scte35_index.h
+ * @brief       Per recording index of every SCTE-35 splice_info_section, so cues can be found
+ *              across days of recordings without rescanning them.
+ *
+ *              Each recording gets a sidecar <recording>.scte35.idx, written by
+ *              tstools_scte35_inspector -I and read by tstools_scte35_query. A sidecar
+ *              whose recording size and mtime still match is up to date and isn't rebuilt,
+ *              so indexing a growing archive only scans the new files.
+ *
+ *              File layout, host byte order:
+ *                 struct scte35_index_header_s
+ *                 entryCount x struct scte35_index_entry_s, in file order
+ */
+
+#ifndef SCTE35_INDEX_H
+#define SCTE35_INDEX_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SCTE35_INDEX_SUFFIX  ".scte35.idx"
+#define SCTE35_INDEX_MAGIC   0x49353353 /* 'S35I' */
+#define SCTE35_INDEX_VERSION 1
+
+#define SCTE35_INDEX_FLAG_OUT_OF_NETWORK 0x01
+#define SCTE35_INDEX_FLAG_CANCEL         0x02
+#define SCTE35_INDEX_FLAG_IMMEDIATE      0x04
+#define SCTE35_INDEX_FLAG_PTS            0x08 /* pts is valid */
+#define SCTE35_INDEX_FLAG_DURATION       0x10 /* duration is valid */
+#define SCTE35_INDEX_FLAG_ENCRYPTED      0x20 /* Only the command type is known */
+#define SCTE35_INDEX_FLAG_SEGMENTATION   0x40 /* eventId and segmentationTypeId are from a segmentation_descriptor */
+
+struct scte35_index_header_s
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t entryCount;
+	uint32_t reserved;
+	uint64_t recordingSize;   /* Of the recording when it was indexed */
+	int64_t  recordingMtime;
+	int64_t  startUs;         /* Wallclock of the first and last packets, us since 1970 */
+	int64_t  endUs;
+};
+
+struct scte35_index_entry_s
+{
+	uint64_t offset;          /* Of the transport packet that starts the section */
+	int64_t  wallclockUs;     /* us since 1970, from the recording start time and PCR */
+	uint64_t pts;             /* splice_time, pts_adjustment applied, 90kHz */
+	uint64_t duration;        /* break_duration or segmentation_duration, 90kHz */
+	uint32_t eventId;         /* splice_event_id, or segmentation_event_id */
+	uint16_t pid;
+	uint8_t  commandType;     /* splice_command_type */
+	uint8_t  flags;           /* SCTE35_INDEX_FLAG_* */
+	uint8_t  segmentationTypeId;
+	uint8_t  reserved[7];
+};
+
+/**
+ * @brief       Index every transport file (.ts, .m2ts, .mts) under path, a directory (recursively) or a single file.
+ * @param[in]   int threads - Files indexed in parallel.
+ * @param[in]   int force - Rebuild sidecars that are already up to date.
+ * @return      Number of files that failed, 0 on success.
+ */
+int scte35_index_path(const char *path, int threads, int force, int verbose);
+
+/**
+ * @brief       Short name of a splice_command_type, "splice_insert" etc.
+ */
+const char *scte35_index_command_name(uint8_t commandType);
+
+/**
+ * @brief       True for the start of a break: an out of network splice_insert, or a segmentation
+ *              descriptor for a break, ad or placement opportunity start.
+ */
+int scte35_index_is_break_start(const struct scte35_index_entry_s *e);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* SCTE35_INDEX_H */
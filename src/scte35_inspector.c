@@ -15,9 +15,12 @@
 #include <libklscte35/scte35.h>
 #include "ffmpeg-includes.h"
 #include "source-avio.h"
+#include "scte35_index.h"
 
 char *strcasestr(const char *haystack, const char *needle);
 
+#define DEFAULT_INDEX_THREADS 4
+
 struct tool_ctx_s
 {
 	int   verbose;
@@ -45,6 +48,9 @@ struct tool_ctx_s
 
 	int isRTP;
 
+	char *indexPath;
+	int indexThreads;
+	int indexRebuild;
 };
 
 static int gRunning = 1;
@@ -152,11 +158,16 @@ static void usage(const char *progname)
 	printf("  -V 0xnnnn PID containing the video stream (Optional)\n");
 	printf("  -F exact pcap filter. Eg 'host 227.1.20.80 && udp port 4001'\n");
 	printf("     DON'T PASS A FILTER WITH MPTS or something with multiple different streams - be very specific, one stream one program\n");
+	printf("  -I <dir | file> Index every SCTE35 message in a directory of recordings, for tstools_scte35_query.\n");
+	printf("     Writes <recording>" SCTE35_INDEX_SUFFIX " alongside each, recordings already indexed are skipped.\n");
+	printf("  -j <threads> Recordings indexed in parallel with -I [def: %d]\n", DEFAULT_INDEX_THREADS);
+	printf("  -R With -I, rebuild indexes that are already up to date.\n");
 	printf("\nExample:\n");
 	printf("  sudo ./tstools_scte35_inspector -i eno2 -F 'host 227.1.20.80 && udp port 4001'  -- auto-detect SCTE/video pids from nic\n");
 	printf("       ./tstools_scte35_inspector -i recording.ts                                 -- auto-detect SCTE/video pids from file\n");
 	printf("       ./tstools_scte35_inspector -i recording.ts -V 0x1e1 -P 0x67                -- Disable auto-detect force decode of pid 0x67\n");
 	printf("       ./tstools_scte35_inspector -i udp://227.1.20.80:4001                       -- auto-detect SCTE/video pids from socket/stream\n");
+	printf("       ./tstools_scte35_inspector -I /archive/wxyz -j 8                           -- index a recording archive\n");
 }
 
 static void process_transport_buffer(struct tool_ctx_s *ctx, const unsigned char *buf, int byteCount)
@@ -371,10 +382,11 @@ int scte35_inspector(int argc, char *argv[])
 	ctx->verbose = 1;
 	ctx->streamId = 0xe0; /* Default PES video stream ID */
 	ctx->mode = MODE_SOURCE_AVIO;
+	ctx->indexThreads = DEFAULT_INDEX_THREADS;
 
 	int ch;
 
-	while ((ch = getopt(argc, argv, "?hvi:F:P:V:S:")) != -1) {
+	while ((ch = getopt(argc, argv, "?hvi:F:I:j:P:RV:S:")) != -1) {
 		switch (ch) {
 		case '?':
 		case 'h':
@@ -388,6 +400,19 @@ int scte35_inspector(int argc, char *argv[])
 			ctx->pcap_filter = strdup(optarg);
 			ctx->mode = MODE_SOURCE_PCAP;
 			break;
+		case 'I':
+			ctx->indexPath = strdup(optarg);
+			break;
+		case 'j':
+			ctx->indexThreads = atoi(optarg);
+			if (ctx->indexThreads < 1) {
+				usage(argv[0]);
+				exit(1);
+			}
+			break;
+		case 'R':
+			ctx->indexRebuild = 1;
+			break;
 		case 'P':
 			if ((sscanf(optarg, "0x%x", &ctx->scte35PID) != 1) || (ctx->scte35PID > 0x1fff)) {
 				usage(argv[0]);
@@ -415,6 +440,12 @@ int scte35_inspector(int argc, char *argv[])
 		}
 	}
 
+	if (ctx->indexPath) {
+		int failed = scte35_index_path(ctx->indexPath, ctx->indexThreads, ctx->indexRebuild, ctx->verbose - 1);
+		free(ctx->indexPath);
+		return failed ? 1 : 0;
+	}
+
 	if (getuid() == 0 && getenv("SUDO_UID") && getenv("SUDO_GID") && ctx->mode != MODE_SOURCE_PCAP) {
 		usage(argv[0]);
 		fprintf(stderr, "\n**** Don't use SUDO against file or udp socket sources, ONLY nic/pcap sources ****.\n\n");
@@ -26,6 +26,7 @@
 #include "source-avio.h"
 #include "xorg-list.h"
 #include "utils.h"
+#include "async_log.h"
 
 #define DEFAULT_STREAMID 0xe0
 #define DEFAULT_PID 0x31
@@ -162,7 +163,7 @@ static void _compareStreams(struct tool_ctx_s *ctx, struct stream_s *stream, str
 
 			if (ctx->verbose) {
 
-				printf("Frame %12d taking %5d ms between sampling points, P1->vPTS %13" PRIi64 ", P1->vDTS %13" PRIi64 ", P2->vPTS %13" PRIi64 ", P2->vDTS %13" PRIi64
+				ASYNC_LOG_RESULT("Frame %12d taking %5d ms between sampling points, P1->vPTS %13" PRIi64 ", P1->vDTS %13" PRIi64 ", P2->vPTS %13" PRIi64 ", P2->vDTS %13" PRIi64
 					", 1:%" PRIi64 " 2:%" PRIi64 "\n",
 					element->sei_framenumber,
 					ms,
@@ -196,7 +197,7 @@ static void _compareStreams(struct tool_ctx_s *ctx, struct stream_s *stream, str
 				finalLatency_ms);
 
 			if (ctx->verbose) {
-				printf("%s", msg);
+				ASYNC_LOG_RESULT("%s", msg);
 			}
 
 			if (ctx->udpOutput) {
@@ -290,7 +291,7 @@ static void _maintain_clocks(struct stream_s *stream, struct ltn_pes_packet_s *p
 	*trueLatency_ms = stream->trueLatency;
 
 #if 1
-	printf("stream%d: drift_ms %6" PRIi64 ", driftPTS_ms %6" PRIi64 ", trueLatency %6" PRIi64 "\n",
+	ASYNC_LOG_RATE(1000, "stream%d: drift_ms %6" PRIi64 ", driftPTS_ms %6" PRIi64 ", trueLatency %6" PRIi64 "\n",
 		stream->nr,
 		stream->drift_ms,
 		stream->driftPTS_ms,
@@ -403,7 +404,8 @@ static void *pe_callback(void *userContext, struct ltn_pes_packet_s *pes)
 
 			int64_t latencySpan = stream->trueLatency_hwm - stream->trueLatency_lwm;
 			int64_t latency =  stream->trueLatency_lwm + (latencySpan / 2);
-			printf("stream#%d: nr %4d, frame %d, bytes %7d, latency %" PRIi64 "ms +- %" PRIi64 "ms\n",
+			/* One per frame, the tools output, never rate limited. */
+			ASYNC_LOG_RESULT("stream#%d: nr %4d, frame %d, bytes %7d, latency %" PRIi64 "ms +- %" PRIi64 "ms\n",
 				stream->nr,
 				e->nr,
 				e->sei_framenumber,
@@ -414,7 +416,7 @@ static void *pe_callback(void *userContext, struct ltn_pes_packet_s *pes)
 
 		if (ctx->verbose)
 		{
-			printf("stream#%d: nr %4d, frame %d, bytes %7d, PTS %13" PRIi64 ", DTS %13" PRIi64 ", seen %9u.%06u, latency %6" PRIi64 "ms, PTS drift %8" PRIi64 " DTS drift %8" PRIi64 ", truelatency %" PRIi64 "ms +- %" PRIi64 "ms\n",
+			ASYNC_LOG_RESULT("stream#%d: nr %4d, frame %d, bytes %7d, PTS %13" PRIi64 ", DTS %13" PRIi64 ", seen %9u.%06u, latency %6" PRIi64 "ms, PTS drift %8" PRIi64 " DTS drift %8" PRIi64 ", truelatency %" PRIi64 "ms +- %" PRIi64 "ms\n",
 				stream->nr,
 				e->nr,
 				e->sei_framenumber,
@@ -817,6 +819,9 @@ int sei_latency_inspector(int argc, char *argv[])
 
 	signal(SIGINT, signal_handler);
 
+	/* Timing reports are generated per frame on the source threads, never let the console stall them. */
+	async_log_start(stdout);
+
 	start_source(ctx, 1);
 
 	if (ctx->compareMode) {
@@ -833,6 +838,8 @@ int sei_latency_inspector(int argc, char *argv[])
 		destroy_source(ctx, 2);
 	}
 
+	async_log_stop();
+
 	if (ctx->udpOutput) {
 		close(ctx->tx_skt);
 	}
@@ -9,6 +9,7 @@
 #include <time.h>
 
 #include <libltntstools/ltntstools.h>
+#include "tsfile_reader.h"
 
 struct videotime_s
 {
@@ -369,8 +370,8 @@ static int _findFirstPCR(struct tool_context_s *ctx)
 		exit(1);
 	}
 
-	FILE *fh = fopen(ctx->ifn, "rb");
-	if (!fh) {
+	void *reader;
+	if (tsfile_reader_alloc(&reader, ctx->ifn, 1048576) < 0) {
 		fprintf(stderr, "Unable to open input file '%s'\n", ctx->ifn);
 		exit(1);
 	}
@@ -382,16 +383,16 @@ static int _findFirstPCR(struct tool_context_s *ctx)
 	int scanLength = 16 * 1048576;
 	int blen = 64 * 188;
 	unsigned char *pkts = malloc(blen);
-	while(scanLength) {
+	while(scanLength > 0) {
 
-		int rlen = fread(pkts, 1, blen, fh);
-		if (rlen <= 0)
+		int count = tsfile_reader_read_copy(reader, pkts, NULL, blen / 188);
+		if (count <= 0)
 			break;
 
-		/* Run the first 64MB through the model. */
-		scanLength -= rlen;
+		/* Run the first 16MB through the model. */
+		scanLength -= count * 188;
 
-		ltntstools_streammodel_write(streamModel, pkts, rlen / 188, &complete);
+		ltntstools_streammodel_write(streamModel, pkts, count, &complete);
 		if (complete) {
 			struct ltntstools_pat_s *pat = NULL;
 			if (ltntstools_streammodel_query_model(streamModel, &pat) == 0) {
@@ -416,7 +417,7 @@ static int _findFirstPCR(struct tool_context_s *ctx)
 		}
 	}
 	free(pkts);
-	fclose(fh);
+	tsfile_reader_free(reader);
 	ltntstools_streammodel_free(streamModel);
 
 	if (!complete)
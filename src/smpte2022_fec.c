@@ -0,0 +1,446 @@
+/* SMPTE 2022-1 column / row FEC recovery, see smpte2022_fec.h */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "smpte2022_fec.h"
+
+#define FEC_RING 1024            /* Media packets, must be a power of two */
+#define FEC_STORE 128            /* FEC packets awaiting the media they protect */
+#define FEC_MTU 1500
+#define RTP_HDR 12
+#define FEC_HDR 16
+
+/* A sequence jump of more than this restarts the engine, rather than waiting for the gap to fill. */
+#define RESYNC_PACKETS (FEC_RING / 2)
+
+struct fec_media_s
+{
+	int64_t seq;             /* Extended, -1 for empty */
+	int recovered;
+	uint64_t timestampNs;    /* Capture time, or when it was recovered */
+	int length;
+	uint8_t data[FEC_MTU];
+};
+
+struct fec_packet_s
+{
+	int inuse;
+	int isRow;
+	int64_t snBase;          /* Extended */
+	int offset;
+	int na;
+	uint16_t lengthRecovery;
+	uint8_t ptRecovery;
+	uint32_t tsRecovery;
+	int length;              /* Of the XOR'd payload */
+	uint8_t payload[FEC_MTU];
+};
+
+struct smpte2022_fec_s
+{
+	smpte2022_fec_output_cb cb;
+	void *userContext;
+
+	struct fec_media_s *ring;
+	struct fec_packet_s *store;
+
+	int64_t highest;         /* Extended sequence of the newest media packet, -1 until the first */
+	int64_t nextOut;         /* Next sequence to release */
+	int fecSeen;
+	uint32_t ssrc;
+	uint64_t timestampNs;    /* Capture time of the packet being written */
+
+	struct smpte2022_fec_stats_s stats;
+};
+
+static int64_t _extend(int64_t ref, uint16_t seq)
+{
+	int64_t ext = (ref & ~0xffffLL) | seq;
+	if (ext < ref - 32768)
+		ext += 65536;
+	else if (ext > ref + 32768)
+		ext -= 65536;
+	return ext;
+}
+
+static struct fec_media_s *_media_find(struct smpte2022_fec_s *ctx, int64_t seq)
+{
+	struct fec_media_s *m = &ctx->ring[seq & (FEC_RING - 1)];
+	if (m->seq != seq)
+		return NULL;
+	return m;
+}
+
+/* Media held back: long enough for the column FEC covering a packet to arrive after it. */
+static int64_t _window(struct smpte2022_fec_s *ctx)
+{
+	if (!ctx->fecSeen)
+		return 0;
+
+	int64_t w;
+	if (ctx->stats.columns && ctx->stats.rows)
+		w = 2 * ctx->stats.columns * ctx->stats.rows + ctx->stats.columns;
+	else
+	if (ctx->stats.columns)
+		w = 2 * ctx->stats.columns;
+	else
+		w = RESYNC_PACKETS;
+
+	if (w > FEC_RING - 64)
+		w = FEC_RING - 64;
+	return w;
+}
+
+/* Rebuild the one missing packet a FEC packet protects. Returns 1 if it recovered something,
+ * 0 if it can't (yet), -1 if the FEC packet is of no further use.
+ */
+static int _recover(struct smpte2022_fec_s *ctx, struct fec_packet_s *f)
+{
+	int64_t missing = -1;
+	int missingCount = 0;
+
+	for (int i = 0; i < f->na; i++) {
+		int64_t seq = f->snBase + (int64_t)i * f->offset;
+		if (_media_find(ctx, seq))
+			continue;
+		if (seq < ctx->nextOut) {
+			/* Already released as lost, or overwritten. */
+			return -1;
+		}
+		missing = seq;
+		if (++missingCount > 1)
+			return 0;
+	}
+	if (missingCount == 0)
+		return -1;
+
+	uint8_t pkt[FEC_MTU];
+	memset(pkt, 0, sizeof(pkt));
+
+	uint16_t length = f->lengthRecovery;
+	uint8_t pt = f->ptRecovery;
+	uint32_t ts = f->tsRecovery;
+	memcpy(pkt + RTP_HDR, f->payload, f->length);
+
+	for (int i = 0; i < f->na; i++) {
+		int64_t seq = f->snBase + (int64_t)i * f->offset;
+		if (seq == missing)
+			continue;
+		struct fec_media_s *m = _media_find(ctx, seq);
+		const uint8_t *h = m->data;
+		int plen = m->length - RTP_HDR;
+
+		length ^= plen;
+		pt ^= h[1] & 0x7f;
+		ts ^= ((uint32_t)h[4] << 24) | (h[5] << 16) | (h[6] << 8) | h[7];
+		if (plen > f->length)
+			plen = f->length;
+		for (int j = 0; j < plen; j++)
+			pkt[RTP_HDR + j] ^= h[RTP_HDR + j];
+	}
+
+	if (length == 0 || length > f->length || length > FEC_MTU - RTP_HDR) {
+		ctx->stats.unsupported++;
+		return -1;
+	}
+
+	pkt[0] = 0x80;
+	pkt[1] = pt & 0x7f;
+	pkt[2] = (missing >> 8) & 0xff;
+	pkt[3] = missing & 0xff;
+	pkt[4] = ts >> 24;
+	pkt[5] = ts >> 16;
+	pkt[6] = ts >> 8;
+	pkt[7] = ts;
+	pkt[8] = ctx->ssrc >> 24;
+	pkt[9] = ctx->ssrc >> 16;
+	pkt[10] = ctx->ssrc >> 8;
+	pkt[11] = ctx->ssrc;
+
+	struct fec_media_s *m = &ctx->ring[missing & (FEC_RING - 1)];
+	m->seq = missing;
+	m->recovered = 1;
+	m->timestampNs = ctx->timestampNs;
+	m->length = RTP_HDR + length;
+	memcpy(m->data, pkt, m->length);
+
+	return 1;
+}
+
+/* Apply every stored FEC packet until nothing more can be rebuilt. */
+static void _recover_all(struct smpte2022_fec_s *ctx)
+{
+	int progress;
+	do {
+		progress = 0;
+		for (int i = 0; i < FEC_STORE; i++) {
+			struct fec_packet_s *f = &ctx->store[i];
+			if (!f->inuse)
+				continue;
+			int ret = _recover(ctx, f);
+			if (ret == 1)
+				progress = 1;
+			if (ret != 0)
+				f->inuse = 0;
+		}
+	} while (progress);
+}
+
+static void _release_one(struct smpte2022_fec_s *ctx)
+{
+	int64_t seq = ctx->nextOut;
+	struct fec_media_s *m = _media_find(ctx, seq);
+	if (m == NULL && ctx->fecSeen) {
+		_recover_all(ctx);
+		m = _media_find(ctx, seq);
+	}
+	ctx->nextOut++;
+
+	if (m == NULL) {
+		ctx->stats.preFecLost++;
+		ctx->stats.postFecLost++;
+		return;
+	}
+	if (m->recovered) {
+		ctx->stats.preFecLost++;
+		ctx->stats.recovered++;
+	}
+	if (ctx->cb)
+		ctx->cb(ctx->userContext, m->data, m->length, m->recovered, m->timestampNs);
+}
+
+static void _release(struct smpte2022_fec_s *ctx)
+{
+	int64_t w = _window(ctx);
+	while (ctx->nextOut <= ctx->highest - w)
+		_release_one(ctx);
+}
+
+static void _reset(struct smpte2022_fec_s *ctx)
+{
+	for (int i = 0; i < FEC_RING; i++)
+		ctx->ring[i].seq = -1;
+	for (int i = 0; i < FEC_STORE; i++)
+		ctx->store[i].inuse = 0;
+	ctx->highest = -1;
+	ctx->nextOut = 0;
+}
+
+int smpte2022_fec_alloc(void **hdl, smpte2022_fec_output_cb cb, void *userContext)
+{
+	struct smpte2022_fec_s *ctx = calloc(1, sizeof(*ctx));
+	if (!ctx)
+		return -1;
+
+	ctx->ring = calloc(FEC_RING, sizeof(struct fec_media_s));
+	ctx->store = calloc(FEC_STORE, sizeof(struct fec_packet_s));
+	if (!ctx->ring || !ctx->store) {
+		free(ctx->ring);
+		free(ctx->store);
+		free(ctx);
+		return -1;
+	}
+
+	ctx->cb = cb;
+	ctx->userContext = userContext;
+	_reset(ctx);
+
+	*hdl = ctx;
+	return 0;
+}
+
+uint64_t smpte2022_fec_alloc_bytes()
+{
+	return sizeof(struct smpte2022_fec_s) + (FEC_RING * sizeof(struct fec_media_s)) + (FEC_STORE * sizeof(struct fec_packet_s));
+}
+
+void smpte2022_fec_free(void *hdl)
+{
+	struct smpte2022_fec_s *ctx = (struct smpte2022_fec_s *)hdl;
+	if (!ctx)
+		return;
+
+	free(ctx->ring);
+	free(ctx->store);
+	free(ctx);
+}
+
+void smpte2022_fec_flush(void *hdl)
+{
+	struct smpte2022_fec_s *ctx = (struct smpte2022_fec_s *)hdl;
+	if (ctx->highest < 0)
+		return;
+
+	while (ctx->nextOut <= ctx->highest)
+		_release_one(ctx);
+}
+
+void smpte2022_fec_write_media(void *hdl, const uint8_t *rtp, int lengthBytes, uint64_t timestampNs)
+{
+	struct smpte2022_fec_s *ctx = (struct smpte2022_fec_s *)hdl;
+
+	if (lengthBytes <= RTP_HDR || lengthBytes > FEC_MTU || (rtp[0] & 0xc0) != 0x80)
+		return;
+
+	ctx->timestampNs = timestampNs;
+
+	ctx->stats.mediaPackets++;
+
+	if ((rtp[0] & 0x1f) != 0) {
+		/* CSRCs or a header extension, FEC can't rebuild these, pass them along untouched. */
+		ctx->stats.unsupported++;
+	}
+
+	uint16_t seq16 = (rtp[2] << 8) | rtp[3];
+	int64_t seq;
+	if (ctx->highest < 0) {
+		seq = 65536 + seq16; /* Room below for late packets and snBase */
+		ctx->highest = seq - 1;
+		ctx->nextOut = seq;
+	} else {
+		seq = _extend(ctx->highest, seq16);
+	}
+
+	if (seq - ctx->highest > RESYNC_PACKETS || ctx->nextOut - seq > RESYNC_PACKETS) {
+		/* Sender restart, or something we can't bridge. */
+		smpte2022_fec_flush(ctx);
+		_reset(ctx);
+		seq = 65536 + seq16;
+		ctx->highest = seq - 1;
+		ctx->nextOut = seq;
+	}
+
+	if (seq < ctx->nextOut) {
+		ctx->stats.late++;
+		return;
+	}
+	if (_media_find(ctx, seq)) {
+		ctx->stats.duplicates++;
+		return;
+	}
+
+	/* Never overwrite a slot that's still waiting to go out. */
+	while (seq - ctx->nextOut >= FEC_RING - 1)
+		_release_one(ctx);
+
+	ctx->ssrc = ((uint32_t)rtp[8] << 24) | (rtp[9] << 16) | (rtp[10] << 8) | rtp[11];
+
+	struct fec_media_s *m = &ctx->ring[seq & (FEC_RING - 1)];
+	m->seq = seq;
+	m->recovered = 0;
+	m->timestampNs = timestampNs;
+	m->length = lengthBytes;
+	memcpy(m->data, rtp, lengthBytes);
+
+	if (seq > ctx->highest)
+		ctx->highest = seq;
+
+	_release(ctx);
+}
+
+void smpte2022_fec_write_fec(void *hdl, const uint8_t *rtp, int lengthBytes, uint64_t timestampNs)
+{
+	struct smpte2022_fec_s *ctx = (struct smpte2022_fec_s *)hdl;
+
+	ctx->timestampNs = timestampNs;
+
+	if (!smpte2022_fec_is_fec_packet(rtp, lengthBytes)) {
+		ctx->stats.unsupported++;
+		return;
+	}
+
+	const uint8_t *h = rtp + RTP_HDR;
+	int isRow = (h[12] >> 6) & 1;
+	int offset = h[13];
+	int na = h[14];
+
+	if (isRow) {
+		ctx->stats.rowPackets++;
+		ctx->stats.columns = na;
+	} else {
+		ctx->stats.columnPackets++;
+		ctx->stats.columns = offset;
+		ctx->stats.rows = na;
+	}
+	ctx->fecSeen = 1;
+
+	if (ctx->highest < 0) {
+		/* No media yet to anchor the sequence numbers against. */
+		return;
+	}
+
+	int64_t snBase = _extend(ctx->highest, (h[0] << 8) | h[1]);
+	if (snBase + (int64_t)(na - 1) * offset < ctx->nextOut) {
+		/* Protects nothing that's still waiting to go out. */
+		return;
+	}
+
+	/* Take a free slot, or the one protecting the oldest media. */
+	struct fec_packet_s *f = NULL;
+	for (int i = 0; i < FEC_STORE; i++) {
+		struct fec_packet_s *e = &ctx->store[i];
+		if (!e->inuse) {
+			f = e;
+			break;
+		}
+		if (f == NULL || e->snBase < f->snBase)
+			f = e;
+	}
+
+	f->inuse = 1;
+	f->isRow = isRow;
+	f->snBase = snBase;
+	f->offset = offset;
+	f->na = na;
+	f->lengthRecovery = (h[2] << 8) | h[3];
+	f->ptRecovery = h[4] & 0x7f;
+	f->tsRecovery = ((uint32_t)h[8] << 24) | (h[9] << 16) | (h[10] << 8) | h[11];
+	f->length = lengthBytes - RTP_HDR - FEC_HDR;
+	memcpy(f->payload, h + FEC_HDR, f->length);
+
+	_recover_all(ctx);
+	_release(ctx);
+}
+
+void smpte2022_fec_get_stats(void *hdl, struct smpte2022_fec_stats_s *stats)
+{
+	struct smpte2022_fec_s *ctx = (struct smpte2022_fec_s *)hdl;
+	*stats = ctx->stats;
+}
+
+int smpte2022_fec_sprintf(const struct smpte2022_fec_stats_s *stats, char *dst, int lengthBytes)
+{
+	return snprintf(dst, lengthBytes,
+		"FEC %dx%d, media %" PRIu64 ", column %" PRIu64 ", row %" PRIu64
+		", pre-FEC lost %" PRIu64 ", recovered %" PRIu64 ", post-FEC lost %" PRIu64
+		", duplicates %" PRIu64 ", late %" PRIu64 ", unsupported %" PRIu64,
+		stats->columns, stats->rows,
+		stats->mediaPackets, stats->columnPackets, stats->rowPackets,
+		stats->preFecLost, stats->recovered, stats->postFecLost,
+		stats->duplicates, stats->late, stats->unsupported);
+}
+
+int smpte2022_fec_is_fec_packet(const uint8_t *buf, int lengthBytes)
+{
+	if (lengthBytes <= RTP_HDR + FEC_HDR || lengthBytes > FEC_MTU)
+		return 0;
+	if ((buf[0] & 0xc0) != 0x80)
+		return 0;
+
+	const uint8_t *h = buf + RTP_HDR;
+
+	/* E set (extended header), X clear, XOR type and index zero, a non empty matrix. */
+	if ((h[4] & 0x80) == 0)
+		return 0;
+	if (h[12] & 0x80)
+		return 0;
+	if (h[12] & 0x3f)
+		return 0;
+	if (h[13] == 0 || h[14] == 0)
+		return 0;
+
+	return 1;
+}
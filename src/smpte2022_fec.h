@@ -0,0 +1,93 @@
+/**
+ * @file        smpte2022_fec.h
+ * @brief       SMPTE 2022-1 (ST 2022-1:2007, RFC 2733 based) column / row FEC recovery for RTP media.
+ *              Media RTP packets and the FEC packets from the column (port + 2) and row (port + 4)
+ *              flows are written in as they arrive, media packets come out of the callback in
+ *              sequence order, with any packets the FEC could rebuild put back in their place.
+ *
+ *              Until the first FEC packet arrives packets pass straight through. After that, media
+ *              is held back for long enough (2 x L x D + L packets) for the column FEC protecting
+ *              it to arrive, a missing packet is declared lost once that window has passed it.
+ *              Row and column FEC are applied repeatedly, a row recovery can enable a column
+ *              recovery and vice versa.
+ *
+ *              Loss before FEC (what the network did) and after FEC (what the decoder sees) are
+ *              counted separately.
+ *
+ *              Only 12 byte RTP headers are supported, as required by 2022-1. Recovered packets
+ *              get the SSRC of their neighbours and a clear marker bit.
+ *
+ *              Every packet written carries its capture time (nanoseconds), media comes out with
+ *              its own. Recovered packets were never captured, they're stamped with the capture time
+ *              of the packet whose arrival made the recovery possible, and flagged as recovered.
+ */
+
+#ifndef SMPTE2022_FEC_H
+#define SMPTE2022_FEC_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct smpte2022_fec_stats_s
+{
+	uint64_t mediaPackets;      /* Media packets received */
+	uint64_t columnPackets;     /* Column FEC packets received */
+	uint64_t rowPackets;        /* Row FEC packets received */
+	uint64_t preFecLost;        /* Media packets missing on the wire */
+	uint64_t recovered;         /* Of those, rebuilt from FEC */
+	uint64_t postFecLost;       /* Of those, still missing after FEC */
+	uint64_t duplicates;
+	uint64_t late;              /* Arrived after their place in the output had passed */
+	uint64_t unsupported;       /* Media with CSRCs or header extensions, or malformed FEC */
+	int columns;                /* L, 0 until known */
+	int rows;                   /* D, 0 until known */
+};
+
+/**
+ * @brief       Called for every media packet released, in sequence order.
+ * @param[in]   const uint8_t *rtp - RTP header and payload.
+ * @param[in]   int recovered - 1 if this packet was rebuilt from FEC.
+ * @param[in]   uint64_t timestampNs - Capture time written with the packet, or for recovered
+ *              packets the capture time of the packet that completed the recovery.
+ */
+typedef void (*smpte2022_fec_output_cb)(void *userContext, const uint8_t *rtp, int lengthBytes, int recovered,
+	uint64_t timestampNs);
+
+int  smpte2022_fec_alloc(void **hdl, smpte2022_fec_output_cb cb, void *userContext);
+
+/**
+ * @brief       Bytes each engine allocates, the media ring, FEC store and context, for callers
+ *              that budget memory.
+ */
+uint64_t smpte2022_fec_alloc_bytes();
+
+/**
+ * @brief       Free the engine, anything still held back is discarded, see smpte2022_fec_flush().
+ */
+void smpte2022_fec_free(void *hdl);
+
+void smpte2022_fec_write_media(void *hdl, const uint8_t *rtp, int lengthBytes, uint64_t timestampNs);
+void smpte2022_fec_write_fec(void *hdl, const uint8_t *rtp, int lengthBytes, uint64_t timestampNs);
+
+/**
+ * @brief       Release everything held back, missing packets that can't be recovered are counted as lost.
+ */
+void smpte2022_fec_flush(void *hdl);
+
+void smpte2022_fec_get_stats(void *hdl, struct smpte2022_fec_stats_s *stats);
+int  smpte2022_fec_sprintf(const struct smpte2022_fec_stats_s *stats, char *dst, int lengthBytes);
+
+/**
+ * @brief       Does this UDP payload look like a 2022-1 FEC packet?
+ *              RTP version 2, followed by a FEC header rather than transport packets.
+ */
+int  smpte2022_fec_is_fec_packet(const uint8_t *buf, int lengthBytes);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* SMPTE2022_FEC_H */
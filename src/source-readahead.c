@@ -0,0 +1,696 @@
+/* Rate controlled file playout with read ahead, see source-readahead.h
+ *
+ * ltntstools_source_rcts reads the file on the same thread that paces the output,
+ * so every slow read() lands directly on the output timing. Here the pacing thread
+ * never issues I/O. A ring of large buffers is filled ahead of it, either by io_uring
+ * (serviced from the pacing thread, but never waited on unless the ring is empty)
+ * or by a dedicated reader thread.
+ *
+ * Buffers are filled and consumed strictly in file order. When looping, the read ahead
+ * wraps back to the start of the file on its own, so a loop doesn't stall the output either.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+#include "source-readahead.h"
+
+/* Most packets we'll ever hold between two PCRs before we give up waiting and pace by estimate. */
+#define SEGMENT_MAX_PACKETS 32768
+
+/* Bitrate we assume until we've measured one from the PCRs. */
+#define DEFAULT_BPS 20000000ULL
+
+/* How far behind schedule the output can fall before we restart the clock, instead of bursting to catch up. */
+#define LATE_NS (100ULL * 1000000ULL)
+
+enum slot_state_e
+{
+	SLOT_FREE = 0,
+	SLOT_INFLIGHT,
+	SLOT_READY,
+};
+
+struct ra_slot_s
+{
+	uint8_t *buf;
+	enum slot_state_e state;
+	uint64_t offset;
+	int length;  /* Bytes requested */
+	int filled;  /* Bytes read so far */
+	int wrapped; /* Boolean. First block of a new pass through the file. */
+	int eof;     /* Boolean. No more data will follow this slot. */
+};
+
+struct source_readahead_ctx_s
+{
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+
+	void *userContext;
+	struct ltntstools_source_rcts_callbacks_s callbacks;
+
+	int fd;
+	int fileLoops;
+	int isRegular;
+	uint64_t fileSize;
+
+	/* Read ahead ring */
+	int depth;
+	struct ra_slot_s *slots;
+	int submitIdx;       /* Next slot to be filled */
+	int consumeIdx;      /* Next slot the pacing thread will take */
+	uint64_t nextOffset; /* File offset of the next read to be issued */
+	int endOfFile;       /* Boolean. No further reads will be issued. */
+	int primed;          /* Boolean. Playout has begun, waits from here on are underruns. */
+
+	int usingIOUring;
+#ifdef HAVE_LIBURING
+	struct io_uring ring;
+#endif
+	pthread_t readerThreadId;
+	int readerThreadRunning;
+
+	/* Pacing */
+	pthread_t threadId;
+	int threadRunning, threadTerminate, threadTerminated;
+
+	uint8_t *pkts;       /* Packets waiting to go out */
+	uint64_t *due;       /* CLOCK_MONOTONIC ns each scheduled packet is due */
+	int pktCount;
+	int schedCount;      /* Packets [0 - schedCount) have a due time */
+	uint64_t tNext;      /* Due time of the next packet to be scheduled */
+
+	uint8_t carry[188];  /* A packet split across two buffers */
+	int carryLen;
+
+	int pcrPID;
+	int havePCR;
+	uint64_t lastPCR;
+
+	/* Updated by the pacing and reader threads, read without a lock, they're informational. */
+	struct ltntstools_source_readahead_stats_s stats;
+};
+
+extern int ltnpthread_setname_np(pthread_t thread, const char *name);
+
+static uint64_t _now_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+}
+
+/* Assign the next file region to a slot. Returns < 0 when there's nothing left to read, the slot is then
+ * marked as the end of file marker.
+ */
+static int _slot_prepare(struct source_readahead_ctx_s *ctx, struct ra_slot_s *s)
+{
+	s->filled = 0;
+	s->wrapped = 0;
+	s->eof = 0;
+
+	if (ctx->isRegular && ctx->nextOffset >= ctx->fileSize) {
+		if (ctx->fileLoops && ctx->fileSize) {
+			ctx->nextOffset = 0;
+			s->wrapped = 1;
+		} else {
+			s->length = 0;
+			s->eof = 1;
+			ctx->endOfFile = 1;
+			return -1;
+		}
+	}
+
+	s->offset = ctx->nextOffset;
+	s->length = SOURCE_READAHEAD_BLOCK_SIZE;
+	if (ctx->isRegular && ctx->fileSize - s->offset < (uint64_t)s->length)
+		s->length = ctx->fileSize - s->offset;
+
+	ctx->nextOffset += s->length;
+
+	return 0;
+}
+
+/* Reader thread backend. Fill free slots in order, sleeping when the ring is full. */
+static int _read_slot(struct source_readahead_ctx_s *ctx, struct ra_slot_s *s)
+{
+	while (s->filled < s->length) {
+		ssize_t ret;
+		if (ctx->isRegular)
+			ret = pread(ctx->fd, s->buf + s->filled, s->length - s->filled, s->offset + s->filled);
+		else
+			ret = read(ctx->fd, s->buf + s->filled, s->length - s->filled);
+
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			return ret;
+
+		s->filled += ret;
+
+		/* Pipes hand back whatever they have, don't sit on it waiting for a full block. */
+		if (!ctx->isRegular)
+			break;
+	}
+
+	return s->filled;
+}
+
+static void *_reader_thread_func(void *p)
+{
+	struct source_readahead_ctx_s *ctx = p;
+
+	ltnpthread_setname_np(ctx->readerThreadId, "tstools-raread");
+
+	pthread_mutex_lock(&ctx->mutex);
+	while (!ctx->threadTerminate && !ctx->endOfFile) {
+		struct ra_slot_s *s = &ctx->slots[ctx->submitIdx];
+		if (s->state != SLOT_FREE) {
+			/* Ring is full, wait for the pacing thread to hand one back. */
+			pthread_cond_wait(&ctx->cond, &ctx->mutex);
+			continue;
+		}
+
+		if (_slot_prepare(ctx, s) < 0) {
+			s->state = SLOT_READY;
+			pthread_cond_broadcast(&ctx->cond);
+			break;
+		}
+		s->state = SLOT_INFLIGHT;
+		ctx->submitIdx = (ctx->submitIdx + 1) % ctx->depth;
+		pthread_mutex_unlock(&ctx->mutex);
+
+		int ret = _read_slot(ctx, s);
+
+		pthread_mutex_lock(&ctx->mutex);
+		if (ret <= 0) {
+			/* Read error, or the file was truncated underneath us. */
+			s->eof = 1;
+			ctx->endOfFile = 1;
+		}
+		ctx->stats.readsCompleted++;
+		ctx->stats.bytesRead += s->filled;
+		s->state = SLOT_READY;
+		pthread_cond_broadcast(&ctx->cond);
+	}
+	pthread_mutex_unlock(&ctx->mutex);
+
+	return NULL;
+}
+
+#ifdef HAVE_LIBURING
+/* io_uring backend. Queue a read for every free slot, in order. */
+static void _uring_submit(struct source_readahead_ctx_s *ctx)
+{
+	int queued = 0;
+
+	while (!ctx->endOfFile) {
+		struct ra_slot_s *s = &ctx->slots[ctx->submitIdx];
+		if (s->state != SLOT_FREE)
+			break;
+
+		if (_slot_prepare(ctx, s) < 0) {
+			s->state = SLOT_READY;
+			break;
+		}
+
+		/* The ring has an entry per slot, so this can't fail. */
+		struct io_uring_sqe *sqe = io_uring_get_sqe(&ctx->ring);
+		io_uring_prep_read(sqe, ctx->fd, s->buf, s->length, s->offset);
+		io_uring_sqe_set_data(sqe, s);
+
+		s->state = SLOT_INFLIGHT;
+		ctx->submitIdx = (ctx->submitIdx + 1) % ctx->depth;
+		queued++;
+	}
+
+	if (queued)
+		io_uring_submit(&ctx->ring);
+}
+
+static void _uring_complete(struct source_readahead_ctx_s *ctx, struct io_uring_cqe *cqe)
+{
+	struct ra_slot_s *s = io_uring_cqe_get_data(cqe);
+	int res = cqe->res;
+	io_uring_cqe_seen(&ctx->ring, cqe);
+
+	if (res > 0)
+		s->filled += res;
+
+	if ((res > 0 || res == -EINTR || res == -EAGAIN) && s->filled < s->length) {
+		/* Short or interrupted read, queue the remainder into the same slot. */
+		struct io_uring_sqe *sqe = io_uring_get_sqe(&ctx->ring);
+		io_uring_prep_read(sqe, ctx->fd, s->buf + s->filled, s->length - s->filled, s->offset + s->filled);
+		io_uring_sqe_set_data(sqe, s);
+		io_uring_submit(&ctx->ring);
+		return;
+	}
+
+	if (res <= 0 && s->filled < s->length) {
+		/* Read error, or the file was truncated underneath us. */
+		s->eof = 1;
+		ctx->endOfFile = 1;
+	}
+
+	ctx->stats.readsCompleted++;
+	ctx->stats.bytesRead += s->filled;
+	s->state = SLOT_READY;
+}
+
+/* Collect finished reads. If wait is set, block for up to 50ms for one. */
+static void _uring_reap(struct source_readahead_ctx_s *ctx, int wait)
+{
+	struct io_uring_cqe *cqe;
+
+	if (wait) {
+		struct __kernel_timespec ts = { .tv_sec = 0, .tv_nsec = 50 * 1000000 };
+		if (io_uring_wait_cqe_timeout(&ctx->ring, &cqe, &ts) == 0)
+			_uring_complete(ctx, cqe);
+	}
+
+	while (io_uring_peek_cqe(&ctx->ring, &cqe) == 0)
+		_uring_complete(ctx, cqe);
+}
+#endif
+
+/* Return the next completed buffer in file order, waiting for the I/O if we have to.
+ * NULL when we're asked to terminate.
+ */
+static struct ra_slot_s *_slot_acquire(struct source_readahead_ctx_s *ctx)
+{
+	struct ra_slot_s *s = &ctx->slots[ctx->consumeIdx];
+	uint64_t waitStart = 0;
+
+	if (ctx->usingIOUring) {
+#ifdef HAVE_LIBURING
+		_uring_reap(ctx, 0);
+		_uring_submit(ctx);
+		while (s->state != SLOT_READY && !ctx->threadTerminate) {
+			if (!waitStart)
+				waitStart = _now_ns();
+			_uring_reap(ctx, 1);
+		}
+#endif
+	} else {
+		pthread_mutex_lock(&ctx->mutex);
+		while (s->state != SLOT_READY && !ctx->threadTerminate) {
+			if (!waitStart)
+				waitStart = _now_ns();
+			pthread_cond_wait(&ctx->cond, &ctx->mutex);
+		}
+		pthread_mutex_unlock(&ctx->mutex);
+	}
+
+	if (waitStart && ctx->primed) {
+		uint64_t us = (_now_ns() - waitStart) / 1000;
+		ctx->stats.underruns++;
+		ctx->stats.underrunUs += us;
+		if (us > ctx->stats.maxUnderrunUs)
+			ctx->stats.maxUnderrunUs = us;
+	}
+	ctx->primed = 1;
+
+	if (s->state != SLOT_READY)
+		return NULL;
+
+	return s;
+}
+
+static void _slot_release(struct source_readahead_ctx_s *ctx, struct ra_slot_s *s)
+{
+	if (ctx->usingIOUring) {
+		s->state = SLOT_FREE;
+#ifdef HAVE_LIBURING
+		_uring_submit(ctx);
+#endif
+	} else {
+		pthread_mutex_lock(&ctx->mutex);
+		s->state = SLOT_FREE;
+		pthread_cond_broadcast(&ctx->cond);
+		pthread_mutex_unlock(&ctx->mutex);
+	}
+
+	ctx->consumeIdx = (ctx->consumeIdx + 1) % ctx->depth;
+}
+
+static void _sleep_until(struct source_readahead_ctx_s *ctx, uint64_t due)
+{
+	while (!ctx->threadTerminate) {
+		uint64_t now = _now_ns();
+		if (now >= due)
+			return;
+
+		/* Wake periodically so a low bitrate stream can't hold up shutdown. */
+		uint64_t ns = due - now;
+		if (ns > 50 * 1000000)
+			ns = 50 * 1000000;
+
+		struct timespec ts = { .tv_sec = ns / 1000000000ULL, .tv_nsec = ns % 1000000000ULL };
+		nanosleep(&ts, NULL);
+	}
+}
+
+/* How long packetCount packets last at the most recently measured bitrate. */
+static uint64_t _estimate_ns(struct source_readahead_ctx_s *ctx, int packetCount)
+{
+	uint64_t bps = ctx->stats.bps ? ctx->stats.bps : DEFAULT_BPS;
+	return ((uint64_t)packetCount * 188 * 8 * 1000000000ULL) / bps;
+}
+
+/* Spread every unscheduled packet evenly across durationNs. */
+static void _schedule(struct source_readahead_ctx_s *ctx, uint64_t durationNs)
+{
+	int n = ctx->pktCount - ctx->schedCount;
+	if (n <= 0)
+		return;
+
+	if (ctx->tNext == 0)
+		ctx->tNext = _now_ns();
+
+	for (int i = 0; i < n; i++)
+		ctx->due[ctx->schedCount + i] = ctx->tNext + ((durationNs * i) / n);
+
+	ctx->tNext += durationNs;
+	ctx->schedCount = ctx->pktCount;
+}
+
+/* Deliver the scheduled packets in groups of 7, each group at its due time.
+ * Unless we're flushing, a partial group is held back until more packets are scheduled.
+ */
+static void _emit(struct source_readahead_ctx_s *ctx, int flush)
+{
+	int idx = 0;
+
+	while (!ctx->threadTerminate) {
+		int count = ctx->schedCount - idx;
+		if (count <= 0 || (count < 7 && !flush))
+			break;
+		if (count > 7)
+			count = 7;
+
+		uint64_t now = _now_ns();
+		if (now > ctx->due[idx] + LATE_NS) {
+			/* We've fallen well behind, usually after an underrun. Bursting to catch up
+			 * would hurt downstream more than the gap has, restart the clock instead.
+			 */
+			uint64_t shift = now - ctx->due[idx];
+			for (int i = idx; i < ctx->schedCount; i++)
+				ctx->due[i] += shift;
+			ctx->tNext += shift;
+			ctx->stats.lateRebases++;
+		}
+
+		_sleep_until(ctx, ctx->due[idx]);
+
+		if (ctx->callbacks.raw)
+			ctx->callbacks.raw(ctx->userContext, ctx->pkts + (idx * 188), count);
+
+		idx += count;
+	}
+
+	if (idx) {
+		memmove(ctx->pkts, ctx->pkts + (idx * 188), (ctx->pktCount - idx) * 188);
+		memmove(ctx->due, ctx->due + idx, (ctx->schedCount - idx) * sizeof(uint64_t));
+		ctx->pktCount -= idx;
+		ctx->schedCount -= idx;
+	}
+}
+
+static void _packet_push(struct source_readahead_ctx_s *ctx, const uint8_t *pkt)
+{
+	uint64_t pcr;
+	if (ltntstools_scr((uint8_t *)pkt, &pcr) == 0) {
+		uint16_t pid = ltntstools_pid(pkt);
+		if (ctx->pcrPID < 0)
+			ctx->pcrPID = pid;
+
+		if (pid == ctx->pcrPID) {
+			/* Everything since the last PCR plays out over the PCR interval. */
+			int n = ctx->pktCount - ctx->schedCount;
+			uint64_t ticks = ctx->havePCR ? ltntstools_scr_diff(ctx->lastPCR, pcr) : 0;
+			if (n > 0 && ticks > 0 && ticks <= 27000000) {
+				_schedule(ctx, (ticks * 1000) / 27);
+				ctx->stats.bps = ((uint64_t)n * 188 * 8 * 27000000) / ticks;
+			} else {
+				/* First PCR, a discontinuity or we looped, continue at the last known rate. */
+				_schedule(ctx, _estimate_ns(ctx, n));
+			}
+
+			ctx->lastPCR = pcr;
+			ctx->havePCR = 1;
+			_emit(ctx, 0);
+		}
+	}
+
+	if (ctx->pktCount == SEGMENT_MAX_PACKETS) {
+		/* No PCR in a very long time, don't wait for one. */
+		_schedule(ctx, _estimate_ns(ctx, ctx->pktCount - ctx->schedCount));
+		_emit(ctx, 0);
+
+		/* _emit() doesn't drain once we're terminating, the packet has nowhere to go. */
+		if (ctx->pktCount == SEGMENT_MAX_PACKETS)
+			return;
+	}
+
+	memcpy(ctx->pkts + (ctx->pktCount * 188), pkt, 188);
+	ctx->pktCount++;
+}
+
+static void _buffer_process(struct source_readahead_ctx_s *ctx, const uint8_t *buf, int len)
+{
+	int i = 0;
+
+	if (ctx->threadTerminate)
+		return;
+
+	if (ctx->carryLen) {
+		/* Complete the packet that straddled the previous buffer. */
+		int need = 188 - ctx->carryLen;
+		if (len < need) {
+			memcpy(&ctx->carry[ctx->carryLen], buf, len);
+			ctx->carryLen += len;
+			return;
+		}
+		memcpy(&ctx->carry[ctx->carryLen], buf, need);
+		_packet_push(ctx, &ctx->carry[0]);
+		ctx->carryLen = 0;
+		i = need;
+	}
+
+	while (i < len && !ctx->threadTerminate) {
+		if (buf[i] != 0x47) {
+			ctx->stats.bytesLost++;
+			i++;
+			continue;
+		}
+		if (len - i < 188) {
+			memcpy(&ctx->carry[0], buf + i, len - i);
+			ctx->carryLen = len - i;
+			break;
+		}
+		_packet_push(ctx, buf + i);
+		i += 188;
+	}
+}
+
+static void *_pacing_thread_func(void *p)
+{
+	struct source_readahead_ctx_s *ctx = p;
+
+	ltnpthread_setname_np(ctx->threadId, "tstools-rapace");
+
+	while (!ctx->threadTerminate) {
+		struct ra_slot_s *s = _slot_acquire(ctx);
+		if (!s)
+			break;
+
+		if (s->wrapped) {
+			/* Back at the start of the file, a partial packet from the end of the last pass is useless. */
+			ctx->carryLen = 0;
+			ctx->stats.loops++;
+			if (ctx->callbacks.pos)
+				ctx->callbacks.pos(ctx->userContext, ctx->fileSize, ctx->fileSize, 100.0);
+		}
+
+		_buffer_process(ctx, s->buf, s->filled);
+
+		int eof = s->eof;
+		uint64_t pos = s->offset + s->filled;
+		_slot_release(ctx, s);
+
+		if (eof)
+			break;
+
+		/* 100% is reported once the playout has genuinely finished or wrapped. */
+		if (ctx->callbacks.pos && ctx->fileSize && pos < ctx->fileSize)
+			ctx->callbacks.pos(ctx->userContext, pos, ctx->fileSize, ((double)pos / (double)ctx->fileSize) * 100.0);
+	}
+
+	if (!ctx->threadTerminate) {
+		/* End of file, play out whatever is left at the last known rate. */
+		_schedule(ctx, _estimate_ns(ctx, ctx->pktCount - ctx->schedCount));
+		_emit(ctx, 1);
+
+		if (ctx->callbacks.pos)
+			ctx->callbacks.pos(ctx->userContext, ctx->fileSize, ctx->fileSize, 100.0);
+	}
+
+	ctx->threadTerminated = 1;
+
+	return NULL;
+}
+
+static void _free_resources(struct source_readahead_ctx_s *ctx)
+{
+#ifdef HAVE_LIBURING
+	if (ctx->usingIOUring) {
+		/* The kernel may still be writing into our buffers, collect every outstanding read first. */
+		int inflight;
+		do {
+			inflight = 0;
+			for (int i = 0; i < ctx->depth; i++) {
+				if (ctx->slots[i].state == SLOT_INFLIGHT)
+					inflight++;
+			}
+			if (inflight)
+				_uring_reap(ctx, 1);
+		} while (inflight);
+
+		io_uring_queue_exit(&ctx->ring);
+	}
+#endif
+
+	if (ctx->slots) {
+		for (int i = 0; i < ctx->depth; i++)
+			free(ctx->slots[i].buf);
+		free(ctx->slots);
+	}
+	free(ctx->pkts);
+	free(ctx->due);
+
+	if (ctx->fd >= 0)
+		close(ctx->fd);
+
+	pthread_cond_destroy(&ctx->cond);
+	pthread_mutex_destroy(&ctx->mutex);
+
+	free(ctx);
+}
+
+int ltntstools_source_readahead_alloc(void **hdl, void *userContext, struct ltntstools_source_rcts_callbacks_s *callbacks,
+	const char *filename, int fileLoops, int depth)
+{
+	struct source_readahead_ctx_s *ctx = calloc(1, sizeof(*ctx));
+	if (!ctx)
+		return -1;
+
+	pthread_mutex_init(&ctx->mutex, NULL);
+	pthread_cond_init(&ctx->cond, NULL);
+
+	ctx->userContext = userContext;
+	ctx->callbacks = *callbacks;
+	ctx->fileLoops = fileLoops;
+	ctx->pcrPID = -1;
+
+	if (depth <= 0)
+		depth = SOURCE_READAHEAD_DEFAULT_DEPTH;
+	if (depth < 2)
+		depth = 2;
+	if (depth > SOURCE_READAHEAD_MAX_DEPTH)
+		depth = SOURCE_READAHEAD_MAX_DEPTH;
+	ctx->depth = depth;
+	ctx->stats.depth = depth;
+
+	ctx->fd = open(filename, O_RDONLY);
+	if (ctx->fd < 0) {
+		fprintf(stderr, "%s() unable to open '%s', %s\n", __func__, filename, strerror(errno));
+		_free_resources(ctx);
+		return -1;
+	}
+
+	struct stat st;
+	if (fstat(ctx->fd, &st) == 0 && S_ISREG(st.st_mode)) {
+		ctx->isRegular = 1;
+		ctx->fileSize = st.st_size;
+#ifdef __linux__
+		posix_fadvise(ctx->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+	}
+
+	ctx->slots = calloc(ctx->depth, sizeof(struct ra_slot_s));
+	ctx->pkts = malloc(SEGMENT_MAX_PACKETS * 188);
+	ctx->due = malloc(SEGMENT_MAX_PACKETS * sizeof(uint64_t));
+	if (!ctx->slots || !ctx->pkts || !ctx->due) {
+		_free_resources(ctx);
+		return -1;
+	}
+
+	for (int i = 0; i < ctx->depth; i++) {
+		if (posix_memalign((void **)&ctx->slots[i].buf, 4096, SOURCE_READAHEAD_BLOCK_SIZE) != 0) {
+			ctx->slots[i].buf = NULL;
+			_free_resources(ctx);
+			return -1;
+		}
+	}
+
+#ifdef HAVE_LIBURING
+	/* Kernels without io_uring, or containers that filter it, drop back to the reader thread. */
+	if (ctx->isRegular && io_uring_queue_init(ctx->depth, &ctx->ring, 0) == 0) {
+		ctx->usingIOUring = 1;
+	}
+#endif
+	ctx->stats.usingIOUring = ctx->usingIOUring;
+
+	if (!ctx->usingIOUring) {
+		if (pthread_create(&ctx->readerThreadId, NULL, _reader_thread_func, ctx) != 0) {
+			_free_resources(ctx);
+			return -1;
+		}
+		ctx->readerThreadRunning = 1;
+	}
+
+	if (pthread_create(&ctx->threadId, NULL, _pacing_thread_func, ctx) != 0) {
+		ltntstools_source_readahead_free(ctx);
+		return -1;
+	}
+	ctx->threadRunning = 1;
+
+	*hdl = ctx;
+	return 0;
+}
+
+void ltntstools_source_readahead_free(void *hdl)
+{
+	struct source_readahead_ctx_s *ctx = hdl;
+	if (!ctx)
+		return;
+
+	pthread_mutex_lock(&ctx->mutex);
+	ctx->threadTerminate = 1;
+	pthread_cond_broadcast(&ctx->cond);
+	pthread_mutex_unlock(&ctx->mutex);
+
+	if (ctx->threadRunning)
+		pthread_join(ctx->threadId, NULL);
+	if (ctx->readerThreadRunning)
+		pthread_join(ctx->readerThreadId, NULL);
+
+	_free_resources(ctx);
+}
+
+void ltntstools_source_readahead_get_stats(void *hdl, struct ltntstools_source_readahead_stats_s *stats)
+{
+	struct source_readahead_ctx_s *ctx = hdl;
+	memcpy(stats, &ctx->stats, sizeof(*stats));
+}
@@ -0,0 +1,75 @@
+/**
+ * @file        source-readahead.h
+ * @brief       Rate controlled transport stream file playout, with the file I/O decoupled from the pacing.
+ *              A drop in alternative to ltntstools_source_rcts_alloc() for the tools that play files out.
+ *
+ *              A ring of large buffers is kept in flight ahead of the playout position, using io_uring
+ *              when the tools are built with --enable-liburing (and the kernel allows it), else a dedicated
+ *              reader thread. The pacing thread only ever consumes buffers that have already completed,
+ *              so a slow disk or a network filesystem hiccup is absorbed by the ring instead of turning
+ *              into output jitter. When the ring does run dry it's counted as an underrun.
+ *
+ *              Output is paced from the PCR of the first PID found carrying one, packets between two
+ *              PCRs are spread evenly across the PCR interval. Packets are delivered via the rcts raw
+ *              callback in groups of 7, progress via the rcts pos callback.
+ */
+
+#ifndef SOURCE_READAHEAD_H
+#define SOURCE_READAHEAD_H
+
+#include <libltntstools/ltntstools.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SOURCE_READAHEAD_DEFAULT_DEPTH 8
+#define SOURCE_READAHEAD_MAX_DEPTH 64
+#define SOURCE_READAHEAD_BLOCK_SIZE (2 * 1048576)
+
+struct ltntstools_source_readahead_stats_s
+{
+	int      depth;          /* Number of buffers in the ring */
+	int      usingIOUring;   /* Boolean. 0 when the reader thread backend is in use */
+
+	uint64_t bytesRead;
+	uint64_t readsCompleted;
+	uint64_t underruns;      /* Times the pacing thread found no completed buffer waiting */
+	uint64_t underrunUs;     /* Total time the pacing thread spent waiting on I/O */
+	uint64_t maxUnderrunUs;  /* Longest single wait */
+	uint64_t lateRebases;    /* Times the output fell far enough behind schedule that we restarted the clock */
+	uint64_t bytesLost;      /* Bytes discarded while hunting for sync */
+	uint64_t loops;          /* Number of times we've wrapped back to the start of the file */
+	uint64_t bps;            /* Most recently measured output bitrate */
+};
+
+/**
+ * @brief       Open a transport file and begin playing it out. Packets will be delivered via callbacks
+ *              from a dedicated pacing thread. Don't stall the callback.
+ * @param[out]  void **hdl - returned object.
+ * @param[in]   void *userContext - user specific value returned during callbacks
+ * @param[in]   struct ltntstools_source_rcts_callbacks_s *callbacks - raw and pos callbacks.
+ * @param[in]   const char *filename - transport file to play out.
+ * @param[in]   int fileLoops - Boolean. Restart at the beginning of the file when it ends.
+ * @param[in]   int depth - number of read buffers to keep in flight, 0 for the default.
+ * @return      0 - Success, else < 0 on error.
+ */
+int  ltntstools_source_readahead_alloc(void **hdl, void *userContext, struct ltntstools_source_rcts_callbacks_s *callbacks,
+	const char *filename, int fileLoops, int depth);
+
+/**
+ * @brief       Stop the playout and free a previously allocated context.
+ * @param[in]   void *hdl - ltntstools_source_readahead_alloc()
+ */
+void ltntstools_source_readahead_free(void *hdl);
+
+/**
+ * @brief       Query the read ahead and pacing statistics, safe to call from any thread.
+ */
+void ltntstools_source_readahead_get_stats(void *hdl, struct ltntstools_source_readahead_stats_s *stats);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* SOURCE_READAHEAD_H */
@@ -10,6 +10,7 @@
 #include <srt/srt.h>
 
 #include "utils.h"
+#include "source-readahead.h"
 
 static int g_running = 0;
 
@@ -24,6 +25,7 @@ struct tool_ctx_s
 	/* transport file smoother */
 	void *sm;
 	double fileLoopPct;
+	int readaheadDepth; /* 0 - rcts, else the read ahead source with this many buffers in flight. */
 
 	/* SRT */
 	SRTSOCKET skt;
@@ -141,6 +143,8 @@ static void _usage(const char *prog)
 	printf("  -o srt://host:port [mandatory]\n");
 	printf("  -p SRT encryption passphrase (min 10 chars max 79) [optional]");
 	printf("  -s <srt streamid> [optional]\n");
+	printf("  -R <number> keep <number> large file reads in flight ahead of the playout, absorbing disk stalls. [def: 0 disabled, typical: %d]\n",
+		SOURCE_READAHEAD_DEFAULT_DEPTH);
 }
 
 int srt_transmit(int argc, char* argv[])
@@ -151,7 +155,7 @@ int srt_transmit(int argc, char* argv[])
 
 	int ch;
 
-	while ((ch = getopt(argc, argv, "?hi:vlo:p:s:")) != -1) {
+	while ((ch = getopt(argc, argv, "?hi:vlo:p:s:R:")) != -1) {
 		switch(ch) {
 		case 'i':
 			if (ctx->filename)
@@ -197,6 +201,13 @@ int srt_transmit(int argc, char* argv[])
 		case 'v':
 			ctx->verbose++;
 			break;
+		case 'R':
+			ctx->readaheadDepth = atoi(optarg);
+			if (ctx->readaheadDepth < 0 || ctx->readaheadDepth > SOURCE_READAHEAD_MAX_DEPTH) {
+				fprintf(stderr, "-R must be 0 - %d, aborting.\n", SOURCE_READAHEAD_MAX_DEPTH);
+				exit(1);
+			}
+			break;
 		case 'h':
 		case '?':
 		default:
@@ -229,6 +240,12 @@ int srt_transmit(int argc, char* argv[])
 	sm_callbacks.pos = (ltntstools_source_rcts_pos_callback)sm_cb_pos;
 
 	/* Initialize a rate Controlled Transport Stream input object. */
+	if (ctx->readaheadDepth) {
+		if (ltntstools_source_readahead_alloc(&ctx->sm, ctx, &sm_callbacks, ctx->filename, ctx->fileLoops, ctx->readaheadDepth) < 0) {
+			fprintf(stderr, "%s() Unable to open filename, aborting.\n", __func__);
+			exit(1);
+		}
+	} else
 	if (ltntstools_source_rcts_alloc(&ctx->sm, ctx, &sm_callbacks, ctx->filename, ctx->fileLoops) < 0) {
 		fprintf(stderr, "%s() Unable to open filename, aborting.\n", __func__);
 		exit(1);
@@ -254,12 +271,22 @@ int srt_transmit(int argc, char* argv[])
 					ctx->stats.pktSndDropTotal,
 					ctx->stats.pktRetransTotal);
 			}
+			if (ctx->readaheadDepth) {
+				struct ltntstools_source_readahead_stats_s ras;
+				ltntstools_source_readahead_get_stats(ctx->sm, &ras);
+				printf("Readahead: %s depth %d underruns %" PRIu64 " (max %" PRIu64 "us) rebases %" PRIu64 " @ %.2f Mb/ps\n",
+					ras.usingIOUring ? "io_uring" : "thread", ras.depth,
+					ras.underruns, ras.maxUnderrunUs, ras.lateRebases, (double)ras.bps / 1e6);
+			}
 		}
 	}
 	printf("\n");
 
 	/* Teardown */
-	ltntstools_source_rcts_free(ctx->sm);
+	if (ctx->readaheadDepth)
+		ltntstools_source_readahead_free(ctx->sm);
+	else
+		ltntstools_source_rcts_free(ctx->sm);
 	tool_srt_close(ctx);
 	srt_cleanup();
 
@@ -0,0 +1,780 @@
+/* One way transit latency, jitter and loss between two capture points of the same stream.
+ *
+ * Each TS packet is reduced to a 64 bit fingerprint of its pid, continuity counter and
+ * payload, less any PCR and OPCR, which a remultiplexer may restamp. A packet seen at both points is matched by fingerprint through a hash table,
+ * no payload is ever compared, so full rate streams are fine. Latency is the difference
+ * of the two capture timestamps, so it's only as good as the agreement between the two
+ * clocks: same host, PTP, or a known offset (-O).
+ *
+ * Inputs are pcap files, merged in timestamp order, or two live interfaces on this host.
+ * Packets that can't be told apart inside the matching window (repeated tables, PCR only
+ * packets once their PCRs are left out) are set aside as ambiguous, never mismatched. Null
+ * packets are ignored. A packet seen at -a but not at -b within the window is lost,
+ * the reverse is unexpected (loss before -a, or content inserted between the points).
+ * Nothing is counted lost outside the overlap of the two captures, they rarely start or stop together.
+ *
+ * Example, a gateway between two interfaces:
+ *   tstools_transit_latency -a eno1 -A 227.1.20.45:4001 -b eno2 -B 239.1.1.1:5000
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <math.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+#include <pcap.h>
+
+#define TL_DEFAULT_WINDOW_MS 1000
+#define TL_DEFAULT_INTERVAL_SECS 1
+#define TL_TABLE_MIN (1 << 16)
+#define TL_NULL_PID 0x1fff
+
+static int gRunning = 1;
+
+enum tl_side_e {
+	TL_SIDE_A = 0,
+	TL_SIDE_B,
+};
+
+struct tl_entry_s
+{
+	uint64_t fp;
+	int64_t tsUs;
+	uint8_t used;
+	uint8_t side;
+	uint8_t ambiguous;
+};
+
+/* Arrival order per side, drives expiry. Entries already matched are skipped when they reach the head. */
+struct tl_fifo_s
+{
+	struct {
+		uint64_t fp;
+		int64_t tsUs;
+	} *items;
+	uint64_t head, tail, size;
+};
+
+struct tl_stats_s
+{
+	uint64_t matched;
+	int64_t minUs, maxUs;
+	double sumUs;
+	double sumSqUs;
+	uint64_t lost;
+	uint64_t unexpected;
+	uint64_t ambiguous;
+};
+
+struct tool_ctx_s;
+
+struct tl_source_s
+{
+	struct tool_ctx_s *ctx;
+	enum tl_side_e side;
+	const char *name;
+	pcap_t *pcap;
+	int live;
+	int datalink;
+	int64_t offsetUs;
+
+	/* Optional destination filter */
+	uint32_t dstAddr; /* Network order, 0 = any */
+	uint16_t dstPort; /* 0 = any */
+
+	/* File inputs, the next packet, held while the other file catches up */
+	int eof;
+	int pending;
+	int64_t pendingUs;
+	const u_char *pendingData;
+	int pendingLength;
+
+	struct tl_fifo_s fifo;
+	uint64_t datagrams;
+	uint64_t tsPackets;
+};
+
+struct tool_ctx_s
+{
+	struct tl_source_s src[2];
+	int64_t windowUs;
+	int64_t intervalUs;
+	int verbose;
+	FILE *csv;
+
+	struct tl_entry_s *table;
+	uint64_t tableSize; /* Power of two */
+	uint64_t tableCount;
+
+	int64_t nowUs;
+	int64_t firstUs;
+	int64_t intervalStartUs;
+	int64_t firstMatchUs; /* -a time of the first and last matches, the overlap of the two captures */
+	int64_t lastMatchUs;
+	uint64_t outside; /* Unmatched, but outside the overlap */
+
+	struct tl_stats_s interval;
+	struct tl_stats_s total;
+};
+
+static void signal_handler(int signum)
+{
+	gRunning = 0;
+}
+
+/* PID, CC and the 184 payload bytes. The other header bits are left out, a gateway may legitimately touch them,
+ * as are the PCR and OPCR, which a remultiplexer restamps.
+ */
+static uint64_t _fingerprint(const uint8_t *pkt)
+{
+	uint8_t body[188];
+	memcpy(body, pkt, sizeof(body));
+
+	/* Adaptation field with a PCR and / or OPCR, 6 bytes each, PCR first. */
+	if ((body[3] & 0x20) && body[4] >= 1) {
+		int afLength = body[4];
+		int offset = 6;
+		if ((body[5] & 0x10) && offset + 6 <= 5 + afLength) {
+			memset(&body[offset], 0, 6);
+			offset += 6;
+		}
+		if ((body[5] & 0x08) && offset + 6 <= 5 + afLength)
+			memset(&body[offset], 0, 6);
+	}
+
+	uint64_t h = 0x9e3779b97f4a7c15ULL;
+	for (int i = 4; i < 188; i += 8) {
+		uint64_t v;
+		memcpy(&v, body + i, sizeof(v));
+		h = (h ^ v) * 0xff51afd7ed558ccdULL;
+		h ^= h >> 32;
+	}
+	h ^= ((uint64_t)(pkt[1] & 0x1f) << 12) | ((uint64_t)pkt[2] << 4) | (pkt[3] & 0x0f);
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 29;
+	return h;
+}
+
+static void _stats_reset(struct tl_stats_s *s)
+{
+	memset(s, 0, sizeof(*s));
+	s->minUs = INT64_MAX;
+	s->maxUs = INT64_MIN;
+}
+
+static void _stats_write(struct tl_stats_s *s, int64_t us)
+{
+	s->matched++;
+	s->sumUs += us;
+	s->sumSqUs += (double)us * us;
+	if (us < s->minUs)
+		s->minUs = us;
+	if (us > s->maxUs)
+		s->maxUs = us;
+}
+
+static double _stats_avg(const struct tl_stats_s *s)
+{
+	return s->matched ? s->sumUs / s->matched : 0;
+}
+
+static double _stats_stddev(const struct tl_stats_s *s)
+{
+	if (s->matched < 2)
+		return 0;
+	double avg = _stats_avg(s);
+	double var = (s->sumSqUs / s->matched) - (avg * avg);
+	return var > 0 ? sqrt(var) : 0;
+}
+
+/* Open addressing, linear probing. */
+static struct tl_entry_s *_table_find(struct tool_ctx_s *ctx, uint64_t fp)
+{
+	uint64_t mask = ctx->tableSize - 1;
+	for (uint64_t i = fp & mask; ; i = (i + 1) & mask) {
+		struct tl_entry_s *e = &ctx->table[i];
+		if (!e->used)
+			return NULL;
+		if (e->fp == fp)
+			return e;
+	}
+}
+
+static void _table_insert_nogrow(struct tool_ctx_s *ctx, const struct tl_entry_s *n)
+{
+	uint64_t mask = ctx->tableSize - 1;
+	uint64_t i = n->fp & mask;
+	while (ctx->table[i].used)
+		i = (i + 1) & mask;
+	ctx->table[i] = *n;
+	ctx->tableCount++;
+}
+
+static int _table_resize(struct tool_ctx_s *ctx, uint64_t size)
+{
+	struct tl_entry_s *old = ctx->table;
+	uint64_t oldSize = ctx->tableSize;
+
+	ctx->table = calloc(size, sizeof(*ctx->table));
+	if (!ctx->table) {
+		ctx->table = old;
+		return -1;
+	}
+	ctx->tableSize = size;
+	ctx->tableCount = 0;
+
+	for (uint64_t i = 0; i < oldSize; i++) {
+		if (old[i].used)
+			_table_insert_nogrow(ctx, &old[i]);
+	}
+	free(old);
+
+	return 0;
+}
+
+static int _table_insert(struct tool_ctx_s *ctx, const struct tl_entry_s *n)
+{
+	/* Keep the load under a half, probes stay short. */
+	if ((ctx->tableCount + 1) * 2 > ctx->tableSize) {
+		if (_table_resize(ctx, ctx->tableSize * 2) < 0)
+			return -1;
+	}
+	_table_insert_nogrow(ctx, n);
+	return 0;
+}
+
+/* Backward shift deletion, no tombstones to slow the probes down. */
+static void _table_remove(struct tool_ctx_s *ctx, struct tl_entry_s *e)
+{
+	uint64_t mask = ctx->tableSize - 1;
+	uint64_t i = e - ctx->table;
+	uint64_t j = i;
+
+	while (1) {
+		j = (j + 1) & mask;
+		if (!ctx->table[j].used)
+			break;
+		uint64_t home = ctx->table[j].fp & mask;
+		/* Move j back into the hole at i unless its home lies cyclically in (i, j]. */
+		if ((j > i && (home <= i || home > j)) || (j < i && (home <= i && home > j))) {
+			ctx->table[i] = ctx->table[j];
+			i = j;
+		}
+	}
+	ctx->table[i].used = 0;
+	ctx->tableCount--;
+}
+
+static int _fifo_push(struct tl_fifo_s *f, uint64_t fp, int64_t tsUs)
+{
+	if (f->tail - f->head == f->size) {
+		uint64_t size = f->size ? f->size * 2 : TL_TABLE_MIN;
+		void *items = malloc(size * sizeof(*f->items));
+		if (!items)
+			return -1;
+		for (uint64_t i = 0; i < f->tail - f->head; i++)
+			memcpy((uint8_t *)items + (i * sizeof(*f->items)), &f->items[(f->head + i) % f->size], sizeof(*f->items));
+		free(f->items);
+		f->items = items;
+		f->tail -= f->head;
+		f->head = 0;
+		f->size = size;
+	}
+	f->items[f->tail % f->size].fp = fp;
+	f->items[f->tail % f->size].tsUs = tsUs;
+	f->tail++;
+	return 0;
+}
+
+static void _report(struct tool_ctx_s *ctx, int64_t startUs)
+{
+	struct tl_stats_s *s = &ctx->interval;
+	double t = (startUs - ctx->firstUs) / 1000000.0;
+
+	if (s->matched) {
+		printf("%10.3f: %8" PRIu64 " matched, latency min %8.3f avg %8.3f max %8.3f ms, jitter %7.3f ms, "
+			"%" PRIu64 " lost, %" PRIu64 " unexpected, %" PRIu64 " ambiguous\n",
+			t, s->matched,
+			s->minUs / 1000.0, _stats_avg(s) / 1000.0, s->maxUs / 1000.0, _stats_stddev(s) / 1000.0,
+			s->lost, s->unexpected, s->ambiguous);
+	} else {
+		printf("%10.3f: %8d matched, %" PRIu64 " lost, %" PRIu64 " unexpected, %" PRIu64 " ambiguous\n",
+			t, 0, s->lost, s->unexpected, s->ambiguous);
+	}
+
+	if (ctx->csv) {
+		fprintf(ctx->csv, "%.3f,%" PRIu64 ",%" PRId64 ",%.1f,%" PRId64 ",%.1f,%" PRIu64 ",%" PRIu64 ",%" PRIu64 "\n",
+			t, s->matched,
+			s->matched ? s->minUs : 0, _stats_avg(s), s->matched ? s->maxUs : 0, _stats_stddev(s),
+			s->lost, s->unexpected, s->ambiguous);
+	}
+
+	_stats_reset(s);
+}
+
+static void _advance_clock(struct tool_ctx_s *ctx, int64_t tsUs)
+{
+	if (ctx->firstUs == 0) {
+		ctx->firstUs = tsUs;
+		ctx->intervalStartUs = tsUs;
+	}
+	if (tsUs > ctx->nowUs)
+		ctx->nowUs = tsUs;
+
+	while (ctx->nowUs >= ctx->intervalStartUs + ctx->intervalUs) {
+		_report(ctx, ctx->intervalStartUs);
+		ctx->intervalStartUs += ctx->intervalUs;
+	}
+}
+
+/* Anything still waiting for its partner longer than the window gives up. */
+static void _expire(struct tool_ctx_s *ctx, int64_t beforeUs)
+{
+	for (int side = 0; side < 2; side++) {
+		struct tl_fifo_s *f = &ctx->src[side].fifo;
+		while (f->head != f->tail) {
+			uint64_t fp = f->items[f->head % f->size].fp;
+			int64_t tsUs = f->items[f->head % f->size].tsUs;
+			if (tsUs >= beforeUs)
+				break;
+			f->head++;
+
+			struct tl_entry_s *e = _table_find(ctx, fp);
+			if (!e || e->side != side || e->tsUs != tsUs)
+				continue; /* Matched long ago */
+
+			if (e->ambiguous) {
+				/* Counted as they arrived */
+			} else
+			if (ctx->total.matched == 0 || tsUs < ctx->firstMatchUs) {
+				ctx->outside++;
+			} else
+			if (side == TL_SIDE_A) {
+				ctx->interval.lost++;
+				ctx->total.lost++;
+			} else {
+				ctx->interval.unexpected++;
+				ctx->total.unexpected++;
+			}
+			_table_remove(ctx, e);
+		}
+	}
+}
+
+static void _observe(struct tool_ctx_s *ctx, struct tl_source_s *src, const uint8_t *pkt, int64_t tsUs)
+{
+	uint64_t fp = _fingerprint(pkt);
+
+	struct tl_entry_s *e = _table_find(ctx, fp);
+	if (!e) {
+		struct tl_entry_s n = { .fp = fp, .tsUs = tsUs, .used = 1, .side = src->side };
+		if (_table_insert(ctx, &n) < 0 || _fifo_push(&src->fifo, fp, tsUs) < 0) {
+			fprintf(stderr, "Unable to grow the fingerprint table, aborting.\n");
+			exit(1);
+		}
+		return;
+	}
+
+	if (e->ambiguous || e->side == src->side) {
+		/* Same content twice inside the window, we can't say which is which. */
+		if (!e->ambiguous) {
+			e->ambiguous = 1;
+			ctx->interval.ambiguous++;
+			ctx->total.ambiguous++;
+		}
+		ctx->interval.ambiguous++;
+		ctx->total.ambiguous++;
+
+		/* Stays ambiguous until the content hasn't been seen, on either side, for a whole window. */
+		e->tsUs = tsUs;
+		e->side = src->side;
+		if (_fifo_push(&src->fifo, fp, tsUs) < 0) {
+			fprintf(stderr, "Unable to grow the fingerprint table, aborting.\n");
+			exit(1);
+		}
+		return;
+	}
+
+	int64_t latencyUs = src->side == TL_SIDE_B ? tsUs - e->tsUs : e->tsUs - tsUs;
+	int64_t aUs = src->side == TL_SIDE_A ? tsUs : e->tsUs;
+	if (ctx->total.matched == 0)
+		ctx->firstMatchUs = aUs;
+	if (aUs > ctx->lastMatchUs)
+		ctx->lastMatchUs = aUs;
+	_stats_write(&ctx->interval, latencyUs);
+	_stats_write(&ctx->total, latencyUs);
+	if (ctx->verbose > 1) {
+		printf("pid 0x%04x cc %2d latency %" PRId64 " us\n", ((pkt[1] << 8) | pkt[2]) & 0x1fff, pkt[3] & 0x0f, latencyUs);
+	}
+	_table_remove(ctx, e);
+}
+
+/* Link layer, IPv4, UDP, optional RTP, transport packets. */
+static void _process_frame(struct tool_ctx_s *ctx, struct tl_source_s *src, int64_t tsUs, const u_char *buf, int len)
+{
+	int offset;
+	switch (src->datalink) {
+	case DLT_EN10MB:
+		offset = 14;
+		if (len >= 18 && buf[12] == 0x81 && buf[13] == 0x00)
+			offset += 4; /* 802.1Q */
+		break;
+	case DLT_NULL:
+		offset = 4;
+		break;
+#ifdef DLT_LINUX_SLL
+	case DLT_LINUX_SLL:
+		offset = 16;
+		break;
+#endif
+	case DLT_RAW:
+		offset = 0;
+		break;
+	default:
+		return;
+	}
+
+	if (len < offset + 20 + 8)
+		return;
+
+	const u_char *ip = buf + offset;
+	if ((ip[0] >> 4) != 4 || ip[9] != 17 /* UDP */)
+		return;
+
+	uint32_t daddr;
+	memcpy(&daddr, ip + 16, sizeof(daddr));
+	if (src->dstAddr && daddr != src->dstAddr)
+		return;
+
+	const u_char *udp = ip + ((ip[0] & 0x0f) * 4);
+	if (udp + 8 > buf + len)
+		return;
+	if (src->dstPort && ((udp[2] << 8) | udp[3]) != src->dstPort)
+		return;
+
+	const u_char *data = udp + 8;
+	int dataLength = (buf + len) - data;
+
+	/* RTP, version 2, skip the header and any CSRCs */
+	if (dataLength > 12 && data[0] != 0x47 && (data[0] & 0xc0) == 0x80) {
+		int hdr = 12 + ((data[0] & 0x0f) * 4);
+		data += hdr;
+		dataLength -= hdr;
+	}
+	if (dataLength < 188 || data[0] != 0x47)
+		return;
+
+	src->datagrams++;
+	tsUs += src->offsetUs;
+	_advance_clock(ctx, tsUs);
+	_expire(ctx, ctx->nowUs - ctx->windowUs);
+
+	for (int i = 0; i + 188 <= dataLength; i += 188) {
+		const uint8_t *pkt = data + i;
+		if (pkt[0] != 0x47)
+			break;
+		if ((((pkt[1] << 8) | pkt[2]) & 0x1fff) == TL_NULL_PID)
+			continue;
+		src->tsPackets++;
+		_observe(ctx, src, pkt, tsUs);
+	}
+}
+
+static void _pcap_cb(u_char *userContext, const struct pcap_pkthdr *h, const u_char *buf)
+{
+	struct tl_source_s *src = (struct tl_source_s *)userContext;
+
+	_process_frame(src->ctx, src, ((int64_t)h->ts.tv_sec * 1000000) + h->ts.tv_usec, buf, h->caplen);
+}
+
+static int _open(struct tl_source_s *src)
+{
+	char errbuf[PCAP_ERRBUF_SIZE];
+	struct stat st;
+
+	if (stat(src->name, &st) == 0 && S_ISREG(st.st_mode)) {
+		src->pcap = pcap_open_offline(src->name, errbuf);
+		if (!src->pcap) {
+			fprintf(stderr, "Cannot open pcap file: %s\n", errbuf);
+			return -1;
+		}
+	} else {
+		src->live = 1;
+		src->pcap = pcap_create(src->name, errbuf);
+		if (!src->pcap) {
+			fprintf(stderr, "Cannot open interface %s: %s\n", src->name, errbuf);
+			return -1;
+		}
+		pcap_set_snaplen(src->pcap, 65535);
+		pcap_set_promisc(src->pcap, 1);
+		pcap_set_timeout(src->pcap, 10);
+		pcap_set_immediate_mode(src->pcap, 1);
+		pcap_set_buffer_size(src->pcap, 64 * 1024 * 1024);
+		if (pcap_activate(src->pcap) < 0) {
+			fprintf(stderr, "Cannot activate interface %s: %s\n", src->name, pcap_geterr(src->pcap));
+			return -1;
+		}
+		if (pcap_setnonblock(src->pcap, 1, errbuf) < 0) {
+			fprintf(stderr, "Cannot set interface %s non-blocking: %s\n", src->name, errbuf);
+			return -1;
+		}
+
+		/* Keep everything but UDP in the kernel. */
+		struct bpf_program fp;
+		if (pcap_compile(src->pcap, &fp, "udp", 1, PCAP_NETMASK_UNKNOWN) == 0) {
+			pcap_setfilter(src->pcap, &fp);
+			pcap_freecode(&fp);
+		}
+	}
+	src->datalink = pcap_datalink(src->pcap);
+
+	return 0;
+}
+
+/* Two files, always take the earlier of the two next packets. */
+static void _run_files(struct tool_ctx_s *ctx)
+{
+	while (gRunning) {
+		for (int i = 0; i < 2; i++) {
+			struct tl_source_s *src = &ctx->src[i];
+			if (src->eof || src->pending)
+				continue;
+
+			struct pcap_pkthdr *h;
+			const u_char *data;
+			if (pcap_next_ex(src->pcap, &h, &data) != 1) {
+				src->eof = 1;
+				continue;
+			}
+			src->pending = 1;
+			src->pendingUs = ((int64_t)h->ts.tv_sec * 1000000) + h->ts.tv_usec + src->offsetUs;
+			src->pendingData = data;
+			src->pendingLength = h->caplen;
+		}
+
+		struct tl_source_s *next = NULL;
+		for (int i = 0; i < 2; i++) {
+			struct tl_source_s *src = &ctx->src[i];
+			if (src->pending && (!next || src->pendingUs < next->pendingUs))
+				next = src;
+		}
+		if (!next)
+			break;
+
+		next->pending = 0;
+		_process_frame(ctx, next, next->pendingUs - next->offsetUs, next->pendingData, next->pendingLength);
+	}
+}
+
+static void _run_live(struct tool_ctx_s *ctx, int durationSecs)
+{
+	struct pollfd fds[2];
+	for (int i = 0; i < 2; i++) {
+		fds[i].fd = pcap_get_selectable_fd(ctx->src[i].pcap);
+		fds[i].events = POLLIN;
+	}
+
+	time_t stopTime = durationSecs ? time(NULL) + durationSecs : 0;
+
+	while (gRunning) {
+		if (stopTime && time(NULL) >= stopTime)
+			break;
+
+		if (poll(fds, 2, 100) < 0)
+			continue;
+
+		for (int i = 0; i < 2; i++) {
+			if (fds[i].revents & POLLIN)
+				pcap_dispatch(ctx->src[i].pcap, -1, _pcap_cb, (u_char *)&ctx->src[i]);
+		}
+	}
+}
+
+static int _parse_addr(const char *arg, struct tl_source_s *src)
+{
+	char ip[64];
+	int port;
+	if (sscanf(arg, "%63[^:]:%d", ip, &port) != 2 || port < 1 || port > 65535)
+		return -1;
+
+	struct in_addr a;
+	if (inet_pton(AF_INET, ip, &a) != 1)
+		return -1;
+
+	src->dstAddr = a.s_addr;
+	src->dstPort = port;
+	return 0;
+}
+
+static void _usage(const char *prog)
+{
+	printf("%s\n", prog);
+	printf("One way latency, latency jitter and loss of a transport stream between two capture points,\n");
+	printf("matched packet by packet on a fingerprint of pid, continuity counter and payload.\n");
+	printf("Both clocks must agree (same host, PTP) or be corrected with -O.\n");
+	printf("Usage:\n");
+	printf("  -a <file.pcap | interface>    First capture point, upstream.\n");
+	printf("  -b <file.pcap | interface>    Second capture point, downstream.\n");
+	printf("                                Two pcap files are merged in timestamp order, two interfaces are captured live.\n");
+	printf("  -A <ip:port>                  Only the stream to this UDP destination at -a [def: any UDP]\n");
+	printf("  -B <ip:port>                  Only the stream to this UDP destination at -b [def: any UDP]\n");
+	printf("  -w <ms>                       Matching window, the most latency we'll look for [def: %d]\n", TL_DEFAULT_WINDOW_MS);
+	printf("  -O <us>                       Add this offset to the -b timestamps, to correct a known clock difference.\n");
+	printf("  -i <seconds>                  Report interval [def: %d]\n", TL_DEFAULT_INTERVAL_SECS);
+	printf("  -o <file.csv>                 Also write each report interval to a CSV file.\n");
+	printf("  -t <seconds>                  Live inputs, stop after this long [def: until ctrl-c]\n");
+	printf("  -v                            Increase verbosity, -vv prints every match.\n");
+}
+
+int transit_latency(int argc, char *argv[])
+{
+	int ch;
+	int durationSecs = 0;
+	const char *csvName = NULL;
+
+	struct tool_ctx_s *ctx = calloc(1, sizeof(*ctx));
+	ctx->windowUs = TL_DEFAULT_WINDOW_MS * 1000LL;
+	ctx->intervalUs = TL_DEFAULT_INTERVAL_SECS * 1000000LL;
+	for (int i = 0; i < 2; i++) {
+		ctx->src[i].ctx = ctx;
+		ctx->src[i].side = i;
+	}
+	_stats_reset(&ctx->interval);
+	_stats_reset(&ctx->total);
+
+	while ((ch = getopt(argc, argv, "?ha:A:b:B:i:o:O:t:vw:")) != -1) {
+		switch (ch) {
+		case 'a':
+			ctx->src[TL_SIDE_A].name = optarg;
+			break;
+		case 'b':
+			ctx->src[TL_SIDE_B].name = optarg;
+			break;
+		case 'A':
+		case 'B':
+			if (_parse_addr(optarg, &ctx->src[ch == 'A' ? TL_SIDE_A : TL_SIDE_B]) < 0) {
+				_usage(argv[0]);
+				fprintf(stderr, "\n *** -%c %s is malformed ***\n", ch, optarg);
+				exit(1);
+			}
+			break;
+		case 'i':
+			ctx->intervalUs = atoi(optarg) * 1000000LL;
+			if (ctx->intervalUs <= 0) {
+				_usage(argv[0]);
+				fprintf(stderr, "\n *** -i must be 1 or more seconds ***\n");
+				exit(1);
+			}
+			break;
+		case 'o':
+			csvName = optarg;
+			break;
+		case 'O':
+			ctx->src[TL_SIDE_B].offsetUs = atoll(optarg);
+			break;
+		case 't':
+			durationSecs = atoi(optarg);
+			break;
+		case 'v':
+			ctx->verbose++;
+			break;
+		case 'w':
+			ctx->windowUs = atoi(optarg) * 1000LL;
+			if (ctx->windowUs <= 0) {
+				_usage(argv[0]);
+				fprintf(stderr, "\n *** -w must be 1 or more ms ***\n");
+				exit(1);
+			}
+			break;
+		case 'h':
+		case '?':
+		default:
+			_usage(argv[0]);
+			exit(1);
+		}
+	}
+
+	if (!ctx->src[TL_SIDE_A].name || !ctx->src[TL_SIDE_B].name) {
+		_usage(argv[0]);
+		fprintf(stderr, "\n *** -a and -b are mandatory ***\n");
+		exit(1);
+	}
+
+	for (int i = 0; i < 2; i++) {
+		if (_open(&ctx->src[i]) < 0)
+			exit(1);
+	}
+	if (ctx->src[TL_SIDE_A].live != ctx->src[TL_SIDE_B].live) {
+		fprintf(stderr, "\n *** -a and -b must both be files or both be interfaces ***\n");
+		exit(1);
+	}
+
+	if (csvName) {
+		ctx->csv = fopen(csvName, "w");
+		if (!ctx->csv) {
+			fprintf(stderr, "Cannot open output file %s\n", csvName);
+			exit(1);
+		}
+		fprintf(ctx->csv, "seconds,matched,latency_min_us,latency_avg_us,latency_max_us,jitter_us,lost,unexpected,ambiguous\n");
+	}
+
+	if (_table_resize(ctx, TL_TABLE_MIN) < 0) {
+		fprintf(stderr, "Unable to allocate the fingerprint table, aborting.\n");
+		exit(1);
+	}
+
+	signal(SIGINT, signal_handler);
+	signal(SIGTERM, signal_handler);
+
+	if (ctx->src[TL_SIDE_A].live)
+		_run_live(ctx, durationSecs);
+	else
+		_run_files(ctx);
+
+	/* Settle everything up to the last match, anything after it was beyond the end of one of the captures. */
+	_expire(ctx, ctx->lastMatchUs);
+	for (uint64_t i = 0; i < ctx->tableSize; i++) {
+		if (ctx->table[i].used && !ctx->table[i].ambiguous)
+			ctx->outside++;
+	}
+	if (ctx->interval.matched || ctx->interval.lost || ctx->interval.unexpected || ctx->interval.ambiguous)
+		_report(ctx, ctx->intervalStartUs);
+
+	struct tl_stats_s *s = &ctx->total;
+	printf("\n");
+	for (int i = 0; i < 2; i++) {
+		printf("%s %s: %" PRIu64 " datagrams, %" PRIu64 " transport packets (nulls excluded)\n",
+			i == TL_SIDE_A ? "-a" : "-b", ctx->src[i].name, ctx->src[i].datagrams, ctx->src[i].tsPackets);
+	}
+	if (s->matched) {
+		uint64_t expected = s->matched + s->lost;
+		printf("Matched %" PRIu64 " packets, latency min %.3f avg %.3f max %.3f ms, jitter %.3f ms (stddev), %.3f ms (peak to peak)\n",
+			s->matched, s->minUs / 1000.0, _stats_avg(s) / 1000.0, s->maxUs / 1000.0,
+			_stats_stddev(s) / 1000.0, (s->maxUs - s->minUs) / 1000.0);
+		printf("Lost %" PRIu64 " (%.4f%%), unexpected %" PRIu64 ", ambiguous %" PRIu64 ", outside the overlap of the two captures %" PRIu64 "\n",
+			s->lost, expected ? (s->lost * 100.0) / expected : 0.0, s->unexpected, s->ambiguous, ctx->outside);
+		if (s->minUs < 0) {
+			printf("Negative latency, the two clocks disagree, see -O.\n");
+		}
+	} else {
+		printf("No packets matched, are -a and -b capturing the same stream? Check -A, -B and -w.\n");
+	}
+
+	if (ctx->csv)
+		fclose(ctx->csv);
+	for (int i = 0; i < 2; i++) {
+		pcap_close(ctx->src[i].pcap);
+		free(ctx->src[i].fifo.items);
+	}
+	free(ctx->table);
+	free(ctx);
+
+	return 0;
+}
@@ -0,0 +1,519 @@
+/* Join transport stream files into one continuous stream, without demuxing or decoding.
+ *
+ * Packets are copied at disk speed and patched in place. At each join (a seam) the tool
+ * compares the first PCR of the next file with where the output clock would have reached,
+ * projected from the bitrate around the last PCR written. Files that simply carry on from
+ * each other (consecutive segmentwriter files, say) are left alone. Anything else gets:
+ *  - a new timestamp offset so PCR, OPCR, PTS and DTS carry on from the previous file,
+ *  - continuity counters renumbered per pid to follow on from the previous file,
+ *  - the discontinuity_indicator set on the first packet of each pid, where it has an adaptation field,
+ *  - payload packets before each pid's first payload_unit_start nulled, a half PES or section is no use to anybody.
+ *    They become null packets rather than being removed, so the mux rate and PCR spacing survive.
+ *    Those carrying a PCR keep their adaptation field and lose only the payload, so the clock survives too.
+ * Continuity errors inside a file are preserved, only seams are repaired.
+ *
+ * The clock is taken from the first PCR pid found. MPTS programs are assumed to share a timebase.
+ *
+ * Example, join a segmented recording:
+ *   tstools_ts_concat -o joined.ts nic_monitor-eno1-227.1.20.45.4001-*.ts
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <time.h>
+#include <sys/time.h>
+
+#include <libltntstools/ltntstools.h>
+#include "tsfile_reader.h"
+
+#define TC_DEFAULT_TOLERANCE_MS 100
+#define TC_BATCH_PACKETS 4096
+#define TC_HEAD_MAX_PACKETS ((16 * 1048576) / 188) /* Search this far into each file for its first PCR */
+#define TC_PCR_WRAP (0x200000000ULL * 300)
+#define TC_PTS_WRAP 0x200000000ULL
+#define TC_NULL_PID 0x1fff
+
+static const uint8_t nullPacket[188] = { 0x47, 0x1f, 0xff, 0x10 };
+
+struct tc_pid_s
+{
+	uint8_t seen;       /* Written to the output at least once */
+	uint8_t lastCC;     /* Last continuity counter written, payload packets */
+	uint8_t ccDelta;    /* Added to every CC of this pid, since the last seam */
+	uint8_t seamPending;  /* First packet after a seam not yet written */
+	uint8_t awaitingPUSI; /* Nulling payload until the next payload_unit_start */
+	uint8_t ccResync;     /* Next payload packet sets ccDelta */
+};
+
+struct tool_ctx_s
+{
+	FILE *ofh;
+	FILE *report; /* Progress, stderr when the output is stdout */
+	int verbose;
+	int restamp;
+	int64_t toleranceTicks;
+
+	int pcrPID; /* Clock reference, -1 until found */
+	int64_t offset; /* 27MHz, added to every PCR, a multiple of 300 */
+
+	/* Output clock, on pcrPID */
+	int64_t lastPCR;    /* -1 until the first is written */
+	double ticksPerPacket;
+	uint64_t packetsSincePCR;
+
+	struct tc_pid_s pids[8192];
+
+	/* Totals */
+	uint64_t packetsOut;
+	uint64_t packetsNulled;
+	uint64_t packetsStripped; /* Nulled payload, PCR kept */
+	uint64_t seams;
+	uint64_t seamsRestamped;
+	uint64_t discontinuitiesMarked;
+	uint64_t discontinuitiesUnmarked;
+};
+
+/* b - a, the shortest way around the 33 bit clock */
+static int64_t _pcr_delta(int64_t a, int64_t b)
+{
+	int64_t d = (b - a) % (int64_t)TC_PCR_WRAP;
+	if (d > (int64_t)TC_PCR_WRAP / 2)
+		d -= TC_PCR_WRAP;
+	if (d < -(int64_t)TC_PCR_WRAP / 2)
+		d += TC_PCR_WRAP;
+	return d;
+}
+
+static int64_t _pcr_add(int64_t pcr, int64_t offset)
+{
+	int64_t v = (pcr + offset) % (int64_t)TC_PCR_WRAP;
+	if (v < 0)
+		v += TC_PCR_WRAP;
+	return v;
+}
+
+/* 42 bit PCR (base * 300 + extension) at p, 6 bytes. */
+static int64_t _pcr_read(const uint8_t *p)
+{
+	int64_t base = ((int64_t)p[0] << 25) | (p[1] << 17) | (p[2] << 9) | (p[3] << 1) | (p[4] >> 7);
+	int64_t ext = ((p[4] & 0x01) << 8) | p[5];
+	return (base * 300) + ext;
+}
+
+static void _pcr_write(uint8_t *p, int64_t pcr)
+{
+	int64_t base = pcr / 300;
+	int64_t ext = pcr % 300;
+	p[0] = base >> 25;
+	p[1] = base >> 17;
+	p[2] = base >> 9;
+	p[3] = base >> 1;
+	p[4] = ((base & 1) << 7) | 0x7e | ((ext >> 8) & 0x01);
+	p[5] = ext;
+}
+
+/* 33 bit PES timestamp at p, 5 bytes, keeping the 4 bit prefix and marker bits. */
+static int64_t _pts_read(const uint8_t *p)
+{
+	return ((int64_t)(p[0] & 0x0e) << 29) | (p[1] << 22) | ((p[2] & 0xfe) << 14) | (p[3] << 7) | (p[4] >> 1);
+}
+
+static void _pts_write(uint8_t *p, int64_t pts)
+{
+	p[0] = (p[0] & 0xf0) | ((pts >> 29) & 0x0e) | 0x01;
+	p[1] = pts >> 22;
+	p[2] = ((pts >> 14) & 0xfe) | 0x01;
+	p[3] = pts >> 7;
+	p[4] = ((pts << 1) & 0xfe) | 0x01;
+}
+
+static int _has_adaptation(const uint8_t *pkt)
+{
+	return (ltntstools_adaption_field_control((uint8_t *)pkt) & 0x02) && pkt[4] > 0;
+}
+
+static int _has_payload(const uint8_t *pkt)
+{
+	return ltntstools_adaption_field_control((uint8_t *)pkt) & 0x01;
+}
+
+static int _has_pcr(const uint8_t *pkt)
+{
+	return _has_adaptation(pkt) && (pkt[5] & 0x10);
+}
+
+/* Make an adaptation field only packet, the rest of the packet becomes stuffing. */
+static void _strip_payload(uint8_t *pkt)
+{
+	int afLength = pkt[4];
+	if (afLength > 182)
+		afLength = 182;
+
+	pkt[3] = (pkt[3] & 0xcf) | 0x20;
+	memset(&pkt[5 + afLength], 0xff, 188 - 5 - afLength);
+	pkt[4] = 183;
+}
+
+/* Shift the PCR and OPCR in the adaptation field, and PTS/DTS in a PES header starting in this packet. */
+static void _restamp(struct tool_ctx_s *ctx, uint8_t *pkt)
+{
+	int payload = 4;
+
+	if (_has_adaptation(pkt)) {
+		int afLength = pkt[4];
+		if (afLength > 183)
+			return; /* Corrupt */
+		uint8_t flags = pkt[5];
+		int pos = 6;
+		if ((flags & 0x10) && pos + 6 <= 5 + afLength) {
+			_pcr_write(&pkt[pos], _pcr_add(_pcr_read(&pkt[pos]), ctx->offset));
+			pos += 6;
+		}
+		if ((flags & 0x08) && pos + 6 <= 5 + afLength) {
+			_pcr_write(&pkt[pos], _pcr_add(_pcr_read(&pkt[pos]), ctx->offset));
+		}
+		payload = 5 + afLength;
+	}
+
+	if (!_has_payload(pkt) || !ltntstools_payload_unit_start_indicator(pkt))
+		return;
+
+	const int64_t offset90 = ctx->offset / 300;
+	uint8_t *pes = &pkt[payload];
+	int avail = 188 - payload;
+	if (avail < 9 || pes[0] != 0x00 || pes[1] != 0x00 || pes[2] != 0x01)
+		return;
+
+	/* Stream ids without the optional PES header */
+	uint8_t sid = pes[3];
+	if (sid == 0xbc || sid == 0xbe || sid == 0xbf || sid == 0xf0 || sid == 0xf1 || sid == 0xff || sid == 0xf2 || sid == 0xf8)
+		return;
+
+	int flags = pes[7] >> 6;
+	if ((flags & 0x02) && avail >= 14) {
+		int64_t pts = (_pts_read(&pes[9]) + offset90) % (int64_t)TC_PTS_WRAP;
+		_pts_write(&pes[9], pts < 0 ? pts + TC_PTS_WRAP : pts);
+	}
+	if (flags == 0x03 && avail >= 19) {
+		int64_t dts = (_pts_read(&pes[14]) + offset90) % (int64_t)TC_PTS_WRAP;
+		_pts_write(&pes[14], dts < 0 ? dts + TC_PTS_WRAP : dts);
+	}
+}
+
+/* Patch one packet in place for output. */
+static void _process(struct tool_ctx_s *ctx, uint8_t *pkt)
+{
+	uint16_t pid = ltntstools_pid(pkt);
+	if (pid == TC_NULL_PID)
+		return;
+
+	struct tc_pid_s *p = &ctx->pids[pid];
+	int payload = _has_payload(pkt);
+	int stripped = 0;
+
+	if (p->awaitingPUSI && payload) {
+		if (!ltntstools_payload_unit_start_indicator(pkt)) {
+			if (!_has_pcr(pkt)) {
+				memcpy(pkt, nullPacket, sizeof(nullPacket));
+				ctx->packetsNulled++;
+				return;
+			}
+			_strip_payload(pkt);
+			ctx->packetsStripped++;
+			payload = 0;
+			stripped = 1;
+		} else {
+			p->awaitingPUSI = 0;
+		}
+	}
+
+	if (p->seamPending) {
+		p->seamPending = 0;
+		if (_has_adaptation(pkt)) {
+			pkt[5] |= 0x80;
+			ctx->discontinuitiesMarked++;
+		} else {
+			ctx->discontinuitiesUnmarked++;
+		}
+	}
+
+	uint8_t cc = ltntstools_continuity_counter(pkt);
+	if (payload && p->ccResync) {
+		p->ccResync = 0;
+		if (p->seen)
+			p->ccDelta = (p->lastCC + 1 - cc) & 0x0f;
+	}
+
+	if (ctx->offset)
+		_restamp(ctx, pkt);
+
+	if (stripped)
+		cc = p->lastCC; /* No payload now, the counter doesn't advance */
+	else
+		cc = (cc + p->ccDelta) & 0x0f;
+	pkt[3] = (pkt[3] & 0xf0) | cc;
+	if (payload)
+		p->lastCC = cc;
+	p->seen = 1;
+
+	/* Track the output clock, it drives the next seam. */
+	uint64_t pcr;
+	if ((int)pid == ctx->pcrPID && ltntstools_scr(pkt, &pcr) == 0) {
+		if (ctx->lastPCR >= 0 && ctx->packetsSincePCR) {
+			int64_t d = _pcr_delta(ctx->lastPCR, pcr);
+			if (d > 0 && d < 27000000)
+				ctx->ticksPerPacket = (double)d / (double)ctx->packetsSincePCR;
+		}
+		ctx->lastPCR = pcr;
+		ctx->packetsSincePCR = 0;
+	}
+}
+
+/* Decide how the next file joins the output. pcrIndex is the number of packets ahead of its first PCR. */
+static void _seam(struct tool_ctx_s *ctx, const char *fn, int found, int64_t pcr, uint64_t pcrIndex)
+{
+	ctx->seams++;
+
+	if (!found || ctx->lastPCR < 0) {
+		fprintf(ctx->report, "%s: no PCR found, appended as is\n", fn);
+		return;
+	}
+
+	int64_t expected = _pcr_add(ctx->lastPCR, (int64_t)((ctx->packetsSincePCR + pcrIndex) * ctx->ticksPerPacket));
+	int64_t error = _pcr_delta(expected, _pcr_add(pcr, ctx->offset));
+
+	if (llabs(error) <= ctx->toleranceTicks) {
+		if (ctx->verbose)
+			fprintf(ctx->report, "%s: continues, %+.3f ms from the expected clock\n", fn, error / 27000.0);
+		return;
+	}
+
+	if (ctx->restamp) {
+		ctx->offset = ((ctx->offset - error) / 300) * 300;
+		ctx->seamsRestamped++;
+	}
+	fprintf(ctx->report, "%s: %+.3f ms from the expected clock, %s\n", fn, error / 27000.0,
+		ctx->restamp ? "restamped" : "marked discontinuous");
+
+	for (int i = 0; i < 8192; i++) {
+		struct tc_pid_s *p = &ctx->pids[i];
+		p->awaitingPUSI = 1;
+		if (p->seen) {
+			p->seamPending = 1;
+			p->ccResync = 1;
+		}
+	}
+}
+
+static int _write(struct tool_ctx_s *ctx, uint8_t *pkts, int count)
+{
+	for (int i = 0; i < count; i++) {
+		_process(ctx, pkts + (i * 188));
+		ctx->packetsSincePCR++;
+	}
+	ctx->packetsOut += count;
+
+	if (fwrite(pkts, 188, count, ctx->ofh) != (size_t)count) {
+		fprintf(stderr, "Error writing output, aborting.\n");
+		return -1;
+	}
+	return 0;
+}
+
+static int _concat_file(struct tool_ctx_s *ctx, const char *fn, uint8_t *head, int first)
+{
+	void *reader;
+	if (tsfile_reader_alloc(&reader, fn, 0) < 0) {
+		fprintf(stderr, "Unable to open input file '%s'\n", fn);
+		return -1;
+	}
+
+	/* Read up to the first PCR, the seam has to be decided before anything of this file is written. */
+	uint64_t headCount = 0;
+	int found = 0;
+	int64_t pcr = 0;
+	uint64_t pcrIndex = 0;
+	int anyPID = -1;
+	int64_t anyPCR = 0;
+	uint64_t anyIndex = 0;
+	while (!found && headCount < TC_HEAD_MAX_PACKETS) {
+		int max = TC_HEAD_MAX_PACKETS - headCount;
+		if (max > TC_BATCH_PACKETS)
+			max = TC_BATCH_PACKETS;
+		int count = tsfile_reader_read_copy(reader, head + (headCount * 188), NULL, max);
+		if (count <= 0)
+			break;
+
+		for (int i = 0; i < count && !found; i++) {
+			uint8_t *pkt = head + ((headCount + i) * 188);
+			uint64_t v;
+			if (ltntstools_scr(pkt, &v) < 0)
+				continue;
+
+			int pid = ltntstools_pid(pkt);
+			if (anyPID < 0) {
+				anyPID = pid;
+				anyPCR = v;
+				anyIndex = headCount + i;
+			}
+			if (ctx->pcrPID < 0)
+				ctx->pcrPID = pid;
+			if (pid == ctx->pcrPID) {
+				found = 1;
+				pcr = v;
+				pcrIndex = headCount + i;
+			}
+		}
+		headCount += count;
+	}
+
+	/* The clock pid went away, carry on with whatever this file has. */
+	if (!found && anyPID >= 0) {
+		fprintf(ctx->report, "%s: PCR moved from pid 0x%04x to 0x%04x\n", fn, ctx->pcrPID, anyPID);
+		ctx->pcrPID = anyPID;
+		found = 1;
+		pcr = anyPCR;
+		pcrIndex = anyIndex;
+	}
+
+	if (first) {
+		if (found && ctx->verbose)
+			fprintf(ctx->report, "%s: clock reference is PCR pid 0x%04x\n", fn, ctx->pcrPID);
+		for (int i = 0; i < 8192; i++)
+			ctx->pids[i].awaitingPUSI = 1;
+	} else {
+		_seam(ctx, fn, found, pcr, pcrIndex);
+	}
+
+	int ret = 0;
+	for (uint64_t i = 0; i < headCount && ret == 0; i += TC_BATCH_PACKETS) {
+		int count = headCount - i;
+		if (count > TC_BATCH_PACKETS)
+			count = TC_BATCH_PACKETS;
+		ret = _write(ctx, head + (i * 188), count);
+	}
+
+	while (ret == 0) {
+		int count = tsfile_reader_read_copy(reader, head, NULL, TC_BATCH_PACKETS);
+		if (count <= 0)
+			break;
+		ret = _write(ctx, head, count);
+	}
+
+	struct tsfile_reader_stats_s stats;
+	tsfile_reader_get_stats(reader, &stats);
+	if (stats.bytesLost)
+		fprintf(ctx->report, "%s: %" PRIu64 " bytes discarded while finding sync\n", fn, stats.bytesLost);
+
+	tsfile_reader_free(reader);
+	return ret;
+}
+
+static void _usage(const char *prog)
+{
+	printf("%s\n", prog);
+	printf("Join transport stream files into one continuous stream, at disk speed, no remux.\n");
+	printf("Where a file doesn't carry on from the one before, PCR/PTS/DTS are restamped to follow on,\n");
+	printf("continuity counters are repaired, discontinuity indicators set and partial PES nulled, keeping any PCR.\n");
+	printf("Usage:\n");
+	printf("  %s [options] -o <output.ts> <input.ts> [input.ts ...]\n", prog);
+	printf("  -o <output.ts>                Output file, - for stdout.\n");
+	printf("  -n                            Don't restamp, keep the original timestamps and only mark seams discontinuous.\n");
+	printf("  -t <ms>                       A file whose first PCR is within this of the expected clock carries on\n");
+	printf("                                from the previous file and is left alone [def: %d]\n", TC_DEFAULT_TOLERANCE_MS);
+	printf("  -v                            Increase verbosity, report every seam.\n");
+}
+
+int ts_concat(int argc, char *argv[])
+{
+	int ch;
+	const char *ofn = NULL;
+
+	struct tool_ctx_s *ctx = calloc(1, sizeof(*ctx));
+	ctx->restamp = 1;
+	ctx->toleranceTicks = TC_DEFAULT_TOLERANCE_MS * 27000LL;
+	ctx->pcrPID = -1;
+	ctx->lastPCR = -1;
+
+	while ((ch = getopt(argc, argv, "?hno:t:v")) != -1) {
+		switch (ch) {
+		case 'n':
+			ctx->restamp = 0;
+			break;
+		case 'o':
+			ofn = optarg;
+			break;
+		case 't':
+			ctx->toleranceTicks = atoi(optarg) * 27000LL;
+			if (ctx->toleranceTicks < 0) {
+				_usage(argv[0]);
+				fprintf(stderr, "\n *** -t must be 0 or more ms ***\n");
+				exit(1);
+			}
+			break;
+		case 'v':
+			ctx->verbose++;
+			break;
+		case 'h':
+		case '?':
+		default:
+			_usage(argv[0]);
+			exit(1);
+		}
+	}
+
+	if (!ofn || optind >= argc) {
+		_usage(argv[0]);
+		fprintf(stderr, "\n *** -o and at least one input are mandatory ***\n");
+		exit(1);
+	}
+
+	if (strcmp(ofn, "-") == 0) {
+		ctx->ofh = stdout;
+	} else {
+		ctx->ofh = fopen(ofn, "wb");
+		if (!ctx->ofh) {
+			fprintf(stderr, "Cannot open output file %s\n", ofn);
+			exit(1);
+		}
+	}
+	setvbuf(ctx->ofh, NULL, _IOFBF, 4 * 1048576);
+	ctx->report = ctx->ofh == stdout ? stderr : stdout;
+
+	uint8_t *head = malloc(TC_HEAD_MAX_PACKETS * 188);
+	if (!head) {
+		fprintf(stderr, "Unable to allocate read buffer, aborting.\n");
+		exit(1);
+	}
+
+	struct timeval begin, end;
+	gettimeofday(&begin, NULL);
+
+	int ret = 0;
+	for (int i = optind; i < argc && ret == 0; i++) {
+		ret = _concat_file(ctx, argv[i], head, i == optind);
+	}
+
+	if (ctx->ofh != stdout)
+		fclose(ctx->ofh);
+	else
+		fflush(stdout);
+
+	gettimeofday(&end, NULL);
+	double secs = (end.tv_sec - begin.tv_sec) + ((end.tv_usec - begin.tv_usec) / 1000000.0);
+	double mb = (ctx->packetsOut * 188.0) / 1048576.0;
+
+	fprintf(ctx->report, "%d files, %" PRIu64 " packets (%" PRIu64 " partial PES nulled, %" PRIu64 " more kept for their PCR), %.1f MB in %.2fs (%.0f MB/s)\n",
+		argc - optind, ctx->packetsOut, ctx->packetsNulled, ctx->packetsStripped, mb, secs, secs > 0 ? mb / secs : 0.0);
+	fprintf(ctx->report, "%" PRIu64 " seams, %" PRIu64 " restamped, %" PRIu64 " discontinuity indicators set, %" PRIu64 " pids without an adaptation field to carry one\n",
+		ctx->seams, ctx->seamsRestamped, ctx->discontinuitiesMarked, ctx->discontinuitiesUnmarked);
+
+	free(head);
+	free(ctx);
+
+	return ret == 0 ? 0 : 1;
+}
@@ -0,0 +1,824 @@
+/* Fan out a set of UDP/RTP multicast transport streams to many unicast consumers,
+ * without a process or a copy per consumer.
+ *
+ * Every input stream is received once, into a single ring shared by all of its consumers.
+ * Consumers are only a read position into that ring:
+ *   UDP unicast targets (-u), sent each datagram as it arrives.
+ *   Raw TCP (-T), stream N is served on port base + N.
+ *   HTTP chunked transfer (-H), GET /N or /N.ts.
+ * A single epoll loop services everything. A consumer that can't keep up is left behind
+ * (EPOLLOUT) while the others carry on, once it falls further behind than the lag limit
+ * (-l) it's disconnected, nothing ever waits for it. HTTP clients that haven't sent a complete
+ * request within GW_REQUEST_TIMEOUT seconds are disconnected, so they can't hold a client slot.
+ *
+ * Quick local test:
+ *   tstools_ts_gateway -i udp://227.1.20.45:4001 -H 8080 -T 9000 -u 0,127.0.0.1:5000
+ *   curl -s http://127.0.0.1:8080/0 | tstools_clock_inspector -i -
+ *   nc 127.0.0.1 9000 > out.ts
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#if defined(__linux__)
+#include <sys/epoll.h>
+#endif
+
+#include "xorg-list.h"
+#include "udp_receiver.h"
+
+#if defined(__linux__)
+
+#define GW_MAX_STREAMS 16
+#define GW_MAX_UDP_TARGETS 32      /* Per stream */
+#define GW_MAX_EVENTS 256
+#define GW_DEFAULT_RING_MB 8
+#define GW_DEFAULT_LAG_KB 4096
+#define GW_DEFAULT_MAX_CLIENTS 1024
+#define GW_DATAGRAM_MAX 65536
+#define GW_SEND_MAX (256 * 1024)   /* Most we hand the kernel in one call, per client */
+#define GW_DRAIN_MAX (256 * 1024)  /* Most we take from one input per loop, bounds what a lag check can miss */
+#define GW_REQUEST_MAX 2048
+#define GW_REQUEST_TIMEOUT 10      /* Seconds an HTTP client has to send its request, and take any error response */
+#define GW_STATUS_INTERVAL 5
+
+static int gRunning = 1;
+
+/* First member of everything registered with epoll, tells the loop what woke it. */
+enum gw_kind_e {
+	GW_KIND_INPUT = 0,
+	GW_KIND_LISTEN_HTTP,
+	GW_KIND_LISTEN_TCP,
+	GW_KIND_CLIENT,
+};
+
+struct gw_ctx_s;
+struct gw_stream_s;
+
+struct gw_listener_s
+{
+	enum gw_kind_e kind;
+	int fd;
+	int port;
+	struct gw_stream_s *stream; /* Raw TCP only */
+};
+
+struct gw_udp_target_s
+{
+	struct sockaddr_in sa;
+	uint64_t datagrams;
+	uint64_t drops;             /* Socket buffer full */
+};
+
+struct gw_client_s
+{
+	enum gw_kind_e kind;
+	struct xorg_list list;      /* On the streams client list, or the pending list before the HTTP request */
+	int fd;
+	int isHTTP;
+	int closeWhenSent;          /* HTTP error responses */
+	int waitingOut;             /* EPOLLOUT armed, the kernel buffer is full */
+	char peer[32];
+	time_t connected;
+
+	struct gw_stream_s *stream;
+	uint64_t pos;               /* Next ring byte to send, same units as stream->head */
+
+	/* HTTP request, then the response header or current chunk header */
+	char request[GW_REQUEST_MAX];
+	int requestLen;
+	char prefix[256];
+	int prefixLen, prefixSent;
+	uint64_t chunkRemain;       /* Ring bytes left in the current chunk */
+	int chunkTrailer;           /* Bytes of the chunks closing CRLF left to send */
+
+	uint64_t bytesSent;
+	uint64_t stalls;            /* Times the kernel buffer filled */
+};
+
+struct gw_stream_s
+{
+	enum gw_kind_e kind;
+	int nr;
+	const char *url;
+	void *rx;
+	int fd;
+
+	uint8_t *ring;
+	uint64_t ringSize;
+	uint64_t head;              /* Total bytes ever written, ring offset is head % ringSize */
+	int dirty;                  /* New data since the clients were last flushed */
+
+	struct gw_listener_s tcp;
+	struct xorg_list clients;
+	int clientCount;
+
+	struct gw_udp_target_s udp[GW_MAX_UDP_TARGETS];
+	int udpCount;
+
+	uint64_t datagrams;
+	uint64_t clientsServed;
+	uint64_t clientsDropped;    /* Too slow */
+	uint64_t lastBytes;
+};
+
+struct gw_ctx_s
+{
+	int verbose;
+	int epfd;
+	int udpSkt;
+	uint64_t ringSize;
+	uint64_t maxLag;
+	int maxClients;
+	int clientCount;
+
+	struct gw_stream_s streams[GW_MAX_STREAMS];
+	int streamCount;
+
+	struct gw_listener_s http;
+	struct xorg_list pending;   /* HTTP clients that haven't sent their request yet */
+
+	uint8_t buf[GW_DATAGRAM_MAX];
+};
+
+static void signal_handler(int signum)
+{
+	gRunning = 0;
+}
+
+static int _set_nonblocking(int fd)
+{
+	int fl = fcntl(fd, F_GETFL, 0);
+	return fcntl(fd, F_SETFL, fl | O_NONBLOCK);
+}
+
+static int _epoll_mod(struct gw_ctx_s *ctx, int op, int fd, uint32_t events, void *ptr)
+{
+	struct epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = events;
+	ev.data.ptr = ptr;
+	return epoll_ctl(ctx->epfd, op, fd, &ev);
+}
+
+static int _listen(struct gw_ctx_s *ctx, struct gw_listener_s *l)
+{
+	l->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (l->fd < 0)
+		return -1;
+
+	int on = 1;
+	setsockopt(l->fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+	struct sockaddr_in sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sin_family = AF_INET;
+	sa.sin_port = htons(l->port);
+	sa.sin_addr.s_addr = htonl(INADDR_ANY);
+
+	if (bind(l->fd, (struct sockaddr *)&sa, sizeof(sa)) < 0 || listen(l->fd, 128) < 0) {
+		fprintf(stderr, "Unable to listen on port %d, %s\n", l->port, strerror(errno));
+		close(l->fd);
+		l->fd = -1;
+		return -1;
+	}
+
+	return _epoll_mod(ctx, EPOLL_CTL_ADD, l->fd, EPOLLIN, l);
+}
+
+static void _client_close(struct gw_ctx_s *ctx, struct gw_client_s *c, const char *reason)
+{
+	if (c->stream) {
+		printf("client %s %s stream %d closed, %s, sent %" PRIu64 " bytes, %" PRIu64 " stalls\n",
+			c->peer, c->isHTTP ? "http" : "tcp", c->stream->nr,
+			reason, c->bytesSent, c->stalls);
+	} else
+	if (ctx->verbose) {
+		printf("client %s closed, %s\n", c->peer, reason);
+	}
+
+	epoll_ctl(ctx->epfd, EPOLL_CTL_DEL, c->fd, NULL);
+	close(c->fd);
+	xorg_list_del(&c->list);
+	if (c->stream)
+		c->stream->clientCount--;
+	ctx->clientCount--;
+	free(c);
+}
+
+/* Start streaming, from the newest data, so every client begins on a datagram boundary. */
+static void _client_attach(struct gw_client_s *c, struct gw_stream_s *s)
+{
+	xorg_list_del(&c->list);
+	c->stream = s;
+	c->pos = s->head;
+	xorg_list_append(&c->list, &s->clients);
+	s->clientCount++;
+	s->clientsServed++;
+}
+
+/* Send whatever the client hasn't had yet, straight out of the ring.
+ * Returns < 0 when the client has to be closed.
+ */
+static int _client_flush(struct gw_ctx_s *ctx, struct gw_client_s *c)
+{
+	struct gw_stream_s *s = c->stream;
+
+	while (1) {
+		if (s && c->isHTTP && c->chunkRemain == 0 && c->chunkTrailer == 0 && c->prefixSent == c->prefixLen) {
+			uint64_t avail = s->head - c->pos;
+			if (avail == 0)
+				break;
+			if (avail > GW_SEND_MAX)
+				avail = GW_SEND_MAX;
+			c->prefixLen = sprintf(c->prefix, "%" PRIx64 "\r\n", avail);
+			c->prefixSent = 0;
+			c->chunkRemain = avail;
+			c->chunkTrailer = 2;
+		}
+
+		uint64_t data = 0;
+		if (s) {
+			if (c->isHTTP) {
+				data = c->chunkRemain;
+			} else {
+				data = s->head - c->pos;
+				if (data > GW_SEND_MAX)
+					data = GW_SEND_MAX;
+			}
+		}
+
+		struct iovec iov[4];
+		int n = 0;
+		size_t total = 0;
+		if (c->prefixSent < c->prefixLen) {
+			iov[n].iov_base = &c->prefix[c->prefixSent];
+			iov[n].iov_len = c->prefixLen - c->prefixSent;
+			total += iov[n++].iov_len;
+		}
+		if (data) {
+			uint64_t offset = c->pos % s->ringSize;
+			uint64_t first = s->ringSize - offset;
+			if (first > data)
+				first = data;
+			iov[n].iov_base = s->ring + offset;
+			iov[n].iov_len = first;
+			total += iov[n++].iov_len;
+			if (data > first) {
+				iov[n].iov_base = s->ring;
+				iov[n].iov_len = data - first;
+				total += iov[n++].iov_len;
+			}
+		}
+		if (c->chunkTrailer) {
+			iov[n].iov_base = (void *)&"\r\n"[2 - c->chunkTrailer];
+			iov[n].iov_len = c->chunkTrailer;
+			total += iov[n++].iov_len;
+		}
+		if (n == 0)
+			break;
+
+		struct msghdr msg;
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = iov;
+		msg.msg_iovlen = n;
+
+		ssize_t ret = sendmsg(c->fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				return -1;
+			ret = 0;
+		}
+		c->bytesSent += ret;
+
+		/* Consume in the order it was queued: prefix, ring data, trailer. */
+		size_t used = ret;
+		int p = c->prefixLen - c->prefixSent;
+		if (p > 0) {
+			if ((size_t)p > used)
+				p = used;
+			c->prefixSent += p;
+			used -= p;
+		}
+		if (data) {
+			uint64_t d = data > used ? used : data;
+			c->pos += d;
+			if (c->isHTTP)
+				c->chunkRemain -= d;
+			used -= d;
+		}
+		if (c->chunkTrailer && used) {
+			c->chunkTrailer -= used;
+		}
+
+		if ((size_t)ret < total) {
+			/* Kernel buffer full, the others don't wait for us. */
+			if (!c->waitingOut) {
+				c->waitingOut = 1;
+				c->stalls++;
+				_epoll_mod(ctx, EPOLL_CTL_MOD, c->fd, EPOLLIN | EPOLLOUT, c);
+			}
+			return 0;
+		}
+	}
+
+	if (c->closeWhenSent)
+		return -1;
+
+	if (c->waitingOut) {
+		c->waitingOut = 0;
+		_epoll_mod(ctx, EPOLL_CTL_MOD, c->fd, EPOLLIN, c);
+	}
+
+	return 0;
+}
+
+static void _client_accept(struct gw_ctx_s *ctx, struct gw_listener_s *l)
+{
+	while (1) {
+		struct sockaddr_in sa;
+		socklen_t salen = sizeof(sa);
+		int fd = accept4(l->fd, (struct sockaddr *)&sa, &salen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (fd < 0)
+			break;
+
+		if (ctx->clientCount >= ctx->maxClients) {
+			close(fd);
+			continue;
+		}
+
+		struct gw_client_s *c = calloc(1, sizeof(*c));
+		if (!c) {
+			close(fd);
+			continue;
+		}
+		c->kind = GW_KIND_CLIENT;
+		c->fd = fd;
+		c->connected = time(NULL);
+		sprintf(c->peer, "%s:%d", inet_ntoa(sa.sin_addr), ntohs(sa.sin_port));
+		xorg_list_init(&c->list);
+		ctx->clientCount++;
+
+		if (l->kind == GW_KIND_LISTEN_HTTP) {
+			c->isHTTP = 1;
+			xorg_list_append(&c->list, &ctx->pending);
+		} else {
+			_client_attach(c, l->stream);
+			printf("client %s tcp stream %d connected\n", c->peer, l->stream->nr);
+		}
+
+		if (_epoll_mod(ctx, EPOLL_CTL_ADD, fd, EPOLLIN, c) < 0) {
+			_client_close(ctx, c, "epoll failed");
+		}
+	}
+}
+
+static void _http_respond(struct gw_client_s *c, const char *status)
+{
+	c->prefixLen = snprintf(c->prefix, sizeof(c->prefix),
+		"HTTP/1.1 %s\r\nContent-Length: 0\r\nConnection: close\r\n\r\n", status);
+	c->prefixSent = 0;
+	c->closeWhenSent = 1;
+}
+
+/* Anything a client sends is either its HTTP request, or ignored. */
+static void _client_read(struct gw_ctx_s *ctx, struct gw_client_s *c)
+{
+	char junk[512];
+
+	if (!c->isHTTP || c->stream || c->closeWhenSent) {
+		ssize_t len = recv(c->fd, junk, sizeof(junk), 0);
+		if (len == 0 || (len < 0 && errno != EAGAIN && errno != EINTR))
+			_client_close(ctx, c, "disconnected");
+		return;
+	}
+
+	ssize_t len = recv(c->fd, &c->request[c->requestLen], sizeof(c->request) - c->requestLen - 1, 0);
+	if (len == 0 || (len < 0 && errno != EAGAIN && errno != EINTR)) {
+		_client_close(ctx, c, "disconnected");
+		return;
+	}
+	if (len < 0)
+		return;
+
+	c->requestLen += len;
+	c->request[c->requestLen] = 0;
+
+	if (strstr(c->request, "\r\n\r\n") == NULL && strstr(c->request, "\n\n") == NULL) {
+		if (c->requestLen >= (int)sizeof(c->request) - 1) {
+			_http_respond(c, "431 Request Header Fields Too Large");
+			if (_client_flush(ctx, c) < 0)
+				_client_close(ctx, c, "bad request");
+		}
+		return;
+	}
+
+	int nr;
+	char method[8];
+	if (sscanf(c->request, "%7s /%d", method, &nr) != 2 || strcmp(method, "GET") != 0) {
+		_http_respond(c, "400 Bad Request");
+	} else
+	if (nr < 0 || nr >= ctx->streamCount) {
+		_http_respond(c, "404 Not Found");
+	} else {
+		c->prefixLen = snprintf(c->prefix, sizeof(c->prefix),
+			"HTTP/1.1 200 OK\r\n"
+			"Content-Type: video/mp2t\r\n"
+			"Transfer-Encoding: chunked\r\n"
+			"Cache-Control: no-cache\r\n"
+			"Connection: close\r\n\r\n");
+		c->prefixSent = 0;
+		_client_attach(c, &ctx->streams[nr]);
+		printf("client %s http stream %d connected\n", c->peer, nr);
+	}
+
+	if (_client_flush(ctx, c) < 0)
+		_client_close(ctx, c, c->stream ? "send failed" : "bad request");
+}
+
+static void _udp_send(struct gw_ctx_s *ctx, struct gw_stream_s *s, const uint8_t *buf, int len)
+{
+	for (int i = 0; i < s->udpCount; i++) {
+		struct gw_udp_target_s *t = &s->udp[i];
+		if (sendto(ctx->udpSkt, buf, len, MSG_DONTWAIT, (struct sockaddr *)&t->sa, sizeof(t->sa)) < 0)
+			t->drops++;
+		else
+			t->datagrams++;
+	}
+}
+
+static void _ring_write(struct gw_stream_s *s, const uint8_t *buf, int len)
+{
+	uint64_t offset = s->head % s->ringSize;
+	uint64_t first = s->ringSize - offset;
+	if (first > (uint64_t)len)
+		first = len;
+
+	memcpy(s->ring + offset, buf, first);
+	if (first < (uint64_t)len)
+		memcpy(s->ring, buf + first, len - first);
+
+	s->head += len;
+}
+
+static void _input_read(struct gw_ctx_s *ctx, struct gw_stream_s *s)
+{
+	struct timespec arrival;
+
+	/* Drain, but don't let one busy input starve the rest of the loop. */
+	uint64_t start = s->head;
+	while (s->head - start < GW_DRAIN_MAX) {
+		int len = udp_receiver_read(s->rx, ctx->buf, sizeof(ctx->buf), &arrival, 0);
+		if (len <= 0)
+			break;
+
+		s->datagrams++;
+		_udp_send(ctx, s, ctx->buf, len);
+		_ring_write(s, ctx->buf, len);
+		s->dirty = 1;
+	}
+}
+
+/* Anyone further behind than this is about to have the ring overwrite what they haven't sent.
+ * Checked once per loop, after the inputs, the ring has room for maxLag plus one loops input.
+ */
+static int _client_too_slow(struct gw_ctx_s *ctx, struct gw_client_s *c)
+{
+	if (!c->stream || c->stream->head - c->pos <= ctx->maxLag)
+		return 0;
+
+	c->stream->clientsDropped++;
+	_client_close(ctx, c, "too slow");
+	return 1;
+}
+
+static void _status(struct gw_ctx_s *ctx, int interval)
+{
+	for (int i = 0; i < ctx->streamCount; i++) {
+		struct gw_stream_s *s = &ctx->streams[i];
+		struct udp_receiver_stats_s rs;
+		udp_receiver_get_stats(s->rx, &rs);
+
+		double mbps = 0;
+		if (interval)
+			mbps = ((double)(s->head - s->lastBytes) * 8.0) / ((double)interval * 1000000.0);
+		s->lastBytes = s->head;
+
+		uint64_t udpDrops = 0;
+		for (int j = 0; j < s->udpCount; j++)
+			udpDrops += s->udp[j].drops;
+
+		printf("stream %d %s: %6.2f Mb/s, %" PRIu64 " datagrams, %" PRIu64 " kernel drops, "
+			"%d clients, %" PRIu64 " served, %" PRIu64 " dropped slow, %d udp targets, %" PRIu64 " udp drops\n",
+			s->nr, s->url, mbps, s->datagrams, rs.kernelDrops,
+			s->clientCount, s->clientsServed, s->clientsDropped, s->udpCount, udpDrops);
+	}
+}
+
+static void _usage(const char *prog)
+{
+	printf("Usage: %s\n", prog);
+	printf("  -i <url> input stream, repeat for each stream, numbered from 0 [max %d]\n", GW_MAX_STREAMS);
+	printf("     Eg. udp://227.1.20.45:4001?localaddr=192.168.20.45&buffer_size=2500000\n");
+	printf("  -u <nr>,<ip>:<port> send stream nr to a UDP unicast target, repeatable\n");
+	printf("  -T <port> serve stream N as raw TS over TCP, on port + N\n");
+	printf("  -H <port> serve streams over HTTP, chunked, GET /N or /N.ts\n");
+	printf("  -r <MB> ring size per stream [def: %d]\n", GW_DEFAULT_RING_MB);
+	printf("  -l <KB> disconnect TCP/HTTP clients lagging more than this [def: %d]\n", GW_DEFAULT_LAG_KB);
+	printf("  -c <nr> maximum TCP/HTTP clients [def: %d]\n", GW_DEFAULT_MAX_CLIENTS);
+	printf("  -v increase verbosity level, status every %d seconds\n", GW_STATUS_INTERVAL);
+}
+
+int ts_gateway(int argc, char *argv[])
+{
+	struct gw_ctx_s *ctx = calloc(1, sizeof(*ctx));
+	if (!ctx)
+		return -1;
+
+	ctx->ringSize = (uint64_t)GW_DEFAULT_RING_MB * 1048576;
+	ctx->maxLag = (uint64_t)GW_DEFAULT_LAG_KB * 1024;
+	ctx->maxClients = GW_DEFAULT_MAX_CLIENTS;
+	ctx->epfd = -1;
+	ctx->udpSkt = -1;
+	ctx->http.fd = -1;
+	xorg_list_init(&ctx->pending);
+
+	int tcpBase = 0;
+	char *udpTargets[GW_MAX_STREAMS * GW_MAX_UDP_TARGETS];
+	int udpTargetCount = 0;
+
+	int ch;
+	while ((ch = getopt(argc, argv, "?hc:i:H:l:r:T:u:v")) != -1) {
+		switch (ch) {
+		case 'c':
+			ctx->maxClients = atoi(optarg);
+			break;
+		case 'i':
+			if (ctx->streamCount >= GW_MAX_STREAMS) {
+				fprintf(stderr, "\n *** too many -i streams, max %d ***\n", GW_MAX_STREAMS);
+				exit(1);
+			}
+			ctx->streams[ctx->streamCount++].url = optarg;
+			break;
+		case 'H':
+			ctx->http.port = atoi(optarg);
+			break;
+		case 'l':
+			ctx->maxLag = (uint64_t)atoi(optarg) * 1024;
+			break;
+		case 'r':
+			ctx->ringSize = (uint64_t)atoi(optarg) * 1048576;
+			break;
+		case 'T':
+			tcpBase = atoi(optarg);
+			break;
+		case 'u':
+			if (udpTargetCount < GW_MAX_STREAMS * GW_MAX_UDP_TARGETS)
+				udpTargets[udpTargetCount++] = optarg;
+			break;
+		case 'v':
+			ctx->verbose++;
+			break;
+		case 'h':
+		case '?':
+		default:
+			_usage(argv[0]);
+			exit(1);
+		}
+	}
+
+	if (ctx->streamCount == 0) {
+		_usage(argv[0]);
+		fprintf(stderr, "\n *** -i is mandatory ***\n");
+		exit(1);
+	}
+	if (!ctx->http.port && !tcpBase && !udpTargetCount) {
+		_usage(argv[0]);
+		fprintf(stderr, "\n *** at least one of -u, -T or -H is required ***\n");
+		exit(1);
+	}
+	if (ctx->ringSize < 1048576) {
+		_usage(argv[0]);
+		fprintf(stderr, "\n *** -r is too small ***\n");
+		exit(1);
+	}
+
+	/* A client can't lag by more than the ring holds, less what one loop can write into it. */
+	if (ctx->maxLag > ctx->ringSize - GW_DRAIN_MAX - GW_DATAGRAM_MAX)
+		ctx->maxLag = ctx->ringSize - GW_DRAIN_MAX - GW_DATAGRAM_MAX;
+
+	ctx->epfd = epoll_create1(EPOLL_CLOEXEC);
+	ctx->udpSkt = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+	if (ctx->epfd < 0 || ctx->udpSkt < 0) {
+		fprintf(stderr, "Unable to allocate epoll or udp socket, %s\n", strerror(errno));
+		exit(1);
+	}
+	_set_nonblocking(ctx->udpSkt);
+
+	for (int i = 0; i < udpTargetCount; i++) {
+		int nr, port;
+		char ip[64];
+		if (sscanf(udpTargets[i], "%d,%63[^:]:%d", &nr, ip, &port) != 3 || nr < 0 || nr >= ctx->streamCount) {
+			fprintf(stderr, "\n *** -u %s is malformed ***\n", udpTargets[i]);
+			exit(1);
+		}
+		struct gw_stream_s *s = &ctx->streams[nr];
+		if (s->udpCount >= GW_MAX_UDP_TARGETS) {
+			fprintf(stderr, "\n *** too many -u targets for stream %d, max %d ***\n", nr, GW_MAX_UDP_TARGETS);
+			exit(1);
+		}
+		struct gw_udp_target_s *t = &s->udp[s->udpCount++];
+		t->sa.sin_family = AF_INET;
+		t->sa.sin_port = htons(port);
+		if (inet_pton(AF_INET, ip, &t->sa.sin_addr) != 1) {
+			fprintf(stderr, "\n *** -u %s is malformed ***\n", udpTargets[i]);
+			exit(1);
+		}
+	}
+
+	for (int i = 0; i < ctx->streamCount; i++) {
+		struct gw_stream_s *s = &ctx->streams[i];
+		s->kind = GW_KIND_INPUT;
+		s->nr = i;
+		s->ringSize = ctx->ringSize;
+		s->tcp.fd = -1;
+		xorg_list_init(&s->clients);
+
+		s->ring = malloc(s->ringSize);
+		if (!s->ring) {
+			fprintf(stderr, "Unable to allocate %" PRIu64 " byte ring for stream %d\n", s->ringSize, i);
+			exit(1);
+		}
+		if (udp_receiver_alloc(&s->rx, s->url) < 0) {
+			fprintf(stderr, "Unable to open %s\n", s->url);
+			exit(1);
+		}
+		s->fd = udp_receiver_get_fd(s->rx);
+		_epoll_mod(ctx, EPOLL_CTL_ADD, s->fd, EPOLLIN, s);
+
+		if (tcpBase) {
+			s->tcp.kind = GW_KIND_LISTEN_TCP;
+			s->tcp.port = tcpBase + i;
+			s->tcp.stream = s;
+			if (_listen(ctx, &s->tcp) < 0)
+				exit(1);
+		}
+
+		printf("stream %d: %s", i, s->url);
+		if (tcpBase)
+			printf(", tcp port %d", s->tcp.port);
+		if (ctx->http.port)
+			printf(", http://<host>:%d/%d", ctx->http.port, i);
+		for (int j = 0; j < s->udpCount; j++)
+			printf(", udp %s:%d", inet_ntoa(s->udp[j].sa.sin_addr), ntohs(s->udp[j].sa.sin_port));
+		printf("\n");
+	}
+
+	if (ctx->http.port) {
+		ctx->http.kind = GW_KIND_LISTEN_HTTP;
+		if (_listen(ctx, &ctx->http) < 0)
+			exit(1);
+	}
+
+	signal(SIGINT, signal_handler);
+	signal(SIGTERM, signal_handler);
+	signal(SIGPIPE, SIG_IGN);
+
+	time_t lastStatus = time(NULL);
+	time_t lastTimeoutCheck = lastStatus;
+	struct epoll_event events[GW_MAX_EVENTS];
+
+	while (gRunning) {
+		int n = epoll_wait(ctx->epfd, events, GW_MAX_EVENTS, 250);
+		if (n < 0 && errno != EINTR) {
+			fprintf(stderr, "epoll_wait failed, %s\n", strerror(errno));
+			break;
+		}
+
+		/* Inputs first, so a single flush per client covers everything that arrived. */
+		for (int i = 0; i < n; i++) {
+			enum gw_kind_e *kind = events[i].data.ptr;
+			if (*kind == GW_KIND_INPUT)
+				_input_read(ctx, (struct gw_stream_s *)kind);
+		}
+
+		for (int i = 0; i < n; i++) {
+			enum gw_kind_e *kind = events[i].data.ptr;
+			if (*kind == GW_KIND_LISTEN_HTTP || *kind == GW_KIND_LISTEN_TCP) {
+				_client_accept(ctx, (struct gw_listener_s *)kind);
+			}
+		}
+
+		/* Client events last. Clients are only ever closed from here on, each appears
+		 * in events[] once, so closing one can't invalidate a later entry.
+		 */
+		for (int i = 0; i < n; i++) {
+			enum gw_kind_e *kind = events[i].data.ptr;
+			if (*kind != GW_KIND_CLIENT)
+				continue;
+
+			struct gw_client_s *c = (struct gw_client_s *)kind;
+			if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+				_client_close(ctx, c, "disconnected");
+				continue;
+			}
+			if (events[i].events & EPOLLOUT) {
+				if (_client_too_slow(ctx, c))
+					continue;
+				if (_client_flush(ctx, c) < 0) {
+					_client_close(ctx, c, "send failed");
+					continue;
+				}
+			}
+			if (events[i].events & EPOLLIN) {
+				_client_read(ctx, c);
+			}
+		}
+
+		for (int i = 0; i < ctx->streamCount; i++) {
+			struct gw_stream_s *s = &ctx->streams[i];
+			if (!s->dirty)
+				continue;
+			s->dirty = 0;
+
+			struct gw_client_s *c = NULL, *next = NULL;
+			xorg_list_for_each_entry_safe(c, next, &s->clients, list) {
+				if (_client_too_slow(ctx, c))
+					continue;
+				if (c->waitingOut)
+					continue; /* Wakes on EPOLLOUT */
+				if (_client_flush(ctx, c) < 0)
+					_client_close(ctx, c, "send failed");
+			}
+		}
+
+		time_t now = time(NULL);
+		if (now != lastTimeoutCheck) {
+			lastTimeoutCheck = now;
+
+			struct gw_client_s *c = NULL, *next = NULL;
+			xorg_list_for_each_entry_safe(c, next, &ctx->pending, list) {
+				if (now >= c->connected + GW_REQUEST_TIMEOUT)
+					_client_close(ctx, c, "request timeout");
+			}
+		}
+
+		if (ctx->verbose && now >= lastStatus + GW_STATUS_INTERVAL) {
+			_status(ctx, now - lastStatus);
+			lastStatus = now;
+		}
+	}
+
+	printf("\n");
+	_status(ctx, 0);
+
+	struct gw_client_s *c = NULL, *next = NULL;
+	xorg_list_for_each_entry_safe(c, next, &ctx->pending, list) {
+		_client_close(ctx, c, "shutdown");
+	}
+	for (int i = 0; i < ctx->streamCount; i++) {
+		struct gw_stream_s *s = &ctx->streams[i];
+		xorg_list_for_each_entry_safe(c, next, &s->clients, list) {
+			_client_close(ctx, c, "shutdown");
+		}
+		if (s->tcp.fd >= 0)
+			close(s->tcp.fd);
+		udp_receiver_free(s->rx);
+		free(s->ring);
+	}
+	if (ctx->http.fd >= 0)
+		close(ctx->http.fd);
+	close(ctx->udpSkt);
+	close(ctx->epfd);
+	free(ctx);
+
+	return 0;
+}
+
+#else
+
+int ts_gateway(int argc, char *argv[])
+{
+	fprintf(stderr, "%s requires epoll, Linux only.\n", argv[0]);
+	return 1;
+}
+
+#endif /* __linux__ */
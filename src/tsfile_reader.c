@@ -0,0 +1,313 @@
+/* A block based transport file reader, shared by the file based tools.
+ * We want to spend our time analyzing packets, not in read() syscalls,
+ * so we read large page aligned blocks and hand back batches of packet pointers.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "tsfile_reader.h"
+
+#define DEFAULT_BLOCK_SIZE (4 * 1048576)
+#define BLOCK_ALIGNMENT 4096
+
+struct tsfile_reader_ctx_s
+{
+	int fd;
+	int closeFd;
+	int eof;
+	uint64_t fileSize;
+
+	/* Working buffer, data lives between rdpos and wrpos. */
+	uint8_t *buf;
+	int blockSize;
+	int buflen;
+	int rdpos;
+	int wrpos;
+	uint64_t bufFileOffset; /* File offset of buf[0] */
+
+	/* Sync state */
+	int locked;
+	int packetSize;  /* 188, 192 or 204 */
+	int syncOffset;  /* Offset to the 0x47 within each container packet, 4 for M2TS. */
+
+	struct tsfile_reader_stats_s stats;
+};
+
+static const struct {
+	int packetSize;
+	int syncOffset;
+} candidates[] = {
+	{ 188, 0 },
+	{ 204, 0 },
+	{ 192, 4 },
+};
+
+/* Move any unconsumed data to the front of the buffer, then top it up from the file. */
+static int _fill(struct tsfile_reader_ctx_s *ctx)
+{
+	if (ctx->eof)
+		return 0;
+
+	int remain = ctx->wrpos - ctx->rdpos;
+	if (ctx->rdpos) {
+		if (remain)
+			memmove(ctx->buf, ctx->buf + ctx->rdpos, remain);
+		ctx->bufFileOffset += ctx->rdpos;
+		ctx->rdpos = 0;
+		ctx->wrpos = remain;
+	}
+
+	/* Keep reads block sized, the remainder sits in the extra tail allocation. */
+	while (ctx->wrpos < ctx->blockSize) {
+		ssize_t rlen = read(ctx->fd, ctx->buf + ctx->wrpos, ctx->buflen - ctx->wrpos);
+		ctx->stats.readCalls++;
+		if (rlen < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		if (rlen == 0) {
+			ctx->eof = 1;
+			break;
+		}
+		ctx->wrpos += rlen;
+		ctx->stats.bytesRead += rlen;
+
+		/* Pipes return short reads, that's enough to make progress. */
+		if (ctx->fileSize == 0)
+			break;
+	}
+
+	return ctx->wrpos - ctx->rdpos;
+}
+
+/* Check whether we have sync for a given packet size at the read position,
+ * for as many packets as we have available up to TSFILE_READER_SYNC_DEPTH.
+ */
+static int _is_synced(struct tsfile_reader_ctx_s *ctx, int packetSize, int syncOffset)
+{
+	int avail = ctx->wrpos - ctx->rdpos;
+	int depth = avail / packetSize;
+	if (depth > TSFILE_READER_SYNC_DEPTH)
+		depth = TSFILE_READER_SYNC_DEPTH;
+	if (depth == 0)
+		return 0;
+
+	/* Near the end of a file we'll accept fewer packets, but never a single one
+	 * unless that's all the file has.
+	 */
+	if (depth < TSFILE_READER_SYNC_DEPTH && !ctx->eof)
+		return 0;
+
+	const uint8_t *p = ctx->buf + ctx->rdpos + syncOffset;
+	for (int i = 0; i < depth; i++) {
+		if (p[i * packetSize] != 0x47)
+			return 0;
+	}
+
+	return 1;
+}
+
+static int _acquire_sync(struct tsfile_reader_ctx_s *ctx)
+{
+	/* Once a file has been detected, prefer that size during resync. */
+	if (ctx->packetSize) {
+		if (_is_synced(ctx, ctx->packetSize, ctx->syncOffset)) {
+			ctx->locked = 1;
+			return 1;
+		}
+	}
+
+	for (int i = 0; i < sizeof(candidates) / sizeof(candidates[0]); i++) {
+		if (_is_synced(ctx, candidates[i].packetSize, candidates[i].syncOffset)) {
+			ctx->packetSize = candidates[i].packetSize;
+			ctx->syncOffset = candidates[i].syncOffset;
+			ctx->locked = 1;
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+int tsfile_reader_alloc(void **hdl, const char *filename, int blockSize)
+{
+	if (!filename)
+		return -1;
+
+	struct tsfile_reader_ctx_s *ctx = calloc(1, sizeof(*ctx));
+	if (!ctx)
+		return -1;
+
+	if (strcmp(filename, "-") == 0) {
+		ctx->fd = STDIN_FILENO;
+	} else {
+		ctx->fd = open(filename, O_RDONLY);
+		if (ctx->fd < 0) {
+			free(ctx);
+			return -1;
+		}
+		ctx->closeFd = 1;
+	}
+
+	struct stat st;
+	if (fstat(ctx->fd, &st) == 0 && S_ISREG(st.st_mode)) {
+		ctx->fileSize = st.st_size;
+#ifdef __linux__
+		posix_fadvise(ctx->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+	}
+
+	if (blockSize <= 0)
+		blockSize = DEFAULT_BLOCK_SIZE;
+	ctx->blockSize = ((blockSize + BLOCK_ALIGNMENT - 1) / BLOCK_ALIGNMENT) * BLOCK_ALIGNMENT;
+
+	/* One additional block of headroom, so a partially consumed buffer
+	 * can always be topped up with a full, aligned, read.
+	 */
+	ctx->buflen = ctx->blockSize * 2;
+	if (posix_memalign((void **)&ctx->buf, BLOCK_ALIGNMENT, ctx->buflen) != 0) {
+		if (ctx->closeFd)
+			close(ctx->fd);
+		free(ctx);
+		return -1;
+	}
+
+	*hdl = ctx;
+	return 0;
+}
+
+void tsfile_reader_free(void *hdl)
+{
+	struct tsfile_reader_ctx_s *ctx = (struct tsfile_reader_ctx_s *)hdl;
+	if (!ctx)
+		return;
+
+	if (ctx->closeFd)
+		close(ctx->fd);
+	free(ctx->buf);
+	free(ctx);
+}
+
+int tsfile_reader_read(void *hdl, const uint8_t **pkts, uint64_t *offsets, int maxPackets)
+{
+	struct tsfile_reader_ctx_s *ctx = (struct tsfile_reader_ctx_s *)hdl;
+	if (!ctx || !pkts || maxPackets <= 0)
+		return -1;
+
+	int count = 0;
+	int lookahead = 204 * TSFILE_READER_SYNC_DEPTH;
+
+	while (count < maxPackets) {
+		int avail = ctx->wrpos - ctx->rdpos;
+
+		if ((!ctx->locked && avail < lookahead) || (ctx->locked && avail < ctx->packetSize)) {
+			if (ctx->eof) {
+				if (ctx->locked || avail < 188) {
+					/* Trailing partial packet, or not enough data to ever find sync. */
+					ctx->stats.bytesLost += avail;
+					ctx->rdpos = ctx->wrpos;
+					break;
+				}
+			} else {
+				/* Any pointers we've already handed out live in the buffer,
+				 * return what we have before we move data around.
+				 */
+				if (count)
+					break;
+				if (_fill(ctx) < 0)
+					return -1;
+				continue;
+			}
+		}
+
+		if (!ctx->locked) {
+			if (_acquire_sync(ctx) == 0) {
+				ctx->rdpos++;
+				ctx->stats.bytesLost++;
+				continue;
+			}
+		}
+
+		const uint8_t *p = ctx->buf + ctx->rdpos + ctx->syncOffset;
+		if (*p != 0x47) {
+			/* Corruption, drop lock and hunt for the next sync position. */
+			ctx->locked = 0;
+			ctx->stats.resyncCount++;
+			continue;
+		}
+
+		pkts[count] = p;
+		if (offsets)
+			offsets[count] = ctx->bufFileOffset + ctx->rdpos + ctx->syncOffset;
+		count++;
+
+		ctx->rdpos += ctx->packetSize;
+	}
+
+	ctx->stats.packetsRead += count;
+
+	return count;
+}
+
+int tsfile_reader_read_copy(void *hdl, uint8_t *dst, uint64_t *offsets, int maxPackets)
+{
+	struct tsfile_reader_ctx_s *ctx = (struct tsfile_reader_ctx_s *)hdl;
+	if (!ctx || !dst || maxPackets <= 0)
+		return -1;
+
+	const uint8_t *pkts[256];
+	int count = 0;
+
+	while (count < maxPackets) {
+		int want = maxPackets - count;
+		if (want > 256)
+			want = 256;
+
+		int ret = tsfile_reader_read(hdl, pkts, offsets ? offsets + count : NULL, want);
+		if (ret < 0)
+			return count ? count : ret;
+		if (ret == 0)
+			break;
+
+		if (ctx->packetSize == 188 && ret > 1 && pkts[ret - 1] == pkts[0] + ((ret - 1) * 188)) {
+			/* Contiguous run, one copy. */
+			memcpy(dst + (count * 188), pkts[0], ret * 188);
+		} else {
+			for (int i = 0; i < ret; i++)
+				memcpy(dst + ((count + i) * 188), pkts[i], 188);
+		}
+		count += ret;
+
+		/* A short read means we hit a buffer boundary or end of file, let the caller process. */
+		if (ret < want)
+			break;
+	}
+
+	return count;
+}
+
+int tsfile_reader_get_packet_size(void *hdl)
+{
+	struct tsfile_reader_ctx_s *ctx = (struct tsfile_reader_ctx_s *)hdl;
+	return ctx->packetSize;
+}
+
+uint64_t tsfile_reader_get_file_size(void *hdl)
+{
+	struct tsfile_reader_ctx_s *ctx = (struct tsfile_reader_ctx_s *)hdl;
+	return ctx->fileSize;
+}
+
+void tsfile_reader_get_stats(void *hdl, struct tsfile_reader_stats_s *stats)
+{
+	struct tsfile_reader_ctx_s *ctx = (struct tsfile_reader_ctx_s *)hdl;
+	*stats = ctx->stats;
+}
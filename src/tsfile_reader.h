@@ -0,0 +1,92 @@
+/**
+ * @file        tsfile_reader.h
+ * @brief       Shared high throughput reader for transport stream files on disk.
+ *              Reads in large aligned blocks, auto-detects 188 byte (ISO13818-1),
+ *              192 byte (M2TS, 4 byte timecode prefix) and 204 byte (16 bytes of RS parity)
+ *              packet sizes, confirms sync across several consecutive packets and
+ *              resynchronizes after corruption, counting the bytes it had to discard.
+ *
+ *              Packets are handed to the caller in batches, always pointing at the 0x47
+ *              sync byte of each 188 byte transport packet, regardless of the container packet size.
+ */
+
+#ifndef TSFILE_READER_H
+#define TSFILE_READER_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Number of consecutive sync bytes we need to see before we declare lock. */
+#define TSFILE_READER_SYNC_DEPTH 5
+
+struct tsfile_reader_stats_s
+{
+	uint64_t packetsRead;     /* Total TS packets handed back to the caller */
+	uint64_t bytesRead;       /* Total bytes read from the file */
+	uint64_t bytesLost;       /* Bytes discarded while hunting for sync */
+	uint64_t resyncCount;     /* Number of times we lost and re-acquired sync */
+	uint64_t readCalls;       /* Number of read() syscalls issued */
+};
+
+/**
+ * @brief       Open a transport file for reading.
+ * @param[out]  void **hdl - returned object.
+ * @param[in]   const char *filename - file to read, "-" for stdin.
+ * @param[in]   int blockSize - read size in bytes, or 0 for the default (4MB).
+ * @return      0 - Success, else < 0 on error.
+ */
+int  tsfile_reader_alloc(void **hdl, const char *filename, int blockSize);
+
+/**
+ * @brief       Close the file and free a previously allocated context.
+ * @param[in]   void *hdl - tsfile_reader_alloc()
+ */
+void tsfile_reader_free(void *hdl);
+
+/**
+ * @brief       Zero copy read. Return up to maxPackets pointers to 188 byte transport packets.
+ *              The pointers reference the readers internal buffer and remain valid
+ *              until the next call into the reader.
+ * @param[in]   void *hdl - tsfile_reader_alloc()
+ * @param[out]  const uint8_t **pkts - array of at least maxPackets pointers.
+ * @param[out]  uint64_t *offsets - optional (NULL), file offset of each returned TS packet header.
+ * @param[in]   int maxPackets - max number of packets to return.
+ * @return      Number of packets returned, 0 on end of file, < 0 on error.
+ */
+int  tsfile_reader_read(void *hdl, const uint8_t **pkts, uint64_t *offsets, int maxPackets);
+
+/**
+ * @brief       Read up to maxPackets packets and copy them into a contiguous 188 byte aligned buffer,
+ *              stripping any M2TS timecodes or RS parity bytes. Suitable for passing directly
+ *              into any of the libltntstools functions that take (pkts, packetCount).
+ * @param[in]   void *hdl - tsfile_reader_alloc()
+ * @param[out]  uint8_t *dst - buffer of at least maxPackets * 188 bytes.
+ * @param[out]  uint64_t *offsets - optional (NULL), file offset of each returned TS packet header.
+ * @param[in]   int maxPackets - max number of packets to return.
+ * @return      Number of packets returned, 0 on end of file, < 0 on error.
+ */
+int  tsfile_reader_read_copy(void *hdl, uint8_t *dst, uint64_t *offsets, int maxPackets);
+
+/**
+ * @brief       Query the detected container packet size, 188, 192 or 204. 0 if not yet detected.
+ */
+int  tsfile_reader_get_packet_size(void *hdl);
+
+/**
+ * @brief       Query the total file size in bytes, or 0 when unknown (pipes, stdin).
+ */
+uint64_t tsfile_reader_get_file_size(void *hdl);
+
+/**
+ * @brief       Query the readers statistics.
+ */
+void tsfile_reader_get_stats(void *hdl, struct tsfile_reader_stats_s *stats);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* TSFILE_READER_H */
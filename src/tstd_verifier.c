@@ -0,0 +1,641 @@
+/* ISO13818-1 T-STD buffer model verifier, see tstd_verifier.h */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <inttypes.h>
+
+#include <libltntstools/ltntstools.h>
+#include "tstd_verifier.h"
+
+#define TSTD_MAX_CLOCKS 8
+#define TSTD_MAX_ES 32
+#define TSTD_MAX_AUS 512         /* Pending access units per stream, ~8 seconds of 60fps video */
+#define TSTD_TB_SIZE 512
+#define TSTD_HIST_BUCKETS 21     /* 5% steps, 0 - 100% */
+
+#define PCR_WRAP ((int64_t)(1ULL << 33) * 300)
+#define PCR_HZ 27000000.0
+
+/* A PCR jump of more than this, or backwards, restarts the models on that clock. */
+#define DISCONTINUITY_TICKS ((int64_t)PCR_HZ)
+
+static const char *eventNames[TSTD_EVENT_MAX] = {
+	"TB overflow",
+	"MB overflow",
+	"EB overflow",
+	"EB underflow",
+};
+
+struct tstd_clock_s
+{
+	uint16_t pid;
+	int pcrCount;
+	int64_t firstPCR;       /* Extended, no wraps */
+	int64_t lastPCR;
+	uint64_t lastPacketNr;
+	double ticksPerPacket;  /* Offline, the transport rate between the last two PCRs */
+	int64_t wallOriginUs;   /* Live, wallclock of firstPCR */
+	uint64_t discontinuities;
+};
+
+struct tstd_au_s
+{
+	int64_t removal;        /* Extended 27MHz */
+	int64_t size;
+	int complete;
+};
+
+struct tstd_es_s
+{
+	uint16_t pid;
+	uint8_t streamType;
+	const char *kind;
+	struct tstd_clock_s *clk;
+
+	/* Model parameters, bytes and bytes per 27MHz tick */
+	double rx;
+	double rbx;             /* 0, no MB stage */
+	int64_t mbSize;
+	int64_t ebSize;
+
+	/* Model state */
+	int active;
+	int64_t lastTime;
+	double tb, tbPayload;
+	double mb;
+	double eb;
+	double ebDebt;          /* Bytes still upstream that belong to access units already removed */
+	int overflowing[TSTD_EVENT_MAX];
+
+	struct tstd_au_s aus[TSTD_MAX_AUS];
+	int auHead, auCount;
+	int auOpen;             /* Index of the access unit still receiving bytes, -1 for none */
+	int64_t curRemoval;     /* Latest access unit, kept even if it's decoded before it completes */
+	int64_t curLastArrival;
+	int curValid;
+
+	/* Statistics */
+	uint64_t packets;
+	uint64_t accessUnits;
+	uint64_t events[TSTD_EVENT_MAX];
+	double tbMax, mbMax, ebMax;
+	uint64_t mbHist[TSTD_HIST_BUCKETS];
+	uint64_t ebHist[TSTD_HIST_BUCKETS];
+	int64_t slackMin, slackMax;
+	double slackSum;
+	uint64_t slackCount;
+	int64_t rateWindowStart;
+	int64_t rateWindowBytes;
+	int64_t ratePeakBps;
+};
+
+struct tstd_verifier_ctx_s
+{
+	struct tstd_verifier_params_s params;
+	tstd_verifier_event_cb cb;
+	void *userContext;
+
+	void *sm;
+	int smComplete;
+
+	uint64_t packetNr;
+	int clockCount;
+	struct tstd_clock_s clocks[TSTD_MAX_CLOCKS];
+	int esCount;
+	struct tstd_es_s es[TSTD_MAX_ES];
+	struct tstd_es_s *esByPid[8192];
+	struct tstd_clock_s *clockByPid[8192];
+};
+
+const char *tstd_verifier_event_name(enum tstd_event_e type)
+{
+	if (type >= TSTD_EVENT_MAX)
+		return "unknown";
+	return eventNames[type];
+}
+
+/* Video buffer sizes per ISO13818-1 2.4.2.6, 2.14.3 and 2.17.2. MB = BSmux + BSoh, Rx = Rbx = 1.2 * Rmax */
+static void _video_params(struct tstd_verifier_ctx_s *ctx, struct tstd_es_s *es, double rmaxBps, int64_t ebBytes)
+{
+	if (ctx->params.videoMaxBitrateKbps)
+		rmaxBps = ctx->params.videoMaxBitrateKbps * 1000.0;
+	if (ctx->params.videoEBBytes)
+		ebBytes = ctx->params.videoEBBytes;
+
+	es->rx = (1.2 * rmaxBps / 8.0) / PCR_HZ;
+	es->rbx = es->rx;
+	es->mbSize = (int64_t)(((0.004 * rmaxBps) + (rmaxBps / 750.0)) / 8.0);
+	es->ebSize = ebBytes;
+}
+
+static void _audio_params(struct tstd_es_s *es, int64_t bsn)
+{
+	es->rx = (2000000.0 / 8.0) / PCR_HZ;
+	es->rbx = 0;
+	es->mbSize = 0;
+	es->ebSize = bsn;
+}
+
+static int _es_params(struct tstd_verifier_ctx_s *ctx, struct tstd_es_s *es)
+{
+	switch (es->streamType) {
+	case 0x01:
+	case 0x02:
+		es->kind = "MPEG2 video";
+		_video_params(ctx, es, 80000000.0, 9781248 / 8);
+		return 0;
+	case 0x1b:
+		es->kind = "H.264 video";
+		_video_params(ctx, es, 62500000.0, 62500000 / 8);
+		return 0;
+	case 0x24:
+		es->kind = "HEVC video";
+		_video_params(ctx, es, 40000000.0, 40000000 / 8);
+		return 0;
+	case 0x03:
+	case 0x04:
+		es->kind = "MPEG audio";
+		_audio_params(es, 3584);
+		return 0;
+	case 0x0f:
+	case 0x11:
+		es->kind = "AAC audio";
+		_audio_params(es, 3584);
+		return 0;
+	case 0x81:
+		es->kind = "AC3 audio";
+		_audio_params(es, 2592);
+		return 0;
+	case 0x87:
+		es->kind = "EAC3 audio";
+		_audio_params(es, 5696);
+		return 0;
+	default:
+		return -1; /* Not modelled */
+	}
+}
+
+static void _es_reset(struct tstd_es_s *es)
+{
+	es->active = 0;
+	es->tb = es->tbPayload = es->mb = es->eb = es->ebDebt = 0;
+	es->auHead = es->auCount = 0;
+	es->auOpen = -1;
+	es->curValid = 0;
+	memset(es->overflowing, 0, sizeof(es->overflowing));
+}
+
+static void _model_from_pmt(struct tstd_verifier_ctx_s *ctx)
+{
+	struct ltntstools_pat_s *m = NULL;
+	if (ltntstools_streammodel_query_model(ctx->sm, &m) < 0)
+		return;
+
+	for (int p = 0; p < m->program_count; p++) {
+		if (m->programs[p].program_number == 0)
+			continue;
+
+		uint16_t pcrPID = m->programs[p].pmt.PCR_PID;
+		struct tstd_clock_s *clk = ctx->clockByPid[pcrPID];
+		if (!clk) {
+			if (ctx->clockCount >= TSTD_MAX_CLOCKS)
+				continue;
+			clk = &ctx->clocks[ctx->clockCount++];
+			clk->pid = pcrPID;
+			ctx->clockByPid[pcrPID] = clk;
+		}
+
+		for (int s = 0; s < m->programs[p].pmt.stream_count && ctx->esCount < TSTD_MAX_ES; s++) {
+			uint16_t pid = m->programs[p].pmt.streams[s].elementary_PID;
+			if (ctx->esByPid[pid])
+				continue;
+
+			struct tstd_es_s *es = &ctx->es[ctx->esCount];
+			memset(es, 0, sizeof(*es));
+			es->pid = pid;
+			es->streamType = m->programs[p].pmt.streams[s].stream_type;
+			es->clk = clk;
+			if (_es_params(ctx, es) < 0)
+				continue;
+
+			_es_reset(es);
+			ctx->esByPid[pid] = es;
+			ctx->esCount++;
+		}
+	}
+
+	ltntstools_pat_free(m);
+}
+
+static void _event(struct tstd_verifier_ctx_s *ctx, struct tstd_es_s *es, enum tstd_event_e type, int64_t now, int64_t bytes)
+{
+	es->events[type]++;
+
+	if (!ctx->cb)
+		return;
+
+	struct tstd_event_s e;
+	e.type = type;
+	e.pid = es->pid;
+	e.packetNr = ctx->packetNr;
+	e.streamTime = (double)(now - es->clk->firstPCR) / PCR_HZ;
+	e.bytes = bytes;
+	ctx->cb(ctx->userContext, &e);
+}
+
+/* Report the start of each overflow episode, not every packet of it. */
+static void _check_overflow(struct tstd_verifier_ctx_s *ctx, struct tstd_es_s *es, enum tstd_event_e type,
+	double level, int64_t size, int64_t now)
+{
+	if (level > size + 0.5) {
+		if (!es->overflowing[type])
+			_event(ctx, es, type, now, (int64_t)level);
+		es->overflowing[type] = 1;
+	} else {
+		es->overflowing[type] = 0;
+	}
+}
+
+/* How long before its decode time the last byte of an access unit arrived, negative if late. */
+static void _slack(struct tstd_es_s *es)
+{
+	if (!es->curValid)
+		return;
+
+	int64_t slack = es->curRemoval - es->curLastArrival;
+	if (es->slackCount == 0 || slack < es->slackMin)
+		es->slackMin = slack;
+	if (es->slackCount == 0 || slack > es->slackMax)
+		es->slackMax = slack;
+	es->slackSum += slack;
+	es->slackCount++;
+	es->curValid = 0;
+}
+
+static void _eb_in(struct tstd_es_s *es, double bytes)
+{
+	double paid = bytes < es->ebDebt ? bytes : es->ebDebt;
+	es->ebDebt -= paid;
+	es->eb += bytes - paid;
+}
+
+/* Continuous flows, TB -> MB -> EB, up to time t. */
+static void _flow(struct tstd_es_s *es, int64_t t)
+{
+	int64_t dt = t - es->lastTime;
+	if (dt <= 0)
+		return;
+	es->lastTime = t;
+
+	double out = es->rx * dt;
+	if (out > es->tb)
+		out = es->tb;
+	double payload = es->tb > 0 ? out * (es->tbPayload / es->tb) : 0;
+	es->tb -= out;
+	es->tbPayload -= payload;
+
+	if (es->rbx) {
+		es->mb += payload;
+		double mout = es->rbx * dt;
+		if (mout > es->mb)
+			mout = es->mb;
+		es->mb -= mout;
+		_eb_in(es, mout);
+	} else {
+		_eb_in(es, payload);
+	}
+}
+
+static void _remove_access_units(struct tstd_verifier_ctx_s *ctx, struct tstd_es_s *es, int64_t t)
+{
+	while (es->auCount) {
+		struct tstd_au_s *au = &es->aus[es->auHead];
+		if (au->removal > t)
+			break;
+
+		_flow(es, au->removal);
+
+		int64_t missing = 0;
+		if (es->eb + 0.5 < au->size)
+			missing = au->size - (int64_t)es->eb;
+		if (!au->complete && missing == 0)
+			missing = 1; /* More of it is still to come */
+
+		if (missing) {
+			_event(ctx, es, TSTD_EVENT_EB_UNDERFLOW, au->removal, missing);
+		}
+
+		double take = es->eb < au->size ? es->eb : au->size;
+		es->eb -= take;
+		es->ebDebt += au->size - take;
+
+		/* Decoded while still arriving, its remaining bytes become debt. */
+		if (es->auOpen == es->auHead)
+			es->auOpen = -2;
+
+		es->auHead = (es->auHead + 1) % TSTD_MAX_AUS;
+		es->auCount--;
+	}
+}
+
+/* Unwrap a 33 bit PTS/DTS into the extended 27MHz timeline, nearest to now. */
+static int64_t _unwrap(int64_t ts90k, int64_t now)
+{
+	int64_t v = ts90k * 300;
+	int64_t base = now - (now % PCR_WRAP);
+	int64_t best = base + v;
+	if (llabs((best + PCR_WRAP) - now) < llabs(best - now))
+		best += PCR_WRAP;
+	if (llabs((best - PCR_WRAP) - now) < llabs(best - now))
+		best -= PCR_WRAP;
+	return best;
+}
+
+static int64_t _read_ts(const uint8_t *p)
+{
+	return ((int64_t)(p[0] & 0x0e) << 29) | (p[1] << 22) | ((p[2] & 0xfe) << 14) | (p[3] << 7) | (p[4] >> 1);
+}
+
+static void _es_packet(struct tstd_verifier_ctx_s *ctx, struct tstd_es_s *es, const uint8_t *pkt, int64_t t)
+{
+	if (!es->active) {
+		es->active = 1;
+		es->lastTime = t;
+		es->rateWindowStart = t;
+	}
+
+	_remove_access_units(ctx, es, t);
+	_flow(es, t);
+
+	es->packets++;
+
+	int offset = 4;
+	if (pkt[3] & 0x20)
+		offset += 1 + pkt[4];
+	int payload = (pkt[3] & 0x10) && offset < 188 ? 188 - offset : 0;
+	const uint8_t *p = pkt + offset;
+
+	/* A new PES starts a new access unit, if it carries a timestamp. */
+	if (payload >= 14 && (pkt[1] & 0x40) && p[0] == 0 && p[1] == 0 && p[2] == 1 && (p[7] & 0x80)) {
+		int64_t ts = (p[7] & 0x40) && payload >= 19 ? _read_ts(p + 14) : _read_ts(p + 9);
+
+		if (es->auOpen >= 0)
+			es->aus[es->auOpen].complete = 1;
+		es->auOpen = -1;
+		_slack(es);
+
+		if (es->auCount == TSTD_MAX_AUS) {
+			/* Nothing is being decoded, timestamps are garbage. Start again. */
+			_es_reset(es);
+			es->active = 1;
+			es->lastTime = t;
+		}
+
+		int idx = (es->auHead + es->auCount) % TSTD_MAX_AUS;
+		struct tstd_au_s *au = &es->aus[idx];
+		memset(au, 0, sizeof(*au));
+		au->removal = _unwrap(ts, t);
+		es->curRemoval = au->removal;
+		es->curValid = 1;
+		es->auCount++;
+		es->auOpen = idx;
+		es->accessUnits++;
+	}
+
+	if (es->curValid)
+		es->curLastArrival = t;
+
+	if (es->auOpen >= 0) {
+		es->aus[es->auOpen].size += payload;
+	} else
+	if (es->auOpen == -2) {
+		es->ebDebt += payload; /* Belongs to an access unit that's already been decoded */
+	}
+
+	es->tb += 188;
+	es->tbPayload += payload;
+
+	_check_overflow(ctx, es, TSTD_EVENT_TB_OVERFLOW, es->tb, TSTD_TB_SIZE, t);
+	if (es->rbx)
+		_check_overflow(ctx, es, TSTD_EVENT_MB_OVERFLOW, es->mb, es->mbSize, t);
+	_check_overflow(ctx, es, TSTD_EVENT_EB_OVERFLOW, es->eb, es->ebSize, t);
+
+	if (es->tb > es->tbMax)
+		es->tbMax = es->tb;
+	if (es->mb > es->mbMax)
+		es->mbMax = es->mb;
+	if (es->eb > es->ebMax)
+		es->ebMax = es->eb;
+
+	if (es->mbSize) {
+		int b = (int)((es->mb * 100.0 / es->mbSize) / 5.0);
+		es->mbHist[b < TSTD_HIST_BUCKETS ? b : TSTD_HIST_BUCKETS - 1]++;
+	}
+	int b = (int)((es->eb * 100.0 / es->ebSize) / 5.0);
+	es->ebHist[b < TSTD_HIST_BUCKETS ? b : TSTD_HIST_BUCKETS - 1]++;
+
+	/* Peak one second rate, what the mux has to carry for this stream. */
+	if (t - es->rateWindowStart >= (int64_t)PCR_HZ) {
+		int64_t bps = (es->rateWindowBytes * 8 * (int64_t)PCR_HZ) / (t - es->rateWindowStart);
+		if (bps > es->ratePeakBps)
+			es->ratePeakBps = bps;
+		es->rateWindowStart = t;
+		es->rateWindowBytes = 0;
+	}
+	es->rateWindowBytes += 188;
+}
+
+static void _clock_restart(struct tstd_verifier_ctx_s *ctx, struct tstd_clock_s *clk)
+{
+	clk->discontinuities++;
+	for (int i = 0; i < ctx->esCount; i++) {
+		if (ctx->es[i].clk == clk)
+			_es_reset(&ctx->es[i]);
+	}
+}
+
+/* Returns the extended PCR, or -1 if the packet has none. */
+static int64_t _clock_pcr(struct tstd_clock_s *clk, const uint8_t *pkt)
+{
+	uint64_t scr;
+	if (ltntstools_scr((uint8_t *)pkt, &scr) < 0)
+		return -1;
+
+	if (clk->pcrCount == 0)
+		return scr;
+
+	/* Extend past the 33 bit wrap */
+	int64_t last = clk->lastPCR % PCR_WRAP;
+	int64_t diff = ((int64_t)scr - last + PCR_WRAP) % PCR_WRAP;
+	return clk->lastPCR + diff;
+}
+
+static void _write(struct tstd_verifier_ctx_s *ctx, const uint8_t *pkts, int packetCount, int timed, int64_t arrivalUs)
+{
+	for (int i = 0; i < packetCount; i++, ctx->packetNr++) {
+		const uint8_t *pkt = pkts + (i * 188);
+
+		if (!ctx->smComplete) {
+			ltntstools_streammodel_write(ctx->sm, (uint8_t *)pkt, 1, &ctx->smComplete);
+			if (ctx->smComplete)
+				_model_from_pmt(ctx);
+			continue;
+		}
+
+		uint16_t pid = ltntstools_pid((uint8_t *)pkt);
+
+		struct tstd_clock_s *clk = ctx->clockByPid[pid];
+		if (clk) {
+			int64_t pcr = _clock_pcr(clk, pkt);
+			if (pcr >= 0) {
+				if (clk->pcrCount && (pcr - clk->lastPCR) > DISCONTINUITY_TICKS) {
+					_clock_restart(ctx, clk);
+					clk->pcrCount = 0;
+				}
+				if (clk->pcrCount == 0) {
+					clk->firstPCR = pcr;
+					clk->wallOriginUs = arrivalUs;
+				} else
+				if (ctx->packetNr > clk->lastPacketNr) {
+					clk->ticksPerPacket = (double)(pcr - clk->lastPCR) / (double)(ctx->packetNr - clk->lastPacketNr);
+				}
+				clk->lastPCR = pcr;
+				clk->lastPacketNr = ctx->packetNr;
+				clk->pcrCount++;
+			}
+		}
+
+		struct tstd_es_s *es = ctx->esByPid[pid];
+		if (!es)
+			continue;
+
+		int64_t t;
+		if (timed) {
+			if (es->clk->pcrCount == 0)
+				continue;
+			t = es->clk->firstPCR + ((arrivalUs - es->clk->wallOriginUs) * 27);
+		} else {
+			if (es->clk->pcrCount < 2)
+				continue; /* No transport rate yet */
+			t = es->clk->lastPCR + (int64_t)((ctx->packetNr - es->clk->lastPacketNr) * es->clk->ticksPerPacket);
+		}
+
+		_es_packet(ctx, es, pkt, t);
+	}
+}
+
+void tstd_verifier_write(void *hdl, const uint8_t *pkts, int packetCount)
+{
+	_write((struct tstd_verifier_ctx_s *)hdl, pkts, packetCount, 0, 0);
+}
+
+void tstd_verifier_write_timed(void *hdl, const uint8_t *pkts, int packetCount, int64_t arrivalUs)
+{
+	_write((struct tstd_verifier_ctx_s *)hdl, pkts, packetCount, 1, arrivalUs);
+}
+
+int tstd_verifier_alloc(void **hdl, const struct tstd_verifier_params_s *params, tstd_verifier_event_cb cb, void *userContext)
+{
+	struct tstd_verifier_ctx_s *ctx = calloc(1, sizeof(*ctx));
+	if (!ctx)
+		return -1;
+
+	if (params)
+		ctx->params = *params;
+	ctx->cb = cb;
+	ctx->userContext = userContext;
+
+	if (ltntstools_streammodel_alloc(&ctx->sm, NULL) < 0) {
+		free(ctx);
+		return -1;
+	}
+
+	*hdl = ctx;
+	return 0;
+}
+
+void tstd_verifier_free(void *hdl)
+{
+	struct tstd_verifier_ctx_s *ctx = (struct tstd_verifier_ctx_s *)hdl;
+	if (!ctx)
+		return;
+
+	ltntstools_streammodel_free(ctx->sm);
+	free(ctx);
+}
+
+static void _hist_dprintf(int fd, const char *label, const uint64_t *hist)
+{
+	uint64_t total = 0;
+	for (int i = 0; i < TSTD_HIST_BUCKETS; i++)
+		total += hist[i];
+	if (total == 0)
+		return;
+
+	dprintf(fd, "    %s occupancy %%  ", label);
+	for (int i = 0; i < TSTD_HIST_BUCKETS; i++) {
+		if (hist[i])
+			dprintf(fd, " %d-%d:%.1f", i * 5, (i * 5) + 5, ((double)hist[i] / (double)total) * 100.0);
+	}
+	dprintf(fd, "\n");
+}
+
+void tstd_verifier_dprintf(void *hdl, int fd)
+{
+	struct tstd_verifier_ctx_s *ctx = (struct tstd_verifier_ctx_s *)hdl;
+
+	dprintf(fd, "T-STD buffer model, %" PRIu64 " packets\n", ctx->packetNr);
+	if (!ctx->smComplete) {
+		dprintf(fd, "  No PAT/PMT found, nothing modelled\n");
+		return;
+	}
+
+	int64_t peakTotal = 0;
+	double worstSlackMs = 0;
+	int haveSlack = 0;
+
+	for (int i = 0; i < ctx->esCount; i++) {
+		struct tstd_es_s *es = &ctx->es[i];
+
+		dprintf(fd, "  pid 0x%04x %-12s  PCR 0x%04x  %" PRIu64 " packets, %" PRIu64 " access units, peak 1s rate %.2f Mbps\n",
+			es->pid, es->kind, es->clk->pid, es->packets, es->accessUnits, (double)es->ratePeakBps / 1e6);
+		dprintf(fd, "    TB max %5.0f / %d", es->tbMax, TSTD_TB_SIZE);
+		if (es->mbSize)
+			dprintf(fd, "  MB max %.0f / %" PRIi64, es->mbMax, es->mbSize);
+		dprintf(fd, "  EB max %.0f / %" PRIi64 " (%.1f%%)\n", es->ebMax, es->ebSize, (es->ebMax * 100.0) / es->ebSize);
+		dprintf(fd, "    Events:");
+		for (int e = 0; e < TSTD_EVENT_MAX; e++) {
+			if (e == TSTD_EVENT_MB_OVERFLOW && !es->mbSize)
+				continue;
+			dprintf(fd, " %s %" PRIu64 ",", eventNames[e], es->events[e]);
+		}
+		dprintf(fd, "\n");
+		if (es->slackCount) {
+			double minMs = (double)es->slackMin / 27000.0;
+			dprintf(fd, "    Decode slack ms: min %.1f  avg %.1f  max %.1f\n",
+				minMs, (es->slackSum / es->slackCount) / 27000.0, (double)es->slackMax / 27000.0);
+			if (!haveSlack || minMs < worstSlackMs)
+				worstSlackMs = minMs;
+			haveSlack = 1;
+		}
+		_hist_dprintf(fd, "MB", es->mbHist);
+		_hist_dprintf(fd, "EB", es->ebHist);
+
+		peakTotal += es->ratePeakBps;
+	}
+
+	for (int i = 0; i < ctx->clockCount; i++) {
+		if (ctx->clocks[i].discontinuities)
+			dprintf(fd, "  PCR 0x%04x, %" PRIu64 " discontinuities restarted the model\n", ctx->clocks[i].pid, ctx->clocks[i].discontinuities);
+	}
+
+	dprintf(fd, "  Sum of peak elementary stream rates %.2f Mbps, the mux rate must exceed this\n", (double)peakTotal / 1e6);
+	if (haveSlack) {
+		if (worstSlackMs >= 0)
+			dprintf(fd, "  Worst decode slack %.1f ms, latency could be reduced by up to that much\n", worstSlackMs);
+		else
+			dprintf(fd, "  Worst decode slack %.1f ms, access units arrive late, add at least %.1f ms of latency\n", worstSlackMs, -worstSlackMs);
+	}
+}
@@ -0,0 +1,93 @@
+/**
+ * @file        tstd_verifier.h
+ * @brief       ISO13818-1 T-STD decoder buffer model (2.4.2), run against a transport stream.
+ *              Every audio and video elementary stream in the PMT gets its own model:
+ *                TB - 512 byte transport buffer, drains at Rx
+ *                MB - multiplexing buffer, video only, drains at Rbx (leak method)
+ *                EB - elementary stream buffer, each access unit is removed at its DTS (or PTS)
+ *              Packet arrival times come from interpolating the programs PCR (files, offline),
+ *              or from the wallclock the caller supplies (the output of a live smoother).
+ *
+ *              Reports buffer occupancy histograms, overflow and underflow events, the decode
+ *              slack (how long before its DTS each access unit was complete) and the peak one
+ *              second rate of each stream. The minimum slack is how much latency can be removed
+ *              from a feed, or if negative, how much has to be added.
+ *
+ *              Buffer sizes and rates are derived from the stream type, with video assumed
+ *              to be MPEG2 MP@HL, H.264 level 4.1 High or HEVC level 5.1 Main, unless the
+ *              caller supplies the real maximum video bitrate.
+ *
+ *              Caveats: one PES is treated as one access unit, streams with several audio
+ *              frames per PES will see an early removal and a slightly optimistic EB.
+ *              The PMT is taken once, changes later in the stream are ignored.
+ */
+
+#ifndef TSTD_VERIFIER_H
+#define TSTD_VERIFIER_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum tstd_event_e
+{
+	TSTD_EVENT_TB_OVERFLOW = 0,
+	TSTD_EVENT_MB_OVERFLOW,
+	TSTD_EVENT_EB_OVERFLOW,
+	TSTD_EVENT_EB_UNDERFLOW,   /* Access unit not complete in EB at its decode time */
+	TSTD_EVENT_MAX,
+};
+
+struct tstd_event_s
+{
+	enum tstd_event_e type;
+	uint16_t pid;
+	uint64_t packetNr;     /* Transport packet that triggered the event, counted from zero */
+	double   streamTime;   /* Seconds since the model started, on the programs clock */
+	int64_t  bytes;        /* Occupancy for overflows, bytes missing for underflows */
+};
+
+typedef void (*tstd_verifier_event_cb)(void *userContext, const struct tstd_event_s *event);
+
+struct tstd_verifier_params_s
+{
+	int videoMaxBitrateKbps; /* 0 = derive from the stream type */
+	int videoEBBytes;        /* 0 = derive from the stream type */
+};
+
+/**
+ * @brief       Allocate a verifier. The PAT/PMT are learned from the stream.
+ * @param[out]  void **hdl - returned object.
+ * @param[in]   const struct tstd_verifier_params_s *params - may be NULL.
+ * @param[in]   tstd_verifier_event_cb cb - optional, called for every overflow/underflow.
+ * @param[in]   void *userContext - passed to the callback.
+ * @return      0 - Success, else < 0 on error.
+ */
+int  tstd_verifier_alloc(void **hdl, const struct tstd_verifier_params_s *params, tstd_verifier_event_cb cb, void *userContext);
+void tstd_verifier_free(void *hdl);
+
+/**
+ * @brief       Offline. Packet arrival times are interpolated from the PCR.
+ */
+void tstd_verifier_write(void *hdl, const uint8_t *pkts, int packetCount);
+
+/**
+ * @brief       Live. All packets arrived at arrivalUs (any monotonic microsecond clock),
+ *              the first PCR anchors that clock to the programs time base.
+ */
+void tstd_verifier_write_timed(void *hdl, const uint8_t *pkts, int packetCount, int64_t arrivalUs);
+
+const char *tstd_verifier_event_name(enum tstd_event_e type);
+
+/**
+ * @brief       Full report per elementary stream.
+ */
+void tstd_verifier_dprintf(void *hdl, int fd);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* TSTD_VERIFIER_H */
@@ -32,6 +32,12 @@ extern int smpte2038_inspector(int argc, char *argv[]);
 extern int ntt_inspector(int argc, char *argv[]);
 extern int srt_transmit(int argc, char *argv[]);
 extern int sei_latency_inspector(int argc, char *argv[]);
+extern int frame_inspector(int argc, char *argv[]);
+extern int ts_gateway(int argc, char *argv[]);
+extern int transit_latency(int argc, char *argv[]);
+extern int ts_concat(int argc, char *argv[]);
+extern int pcap_merge(int argc, char *argv[]);
+extern int scte35_query(int argc, char *argv[]);
 
 typedef int (*func_ptr)(int, char *argv[]);
 
@@ -72,6 +78,12 @@ int main(int argc, char *argv[])
 #endif
 		{ "tstools_srt_transmit",		srt_transmit, },
 		{ "tstools_sei_latency_inspector", sei_latency_inspector, },
+		{ "tstools_frame_inspector", frame_inspector, },
+		{ "tstools_ts_gateway",		ts_gateway, },
+		{ "tstools_transit_latency",	transit_latency, },
+		{ "tstools_ts_concat",		ts_concat, },
+		{ "tstools_pcap_merge",		pcap_merge, },
+		{ "tstools_scte35_query",	scte35_query, },
 		{ 0, 0 },
 	};
 	char *appname = basename(argv[0]);
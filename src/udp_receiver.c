@@ -0,0 +1,274 @@
+/* Kernel timestamped UDP/RTP receiver, see udp_receiver.h */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "udp_receiver.h"
+
+struct udp_receiver_ctx_s
+{
+	int skt;
+	struct sockaddr_in group;
+	struct in_addr localaddr;
+	int isMulticast;
+	int isRTP;
+	int requestedBufferSize;   /* buffer_size from the url, 0 when not given */
+	int bufferSize;            /* As reported by the kernel, which doubles what was asked for */
+
+	struct udp_receiver_stats_s stats;
+	uint32_t lastKernelDrops;
+};
+
+/* udp://a.b.c.d:port?localaddr=x.x.x.x&buffer_size=n */
+static int _parse_url(struct udp_receiver_ctx_s *ctx, const char *url)
+{
+	char addr[64];
+	int port;
+	const char *p;
+
+	if (strncasecmp(url, "udp://", 6) == 0) {
+		p = url + 6;
+	} else
+	if (strncasecmp(url, "rtp://", 6) == 0) {
+		p = url + 6;
+		ctx->isRTP = 1;
+	} else {
+		return -1;
+	}
+
+	if (*p == '@')
+		p++;
+
+	if (sscanf(p, "%63[^:]:%d", addr, &port) != 2)
+		return -1;
+	if (port <= 0 || port > 65535)
+		return -1;
+
+	ctx->group.sin_family = AF_INET;
+	ctx->group.sin_port = htons(port);
+	if (inet_aton(addr, &ctx->group.sin_addr) == 0)
+		return -1;
+	ctx->isMulticast = IN_MULTICAST(ntohl(ctx->group.sin_addr.s_addr));
+
+	ctx->localaddr.s_addr = htonl(INADDR_ANY);
+
+	const char *q = strchr(p, '?');
+	while (q && *q) {
+		q++;
+		char val[64];
+		if (sscanf(q, "localaddr=%63[^&]", val) == 1) {
+			if (inet_aton(val, &ctx->localaddr) == 0)
+				return -1;
+		} else
+		if (sscanf(q, "buffer_size=%63[^&]", val) == 1) {
+			ctx->requestedBufferSize = atoi(val);
+		}
+		q = strchr(q, '&');
+	}
+
+	return 0;
+}
+
+int udp_receiver_alloc(void **hdl, const char *url)
+{
+	struct udp_receiver_ctx_s *ctx = calloc(1, sizeof(*ctx));
+	if (!ctx)
+		return -1;
+
+	if (_parse_url(ctx, url) < 0) {
+		fprintf(stderr, "%s() unable to parse url '%s'\n", __func__, url);
+		free(ctx);
+		return -1;
+	}
+
+	ctx->skt = socket(AF_INET, SOCK_DGRAM, 0);
+	if (ctx->skt < 0) {
+		free(ctx);
+		return -1;
+	}
+
+	int on = 1;
+	setsockopt(ctx->skt, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+	if (ctx->requestedBufferSize) {
+		setsockopt(ctx->skt, SOL_SOCKET, SO_RCVBUF, &ctx->requestedBufferSize, sizeof(ctx->requestedBufferSize));
+	}
+
+#if defined(SO_TIMESTAMPNS)
+	if (setsockopt(ctx->skt, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) < 0) {
+		fprintf(stderr, "%s() SO_TIMESTAMPNS unavailable, falling back to userspace timestamps\n", __func__);
+	}
+#elif defined(SO_TIMESTAMP)
+	if (setsockopt(ctx->skt, SOL_SOCKET, SO_TIMESTAMP, &on, sizeof(on)) < 0) {
+		fprintf(stderr, "%s() SO_TIMESTAMP unavailable, falling back to userspace timestamps\n", __func__);
+	}
+#endif
+#ifdef SO_RXQ_OVFL
+	setsockopt(ctx->skt, SOL_SOCKET, SO_RXQ_OVFL, &on, sizeof(on));
+#endif
+
+	/* Bind to the group for multicast, so we only see this group on this port. */
+	struct sockaddr_in sin = ctx->group;
+	if (!ctx->isMulticast)
+		sin.sin_addr.s_addr = htonl(INADDR_ANY);
+
+	if (bind(ctx->skt, (struct sockaddr *)&sin, sizeof(sin)) < 0) {
+		fprintf(stderr, "%s() unable to bind '%s', %s\n", __func__, url, strerror(errno));
+		close(ctx->skt);
+		free(ctx);
+		return -1;
+	}
+
+	if (ctx->isMulticast) {
+		struct ip_mreq mreq;
+		mreq.imr_multiaddr = ctx->group.sin_addr;
+		mreq.imr_interface = ctx->localaddr;
+		if (setsockopt(ctx->skt, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0) {
+			fprintf(stderr, "%s() unable to join multicast group, %s\n", __func__, strerror(errno));
+			close(ctx->skt);
+			free(ctx);
+			return -1;
+		}
+	}
+
+	socklen_t len = sizeof(ctx->bufferSize);
+	getsockopt(ctx->skt, SOL_SOCKET, SO_RCVBUF, &ctx->bufferSize, &len);
+
+	*hdl = ctx;
+	return 0;
+}
+
+void udp_receiver_free(void *hdl)
+{
+	struct udp_receiver_ctx_s *ctx = (struct udp_receiver_ctx_s *)hdl;
+	if (!ctx)
+		return;
+
+	close(ctx->skt); /* The kernel drops the multicast membership */
+	free(ctx);
+}
+
+/* Strip a (version 2) RTP header, returns the header length or 0. */
+static int _rtp_header_length(const uint8_t *buf, int len)
+{
+	if (len < 12 || (buf[0] & 0xc0) != 0x80)
+		return 0;
+
+	int hlen = 12 + ((buf[0] & 0x0f) * 4); /* CSRCs */
+	if ((buf[0] & 0x10) && len >= hlen + 4) {
+		hlen += 4 + (((buf[hlen + 2] << 8) | buf[hlen + 3]) * 4); /* Extension */
+	}
+
+	return hlen < len ? hlen : 0;
+}
+
+int udp_receiver_read(void *hdl, uint8_t *buf, int lengthBytes, struct timespec *arrival, int timeoutMs)
+{
+	struct udp_receiver_ctx_s *ctx = (struct udp_receiver_ctx_s *)hdl;
+
+	struct pollfd pfd = { .fd = ctx->skt, .events = POLLIN };
+	int ret = poll(&pfd, 1, timeoutMs);
+	if (ret == 0)
+		return -EAGAIN;
+	if (ret < 0)
+		return errno == EINTR ? -EAGAIN : -errno;
+
+	struct iovec iov = { .iov_base = buf, .iov_len = lengthBytes };
+	uint8_t control[256];
+	struct msghdr msg = { 0 };
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+
+	int len = recvmsg(ctx->skt, &msg, 0);
+	if (len < 0)
+		return errno == EAGAIN || errno == EINTR ? -EAGAIN : -errno;
+
+	int found = 0;
+	for (struct cmsghdr *c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c)) {
+		if (c->cmsg_level != SOL_SOCKET)
+			continue;
+#if defined(SO_TIMESTAMPNS)
+		if (c->cmsg_type == SCM_TIMESTAMPNS) {
+			memcpy(arrival, CMSG_DATA(c), sizeof(*arrival));
+			found = 1;
+		}
+#elif defined(SO_TIMESTAMP)
+		if (c->cmsg_type == SCM_TIMESTAMP) {
+			struct timeval tv;
+			memcpy(&tv, CMSG_DATA(c), sizeof(tv));
+			arrival->tv_sec = tv.tv_sec;
+			arrival->tv_nsec = tv.tv_usec * 1000;
+			found = 1;
+		}
+#endif
+#ifdef SO_RXQ_OVFL
+		if (c->cmsg_type == SO_RXQ_OVFL) {
+			uint32_t drops;
+			memcpy(&drops, CMSG_DATA(c), sizeof(drops));
+			ctx->stats.kernelDrops += drops - ctx->lastKernelDrops;
+			ctx->lastKernelDrops = drops;
+		}
+#endif
+	}
+	if (found) {
+		ctx->stats.kernelTimestamps++;
+	} else {
+		clock_gettime(CLOCK_REALTIME, arrival);
+		ctx->stats.userTimestamps++;
+	}
+
+	ctx->stats.datagrams++;
+
+	/* RTP, by url or by shape. */
+	if (ctx->isRTP || (len % 188) != 0) {
+		int hlen = _rtp_header_length(buf, len);
+		if (hlen) {
+			ctx->stats.rtpDatagrams++;
+			len -= hlen;
+			memmove(buf, buf + hlen, len);
+		}
+	}
+
+	if (len % 188 != 0 || buf[0] != 0x47) {
+		ctx->stats.badDatagrams++;
+		return -EAGAIN;
+	}
+
+	ctx->stats.bytes += len;
+
+	return len;
+}
+
+int udp_receiver_get_fd(void *hdl)
+{
+	struct udp_receiver_ctx_s *ctx = (struct udp_receiver_ctx_s *)hdl;
+	return ctx->skt;
+}
+
+int udp_receiver_get_buffer_size(void *hdl)
+{
+	struct udp_receiver_ctx_s *ctx = (struct udp_receiver_ctx_s *)hdl;
+	return ctx->bufferSize;
+}
+
+int udp_receiver_get_requested_buffer_size(void *hdl)
+{
+	struct udp_receiver_ctx_s *ctx = (struct udp_receiver_ctx_s *)hdl;
+	return ctx->requestedBufferSize;
+}
+
+void udp_receiver_get_stats(void *hdl, struct udp_receiver_stats_s *stats)
+{
+	struct udp_receiver_ctx_s *ctx = (struct udp_receiver_ctx_s *)hdl;
+	*stats = ctx->stats;
+}
@@ -0,0 +1,79 @@
+/**
+ * @file        udp_receiver.h
+ * @brief       Minimal UDP/RTP transport stream receiver that timestamps every datagram
+ *              in the kernel (SO_TIMESTAMPNS), as it comes off the NIC, instead of when
+ *              userspace eventually gets around to reading it. Needed for any measurement
+ *              of network or encoder timing, where the tools own buffering and scheduling
+ *              would otherwise swamp the measurement.
+ *
+ *              Accepts the same udp:// and rtp:// urls as the avio based tools:
+ *                udp://227.1.20.45:4001?localaddr=192.168.20.45&buffer_size=2500000
+ *              localaddr selects the interface for the IGMP join, buffer_size sets SO_RCVBUF,
+ *              any other url options are ignored. RTP headers are removed.
+ */
+
+#ifndef UDP_RECEIVER_H
+#define UDP_RECEIVER_H
+
+#include <stdint.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct udp_receiver_stats_s
+{
+	uint64_t datagrams;
+	uint64_t bytes;           /* Transport packet bytes, after RTP header removal */
+	uint64_t rtpDatagrams;
+	uint64_t badDatagrams;    /* Not a whole number of transport packets */
+	uint64_t kernelTimestamps;
+	uint64_t userTimestamps;  /* Kernel didn't supply a timestamp, clock_gettime() used instead */
+	uint64_t kernelDrops;     /* SO_RXQ_OVFL, datagrams the kernel dropped on our socket */
+};
+
+/**
+ * @brief       Parse the url, open and bind the socket, join the multicast group if needed.
+ * @param[out]  void **hdl - returned object.
+ * @param[in]   const char *url - udp:// or rtp://
+ * @return      0 - Success, else < 0 on error.
+ */
+int  udp_receiver_alloc(void **hdl, const char *url);
+
+void udp_receiver_free(void *hdl);
+
+/**
+ * @brief       Receive a single datagram.
+ * @param[out]  uint8_t *buf - transport packets, RTP header removed.
+ * @param[in]   int lengthBytes - size of buf, at least 65536 is recommended.
+ * @param[out]  struct timespec *arrival - CLOCK_REALTIME the datagram arrived.
+ * @param[in]   int timeoutMs - how long to wait for a datagram.
+ * @return      Number of bytes (a multiple of 188), -EAGAIN on timeout, else < 0 on error.
+ */
+int  udp_receiver_read(void *hdl, uint8_t *buf, int lengthBytes, struct timespec *arrival, int timeoutMs);
+
+/**
+ * @brief       The underlying socket, for callers multiplexing several receivers in their own
+ *              poll/epoll loop. Call udp_receiver_read() with a zero timeout once it's readable.
+ */
+int  udp_receiver_get_fd(void *hdl);
+
+/**
+ * @brief       The negotiated socket receive buffer size, as reported by the kernel.
+ */
+int  udp_receiver_get_buffer_size(void *hdl);
+
+/**
+ * @brief       The buffer_size asked for in the url, 0 when none was. Compare this against
+ *              rmem_max, not the negotiated size, Linux reports SO_RCVBUF doubled.
+ */
+int  udp_receiver_get_requested_buffer_size(void *hdl);
+
+void udp_receiver_get_stats(void *hdl, struct udp_receiver_stats_s *stats);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* UDP_RECEIVER_H */
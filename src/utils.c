@@ -4,6 +4,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <inttypes.h>
 #include <time.h>
 #include <ifaddrs.h>
 #include <net/if.h>
@@ -359,6 +360,59 @@ void timeval_subtract(struct timeval *result, struct timeval *now, unsigned int
 	result->tv_usec -= (ms * 1000);
 }
 
+void stuffing_strip_init(struct stuffing_strip_s *ss)
+{
+	memset(ss, 0, sizeof(*ss));
+	ss->pids[0x1fff] = 1;
+}
+
+void stuffing_strip_add_pid(struct stuffing_strip_s *ss, uint16_t pid)
+{
+	ss->pids[pid & 0x1fff] = 1;
+}
+
+static int stuffing_has_pcr(const uint8_t *pkt)
+{
+	/* Adaptation field present, non zero length, PCR flag set. */
+	return (pkt[3] & 0x20) && pkt[4] > 0 && (pkt[5] & 0x10);
+}
+
+int stuffing_strip(struct stuffing_strip_s *ss, struct stuffing_strip_stats_s *stats,
+	const uint8_t *src, uint8_t *dst, int packetCount)
+{
+	int count = 0;
+
+	for (int i = 0; i < packetCount; i++) {
+		const uint8_t *pkt = src + (i * 188);
+		uint16_t pid = ((pkt[1] & 0x1f) << 8) | pkt[2];
+
+		if (ss->pids[pid] && !stuffing_has_pcr(pkt))
+			continue;
+
+		if (dst + (count * 188) != pkt)
+			memmove(dst + (count * 188), pkt, 188);
+		count++;
+	}
+
+	stats->packetsIn += packetCount;
+	stats->packetsStripped += packetCount - count;
+
+	return count;
+}
+
+int stuffing_strip_sprintf(char *dst, int lengthBytes, struct stuffing_strip_stats_s *stats)
+{
+	double pct = 0;
+	if (stats->packetsIn)
+		pct = ((double)stats->packetsStripped / (double)stats->packetsIn) * 100.0;
+
+	return snprintf(dst, lengthBytes, "stuffing stripped %" PRIu64 " of %" PRIu64 " packets (%.1f%%), %.2f MB saved",
+		stats->packetsStripped,
+		stats->packetsIn,
+		pct,
+		((double)stats->packetsStripped * 188.0) / 1048576.0);
+}
+
 int ISO8601_UTC_CreateTimestamp(struct timeval *tv, char **dst)
 {
     struct timeval curTime;
@@ -2,6 +2,7 @@
 #ifndef LTNTOOLS_UTILS_H
 #define LTNTOOLS_UTILS_H
 
+#include <stdint.h>
 #include <pcap.h>
 #include <arpa/inet.h>
 #include <netinet/if_ether.h>
@@ -60,4 +61,31 @@ int process_memory_sprintf(char *dst, struct statm_context_s *ctx, int reportSec
 
 void timeval_subtract(struct timeval *result, struct timeval *now, unsigned int ms);
 
+/* Stuffing removal, turns a CBR padded transport stream into VBR for output.
+ * Null packets (0x1fff) and any other configured stuffing pids are removed.
+ * Packets carrying a PCR are never removed, and the remaining packets are
+ * passed through as they arrive, so the PCR timing is untouched.
+ */
+struct stuffing_strip_s
+{
+	int enabled;
+	uint8_t pids[8192]; /* Boolean, strip this pid */
+};
+
+struct stuffing_strip_stats_s
+{
+	uint64_t packetsIn;
+	uint64_t packetsStripped;
+};
+
+void stuffing_strip_init(struct stuffing_strip_s *ss);
+void stuffing_strip_add_pid(struct stuffing_strip_s *ss, uint16_t pid);
+
+/* Copy packetCount packets from src to dst, minus the stuffing. dst may equal src.
+ * Return the number of packets written to dst.
+ */
+int  stuffing_strip(struct stuffing_strip_s *ss, struct stuffing_strip_stats_s *stats,
+	const uint8_t *src, uint8_t *dst, int packetCount);
+int  stuffing_strip_sprintf(char *dst, int lengthBytes, struct stuffing_strip_stats_s *stats);
+
 #endif  /* LTNTOOLS_UTILS_H */
@@ -0,0 +1,588 @@
+/* Decode free video frame and GOP statistics, see video_frame_stats.h */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <pthread.h>
+
+#include "video_frame_stats.h"
+
+/* How much of each access unit we keep for classification. Enough to get past
+ * the AUD, SPS/PPS and typical SEI to the first slice header.
+ */
+#define VFS_HEADER_BYTES 2048
+
+/* Consecutive frames at a new duration before we accept the frame rate has changed. */
+#define VFS_CADENCE_RELOCK 8
+
+#define PTS_MASK 0x1FFFFFFFFULL
+
+struct vfs_pid_s
+{
+	struct video_frame_stats_s s;
+
+	int inFrame;
+	uint32_t frameBytes;
+	int hasPTS, hasDTS;
+	uint64_t pts, dts;
+
+	uint8_t hdr[VFS_HEADER_BYTES];
+	int hdrLen;
+
+	int haveLastTS;
+	uint64_t lastTS;
+	uint32_t candidateDuration;
+	int candidateCount;
+	double avgDuration;
+
+	int haveI;
+	uint32_t framesSinceI;
+	int haveIDR;
+	uint32_t framesSinceIDR;
+	uint64_t lastIDRTS;
+	int patternLen;
+	char pattern[64];
+};
+
+struct vfs_ctx_s
+{
+	pthread_mutex_t mutex;
+	uint8_t tracked[8192 / 8];
+	uint8_t ignored[8192 / 8]; /* PES, but not video */
+	int pidCount;
+	struct vfs_pid_s *pids[VFS_MAX_PIDS];
+};
+
+/* Minimal bit reader for exp-golomb slice header fields. Emulation prevention
+ * bytes can't occur in the few leading bits we read, so they're not handled.
+ */
+struct vfs_bits_s
+{
+	const uint8_t *buf;
+	int lengthBits;
+	int pos;
+};
+
+static int _bit(struct vfs_bits_s *b)
+{
+	if (b->pos >= b->lengthBits)
+		return -1;
+	int v = (b->buf[b->pos >> 3] >> (7 - (b->pos & 7))) & 1;
+	b->pos++;
+	return v;
+}
+
+static int _ue(struct vfs_bits_s *b)
+{
+	int zeros = 0;
+	int v;
+	while ((v = _bit(b)) == 0) {
+		if (++zeros > 16)
+			return -1;
+	}
+	if (v < 0)
+		return -1;
+
+	uint32_t val = 1;
+	for (int i = 0; i < zeros; i++) {
+		if ((v = _bit(b)) < 0)
+			return -1;
+		val = (val << 1) | v;
+	}
+	return val - 1;
+}
+
+const char *video_frame_stats_codec_name(enum vfs_codec_e codec)
+{
+	switch (codec) {
+	case VFS_CODEC_MPEG2: return "MPEG2";
+	case VFS_CODEC_H264:  return "H.264";
+	case VFS_CODEC_HEVC:  return "HEVC";
+	default:              return "???";
+	}
+}
+
+static char _frame_type_char(enum vfs_frame_type_e t)
+{
+	switch (t) {
+	case VFS_FRAME_I: return 'I';
+	case VFS_FRAME_P: return 'P';
+	case VFS_FRAME_B: return 'B';
+	default:          return '?';
+	}
+}
+
+static enum vfs_codec_e _detect_codec(const uint8_t *buf, int len)
+{
+	for (int i = 0; i + 4 < len; i++) {
+		if (buf[i] != 0 || buf[i + 1] != 0 || buf[i + 2] != 1)
+			continue;
+
+		const uint8_t *p = buf + i + 3;
+		if (p[0] == 0xB3 || p[0] == 0xB8)
+			return VFS_CODEC_MPEG2; /* Sequence or GOP header */
+		if (p[0] == 0x00 && i + 5 < len && (p[2] & 0x38))
+			return VFS_CODEC_MPEG2; /* Picture header, temporal_reference(10) then picture_coding_type(3), never zero.
+						 * Checked ahead of the SPS, MPEG2 slice start codes overlap it. */
+		if (p[0] == 0x09 && (p[1] & 0x1f) == 0x10)
+			return VFS_CODEC_H264;  /* AUD, primary_pic_type + stop bit */
+		if ((p[0] & 0x9f) == 0x07)
+			return VFS_CODEC_H264;  /* SPS, any nal_ref_idc */
+		if ((p[0] == 0x46 || p[0] == 0x40 || p[0] == 0x42) && p[1] == 0x01)
+			return VFS_CODEC_HEVC;  /* AUD, VPS or SPS, layer 0 tid 1 */
+	}
+
+	return VFS_CODEC_UNKNOWN;
+}
+
+/* Find the frame type from the start of the access unit. Slice headers are preferred,
+ * the AUD only tells us the most complex slice type that may be present.
+ */
+static enum vfs_frame_type_e _classify(enum vfs_codec_e codec, const uint8_t *buf, int len, int *isIDR)
+{
+	enum vfs_frame_type_e audType = VFS_FRAME_UNKNOWN;
+	int sequenceHeader = 0;
+
+	*isIDR = 0;
+
+	for (int i = 0; i + 5 < len; i++) {
+		if (buf[i] != 0 || buf[i + 1] != 0 || buf[i + 2] != 1)
+			continue;
+
+		const uint8_t *p = buf + i + 3;
+		struct vfs_bits_s b = { p, (len - (i + 3)) * 8, 0 };
+
+		if (codec == VFS_CODEC_MPEG2) {
+			if (p[0] == 0xB3) {
+				sequenceHeader = 1;
+			} else
+			if (p[0] == 0x00) {
+				/* Picture header: temporal_reference(10) picture_coding_type(3) */
+				switch ((p[2] >> 3) & 0x07) {
+				case 1: *isIDR = sequenceHeader; return VFS_FRAME_I;
+				case 2: return VFS_FRAME_P;
+				case 3: return VFS_FRAME_B;
+				}
+				return VFS_FRAME_UNKNOWN;
+			}
+		} else
+		if (codec == VFS_CODEC_H264) {
+			int type = p[0] & 0x1f;
+			if (type == 9) {
+				static const enum vfs_frame_type_e aud[8] = {
+					VFS_FRAME_I, VFS_FRAME_P, VFS_FRAME_B, VFS_FRAME_I, VFS_FRAME_P, VFS_FRAME_I, VFS_FRAME_P, VFS_FRAME_B };
+				audType = aud[p[1] >> 5];
+			} else
+			if (type == 1 || type == 5) {
+				if (type == 5)
+					*isIDR = 1;
+				b.pos = 8;
+				_ue(&b); /* first_mb_in_slice */
+				int sliceType = _ue(&b);
+				if (sliceType < 0)
+					break;
+				switch (sliceType % 5) {
+				case 0: case 3: return VFS_FRAME_P; /* P, SP */
+				case 1:         return VFS_FRAME_B;
+				default:        return VFS_FRAME_I; /* I, SI */
+				}
+			}
+		} else
+		if (codec == VFS_CODEC_HEVC) {
+			int type = (p[0] >> 1) & 0x3f;
+			if (type == 35) {
+				static const enum vfs_frame_type_e aud[8] = { VFS_FRAME_I, VFS_FRAME_P, VFS_FRAME_B };
+				audType = aud[p[2] >> 5];
+			} else
+			if (type >= 16 && type <= 21) {
+				/* IRAP, always intra coded */
+				if (type == 19 || type == 20)
+					*isIDR = 1;
+				return VFS_FRAME_I;
+			} else
+			if (type <= 9) {
+				/* first_slice_segment_in_pic_flag, slice_pic_parameter_set_id, then slice_type.
+				 * Assumes num_extra_slice_header_bits is zero, as it is in every encoder we've seen,
+				 * otherwise we'd need to track the PPS.
+				 */
+				b.pos = 16;
+				if (_bit(&b) != 1)
+					continue; /* Not the first slice of the picture */
+				_ue(&b);
+				int sliceType = _ue(&b);
+				switch (sliceType) {
+				case 0: return VFS_FRAME_B;
+				case 1: return VFS_FRAME_P;
+				case 2: return VFS_FRAME_I;
+				}
+				break;
+			}
+		}
+	}
+
+	return audType;
+}
+
+static uint64_t _pes_timestamp(const uint8_t *p)
+{
+	return ((uint64_t)(p[0] & 0x0e) << 29) |
+		((uint64_t)p[1] << 22) |
+		((uint64_t)(p[2] & 0xfe) << 14) |
+		((uint64_t)p[3] << 7) |
+		((uint64_t)p[4] >> 1);
+}
+
+static void _cadence_update(struct vfs_pid_s *e, uint64_t ts)
+{
+	struct video_frame_stats_s *s = &e->s;
+
+	if (!e->haveLastTS) {
+		e->haveLastTS = 1;
+		e->lastTS = ts;
+		return;
+	}
+
+	uint64_t diff = (ts - e->lastTS) & PTS_MASK;
+	e->lastTS = ts;
+
+	if (diff > (PTS_MASK >> 1)) {
+		s->dtsBackwards++;
+		return;
+	}
+
+	uint32_t d = diff;
+	if (s->frameDuration == 0) {
+		s->frameDuration = d;
+		e->avgDuration = d;
+	} else
+	if (d + 1 < s->frameDuration || d > s->frameDuration + 1) {
+		/* +/- 1 tick, 59.94 alternates between 1501 and 1502 */
+		s->cadenceErrors++;
+
+		/* A sustained new duration means the frame rate changed, adopt it. */
+		if (e->candidateCount && d + 1 >= e->candidateDuration && d <= e->candidateDuration + 1) {
+			if (++e->candidateCount >= VFS_CADENCE_RELOCK) {
+				s->frameDuration = d;
+				e->avgDuration = d;
+				e->candidateCount = 0;
+			}
+		} else {
+			e->candidateDuration = d;
+			e->candidateCount = 1;
+		}
+		return;
+	} else {
+		e->candidateCount = 0;
+	}
+
+	e->avgDuration = ((e->avgDuration * 15.0) + d) / 16.0;
+	if (e->avgDuration > 0)
+		s->frameRate = 90000.0 / e->avgDuration;
+}
+
+static void _frame_complete(struct vfs_pid_s *e)
+{
+	struct video_frame_stats_s *s = &e->s;
+
+	if (s->codec == VFS_CODEC_UNKNOWN) {
+		s->codec = _detect_codec(e->hdr, e->hdrLen);
+	}
+
+	int isIDR = 0;
+	enum vfs_frame_type_e t = _classify(s->codec, e->hdr, e->hdrLen, &isIDR);
+
+	s->frames++;
+	s->lastFrameType = t;
+
+	struct video_frame_stats_size_s *sz = &s->sizes[t];
+	if (sz->count == 0 || e->frameBytes < sz->minBytes)
+		sz->minBytes = e->frameBytes;
+	if (e->frameBytes > sz->maxBytes)
+		sz->maxBytes = e->frameBytes;
+	sz->lastBytes = e->frameBytes;
+	sz->totalBytes += e->frameBytes;
+	sz->count++;
+
+	/* Timing */
+	if (!e->hasPTS) {
+		s->ptsMissing++;
+	} else {
+		if (e->hasDTS && ((e->pts - e->dts) & PTS_MASK) > (PTS_MASK >> 1))
+			s->ptsBeforeDts++;
+		_cadence_update(e, e->hasDTS ? e->dts : e->pts);
+	}
+
+	/* GOP structure */
+	if (t == VFS_FRAME_I) {
+		if (e->haveI) {
+			s->gopLength = e->framesSinceI;
+			if (s->gopLengthMin == 0 || s->gopLength < s->gopLengthMin)
+				s->gopLengthMin = s->gopLength;
+			if (s->gopLength > s->gopLengthMax)
+				s->gopLengthMax = s->gopLength;
+			memcpy(&s->gopPattern[0], &e->pattern[0], e->patternLen);
+			s->gopPattern[e->patternLen] = 0;
+		}
+		e->haveI = 1;
+		e->framesSinceI = 0;
+		e->patternLen = 0;
+	}
+	if (e->patternLen < (int)sizeof(e->pattern) - 1)
+		e->pattern[e->patternLen++] = _frame_type_char(t);
+	e->framesSinceI++;
+
+	if (isIDR) {
+		s->idrFrames++;
+		if (e->haveIDR) {
+			s->idrIntervalFrames = e->framesSinceIDR;
+			if (e->hasPTS) {
+				uint64_t ts = e->hasDTS ? e->dts : e->pts;
+				s->idrIntervalMs = (double)((ts - e->lastIDRTS) & PTS_MASK) / 90.0;
+			}
+		}
+		e->haveIDR = 1;
+		e->framesSinceIDR = 0;
+		if (e->hasPTS)
+			e->lastIDRTS = e->hasDTS ? e->dts : e->pts;
+	}
+	e->framesSinceIDR++;
+}
+
+static struct vfs_pid_s *_pid_lookup(struct vfs_ctx_s *ctx, uint16_t pid)
+{
+	for (int i = 0; i < ctx->pidCount; i++) {
+		if (ctx->pids[i]->s.pid == pid)
+			return ctx->pids[i];
+	}
+	return NULL;
+}
+
+static void _write_packet(struct vfs_ctx_s *ctx, const uint8_t *pkt)
+{
+	if (pkt[0] != 0x47)
+		return;
+
+	uint16_t pid = ((pkt[1] & 0x1f) << 8) | pkt[2];
+	int pusi = pkt[1] & 0x40;
+	int isTracked = ctx->tracked[pid >> 3] & (1 << (pid & 7));
+
+	/* Cheap reject for everything that isn't, or can't become, a video pid. */
+	if (!isTracked && (!pusi || (ctx->ignored[pid >> 3] & (1 << (pid & 7)))))
+		return;
+
+	if (!(pkt[3] & 0x10))
+		return; /* No payload */
+
+	int offset = 4;
+	if (pkt[3] & 0x20)
+		offset += 1 + pkt[4];
+	if (offset >= 188)
+		return;
+
+	const uint8_t *payload = pkt + offset;
+	int len = 188 - offset;
+
+	struct vfs_pid_s *e = NULL;
+
+	if (pusi) {
+		if (len < 9 || payload[0] != 0 || payload[1] != 0 || payload[2] != 1)
+			return;
+
+		if (payload[3] < 0xE0 || payload[3] > 0xEF) {
+			if (!isTracked)
+				ctx->ignored[pid >> 3] |= (1 << (pid & 7));
+			return;
+		}
+
+		if (isTracked) {
+			e = _pid_lookup(ctx, pid);
+			if (!e)
+				return;
+		} else {
+			if (ctx->pidCount == VFS_MAX_PIDS)
+				return;
+			e = calloc(1, sizeof(*e));
+			if (!e)
+				return;
+			e->s.pid = pid;
+			ctx->pids[ctx->pidCount++] = e;
+			ctx->tracked[pid >> 3] |= (1 << (pid & 7));
+		}
+
+		if (e->inFrame)
+			_frame_complete(e);
+
+		/* New access unit */
+		e->inFrame = 1;
+		e->frameBytes = 0;
+		e->hdrLen = 0;
+		e->hasPTS = 0;
+		e->hasDTS = 0;
+
+		int flags = payload[7];
+		int hdrlen = 9 + payload[8];
+		if ((flags & 0x80) && len >= 14) {
+			e->hasPTS = 1;
+			e->pts = _pes_timestamp(&payload[9]);
+		}
+		if ((flags & 0xC0) == 0xC0 && len >= 19) {
+			e->hasDTS = 1;
+			e->dts = _pes_timestamp(&payload[14]);
+		}
+		if (hdrlen >= len)
+			return;
+
+		payload += hdrlen;
+		len -= hdrlen;
+	} else {
+		e = _pid_lookup(ctx, pid);
+		if (!e || !e->inFrame)
+			return;
+	}
+
+	e->frameBytes += len;
+
+	if (e->hdrLen < VFS_HEADER_BYTES) {
+		int n = VFS_HEADER_BYTES - e->hdrLen;
+		if (n > len)
+			n = len;
+		memcpy(&e->hdr[e->hdrLen], payload, n);
+		e->hdrLen += n;
+	}
+}
+
+int video_frame_stats_alloc(void **hdl)
+{
+	struct vfs_ctx_s *ctx = calloc(1, sizeof(*ctx));
+	if (!ctx)
+		return -1;
+
+	pthread_mutex_init(&ctx->mutex, NULL);
+
+	*hdl = ctx;
+	return 0;
+}
+
+void video_frame_stats_free(void *hdl)
+{
+	struct vfs_ctx_s *ctx = hdl;
+	if (!ctx)
+		return;
+
+	for (int i = 0; i < ctx->pidCount; i++)
+		free(ctx->pids[i]);
+
+	pthread_mutex_destroy(&ctx->mutex);
+	free(ctx);
+}
+
+void video_frame_stats_write(void *hdl, const uint8_t *pkts, int packetCount)
+{
+	struct vfs_ctx_s *ctx = hdl;
+
+	pthread_mutex_lock(&ctx->mutex);
+	for (int i = 0; i < packetCount; i++)
+		_write_packet(ctx, pkts + (i * 188));
+	pthread_mutex_unlock(&ctx->mutex);
+}
+
+int video_frame_stats_enum(void *hdl, int *idx, struct video_frame_stats_s *out)
+{
+	struct vfs_ctx_s *ctx = hdl;
+	int ret = -1;
+
+	pthread_mutex_lock(&ctx->mutex);
+	if (*idx >= 0 && *idx < ctx->pidCount) {
+		memcpy(out, &ctx->pids[*idx]->s, sizeof(*out));
+		(*idx)++;
+		ret = 0;
+	}
+	pthread_mutex_unlock(&ctx->mutex);
+
+	return ret;
+}
+
+void video_frame_stats_reset(void *hdl)
+{
+	struct vfs_ctx_s *ctx = hdl;
+
+	pthread_mutex_lock(&ctx->mutex);
+	for (int i = 0; i < ctx->pidCount; i++) {
+		struct vfs_pid_s *e = ctx->pids[i];
+		uint16_t pid = e->s.pid;
+		enum vfs_codec_e codec = e->s.codec;
+		memset(e, 0, sizeof(*e));
+		e->s.pid = pid;
+		e->s.codec = codec;
+	}
+	pthread_mutex_unlock(&ctx->mutex);
+}
+
+void video_frame_stats_discontinuity(void *hdl)
+{
+	struct vfs_ctx_s *ctx = hdl;
+
+	pthread_mutex_lock(&ctx->mutex);
+	for (int i = 0; i < ctx->pidCount; i++) {
+		struct vfs_pid_s *e = ctx->pids[i];
+
+		/* Drop the partial access unit, and anything measured across the gap. */
+		e->inFrame = 0;
+		e->frameBytes = 0;
+		e->hdrLen = 0;
+		e->haveLastTS = 0;
+		e->candidateCount = 0;
+		e->haveI = 0;
+		e->framesSinceI = 0;
+		e->patternLen = 0;
+		e->haveIDR = 0;
+		e->framesSinceIDR = 0;
+	}
+	pthread_mutex_unlock(&ctx->mutex);
+}
+
+static uint32_t _avg_kb(const struct video_frame_stats_size_s *sz)
+{
+	return sz->count ? (uint32_t)((sz->totalBytes / sz->count) / 1024) : 0;
+}
+
+int video_frame_stats_sprintf(const struct video_frame_stats_s *s, char *dst, int lengthBytes)
+{
+	return snprintf(dst, lengthBytes, "0x%04x %-5s %6.2ffps GOP %3d IDR %6.0fms avg I/P/B %4d/%4d/%4d KB cadence-errs %" PRIu64,
+		s->pid,
+		video_frame_stats_codec_name(s->codec),
+		s->frameRate,
+		s->gopLength,
+		s->idrIntervalMs,
+		_avg_kb(&s->sizes[VFS_FRAME_I]),
+		_avg_kb(&s->sizes[VFS_FRAME_P]),
+		_avg_kb(&s->sizes[VFS_FRAME_B]),
+		s->cadenceErrors);
+}
+
+void video_frame_stats_dprintf(void *hdl, int fd)
+{
+	struct video_frame_stats_s s;
+	int idx = 0;
+
+	while (video_frame_stats_enum(hdl, &idx, &s) == 0) {
+		dprintf(fd, "Video PID 0x%04x (%s), %" PRIu64 " frames, %.2f fps (%d ticks)\n",
+			s.pid, video_frame_stats_codec_name(s.codec), s.frames, s.frameRate, s.frameDuration);
+		dprintf(fd, "  GOP length %d (min %d max %d) %s\n",
+			s.gopLength, s.gopLengthMin, s.gopLengthMax, s.gopPattern);
+		dprintf(fd, "  IDR frames %" PRIu64 ", interval %d frames / %.1f ms\n",
+			s.idrFrames, s.idrIntervalFrames, s.idrIntervalMs);
+		dprintf(fd, "  Type       Count     Min(B)     Avg(B)     Max(B)\n");
+		for (int i = 0; i < VFS_FRAME_MAX; i++) {
+			const struct video_frame_stats_size_s *sz = &s.sizes[i];
+			if (sz->count == 0)
+				continue;
+			dprintf(fd, "     %c %10" PRIu64 " %10d %10" PRIu64 " %10d\n",
+				_frame_type_char(i), sz->count, sz->minBytes, sz->totalBytes / sz->count, sz->maxBytes);
+		}
+		dprintf(fd, "  Cadence errors %" PRIu64 ", DTS backwards %" PRIu64 ", PTS before DTS %" PRIu64 ", PTS missing %" PRIu64 "\n",
+			s.cadenceErrors, s.dtsBackwards, s.ptsBeforeDts, s.ptsMissing);
+		dprintf(fd, "\n");
+	}
+}
@@ -0,0 +1,133 @@
+/**
+ * @file        video_frame_stats.h
+ * @brief       Decode free video frame and GOP statistics.
+ *              Derives frame type, frame size, GOP length, IDR interval, frame rate and
+ *              PTS/DTS cadence errors from PES headers and the first few bytes of each
+ *              access unit (AUD, slice header or MPEG2 picture header). Nothing is decoded,
+ *              so it costs a tiny fraction of a decoder and can run on every video PID
+ *              of every stream.
+ *
+ *              Video PIDs are discovered automatically from their PES stream_id (0xE0 - 0xEF)
+ *              and the codec (MPEG2, H.264 or HEVC) is detected from the elementary stream.
+ *              One access unit per PES is assumed, which is what broadcast encoders produce.
+ */
+
+#ifndef VIDEO_FRAME_STATS_H
+#define VIDEO_FRAME_STATS_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Maximum number of video pids tracked per instance. */
+#define VFS_MAX_PIDS 16
+
+enum vfs_codec_e
+{
+	VFS_CODEC_UNKNOWN = 0,
+	VFS_CODEC_MPEG2,
+	VFS_CODEC_H264,
+	VFS_CODEC_HEVC,
+};
+
+enum vfs_frame_type_e
+{
+	VFS_FRAME_UNKNOWN = 0,
+	VFS_FRAME_I,
+	VFS_FRAME_P,
+	VFS_FRAME_B,
+	VFS_FRAME_MAX,
+};
+
+struct video_frame_stats_size_s
+{
+	uint64_t count;
+	uint64_t totalBytes;
+	uint32_t minBytes;
+	uint32_t maxBytes;
+	uint32_t lastBytes;
+};
+
+struct video_frame_stats_s
+{
+	uint16_t pid;
+	enum vfs_codec_e codec;
+
+	uint64_t frames;
+	uint64_t idrFrames;        /* H.264/HEVC IDR, MPEG2 I frames carrying a sequence header */
+	enum vfs_frame_type_e lastFrameType;
+	struct video_frame_stats_size_s sizes[VFS_FRAME_MAX]; /* Elementary stream bytes, indexed by frame type */
+
+	/* GOP length is measured in frames, I to I. */
+	uint32_t gopLength;
+	uint32_t gopLengthMin;
+	uint32_t gopLengthMax;
+	char     gopPattern[64];   /* Frame types of the most recently completed GOP, eg IBBPBBP */
+
+	uint32_t idrIntervalFrames;
+	double   idrIntervalMs;
+
+	/* Timing, from the DTS when present, else the PTS. */
+	double   frameRate;
+	uint32_t frameDuration;    /* Nominal, in 90KHz ticks */
+	uint64_t ptsMissing;       /* Frames with no PTS */
+	uint64_t cadenceErrors;    /* Frame to frame timestamp step didn't match the nominal duration */
+	uint64_t dtsBackwards;     /* Decode timestamps stepped backwards (excluding 33bit wrap) */
+	uint64_t ptsBeforeDts;     /* PTS earlier than its DTS, illegal */
+};
+
+/**
+ * @brief       Allocate a new frame statistics engine.
+ * @param[out]  void **hdl - returned object.
+ * @return      0 - Success, else < 0 on error.
+ */
+int  video_frame_stats_alloc(void **hdl);
+
+/**
+ * @brief       Free a previously allocated context.
+ */
+void video_frame_stats_free(void *hdl);
+
+/**
+ * @brief       Feed transport packets. Any video pid is picked up automatically.
+ *              Safe to call while another thread queries.
+ */
+void video_frame_stats_write(void *hdl, const uint8_t *pkts, int packetCount);
+
+/**
+ * @brief       Enumerate the video pids found so far.
+ * @param[in]   int *idx - start at zero, updated by the call.
+ * @return      0 - out has been filled, < 0 no more pids.
+ */
+int  video_frame_stats_enum(void *hdl, int *idx, struct video_frame_stats_s *out);
+
+/**
+ * @brief       Clear all statistics, keeping the discovered pids and codecs.
+ */
+void video_frame_stats_reset(void *hdl);
+
+/**
+ * @brief       The caller is about to skip some packets. Abandon any partially collected frame
+ *              and don't measure cadence, GOP or IDR interval across the gap. Statistics are kept.
+ */
+void video_frame_stats_discontinuity(void *hdl);
+
+/**
+ * @brief       One line human readable summary of a pid.
+ */
+int  video_frame_stats_sprintf(const struct video_frame_stats_s *s, char *dst, int lengthBytes);
+
+/**
+ * @brief       Detailed report for every pid.
+ */
+void video_frame_stats_dprintf(void *hdl, int fd);
+
+const char *video_frame_stats_codec_name(enum vfs_codec_e codec);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* VIDEO_FRAME_STATS_H */